@@ -180,8 +180,10 @@ namespace EspMon
                 }
                 else
                 {
-                    var str = _port.ReadExisting();
-                    System.Diagnostics.Debug.WriteLine("Read junk data: (unrecognized command {0} - {1})",i,str);
+                    // requests are always 2 bytes, so skip just this one
+                    // and leave any queued behind it
+                    int arg = _port.ReadByte();
+                    System.Diagnostics.Debug.WriteLine("Skipped unrecognized command {0} ({1})",i,arg);
                 }
             }
             catch
@@ -125,7 +125,7 @@ namespace EspMon
             /*
             typedef struct { // 74 bytes on the wire
                 int8_t index; // written by caller
-                uint8_t flags; // bit 0 top 1 is gradient, bit 1 top 2 is gradient, bit 2 bottom 1 is gradient, bit 3 bottom 2 is gradient
+                uint8_t flags; // bit 0 top 1 is gradient, bit 1 top 2 is gradient, bit 2 bottom 1 is gradient, bit 3 bottom 2 is gradient, bit 7 host answers pings (this host doesn't)
                 char top_label[12];
                 uint8_t top_label_color[4];
                 uint8_t top_color1[4];
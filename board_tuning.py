@@ -0,0 +1,69 @@
+# PlatformIO pre-build script. generates board_tuning.h for the board being
+# built from display_test.cpp's output.
+#
+# flash display_test.cpp built with -DDISPLAY_TUNE and save its serial
+# output to tuning/<env>.log, e.g. tuning/m5stack-core2.log. the last
+# "tune,best,..." line in it becomes LCD_TUNED_BUFFER_SIZE/COUNT/PSRAM in
+# a board_tuning.h under the build directory, which main.cpp picks up.
+# counts above two are only reachable through the flush ring, so they
+# also set LCD_FLUSH_RING_DEPTH unless the build already picked a depth
+# or uses a mode the ring can't be combined with. boards without a log
+# build with the panel's own transfer buffers, as before
+import os
+
+Import("env")
+
+def parse_best(path):
+    best = None
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("tune,best,"):
+                continue
+            fields = {}
+            for field in line.split(",")[2:]:
+                key, _, value = field.partition("=")
+                fields[key] = value
+            try:
+                best = (int(fields["size"]), int(fields["count"]), int(fields["psram"]), line)
+            except (KeyError, ValueError):
+                print("board_tuning: ignoring bad line in %s: %s" % (path, line))
+    return best
+
+def generate(source, out_dir):
+    best = parse_best(source)
+    if best is None:
+        print("board_tuning: no tune,best line in %s" % source)
+        return False
+    size, count, psram, line = best
+    text = ("#pragma once\n"
+            "// generated by board_tuning.py from %s\n"
+            "// %s\n"
+            "#define LCD_TUNED_BUFFER_SIZE %d\n"
+            "#define LCD_TUNED_BUFFER_COUNT %d\n"
+            "#define LCD_TUNED_BUFFER_PSRAM %d\n") % (
+                os.path.basename(source), line, size, count, psram)
+    if count > 2:
+        text += ("#if !defined(LCD_FLUSH_RING_DEPTH) && !defined(LCD_INDEXED_BITS) && !defined(LCD_PAGE_FORMAT)\n"
+                 "#define LCD_FLUSH_RING_DEPTH %d\n"
+                 "#endif\n") % count
+    os.makedirs(out_dir, exist_ok=True)
+    header = os.path.join(out_dir, "board_tuning.h")
+    # leave it alone if nothing changed, so it doesn't force a rebuild
+    if os.path.exists(header):
+        with open(header, "r") as f:
+            if f.read() == text:
+                return True
+    with open(header, "w") as f:
+        f.write(text)
+    print("board_tuning: %s" % line)
+    return True
+
+source = os.path.join(env.subst("$PROJECT_DIR"), "tuning", env.subst("$PIOENV") + ".log")
+out_dir = os.path.join(env.subst("$BUILD_DIR"), "tuning")
+header = os.path.join(out_dir, "board_tuning.h")
+if os.path.exists(source) and generate(source, out_dir):
+    env.Append(CPPPATH=[out_dir])
+elif os.path.exists(header):
+    # the log went away, so the settings from it go too
+    os.remove(header)
@@ -1,21 +1,63 @@
+// shows a test pattern. building with DISPLAY_TUNE adds the transfer
+// buffer sweep, and DISPLAY_BENCH the dashboard workloads, which the
+// sweep also times each configuration with. both print on the serial
+// port the host protocol uses, so they're off by default
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include <memory.h>
+#include <stdio.h>
 #include "panel.h"
 #include <gfx.hpp>
 #include <uix.hpp>
-//#define BUNGEE_IMPLEMENTATION
-//#include "assets/bungee.h"
+#include "fixed_point.hpp"
+#include "dashboard_controls.hpp"
+#define BUNGEE_IMPLEMENTATION
+#include "assets/bungee.h"
 
 using namespace gfx;
 using namespace uix;
+using namespace dashboard;
 
 static uix::display disp;
+// flush timing, in microseconds
+static volatile int64_t flush_start_us = 0;
+static volatile int64_t flush_busy_us = 0;
+static volatile uint32_t flush_count = 0;
+static volatile uint64_t flush_pixels = 0;
+#if defined(DISPLAY_TUNE) && LCD_SYNC_TRANSFER == 0 && LCD_BIT_DEPTH >= 8
+// counts above two are run the way main.cpp's flush ring runs them: uix
+// renders into two buffers, and each flush is copied into the next free
+// buffer of a ring of DMA buffers
+#define TUNE_RING
+#ifndef TUNE_MAX_COUNT
+#if defined(LCD_FLUSH_RING_DEPTH) && LCD_FLUSH_RING_DEPTH > 2
+#define TUNE_MAX_COUNT LCD_FLUSH_RING_DEPTH
+#else
+#define TUNE_MAX_COUNT 4
+#endif
+#endif
+static uint8_t* tune_ring[TUNE_MAX_COUNT];
+// 0 when the ring isn't in use
+static size_t tune_ring_count = 0;
+static size_t tune_ring_next = 0;
+static SemaphoreHandle_t tune_ring_free = nullptr;
+#endif
 #if LCD_SYNC_TRANSFER == 0
 // indicates the LCD DMA transfer is complete
-void panel_lcd_flush_complete(void) {
+IRAM_ATTR void panel_lcd_flush_complete(void) {
+    flush_busy_us = flush_busy_us + (esp_timer_get_time()-flush_start_us);
+#ifdef TUNE_RING
+    if(tune_ring_count>0) {
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(tune_ring_free,&woken);
+        portYIELD_FROM_ISR(woken);
+        return;
+    }
+#endif
     disp.flush_complete();
 }
 #endif
@@ -23,14 +65,30 @@ void panel_lcd_flush_complete(void) {
 static void uix_on_flush(const rect16& bounds,
                              const void *bitmap, void* state) {
     //printf("flush (%d, %d)-(%d, %d)\n",bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+    ++flush_count;
+    flush_pixels = flush_pixels + ((uint64_t)bounds.width())*bounds.height();
+#ifdef TUNE_RING
+    if(tune_ring_count>0) {
+        xSemaphoreTake(tune_ring_free,portMAX_DELAY);
+        uint8_t* buf = tune_ring[tune_ring_next];
+        tune_ring_next = (tune_ring_next+1)%tune_ring_count;
+        memcpy(buf,bitmap,((size_t)bounds.width())*bounds.height()*((LCD_BIT_DEPTH+7)/8));
+        flush_start_us = esp_timer_get_time();
+        panel_lcd_flush(bounds.x1, bounds.y1, bounds.x2, bounds.y2,buf);
+        disp.flush_complete();
+        return;
+    }
+#endif
+    flush_start_us = esp_timer_get_time();
     panel_lcd_flush(bounds.x1, bounds.y1, bounds.x2, bounds.y2,
                               (void *)bitmap);
 #if LCD_SYNC_TRANSFER > 0
+    flush_busy_us = flush_busy_us + (esp_timer_get_time()-flush_start_us);
     disp.flush_complete();
 #endif
 }
 
-//const_buffer_stream text_font_stm(bungee,sizeof(bungee));
+const_buffer_stream text_font_stm(bungee,sizeof(bungee));
 
 
 #if LCD_COLOR_SPACE == LCD_COLOR_GSC
@@ -60,9 +118,11 @@ using painter_t = painter<screen_t::control_surface_type>;
 static screen_t main_screen;
 
 static painter_t main_painter;
+// the theme switch workload flips the gradient's start color
+static bool bench_light = false;
 
 static void main_painter_on_paint(screen_t::control_surface_type& destination,const srect16& clip, void* state) {
-    pixel_t px_start = color_t::black;
+    pixel_t px_start = bench_light?color_t::white:color_t::black;
     pixel_t px_r = color_t::red;
     pixel_t px_g = color_t::green;
     pixel_t px_b = color_t::blue;
@@ -80,6 +140,189 @@ static void main_painter_on_paint(screen_t::control_surface_type& destination,co
     }
 }
 
+// the dashboard's controls, laid out roughly like the firmware's screen,
+// for the benchmark workloads
+#if defined(DISPLAY_BENCH) || defined(DISPLAY_TUNE)
+#define BENCH_WORKLOADS
+using vert_label_t = vvert_label<screen_t::control_surface_type>;
+using numeric_label_t = vnumeric_label<screen_t::control_surface_type>;
+using bar_t = bar<screen_t::control_surface_type>;
+static vert_label_t bench_title;
+static numeric_label_t bench_label;
+static bar_t bench_bar;
+static bar_t bench_gradient_bar;
+#if LCD_HEIGHT > 128
+using graph_t = vgraph<screen_t::control_surface_type>;
+static graph_t bench_graph;
+#endif
+static void bench_init() {
+    const int w = main_screen.dimensions().width;
+#if LCD_HEIGHT > 128
+    const int h = main_screen.dimensions().height/2;
+#else
+    const int h = main_screen.dimensions().height;
+#endif
+    bench_title.bounds(srect16(0,0,w/10-1,h-1).inflate(-2,-4));
+    bench_title.font(text_font_stm);
+    bench_title.text("CPU");
+    main_screen.register_control(bench_title);
+    bench_label.bounds(srect16(w/10+1,0,w/10+w/5,h/2-1));
+    bench_label.font(text_font_stm);
+    bench_label.suffix("%");
+    bench_label.text("---");
+    main_screen.register_control(bench_label);
+    bench_bar.bounds(srect16(w/10+w/5+4,0,w-1,h/2-3));
+    bench_bar.color(gfx::color<uix_pixel>::green);
+    main_screen.register_control(bench_bar);
+    bench_gradient_bar.bounds(srect16(w/10+w/5+4,h/2,w-1,h-3));
+    bench_gradient_bar.is_gradient(true);
+    main_screen.register_control(bench_gradient_bar);
+#if LCD_HEIGHT > 128
+    bench_graph.bounds(srect16(0,h+1,w-1,main_screen.dimensions().height-1));
+    bench_graph.add_line(gfx::color<uix_pixel>::green);
+    bench_graph.add_line(gfx::color<uix_pixel>::yellow);
+    bench_graph.add_line(gfx::color<uix_pixel>::red);
+    bench_graph.add_line(gfx::color<uix_pixel>::cyan);
+    main_screen.register_control(bench_graph);
+#endif
+}
+// workloads are deterministic so runs can be compared across builds
+static uint32_t bench_seed = 1;
+static q16_t bench_random() {
+    bench_seed = bench_seed*1664525+1013904223;
+    return (q16_t)(bench_seed>>16);
+}
+static q16_t bench_sweep(int i) {
+    // up and back down in 64 steps each way
+    const int p = i%128;
+    return (q16_t)((p<64?p:127-p)*(q16_one/63));
+}
+static void bench_bar_sweep(int i) {
+    bench_bar.value_q16(q16_clamp(bench_sweep(i)));
+}
+static void bench_gradient_sweep(int i) {
+    bench_gradient_bar.value_q16(q16_clamp(bench_sweep(i)));
+}
+#if LCD_HEIGHT > 128
+static void bench_graph_scroll(int i) {
+    for(int line = 0;line<4;++line) {
+        bench_graph.add_data_q16(line,bench_random());
+    }
+}
+#endif
+static void bench_label_churn(int i) {
+    bench_label.value((i*37)%1000);
+}
+static void bench_theme_switch(int i) {
+    bench_light = !bench_light;
+    const uix_pixel fg = bench_light?gfx::color<uix_pixel>::black:gfx::color<uix_pixel>::white;
+    bench_title.color(fg);
+    bench_label.color(fg);
+    main_painter.invalidate();
+}
+static void bench_full_repaint(int i) {
+    main_screen.invalidate();
+}
+// what a data packet does: every value changes at once
+static void bench_value_tick(int i) {
+    bench_bar.value_q16(q16_clamp(bench_random()));
+    bench_gradient_bar.value_q16(q16_clamp(bench_random()));
+    bench_label.value((int)(bench_random()%100));
+#if LCD_HEIGHT > 128
+    bench_graph_scroll(i);
+#endif
+}
+// what a screen packet does: new title and colors, so everything repaints
+static void bench_screen_switch(int i) {
+    static const char* titles[] = {"CPU","GPU"};
+    bench_title.text(titles[i&1]);
+    bench_bar.color((i&1)?gfx::color<uix_pixel>::red:gfx::color<uix_pixel>::green);
+    bench_gradient_bar.is_gradient((i&1)==0);
+    main_screen.invalidate();
+}
+struct bench_workload {
+    const char* name;
+    int steps;
+    void(*step)(int index);
+    // part of the transfer buffer sweep's score
+    bool tuned;
+};
+static const bench_workload bench_workloads[] = {
+    {"bar_sweep",128,bench_bar_sweep,false},
+    {"gradient_bar",128,bench_gradient_sweep,false},
+    {"value_tick",100,bench_value_tick,true},
+#if LCD_HEIGHT > 128
+    {"graph_scroll",100,bench_graph_scroll,true},
+#endif
+    {"label_churn",100,bench_label_churn,false},
+    {"screen_switch",16,bench_screen_switch,true},
+    {"theme_switch",16,bench_theme_switch,true},
+    {"full_repaint",16,bench_full_repaint,false}
+};
+static const int bench_max_steps = 128;
+static int32_t bench_percentile(int32_t* values, int count, int percent) {
+    // insertion sort, the sample counts are small
+    for(int i = 1;i<count;++i) {
+        for(int j = i;j>0 && values[j]<values[j-1];--j) {
+            const int32_t t = values[j];values[j] = values[j-1];values[j-1] = t;
+        }
+    }
+    int index = (count*percent+99)/100-1;
+    return values[index<0?0:index];
+}
+static void bench_print_percentiles(const char* name, int32_t* values, int count) {
+    printf(",%s_p50_us=%d,%s_p90_us=%d,%s_p99_us=%d,%s_max_us=%d",
+        name,(int)bench_percentile(values,count,50),
+        name,(int)bench_percentile(values,count,90),
+        name,(int)bench_percentile(values,count,99),
+        name,(int)values[count-1]);
+}
+static void refresh_display();
+static int32_t bench_frames[bench_max_steps];
+static int32_t bench_flushes[bench_max_steps];
+static int32_t bench_paints[bench_max_steps];
+// runs up to max_steps of a workload from a settled screen, timing each
+// step into the arrays above. returns the steps run
+static int bench_measure(const bench_workload& wl, int max_steps) {
+    const int steps = wl.steps<max_steps?wl.steps:max_steps;
+    bench_seed = 1;
+    // start from a settled screen
+    main_screen.invalidate();
+    refresh_display();
+    flush_count = 0;
+    flush_pixels = 0;
+    for(int i = 0;i<steps;++i) {
+        wl.step(i);
+        flush_busy_us = 0;
+        const int64_t start = esp_timer_get_time();
+        refresh_display();
+        bench_frames[i] = (int32_t)(esp_timer_get_time()-start);
+        bench_flushes[i] = (int32_t)flush_busy_us;
+        bench_paints[i] = bench_frames[i]>bench_flushes[i]?bench_frames[i]-bench_flushes[i]:0;
+    }
+    return steps;
+}
+#endif
+#ifdef DISPLAY_BENCH
+// runs every workload and prints one "bench,..." line for each
+static void bench_run() {
+    printf("bench,begin,width=%d,height=%d,bit_depth=%d,transfer_size=%d,sync=%d\n",
+        (int)LCD_WIDTH,(int)LCD_HEIGHT,(int)LCD_BIT_DEPTH,(int)LCD_TRANSFER_SIZE,(int)(LCD_SYNC_TRANSFER>0));
+    for(size_t w = 0;w<sizeof(bench_workloads)/sizeof(bench_workloads[0]);++w) {
+        const bench_workload& wl = bench_workloads[w];
+        const int steps = bench_measure(wl,bench_max_steps);
+        printf("bench,workload=%s,steps=%d,flushes=%d,pixels=%llu",wl.name,steps,(int)flush_count,(unsigned long long)flush_pixels);
+        bench_print_percentiles("frame",bench_frames,steps);
+        bench_print_percentiles("paint",bench_paints,steps);
+        bench_print_percentiles("flush",bench_flushes,steps);
+        printf(",heap_free=%d,heap_min=%d\n",
+            (int)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+            (int)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+    }
+    printf("bench,end\n");
+}
+#endif
+
 void loop();
 static void loop_task(void* arg) {
     TickType_t wdt_ts = xTaskGetTickCount();
@@ -117,12 +360,204 @@ extern "C" void app_main() {
     main_painter.bounds(main_screen.bounds());
     main_painter.on_paint_callback(main_painter_on_paint);
     main_screen.register_control(main_painter);
+#ifdef BENCH_WORKLOADS
+    bench_init();
+#endif
+#ifdef TUNE_RING
+    tune_ring_free = xSemaphoreCreateCounting(TUNE_MAX_COUNT,0);
+#endif
     disp.active_screen(main_screen);
     refresh_display();
     TaskHandle_t loop_handle;
     xTaskCreate(loop_task,"loop_task",4096,nullptr,20,&loop_handle);
 }
 
+// transfer buffer tuning. every combination of size, count and memory
+// placement runs the dashboard workloads the firmware spends its time
+// in, and the one picked is printed as a "tune,best,..." line. results
+// are printed as "tune,key=value,..." lines so they can be collected, and
+// board_tuning.py builds the board's board_tuning.h from a capture
+#ifdef DISPLAY_TUNE
+#ifndef TUNE_MAX_COUNT
+#if LCD_SYNC_TRANSFER == 0
+#define TUNE_MAX_COUNT 2
+#else
+#define TUNE_MAX_COUNT 1
+#endif
+#endif
+struct tune_config {
+    size_t size;
+    int count;
+    bool psram;
+};
+struct tune_result {
+    tune_config config;
+    // the sums of each tuned workload's median step
+    int64_t frame_us;
+    int64_t flush_us;
+    int64_t paint_us;
+};
+// steps of each workload per configuration, so a sweep stays in minutes
+static const int tune_steps = 32;
+static uint8_t* tune_buffers[2] = {nullptr,nullptr};
+static void tune_free() {
+    for(int i = 0;i<2;++i) {
+        if(tune_buffers[i]!=nullptr) {
+            heap_caps_free(tune_buffers[i]);
+            tune_buffers[i] = nullptr;
+        }
+    }
+#ifdef TUNE_RING
+    for(size_t i = 0;i<tune_ring_count;++i) {
+        heap_caps_free(tune_ring[i]);
+    }
+    tune_ring_count = 0;
+    tune_ring_next = 0;
+    // the ring is idle between runs, so whatever is left is stale
+    while(pdTRUE==xSemaphoreTake(tune_ring_free,0)) {
+    }
+#endif
+}
+static void tune_restore() {
+    tune_free();
+    disp.buffer_size(LCD_TRANSFER_SIZE);
+    disp.buffer1((uint8_t*)panel_lcd_transfer_buffer());
+#if LCD_SYNC_TRANSFER == 0
+    disp.buffer2((uint8_t*)panel_lcd_transfer_buffer2());
+#endif
+}
+static bool tune_apply(const tune_config& cfg) {
+    tune_free();
+    const uint32_t caps = cfg.psram?(MALLOC_CAP_SPIRAM|MALLOC_CAP_8BIT):(MALLOC_CAP_DMA|MALLOC_CAP_INTERNAL);
+    // with a ring uix keeps two buffers of its own
+    const int render_count = cfg.count>2?2:cfg.count;
+    for(int i = 0;i<render_count;++i) {
+        // DMA from PSRAM wants cache line alignment
+        tune_buffers[i] = (uint8_t*)heap_caps_aligned_alloc(64,cfg.size,caps);
+        if(tune_buffers[i]==nullptr) {
+            tune_free();
+            return false;
+        }
+    }
+#ifdef TUNE_RING
+    if(cfg.count>2) {
+        for(int i = 0;i<cfg.count;++i) {
+            uint8_t* buf = (uint8_t*)heap_caps_aligned_alloc(64,cfg.size,MALLOC_CAP_DMA|MALLOC_CAP_INTERNAL);
+            if(buf==nullptr) {
+                tune_free();
+                return false;
+            }
+            tune_ring[tune_ring_count++] = buf;
+            xSemaphoreGive(tune_ring_free);
+        }
+    }
+#endif
+    disp.buffer_size(cfg.size);
+    disp.buffer1(tune_buffers[0]);
+    disp.buffer2(tune_buffers[1]);
+    return true;
+}
+// runs each tuned workload and prints its median step
+static tune_result tune_measure(const tune_config& cfg) {
+    tune_result result;
+    result.config = cfg;
+    result.frame_us = 0;
+    result.flush_us = 0;
+    for(size_t w = 0;w<sizeof(bench_workloads)/sizeof(bench_workloads[0]);++w) {
+        const bench_workload& wl = bench_workloads[w];
+        if(!wl.tuned) {
+            continue;
+        }
+        const int steps = bench_measure(wl,tune_steps);
+        const int32_t frame = bench_percentile(bench_frames,steps,50);
+        const int32_t flush = bench_percentile(bench_flushes,steps,50);
+        printf(",%s_us=%d",wl.name,(int)frame);
+        result.frame_us+=frame;
+        result.flush_us+=flush;
+    }
+    // with async transfers some of the flush overlaps the paint, so this
+    // is the time the CPU wasn't waiting on the bus at best
+    result.paint_us = result.frame_us>result.flush_us?result.frame_us-result.flush_us:0;
+    return result;
+}
+static void tune_run() {
+    // at least a row band per transfer, and no more than the whole frame
+    const size_t min_size = LCD_WIDTH*LCD_Y_ALIGN*((LCD_BIT_DEPTH+7)/8);
+    const size_t max_size = ((size_t)LCD_WIDTH)*LCD_HEIGHT*((LCD_BIT_DEPTH+7)/8);
+    const size_t sizes[] = {LCD_TRANSFER_SIZE/8,LCD_TRANSFER_SIZE/4,LCD_TRANSFER_SIZE/2,LCD_TRANSFER_SIZE,
+        LCD_TRANSFER_SIZE*2,LCD_TRANSFER_SIZE*4};
+    constexpr static const size_t size_count = sizeof(sizes)/sizeof(sizes[0]);
+#if CONFIG_SPIRAM
+    const int placements = 2;
+#else
+    const int placements = 1;
+#endif
+    static tune_result results[size_count*TUNE_MAX_COUNT*2];
+    size_t result_count = 0;
+    for(size_t si = 0;si<size_count;++si) {
+        if(sizes[si]<min_size || sizes[si]>max_size) {
+            continue;
+        }
+        for(int count = 1;count<=TUNE_MAX_COUNT;++count) {
+            for(int placement = 0;placement<placements;++placement) {
+                const tune_config cfg = {sizes[si],count,placement==1};
+                if(!tune_apply(cfg)) {
+                    printf("tune,size=%d,count=%d,psram=%d,error=alloc\n",(int)cfg.size,cfg.count,(int)cfg.psram);
+                    continue;
+                }
+                printf("tune,size=%d,count=%d,psram=%d",(int)cfg.size,cfg.count,(int)cfg.psram);
+                const tune_result r = tune_measure(cfg);
+                printf(",frame_us=%d,flush_us=%d,paint_us=%d\n",(int)r.frame_us,(int)r.flush_us,(int)r.paint_us);
+                results[result_count++] = r;
+            }
+        }
+    }
+    tune_restore();
+    if(result_count==0) {
+        return;
+    }
+    int64_t fastest = results[0].frame_us;
+    for(size_t i = 1;i<result_count;++i) {
+        if(results[i].frame_us<fastest) {
+            fastest = results[i].frame_us;
+        }
+    }
+    // anything within 5% of the fastest counts as a tie, and ties go to
+    // whatever uses the least internal RAM, then to the faster one
+    const tune_result* best = nullptr;
+    size_t best_internal = 0;
+    for(size_t i = 0;i<result_count;++i) {
+        const tune_result& r = results[i];
+        if(r.frame_us*100>fastest*105) {
+            continue;
+        }
+        // a ring's own buffers are always internal, on top of uix's two
+        const size_t ring = r.config.count>2?r.config.size*r.config.count:0;
+        const size_t render = r.config.psram?0:r.config.size*(r.config.count>2?2:r.config.count);
+        const size_t internal = ring+render;
+        if(best==nullptr || internal<best_internal || (internal==best_internal && r.frame_us<best->frame_us)) {
+            best = &r;
+            best_internal = internal;
+        }
+    }
+    // board_tuning.py turns this line into the board's board_tuning.h
+    printf("tune,best,size=%d,count=%d,psram=%d,frame_us=%d,fastest_us=%d\n",(int)best->config.size,best->config.count,
+        (int)best->config.psram,(int)best->frame_us,(int)fastest);
+}
+#endif
 void loop() {
-    
+#ifdef DISPLAY_TUNE
+    static bool tuned = false;
+    if(!tuned) {
+        tuned = true;
+        tune_run();
+    }
+#endif
+#ifdef DISPLAY_BENCH
+    static bool benched = false;
+    if(!benched) {
+        benched = true;
+        bench_run();
+    }
+#endif
 }
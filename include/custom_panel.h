@@ -1,4 +1,7 @@
 // you don't actually need a #ifdef guard on a custom panel for many projects, only for projects where you might support more than one device (either custom, or otherwise)
+#if defined(C6DEVKITC1) || defined(ESP32_S3_DEVKITC_1)
+#include "ssd1306_pages.h"
+#endif
 #ifdef C6DEVKITC1 // Works, but is a custom kit
 #define LCD_I2C_HOST    I2C_1
 #define LCD_I2C_ADDRESS 0x3C
@@ -25,29 +28,9 @@
 #define LCD_VENDOR_CONFIG esp_lcd_panel_ssd1306_config_t vendor_config = {\
     .height = LCD_VRES,\
 };
-#define LCD_TRANSLATE static uint8_t ssd1306_buffer[LCD_TRANSFER_SIZE];\
-     int src_width = x2 - x1 + 1;\
-     int dst_width = src_width;\
-     int dst_height_pages = (y2 - y1 + 1) >> 3;  /* Height in pages (8-pixel groups) */\
-     \
-     for (int page = 0; page < dst_height_pages; page++) {\
-        for (int x = 0; x < dst_width; x++) {\
-            uint8_t dst_byte = 0;\
-            for (int bit = 0; bit < 8; bit++) {\
-                /* Calculate source bit position */\
-                int src_y = page * 8 + bit;\
-                int total_bit_offset = src_y * src_width + x;\
-                int src_byte_index = total_bit_offset >> 3;\
-                int src_bit = 7 - (total_bit_offset & 7);\
-                \
-                if (((uint8_t*)bitmap)[src_byte_index] & (1 << src_bit)) {\
-                    dst_byte |= (1 << bit);\
-                }\
-            }\
-            ssd1306_buffer[page * dst_width + x] = dst_byte;\
-        }\
-     }\
-     bitmap = ssd1306_buffer;
+// the application hands over page format data (see ssd1306_pages.h)
+// so it can send minimal windows of each page
+#define LCD_PAGE_FORMAT
 #endif
 
 #ifdef ESP32_S3_DEVKITC_1
@@ -76,29 +59,9 @@
 #define LCD_VENDOR_CONFIG esp_lcd_panel_ssd1306_config_t vendor_config = {\
     .height = LCD_VRES,\
 };
-#define LCD_TRANSLATE static uint8_t ssd1306_buffer[LCD_TRANSFER_SIZE];\
-     int src_width = x2 - x1 + 1;\
-     int dst_width = src_width;\
-     int dst_height_pages = (y2 - y1 + 1) >> 3;  /* Height in pages (8-pixel groups) */\
-     \
-     for (int page = 0; page < dst_height_pages; page++) {\
-        for (int x = 0; x < dst_width; x++) {\
-            uint8_t dst_byte = 0;\
-            for (int bit = 0; bit < 8; bit++) {\
-                /* Calculate source bit position */\
-                int src_y = page * 8 + bit;\
-                int total_bit_offset = src_y * src_width + x;\
-                int src_byte_index = total_bit_offset >> 3;\
-                int src_bit = 7 - (total_bit_offset & 7);\
-                \
-                if (((uint8_t*)bitmap)[src_byte_index] & (1 << src_bit)) {\
-                    dst_byte |= (1 << bit);\
-                }\
-            }\
-            ssd1306_buffer[page * dst_width + x] = dst_byte;\
-        }\
-     }\
-     bitmap = ssd1306_buffer;
+// the application hands over page format data (see ssd1306_pages.h)
+// so it can send minimal windows of each page
+#define LCD_PAGE_FORMAT
 #define BUTTON_MASK BUTTON_PIN(0)
 #define BUTTON_ON_LEVEL 0
 #endif // ESP32_S3_DEVKITC_1
@@ -0,0 +1,926 @@
+#pragma once
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gfx.hpp>
+#include <uix.hpp>
+#include <type_traits>
+#include <utility>
+#include "fixed_point.hpp"
+#include "pixel_kernels.hpp"
+
+// the dashboard's controls, shared by the firmware and the display test
+// benchmarks. text controls have no font until one is set with font()
+namespace dashboard {
+using namespace gfx;
+using namespace uix;
+
+// bitmaps whose memory can be written directly. uix control surfaces
+// can't, so they only get single color fills
+template<typename Destination, typename = void>
+struct kernel_target : std::false_type {};
+template<typename Destination>
+struct kernel_target<Destination,std::void_t<decltype(std::declval<Destination&>().begin()),
+        decltype(Destination(size16(1,1),(uint8_t*)nullptr,std::declval<Destination&>().palette()))>> :
+    std::integral_constant<bool,Destination::pixel_type::bit_depth==1 ||
+        (Destination::pixel_type::bit_depth%8==0 &&
+            pixel_kernels<(Destination::pixel_type::bit_depth%8==0?Destination::pixel_type::bit_depth:8)>::specialized)> {};
+
+// fills through the pixel kernels when there's one for the destination,
+// otherwise through gfx
+template<typename Destination>
+void kernel_fill(Destination& destination, const srect16& rect, typename Destination::pixel_type px) {
+    if constexpr(kernel_target<Destination>::value) {
+        if(!rect.intersects((srect16)destination.bounds())) {
+            return;
+        }
+        const srect16 r = rect.crop((srect16)destination.bounds());
+        // let gfx encode the pixel, so byte order and palettes are its problem
+        uint8_t encoded[4] = {0,0,0,0};
+        Destination one({1,1},encoded,destination.palette());
+        one.point({0,0},px);
+        pixel_kernels_fill_rect<Destination::pixel_type::bit_depth>(destination.begin(),destination.dimensions().width,r.x1,r.y1,r.x2,r.y2,encoded);
+    } else {
+        draw::filled_rectangle(destination,rect,px);
+    }
+}
+template<typename Destination>
+void kernel_fill(Destination& destination, const srect16& rect, rgba_pixel<32> color) {
+    if constexpr(kernel_target<Destination>::value) {
+        if(color.template channel<channel_name::A>()==255) {
+            // converted through draw:: so it also works on indexed targets
+            uint8_t encoded[4] = {0,0,0,0};
+            Destination one({1,1},encoded,destination.palette());
+            draw::filled_rectangle(one,srect16(0,0,0,0),color);
+            typename Destination::pixel_type px;
+            one.point({0,0},&px);
+            kernel_fill(destination,rect,px);
+            return;
+        }
+    }
+    draw::filled_rectangle(destination,rect,color);
+}
+// paints color alpha blended over rect, which is solid bg. the result is
+// one color, so on RGB565 it's blended once and filled opaque instead of
+// gfx blending every pixel
+template<typename Destination, typename Pixel>
+void kernel_blend_solid(Destination& destination, const srect16& rect, typename Destination::pixel_type bg, Pixel color) {
+    using pixel_type = typename Destination::pixel_type;
+    if constexpr(std::is_same<pixel_type,rgb_pixel<16>>::value) {
+        rgba_pixel<32> c;
+        convert(color,&c);
+        rgb_pixel<16> fg;
+        convert(c,&fg);
+        pixel_type px;
+        px.native_value = pixel_kernels_565::blend(fg.native_value,bg.native_value,c.template channel<channel_name::A>());
+        kernel_fill(destination,rect,px);
+    } else {
+        draw::filled_rectangle(destination,rect,bg);
+        draw::filled_rectangle(destination,rect,color);
+    }
+}
+
+template<typename ControlSurfaceType>
+class vvert_label : public canvas_control<ControlSurfaceType> {
+    using base_type = canvas_control<ControlSurfaceType>;
+public:
+    using type = vvert_label;
+    using control_surface_type = ControlSurfaceType;
+private:
+    canvas_text_info m_label_text;
+    canvas_path m_label_text_path;
+    rectf m_label_text_bounds;
+    bool m_label_text_dirty;
+    vector_pixel m_color;
+    uix_pixel m_background_color;
+    void build_label_path_untransformed() {
+        const float target_width = this->dimensions().height;
+        float fsize = this->dimensions().width;
+        if(m_label_text_path.initialized()) {
+            m_label_text_path.clear();
+        } else {
+            m_label_text_path.initialize();
+        }
+        do {
+            m_label_text_path.clear();
+            m_label_text.font_size = fsize;
+            m_label_text_path.text({0.f,0.f},m_label_text);
+            m_label_text_bounds = m_label_text_path.bounds(true);
+            --fsize;
+            
+        } while(fsize>0.f && m_label_text_bounds.width()>=target_width);
+    }
+public:
+    vvert_label() : base_type() ,m_label_text_dirty(true) {
+        m_label_text.ttf_font = nullptr;
+        m_label_text.text_sz("Label");
+        m_label_text.encoding = &text_encoding::utf8;
+        m_label_text.ttf_font_face = 0;
+        m_color = vector_pixel(255,255,255,255);
+    }
+    virtual ~vvert_label() {
+
+    }
+    void font(io::stream& value) {
+        m_label_text.ttf_font = &value;
+        m_label_text_dirty = true;
+        this->invalidate();
+    }
+    text_handle text() const {
+        return m_label_text.text;
+    }
+    void text(text_handle text, size_t text_byte_count) {
+        m_label_text.text=text;
+        m_label_text.text_byte_count = text_byte_count;
+        m_label_text_dirty = true;
+        this->invalidate();
+    }
+    void text(const char* sz) {
+        m_label_text.text_sz(sz);
+        m_label_text_dirty = true;
+        this->invalidate();
+    }
+    rgba_pixel<32> color() const {
+        rgba_pixel<32> result;
+        convert(m_color,&result);
+        return result;
+    }
+    void color(rgba_pixel<32> value) {
+        convert(value,&m_color);
+        this->invalidate();
+    }
+    gfx::rgba_pixel<32> background_color() const {
+        return m_background_color;
+    }
+    void background_color(gfx::rgba_pixel<32> value) {
+        m_background_color = value;
+        this->invalidate();
+    }
+    
+protected:
+    virtual void on_before_paint() override {
+        if(m_label_text_dirty) {
+            build_label_path_untransformed();
+            m_label_text_dirty = false;
+        }
+    }
+    virtual void on_paint(control_surface_type& destination, const gfx::srect16& clip) {
+        if(m_background_color.opacity()!=0) {
+            gfx::draw::filled_rectangle(destination,destination.bounds(),m_background_color);
+        }
+        base_type::on_paint(destination,clip);
+    }
+    virtual void on_paint(canvas& destination, const srect16& clip) override {
+        canvas_style si = destination.style();
+        si.fill_paint_type = paint_type::solid;
+        si.stroke_paint_type = paint_type::none;
+        si.fill_color = m_color;
+        destination.style(si);
+        // save the current transform
+        matrix old = destination.transform();
+        matrix m = old.rotate(math::deg2rad(-90));
+        
+        m=m.translate(-m_label_text_bounds.width()-((destination.dimensions().height-m_label_text_bounds.width())*0.5f),m_label_text_bounds.height());
+        destination.transform(m);
+        destination.path(m_label_text_path);
+        destination.render();
+        destination.clear_path();
+        // restore the old transform
+        destination.transform(old);
+    }
+};
+
+// a label for integer values with a fixed suffix. each character gets a
+// fixed width cell sized to the widest digit so the layout never shifts,
+// and only the cells whose character changed are invalidated
+template<typename ControlSurfaceType, size_t Cells = 6>
+class vnumeric_label : public canvas_control<ControlSurfaceType> {
+    using base_type = canvas_control<ControlSurfaceType>;
+public:
+    using type = vnumeric_label;
+    using control_surface_type = ControlSurfaceType;
+    constexpr static const size_t cells = Cells;
+private:
+    // cached glyphs for 0-9 and '-'
+    constexpr static const size_t glyph_count = 11;
+    canvas_text_info m_text_info;
+    canvas_path m_glyphs[glyph_count];
+    rectf m_glyph_bounds[glyph_count];
+    canvas_path m_suffix_path;
+    rectf m_suffix_bounds;
+    char m_suffix[8];
+    // the character in each cell
+    char m_cells[Cells];
+    size_t m_count;
+    bool m_suffix_visible;
+    size_t m_fit_digits;
+    float m_cell_width;
+    float m_glyph_top;
+    float m_glyph_height;
+    bool m_layout_dirty;
+    vector_pixel m_color;
+    uix_pixel m_background_color;
+    static int glyph_index(char ch) {
+        return ch=='-'?10:ch-'0';
+    }
+    void build_text(canvas_path& path,const char* sz) {
+        if(path.initialized()) {
+            path.clear();
+        } else {
+            path.initialize();
+        }
+        m_text_info.text_sz(sz);
+        path.text({0.f,0.f},m_text_info);
+    }
+    void build_glyphs() {
+        const float height = this->dimensions().height;
+        const float width = this->dimensions().width;
+        float fsize = height;
+        do {
+            m_text_info.font_size = fsize;
+            m_cell_width = 0;
+            char sz[2] = {0,0};
+            for(size_t i = 0;i<glyph_count;++i) {
+                sz[0] = i<10?'0'+i:'-';
+                build_text(m_glyphs[i],sz);
+                m_glyph_bounds[i] = m_glyphs[i].bounds(true);
+                if(m_glyph_bounds[i].width()>m_cell_width) {
+                    m_cell_width = m_glyph_bounds[i].width();
+                }
+            }
+            // a little spacing between cells
+            m_cell_width = ceilf(m_cell_width*1.15f);
+            build_text(m_suffix_path,m_suffix);
+            m_suffix_bounds = m_suffix_path.bounds(true);
+            // use the digits for the line metrics so every cell shares a baseline
+            m_glyph_top = m_glyph_bounds[0].y1;
+            m_glyph_height = m_glyph_bounds[0].height();
+            --fsize;
+        } while(fsize>1.f && (m_glyph_height>=height ||
+            m_cell_width*m_fit_digits+(m_suffix[0]?m_suffix_bounds.width():0)>=width));
+    }
+    srect16 cell_rect(size_t index) const {
+        const int16_t x = (int16_t)(index*m_cell_width);
+        return srect16(x,0,(int16_t)(x+m_cell_width),this->dimensions().height-1);
+    }
+    srect16 suffix_rect(size_t count) const {
+        const int16_t x = (int16_t)(count*m_cell_width);
+        return srect16(x,0,(int16_t)(x+m_suffix_bounds.width()+1),this->dimensions().height-1);
+    }
+    void invalidate_local(const srect16& rect) {
+        this->invalidate(rect.offset(this->bounds().x1,this->bounds().y1));
+    }
+    void set_cells(const char* chars, size_t count, bool suffix_visible) {
+        if(m_layout_dirty) {
+            // no metrics yet, everything gets painted anyway
+            memcpy(m_cells,chars,count);
+            m_count = count;
+            m_suffix_visible = suffix_visible;
+            this->invalidate();
+            return;
+        }
+        const size_t max_count = count>m_count?count:m_count;
+        for(size_t i = 0;i<max_count;++i) {
+            const char ch = i<count?chars[i]:0;
+            if(i>=m_count || i>=count || m_cells[i]!=ch) {
+                invalidate_local(cell_rect(i));
+            }
+            if(i<count) {
+                m_cells[i]=ch;
+            }
+        }
+        if(count!=m_count || suffix_visible!=m_suffix_visible) {
+            // the suffix moves or toggles
+            invalidate_local(suffix_rect(m_count));
+            invalidate_local(suffix_rect(count));
+            m_count = count;
+            m_suffix_visible = suffix_visible;
+        }
+    }
+    void render_path(canvas& destination, const canvas_path& path, const rectf& bounds, float x) {
+        matrix old = destination.transform();
+        const float y = (this->dimensions().height-m_glyph_height)*.5f-m_glyph_top;
+        destination.transform(old.translate(x-bounds.x1,y));
+        destination.path(path);
+        destination.render();
+        destination.clear_path();
+        destination.transform(old);
+    }
+public:
+    vnumeric_label() : base_type(), m_count(0), m_suffix_visible(false), m_fit_digits(3), m_cell_width(0), m_layout_dirty(true) {
+        m_text_info.ttf_font = nullptr;
+        m_text_info.encoding = &text_encoding::utf8;
+        m_text_info.ttf_font_face = 0;
+        m_suffix[0] = 0;
+        m_color = vector_pixel(255,255,255,255);
+        m_background_color = uix_pixel(0,0,0,0);
+    }
+    virtual ~vnumeric_label() {
+
+    }
+    void font(io::stream& value) {
+        m_text_info.ttf_font = &value;
+        m_layout_dirty = true;
+        this->invalidate();
+    }
+    // the number of digits (plus suffix) the font is sized to fit
+    size_t fit_digits() const {
+        return m_fit_digits;
+    }
+    void fit_digits(size_t value) {
+        value = value<1?1:value>Cells?Cells:value;
+        if(value==m_fit_digits) {
+            return;
+        }
+        m_fit_digits = value;
+        m_layout_dirty = true;
+        this->invalidate();
+    }
+    const char* suffix() const {
+        return m_suffix;
+    }
+    void suffix(const char* value) {
+        if(0==strncmp(value,m_suffix,sizeof(m_suffix)-1)) {
+            return;
+        }
+        strncpy(m_suffix,value,sizeof(m_suffix)-1);
+        m_suffix[sizeof(m_suffix)-1]=0;
+        m_layout_dirty = true;
+        this->invalidate();
+    }
+    void value(unsigned int value) {
+        char digits[Cells];
+        size_t count = 0;
+        do {
+            digits[Cells-1-count]='0'+(value%10);
+            value/=10;
+            ++count;
+        } while(value && count<Cells);
+        set_cells(digits+Cells-count,count,true);
+    }
+    // shows a run of dashes (or digits) without the suffix
+    void text(const char* sz) {
+        char chars[Cells];
+        size_t count = 0;
+        while(*sz && count<Cells) {
+            const char ch = *sz++;
+            if(ch=='-' || (ch>='0' && ch<='9')) {
+                chars[count++]=ch;
+            }
+        }
+        set_cells(chars,count,false);
+    }
+    rgba_pixel<32> color() const {
+        rgba_pixel<32> result;
+        convert(m_color,&result);
+        return result;
+    }
+    void color(rgba_pixel<32> value) {
+        convert(value,&m_color);
+        this->invalidate();
+    }
+    gfx::rgba_pixel<32> background_color() const {
+        return m_background_color;
+    }
+    void background_color(gfx::rgba_pixel<32> value) {
+        m_background_color = value;
+        this->invalidate();
+    }
+protected:
+    virtual void on_before_paint() override {
+        if(m_layout_dirty) {
+            build_glyphs();
+            m_layout_dirty = false;
+        }
+    }
+    virtual void on_paint(control_surface_type& destination, const gfx::srect16& clip) {
+        if(m_background_color.opacity()!=0) {
+            gfx::draw::filled_rectangle(destination,destination.bounds(),m_background_color);
+        }
+        base_type::on_paint(destination,clip);
+    }
+    virtual void on_paint(canvas& destination, const srect16& clip) override {
+        canvas_style si = destination.style();
+        si.fill_paint_type = paint_type::solid;
+        si.stroke_paint_type = paint_type::none;
+        si.fill_color = m_color;
+        destination.style(si);
+        for(size_t i = 0;i<m_count;++i) {
+            const srect16 r = cell_rect(i);
+            if(!r.intersects(clip)) {
+                continue;
+            }
+            const int gi = glyph_index(m_cells[i]);
+            const rectf& gb = m_glyph_bounds[gi];
+            render_path(destination,m_glyphs[gi],gb,r.x1+(m_cell_width-gb.width())*.5f);
+        }
+        if(m_suffix_visible && m_suffix[0] && suffix_rect(m_count).intersects(clip)) {
+            render_path(destination,m_suffix_path,m_suffix_bounds,m_count*m_cell_width);
+        }
+    }
+};
+
+template<typename ControlSurfaceType>
+class bar : public control<ControlSurfaceType> {
+    using base_type = control<ControlSurfaceType>;
+public:
+    using type = bar;
+    using control_surface_type = ControlSurfaceType;
+#if LCD_HEIGHT < 128
+    using buffer_t = data::circular_buffer<uint8_t,100>;
+#endif
+private:
+    rgba_pixel<32> m_color;
+    rgba_pixel<32> m_back_color;
+    bool m_is_gradient;
+    bool m_static_cached;
+    q16_t m_value;
+#if LCD_HEIGHT < 128
+    buffer_t m_buffer;
+    rgba_pixel<32> m_trace_color;
+#endif
+    uint16_t back_height() const {
+        return m_is_gradient?
+            this->dimensions().height*6666/10000:
+            this->dimensions().height-1;
+    }
+public:
+    bar() : base_type(), m_is_gradient(false), m_static_cached(false), m_value(0) {
+        static constexpr const rgb_pixel<24> px(0,255,0);
+        static constexpr const rgb_pixel<24> black(0,0,0);
+        convert(px,&m_color);
+        rgba_pixel<32> px2;
+        convert(black,&px2);
+        m_back_color = m_color.blend(px2,.125f);
+#if LCD_HEIGHT < 128
+        m_trace_color = px2;
+#endif
+    }
+    
+    virtual ~bar() {
+
+    }
+    float value() const {
+        return q16_to_float(m_value);
+    }
+    void value(float value) {
+        value_q16(q16_from_float(value));
+    }
+    q16_t value_q16() const {
+        return m_value;
+    }
+    void value_q16(q16_t value) {
+        value = q16_clamp(value);
+        if(value!=m_value) {
+            m_value = value;
+            this->invalidate();
+        }
+#if LCD_HEIGHT < 128
+        if(m_buffer.size()==m_buffer.capacity) {
+            uint8_t tmp;
+            m_buffer.get(&tmp);
+        }
+        m_buffer.put(q16_to_u8(value));
+        this->invalidate();
+#endif
+
+    }
+#if LCD_HEIGHT < 128
+    void clear() {
+        m_buffer.clear();
+        this->invalidate();
+    }
+    // the color of the history trace where it crosses the filled part
+    rgba_pixel<32> trace_color() const {
+        return m_trace_color;
+    }
+    void trace_color(rgba_pixel<32> value) {
+        m_trace_color = value;
+        this->invalidate();
+    }
+#endif
+    bool is_gradient() const {
+        return m_is_gradient;
+    }
+    void is_gradient(bool value) {
+        m_is_gradient= value;
+        this->invalidate();
+    }
+    rgba_pixel<32> color() const {
+        return m_color;
+    }
+    void color(rgba_pixel<32> value) {
+        m_color=value;
+        this->invalidate();
+    }
+    rgba_pixel<32> back_color() const {
+        return m_back_color;
+    }
+    void back_color(rgba_pixel<32> value) {
+        m_back_color  = value;
+        this->invalidate();
+    }
+    // indicates the back color is already provided by a layer cache
+    bool static_cached() const {
+        return m_static_cached;
+    }
+    void static_cached(bool value) {
+        m_static_cached = value;
+        this->invalidate();
+    }
+    // paints the parts of the bar that don't depend on the value, in screen coordinates
+    template<typename Destination>
+    void paint_static(Destination& destination) const {
+        const srect16 b = this->bounds();
+        kernel_fill(destination,srect16(b.x1,b.y1,b.x2,b.y1+back_height()),m_back_color);
+    }
+protected:
+    virtual void on_paint(control_surface_type& destination, const srect16& clip) {
+        typename control_surface_type::pixel_type scr_bg;
+        // sample below the back color, since that may already be painted by a layer
+        destination.point({0,(int16_t)(destination.dimensions().height-1)},&scr_bg);
+        uint16_t x_end = q16_scale(m_value,destination.dimensions().width)-1;
+        uint16_t y_end = back_height();
+        if(m_is_gradient) {
+            // two reference points for the ends of the graph
+            hsva_pixel<32> px = gfx::color<gfx::hsva_pixel<32>>::red;
+            hsva_pixel<32> px2 = gfx::color<gfx::hsva_pixel<32>>::green;
+            auto h1 = px.channel<channel_name::H>();
+            auto h2 = px2.channel<channel_name::H>();
+            // adjust so we don't overshoot
+            h2 -= 64;
+            // the actual range we're drawing
+            auto range = abs(h2 - h1) + 1;
+            // the width of each gradient segment
+            int w = (destination.dimensions().width+range-1)/range + 1;
+            // the step of each segment - default 1
+            int s = 1;
+            // if the gradient is larger than the control
+            if (destination.dimensions().width < range) {
+                // change the segment to width 1
+                w = 1;
+                // and make its step larger
+                s = range / destination.dimensions().width;
+            } 
+            int x = 0;
+            // c is the current color offset
+            // it increases by s (step)
+            int c = 0;
+            // for each color in the range
+            for (auto j = 0; j < range; ++j) {
+                // adjust the H value (inverted and offset)
+                px.channel<channel_name::H>(range - c - 1 + h1);
+                // if we're drawing the filled part
+                // it's fully opaque
+                // otherwise it's semi-transparent
+                int sw = w;
+                int diff=0;
+                if (m_value==0||x> x_end) {
+                    px.channel<channel_name::A>(95);
+                    if((x-w)<=x_end) {
+                        sw = x_end-x+1;
+                        diff = w-sw;
+                    }
+                } else {
+                    px.channel<channel_name::A>(255);
+                }
+                // create the rect for our segment
+                srect16 r(x, y_end+1, x + sw , destination.dimensions().height-1);
+                // the segment is blended over the screen background, not
+                // whatever was painted underneath it
+                kernel_blend_solid(destination,r,scr_bg,px);
+                if(diff>0) {
+                    r=srect16(x+sw,y_end+1,x+w,destination.dimensions().height-1);
+                    kernel_blend_solid(destination,r,scr_bg,px);
+                }
+                // increment
+                x += w;
+                c += s;
+            }
+        } 
+        if(m_value>0) {
+            kernel_fill(destination,srect16(0,0,x_end,y_end),m_color);
+            if(!m_static_cached) {
+                kernel_fill(destination,srect16(x_end+1,0,destination.dimensions().width-1,y_end),m_back_color);
+            }
+        } else if(!m_static_cached) {
+            kernel_fill(destination,srect16(0,0,destination.dimensions().width-1,y_end),m_back_color);
+        }
+#if LCD_HEIGHT < 128
+        if(m_buffer.size()>0) {
+            const int x_span = destination.dimensions().width-1;
+            point16 opt(0,y_end);
+            size_t i = 0;
+            auto px = (m_value==0)?m_color:m_trace_color;
+            while(i<m_buffer.size()) {
+                const int x = (i+1)*x_span/(buffer_t::capacity-1);
+                uint8_t v=255-*m_buffer.peek(i);
+                point16 pt(x,v*(y_end)/255);
+                draw::line(destination,rect16(opt,pt),px);
+                if(x>x_end) {
+                    px=m_color;
+                }
+                opt=pt;
+                ++i;           
+            }
+        }
+#endif
+    }
+};
+
+template<typename ControlSurfaceType>
+class vgraph : public control<ControlSurfaceType> {
+    using base_type = control<ControlSurfaceType>;
+    using buffer_t = data::circular_buffer<uint8_t,100>;
+public:
+    using type = vgraph;
+    using control_surface_type = ControlSurfaceType;
+private:
+    struct data_line {
+        rgba_pixel<32> color;
+        buffer_t buffer;
+        data_line* next;
+    };
+    data_line* m_first;
+    bool m_static_cached;
+    template<typename Destination>
+    static void paint_chrome(Destination& destination, srect16 b) {
+        // converted through draw:: so it also works on indexed targets
+        const auto px = gfx::color<uix_pixel>::gray;
+        draw::rectangle(destination,b,px);
+        b.inflate_inplace(-1,-1);
+        const int w = b.width();
+        const int h = b.height();
+        for(int i = 0;i<10;++i) {
+            const int x = b.x1+(i*w)/10;
+            kernel_fill(destination,srect16(x,b.y1,x,b.y2),px);
+        }
+        for(int i = 0;i<10;++i) {
+            const int y = b.y1+(i*h)/10;
+            kernel_fill(destination,srect16(b.x1,y,b.x2,y),px);
+        }
+    }
+    void clear_lines() {
+        data_line*entry=m_first;
+        while(entry!=nullptr) {
+            data_line* n = entry->next;
+            delete entry;
+            entry = n;
+        }
+        m_first = nullptr;
+    }
+public:
+    vgraph() : base_type(), m_first(nullptr), m_static_cached(false) {
+    }
+    virtual ~vgraph() {
+        clear_lines();
+    }
+    void remove_lines() {
+        clear_lines();
+        this->invalidate();
+    }
+    size_t add_line(rgba_pixel<32> color) {
+        data_line* n;
+        if(m_first==nullptr) {
+            n = new data_line();
+            if(n==nullptr) {
+                return 0; // out of memory
+            }
+            n->color = color;
+            n->next = nullptr;
+            m_first = n;
+            return 1;
+        }
+        size_t result = 0;
+        data_line*entry=m_first;
+        while(entry!=nullptr) {
+            n = entry->next;
+            if(n==nullptr) {
+                n = new data_line();
+                if(n==nullptr) {
+                    return 0; // out of memory
+                }
+                n->color =color;
+                n->next = nullptr;
+                entry->next = n;
+                break;
+            }
+            entry = n;
+            ++result;
+        }
+        this->invalidate();
+        return result+1;
+    }
+    bool set_line(size_t index, rgba_pixel<32> color) {
+        if(m_first==nullptr) {
+            return false;
+        }
+        data_line*entry=m_first;
+        while(entry!=nullptr && index-->0) {
+            entry = entry->next;
+            if(entry==nullptr) {
+                return false;
+            }
+        }
+        entry->color = color;
+        this->invalidate();
+        return true;
+    }
+    bool add_data(size_t line_index,float value) {
+        return add_data_q16(line_index,q16_from_float(value));
+    }
+    bool add_data_q16(size_t line_index,q16_t value) {
+        uint8_t v = q16_to_u8(value);
+        size_t i = 0;
+        for(data_line* entry = m_first;entry!=nullptr;entry=entry->next) {
+            if(i==line_index) {
+                if(entry->buffer.size()==entry->buffer.capacity) {
+                    uint8_t tmp;
+                    entry->buffer.get(&tmp);
+                }
+                entry->buffer.put(v);
+                this->invalidate();
+                return true;
+            }
+            ++i;
+        }
+        return false;
+    }
+    void clear_data() {
+        for(data_line* entry = m_first;entry!=nullptr;entry=entry->next) {
+            entry->buffer.clear();
+        }
+        this->invalidate();
+    }
+    // indicates the border and grid are already provided by a layer cache
+    bool static_cached() const {
+        return m_static_cached;
+    }
+    void static_cached(bool value) {
+        m_static_cached = value;
+        this->invalidate();
+    }
+    // paints the border and grid, in screen coordinates
+    template<typename Destination>
+    void paint_static(Destination& destination) const {
+        paint_chrome(destination,this->bounds());
+    }
+protected:
+    void on_paint(control_surface_type& destination, const srect16& clip) {
+        srect16 b = (srect16)destination.bounds();
+        if(!m_static_cached) {
+            paint_chrome(destination,b);
+        }
+        b.inflate_inplace(-1,-1);
+        const int w = b.width();
+        const int h = b.height();
+        // Q16 coordinates: each sample advances a hundredth of the width
+        const q16_t x_step = (q16_t)((((int64_t)w)<<16)/100);
+        for(data_line* entry = m_first;entry!=nullptr;entry=entry->next) {
+            if(entry->buffer.size()) {
+                q16_t x = ((q16_t)b.x1)<<16;
+                q16_t y = (q16_t)((((int64_t)(255-*entry->buffer.peek(0))*h)<<16)/255);
+                for(int i = 1;i<(int)entry->buffer.size();++i) {
+                    const q16_t x2 = x+x_step;
+                    const q16_t y2 = (q16_t)((((int64_t)(255-*entry->buffer.peek(i))*h)<<16)/255);
+                    const int l = q16_floor_int(x), t = q16_floor_int(y);
+                    const int r = q16_ceil_int(x2), btm = q16_ceil_int(y2);
+                    kernel_fill(destination,srect16(l,t,r,btm),entry->color);
+                    kernel_fill(destination,srect16(l-1,t-1,r-1,btm-1),entry->color);
+                    x=x2;
+                    y=y2;
+                }
+            }
+        }
+    }
+};
+
+// composites the static parts of a screen (background, grid, chrome)
+// from a cached bitmap. it's rendered once through the paint callback and
+// then each dirty rect starts with a copy out of it. the cache is only
+// rebuilt when invalidate_layer() is called
+template<typename ControlSurfaceType>
+class vlayer : public control<ControlSurfaceType> {
+    using base_type = control<ControlSurfaceType>;
+public:
+    using type = vlayer;
+    using control_surface_type = ControlSurfaceType;
+    using pixel_type = typename control_surface_type::pixel_type;
+    using palette_type = typename control_surface_type::palette_type;
+    using bitmap_type = bitmap<pixel_type,palette_type>;
+    typedef void(*on_paint_layer_callback_type)(bitmap_type& destination, void* state);
+private:
+    bitmap_type m_bitmap;
+    bool m_layer_valid;
+    on_paint_layer_callback_type m_on_paint_layer_cb;
+    void* m_on_paint_layer_state;
+public:
+    vlayer() : base_type(), m_layer_valid(false), m_on_paint_layer_cb(nullptr), m_on_paint_layer_state(nullptr) {
+    }
+    virtual ~vlayer() {
+
+    }
+    static size_t buffer_size(size16 dimensions) {
+        return bitmap_type::sizeof_buffer(dimensions);
+    }
+    // the buffer must be buffer_size() bytes for the control's dimensions
+    void buffer(uint8_t* value, const palette_type* palette = nullptr) {
+        m_bitmap = bitmap_type(this->dimensions(),value,palette);
+        m_layer_valid = false;
+        this->invalidate();
+    }
+    bool cached() const {
+        return m_bitmap.begin()!=nullptr;
+    }
+    void on_paint_layer_callback(on_paint_layer_callback_type callback, void* state = nullptr) {
+        m_on_paint_layer_cb = callback;
+        m_on_paint_layer_state = state;
+        invalidate_layer();
+    }
+    // call when the theme, screen or layout changes
+    void invalidate_layer() {
+        m_layer_valid = false;
+        this->invalidate();
+    }
+protected:
+    virtual void on_paint(control_surface_type& destination, const srect16& clip) override {
+        if(!cached() || m_on_paint_layer_cb==nullptr) {
+            return;
+        }
+        if(!m_layer_valid) {
+            m_on_paint_layer_cb(m_bitmap,m_on_paint_layer_state);
+            m_layer_valid = true;
+        }
+        // same pixel format on both sides, so this is a row copy
+        draw::bitmap(destination,clip,m_bitmap,(rect16)clip);
+    }
+};
+
+// time spent painting one control since the counters were last cleared
+struct paint_counters {
+    uint32_t paints;
+    uint32_t total_us;
+    uint32_t max_us;
+    // the control's place in its layout, for tracing. clear() keeps it
+    uint8_t index;
+    void clear() {
+        paints = 0;
+        total_us = 0;
+        max_us = 0;
+    }
+};
+// the microsecond clock paint_timed uses. left null (the host renderer)
+// only the paints are counted
+typedef uint32_t(*paint_clock_type)();
+static inline paint_clock_type& paint_clock() {
+    static paint_clock_type clock = nullptr;
+    return clock;
+}
+// called around each timed paint with the control's index, if set
+typedef void(*paint_trace_type)(bool end, uint8_t index);
+static inline paint_trace_type& paint_trace() {
+    static paint_trace_type trace = nullptr;
+    return trace;
+}
+// wraps a control to count and time its paints. it costs two clock reads
+// per paint, so it stays on in release builds
+template<typename Control>
+class paint_timed : public Control {
+    paint_counters m_paint;
+public:
+    using control_surface_type = typename Control::control_surface_type;
+    paint_timed() : Control() {
+        m_paint.clear();
+        m_paint.index = 0;
+    }
+    paint_counters& paint() {
+        return m_paint;
+    }
+    const paint_counters& paint() const {
+        return m_paint;
+    }
+protected:
+    using Control::on_paint;
+    virtual void on_paint(control_surface_type& destination, const srect16& clip) override {
+        const paint_clock_type clock = paint_clock();
+        const paint_trace_type trace = paint_trace();
+        if(trace!=nullptr) {
+            trace(false,m_paint.index);
+        }
+        const uint32_t start = clock==nullptr?0:clock();
+        Control::on_paint(destination,clip);
+        ++m_paint.paints;
+        if(clock!=nullptr) {
+            const uint32_t elapsed = clock()-start;
+            m_paint.total_us+=elapsed;
+            if(elapsed>m_paint.max_us) {
+                m_paint.max_us = elapsed;
+            }
+        }
+        if(trace!=nullptr) {
+            trace(true,m_paint.index);
+        }
+    }
+};
+
+} // namespace dashboard
@@ -0,0 +1,194 @@
+#pragma once
+#include <gfx.hpp>
+#include <uix.hpp>
+#include "dashboard_controls.hpp"
+
+// the dashboard's screen: its controls and where they go. the firmware and
+// the host renderer build both lay out the screen through here, so what
+// gets measured on a PC is what the device draws. LCD_HEIGHT must be
+// defined (panel.h does that)
+namespace dashboard {
+
+template<typename ControlSurfaceType>
+struct dashboard_view {
+    using control_surface_type = ControlSurfaceType;
+    using vert_label_type = paint_timed<vvert_label<control_surface_type>>;
+    using label_type = paint_timed<vlabel<control_surface_type>>;
+    using numeric_label_type = paint_timed<vnumeric_label<control_surface_type>>;
+    using bar_type = paint_timed<bar<control_surface_type>>;
+#if LCD_HEIGHT > 128
+    using graph_type = paint_timed<vgraph<control_surface_type>>;
+#endif
+    vert_label_type value1_label;
+    vert_label_type value2_label;
+    numeric_label_type top_value1_label;
+    numeric_label_type top_value2_label;
+    bar_type top_value1_bar;
+    bar_type top_value2_bar;
+    numeric_label_type bottom_value1_label;
+    numeric_label_type bottom_value2_label;
+    bar_type bottom_value1_bar;
+    bar_type bottom_value2_bar;
+#if LCD_HEIGHT > 128
+    graph_type history_graph;
+#endif
+    label_type disconnected_label;
+    // link timing (link_stats.hpp), hidden until the host asks for it
+    label_type diagnostics_label;
+
+    // sizes the controls to the screen and registers them with it.
+    // label_background is what the vertical labels paint behind
+    // themselves (transparent when something underneath already does)
+    template<typename Screen>
+    void layout(Screen& screen, io::stream& font, uix_pixel label_background) {
+        using uix_color_t = color<uix_pixel>;
+#if LCD_HEIGHT > 128
+        static const int section_height_divisor = 4;
+#else
+        static const int section_height_divisor = 2;
+#endif
+        const int width = screen.dimensions().width;
+        const int height = screen.dimensions().height;
+        value1_label.bounds(srect16(0,0,width/10-1,height/section_height_divisor).inflate(-2,-4));
+        value1_label.text("---");
+        value1_label.font(font);
+        value1_label.background_color(label_background);
+        value1_label.color(uix_color_t::white);
+        screen.register_control(value1_label);
+        srect16 b = value1_label.bounds();
+        top_value1_label.bounds(srect16(b.x2+2,b.y1,b.x2+1+(width/5),b.height()/2+b.y1));
+        top_value1_label.text("---");
+        top_value1_label.font(font);
+        top_value1_label.color(uix_color_t::white);
+        screen.register_control(top_value1_label);
+        b = top_value1_label.bounds();
+        top_value2_label.bounds(srect16(b.x1,b.y2+1,b.x2,b.y2+b.height()));
+        top_value2_label.text("---");
+        top_value2_label.font(font);
+        top_value2_label.color(uix_color_t::white);
+        screen.register_control(top_value2_label);
+
+        b = top_value1_label.bounds();
+        b.x1 = b.x2+4;
+        b.x2 = width-1;
+        b.y2-=2;
+        top_value1_bar.bounds(b);
+        top_value1_bar.back_color(uix_color_t::black);
+        screen.register_control(top_value1_bar);
+
+        b = top_value2_label.bounds();
+        b.x1 = b.x2+4;
+        b.x2 = width-1;
+        b.y2-=2;
+        top_value2_bar.bounds(b);
+        top_value2_bar.color(uix_color_t::white);
+        top_value2_bar.is_gradient(true);
+        top_value2_bar.back_color(uix_color_t::black);
+        screen.register_control(top_value2_bar);
+
+        value2_label.bounds(value1_label.bounds().offset(0,height/section_height_divisor+3));
+        value2_label.color(uix_color_t::white);
+        value2_label.background_color(label_background);
+        value2_label.text("---");
+        value2_label.font(font);
+        screen.register_control(value2_label);
+        b = value2_label.bounds();
+        bottom_value1_label.bounds(srect16(b.x2+2,b.y1,b.x2+1+(width/5),b.height()/2+b.y1));
+        bottom_value1_label.text("---");
+        bottom_value1_label.font(font);
+        bottom_value1_label.color(uix_color_t::white);
+        screen.register_control(bottom_value1_label);
+        b = bottom_value1_label.bounds();
+        bottom_value2_label.bounds(srect16(b.x1,b.y2+1,b.x2,b.y2+b.height()));
+        bottom_value2_label.text("---"); // \xC2\xB0
+        bottom_value2_label.color(uix_color_t::white);
+        bottom_value2_label.font(font);
+        screen.register_control(bottom_value2_label);
+
+        b = bottom_value1_label.bounds();
+        b.x1 = b.x2+4;
+        b.x2 = width-1;
+        b.y2-=2;
+        bottom_value1_bar.bounds(b);
+        bottom_value1_bar.color(uix_color_t::white);
+        bottom_value1_bar.back_color(uix_color_t::black);
+        screen.register_control(bottom_value1_bar);
+
+        b = bottom_value2_label.bounds();
+        b.x1 = b.x2+4;
+        b.x2 = width-1;
+        b.y2-=2;
+        bottom_value2_bar.bounds(b);
+        bottom_value2_bar.color(uix_color_t::white);
+        bottom_value2_bar.back_color(uix_color_t::black);
+        bottom_value2_bar.is_gradient(true);
+        screen.register_control(bottom_value2_bar);
+
+#if LCD_HEIGHT > 128
+        b = screen.bounds();
+        b.y1 = height/2+1;
+        history_graph.bounds(b);
+        history_graph.add_line(top_value1_bar.color());
+        history_graph.add_line(top_value2_bar.color());
+        history_graph.add_line(bottom_value1_bar.color());
+        history_graph.add_line(bottom_value2_bar.color());
+        screen.register_control(history_graph);
+#endif
+        disconnected_label.bounds(srect16(0,0,width/2,width/8).center(screen.bounds()));
+        disconnected_label.font(font);
+        disconnected_label.color(uix_color_t::white);
+        disconnected_label.background_color(uix_color_t::black);
+        disconnected_label.text("[ disconnected ]");
+        disconnected_label.text_justify(uix_justify::center);
+        screen.register_control(disconnected_label);
+        diagnostics_label.bounds(srect16(0,height-width/16,width-1,height-1));
+        diagnostics_label.font(font);
+        diagnostics_label.color(uix_color_t::white);
+        diagnostics_label.background_color(uix_color_t::black);
+        diagnostics_label.text_justify(uix_justify::center_left);
+        diagnostics_label.visible(false);
+        screen.register_control(diagnostics_label);
+        dashboard::paint_counters* counters[control_count];
+        paint_counters(counters);
+        for(size_t i = 0;i<control_count;++i) {
+            counters[i]->index = (uint8_t)i;
+        }
+    }
+#if LCD_HEIGHT > 128
+    constexpr static const size_t control_count = 13;
+#else
+    constexpr static const size_t control_count = 12;
+#endif
+    // every control's paint counters, in layout order
+    void paint_counters(dashboard::paint_counters** out) {
+        size_t i = 0;
+        out[i++] = &value1_label.paint();
+        out[i++] = &top_value1_label.paint();
+        out[i++] = &top_value2_label.paint();
+        out[i++] = &top_value1_bar.paint();
+        out[i++] = &top_value2_bar.paint();
+        out[i++] = &value2_label.paint();
+        out[i++] = &bottom_value1_label.paint();
+        out[i++] = &bottom_value2_label.paint();
+        out[i++] = &bottom_value1_bar.paint();
+        out[i++] = &bottom_value2_bar.paint();
+#if LCD_HEIGHT > 128
+        out[i++] = &history_graph.paint();
+#endif
+        out[i++] = &disconnected_label.paint();
+        out[i++] = &diagnostics_label.paint();
+    }
+    // marks the bars and graph as having their static parts drawn by a
+    // layer underneath them
+    void static_cached(bool value) {
+        top_value1_bar.static_cached(value);
+        top_value2_bar.static_cached(value);
+        bottom_value1_bar.static_cached(value);
+        bottom_value2_bar.static_cached(value);
+#if LCD_HEIGHT > 128
+        history_graph.static_cached(value);
+#endif
+    }
+};
+
+} // namespace dashboard
@@ -0,0 +1,935 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "serial.hpp"
+
+// the serial protocol, shared by the firmware and the host tools.
+//
+// the device asks with 2 byte requests: a command and the screen index.
+// the host answers with the command byte followed by that command's
+// payload. multi-byte values are little endian and there's no padding, so
+// frames are read and written field by field at fixed offsets instead of
+// by copying structs. the views read straight out of a received buffer
+// and the writers fill a buffer to send, neither copies anything
+namespace espmon {
+
+enum struct command : uint8_t {
+    screen = 0,
+    data = 1,
+    // link timing (see link_stats.hpp). the Windows host doesn't know
+    // these and throws away whatever it has buffered when it sees one, so
+    // the device only pings a host that sets screen_pings in its screen
+    // payloads, and only asks for data_ex once that host has answered.
+    // the device's ping carries an id in place of the screen index; the
+    // host's pong echoes it with its receive and send times
+    ping = 2,
+    // data with a sequence number and the host time it was sampled
+    data_ex = 3,
+    // the host asks with a flags byte, and the device answers with a
+    // request whose second byte is the size of the report that follows
+    diagnostics = 4,
+    // the device's own counters, asked for and answered like diagnostics.
+    // each report covers the time since the last one
+    telemetry = 5,
+    // dumps the trace rings (trace_ring.hpp) as a run of reports, one
+    // trace_chunk each. builds without tracing answer with one empty chunk
+    trace = 6,
+    // dumps the sampling profiler's counts (sample_histogram.hpp) as a run
+    // of reports, one profile_chunk each, and starts, retunes or stops it.
+    // builds without the profiler answer with one empty chunk
+    profile = 7,
+    // input to photon latency (input_latency.hpp), asked for and answered
+    // like diagnostics
+    latency = 8
+};
+
+constexpr static const size_t request_size = 2;
+constexpr static const size_t screen_payload_size = 74;
+constexpr static const size_t data_payload_size = 8;
+constexpr static const size_t pong_payload_size = 9;
+constexpr static const size_t data_ex_payload_size = 16;
+constexpr static const size_t diagnostics_query_size = 1;
+constexpr static const size_t diagnostics_report_size = 72;
+constexpr static const size_t telemetry_query_size = 1;
+constexpr static const size_t trace_query_size = 1;
+// set in a trace query to leave the events in place after the dump
+constexpr static const uint8_t trace_keep = 1;
+constexpr static const size_t profile_query_size = 4;
+// set in a profile query to keep sampling after the dump (or to start)
+constexpr static const uint8_t profile_run = 1;
+// set in a profile query to start the counts over after the dump
+constexpr static const uint8_t profile_clear = 2;
+constexpr static const size_t latency_query_size = 1;
+// set in a latency query to start the counts over after the report
+constexpr static const uint8_t latency_clear = 1;
+constexpr static const size_t latency_report_size = 244;
+constexpr static const size_t max_payload_size = screen_payload_size;
+// set in a screen payload's flags by a host that answers pings
+constexpr static const uint8_t screen_pings = 0x80;
+
+// the payload that follows a command byte from the host, or 0 if the
+// command is unknown
+constexpr static inline size_t payload_size(uint8_t cmd) {
+    return cmd==(uint8_t)command::screen?screen_payload_size:
+        cmd==(uint8_t)command::data?data_payload_size:
+        cmd==(uint8_t)command::ping?pong_payload_size:
+        cmd==(uint8_t)command::data_ex?data_ex_payload_size:
+        cmd==(uint8_t)command::diagnostics?diagnostics_query_size:
+        cmd==(uint8_t)command::telemetry?telemetry_query_size:
+        cmd==(uint8_t)command::trace?trace_query_size:
+        cmd==(uint8_t)command::profile?profile_query_size:
+        cmd==(uint8_t)command::latency?latency_query_size:0;
+}
+
+constexpr static inline uint16_t read_u16(const uint8_t* p) {
+    return (uint16_t)(p[0]|(p[1]<<8));
+}
+constexpr static inline void write_u16(uint8_t* p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value>>8);
+}
+constexpr static inline uint32_t read_u32(const uint8_t* p) {
+    return (uint32_t)p[0]|((uint32_t)p[1]<<8)|((uint32_t)p[2]<<16)|((uint32_t)p[3]<<24);
+}
+constexpr static inline void write_u32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value>>8);
+    p[2] = (uint8_t)(value>>16);
+    p[3] = (uint8_t)(value>>24);
+}
+
+// a fixed width text field. it's NUL padded, but might not be terminated
+// if the sender filled it
+struct text_field {
+    const char* data;
+    size_t capacity;
+    constexpr size_t length() const {
+        size_t result = 0;
+        while(result<capacity && data[result]!=0) {
+            ++result;
+        }
+        return result;
+    }
+    // copies into a field of the same capacity, zero padded. a full
+    // field loses its last character to the terminator
+    void copy(char* dst) const {
+        size_t len = length();
+        if(len==capacity) {
+            --len;
+        }
+        memcpy(dst,data,len);
+        memset(dst+len,0,capacity-len);
+    }
+};
+
+// a request from the device
+struct request {
+    uint8_t cmd;
+    uint8_t screen_index;
+    constexpr static const size_t size = request_size;
+    void encode(uint8_t* dst) const {
+        dst[0] = cmd;
+        dst[1] = screen_index;
+    }
+    static constexpr request decode(const uint8_t* src) {
+        return request{src[0],src[1]};
+    }
+};
+// how many bytes follow a request from the device. only reports carry any
+constexpr static inline size_t request_payload_size(const request& req) {
+    return (req.cmd==(uint8_t)command::diagnostics || req.cmd==(uint8_t)command::telemetry ||
+        req.cmd==(uint8_t)command::trace || req.cmd==(uint8_t)command::profile ||
+        req.cmd==(uint8_t)command::latency)?req.screen_index:0;
+}
+
+// a screen has a top and bottom section laid out the same way, each with a
+// label and two values
+namespace layout {
+    constexpr static const size_t label = 0;
+    constexpr static const size_t label_size = 12;
+    constexpr static const size_t label_color = 12;
+    constexpr static const size_t value1 = 16;
+    constexpr static const size_t value2 = 26;
+    // within a value
+    constexpr static const size_t value_color = 0;
+    constexpr static const size_t value_suffix = 4;
+    constexpr static const size_t value_suffix_size = 4;
+    constexpr static const size_t value_max = 8;
+    constexpr static const size_t value_size = 10;
+    constexpr static const size_t section_size = 36;
+    // within a screen payload
+    constexpr static const size_t index = 0;
+    constexpr static const size_t flags = 1;
+    constexpr static const size_t top = 2;
+    constexpr static const size_t bottom = 38;
+    static_assert(bottom+section_size==screen_payload_size,"Screen layout doesn't match the payload size");
+}
+
+class value_view {
+    const uint8_t* m_data;
+public:
+    constexpr explicit value_view(const uint8_t* data) : m_data(data) {}
+    // RGBA
+    constexpr const uint8_t* color() const { return m_data+layout::value_color; }
+    text_field suffix() const { return text_field{(const char*)m_data+layout::value_suffix,layout::value_suffix_size}; }
+    constexpr uint16_t max() const { return read_u16(m_data+layout::value_max); }
+};
+class section_view {
+    const uint8_t* m_data;
+public:
+    constexpr explicit section_view(const uint8_t* data) : m_data(data) {}
+    text_field label() const { return text_field{(const char*)m_data+layout::label,layout::label_size}; }
+    constexpr const uint8_t* label_color() const { return m_data+layout::label_color; }
+    constexpr value_view value1() const { return value_view(m_data+layout::value1); }
+    constexpr value_view value2() const { return value_view(m_data+layout::value2); }
+};
+// reads a screen payload in place
+class screen_view {
+    const uint8_t* m_data;
+public:
+    constexpr static const size_t size = screen_payload_size;
+    constexpr explicit screen_view(const uint8_t* data) : m_data(data) {}
+    constexpr int8_t index() const { return (int8_t)m_data[layout::index]; }
+    // bit 0 top 1 is gradient, bit 1 top 2, bit 2 bottom 1, bit 3 bottom 2,
+    // and screen_pings
+    constexpr uint8_t flags() const { return m_data[layout::flags]; }
+    constexpr section_view top() const { return section_view(m_data+layout::top); }
+    constexpr section_view bottom() const { return section_view(m_data+layout::bottom); }
+};
+// reads a data payload in place
+class data_view {
+    const uint8_t* m_data;
+public:
+    constexpr static const size_t size = data_payload_size;
+    constexpr explicit data_view(const uint8_t* data) : m_data(data) {}
+    constexpr uint16_t top_value1() const { return read_u16(m_data+0); }
+    constexpr uint16_t top_value2() const { return read_u16(m_data+2); }
+    constexpr uint16_t bottom_value1() const { return read_u16(m_data+4); }
+    constexpr uint16_t bottom_value2() const { return read_u16(m_data+6); }
+};
+
+class pong_view {
+    const uint8_t* m_data;
+public:
+    constexpr static const size_t size = pong_payload_size;
+    constexpr explicit pong_view(const uint8_t* data) : m_data(data) {}
+    constexpr uint8_t id() const { return m_data[0]; }
+    // low 32 bits of the host's microsecond clock
+    constexpr uint32_t host_receive_us() const { return read_u32(m_data+1); }
+    constexpr uint32_t host_send_us() const { return read_u32(m_data+5); }
+};
+class data_ex_view {
+    const uint8_t* m_data;
+public:
+    constexpr static const size_t size = data_ex_payload_size;
+    constexpr explicit data_ex_view(const uint8_t* data) : m_data(data) {}
+    constexpr data_view data() const { return data_view(m_data); }
+    constexpr uint16_t seq() const { return read_u16(m_data+8); }
+    // 10-11 are reserved
+    constexpr uint32_t sample_us() const { return read_u32(m_data+12); }
+};
+// u8 flags, u8 depth, u16 rate_hz. a depth or rate of 0 keeps the
+// current one
+class profile_query_view {
+    const uint8_t* m_data;
+public:
+    constexpr static const size_t size = profile_query_size;
+    constexpr explicit profile_query_view(const uint8_t* data) : m_data(data) {}
+    constexpr uint8_t flags() const { return m_data[0]; }
+    // program counters kept per sample, the interrupted one first
+    constexpr uint8_t depth() const { return m_data[1]; }
+    constexpr uint16_t rate_hz() const { return read_u16(m_data+2); }
+};
+// the device's link report (link_stats.hpp). times are microseconds
+class diagnostics_view {
+    const uint8_t* m_data;
+public:
+    constexpr static const size_t size = diagnostics_report_size;
+    constexpr static const size_t histogram_buckets = 8;
+    constexpr explicit diagnostics_view(const uint8_t* data) : m_data(data) {}
+    // bit 0 the clocks are synced, bit 1 the overlay is showing
+    constexpr uint8_t flags() const { return m_data[0]; }
+    constexpr uint16_t pings() const { return read_u16(m_data+2); }
+    constexpr uint16_t pongs() const { return read_u16(m_data+4); }
+    // data_ex frames missing from the sequence
+    constexpr uint16_t seq_gaps() const { return read_u16(m_data+6); }
+    constexpr uint32_t rtt_last() const { return read_u32(m_data+8); }
+    constexpr uint32_t rtt_min() const { return read_u32(m_data+12); }
+    constexpr uint32_t rtt_mean() const { return read_u32(m_data+16); }
+    // host clock minus device clock
+    constexpr int32_t offset() const { return (int32_t)read_u32(m_data+20); }
+    constexpr uint32_t jitter() const { return read_u32(m_data+24); }
+    // how old a sample was once it was on screen
+    constexpr uint32_t age_last() const { return read_u32(m_data+28); }
+    constexpr uint32_t age_mean() const { return read_u32(m_data+32); }
+    constexpr uint32_t age_max() const { return read_u32(m_data+36); }
+    // bucket i counts values under 250us<<i (jitter) or 5ms<<i (age), the
+    // last one everything above
+    constexpr uint16_t jitter_histogram(size_t i) const { return read_u16(m_data+40+i*2); }
+    constexpr uint16_t age_histogram(size_t i) const { return read_u16(m_data+56+i*2); }
+};
+
+// the device's telemetry report. the fixed part is followed by a list of
+// task stacks and then one entry per control, in layout order. counters
+// cover the interval since the last report; heap and stack figures are
+// as of the report
+class telemetry_view {
+    const uint8_t* m_data;
+    size_t m_size;
+public:
+    constexpr static const size_t fixed_size = 102;
+    constexpr static const size_t stack_size = 12;
+    constexpr static const size_t stack_name_size = 8;
+    constexpr static const size_t control_size = 8;
+    constexpr static const size_t max_stacks = 4;
+    constexpr static const size_t max_controls = 13;
+    // heap capabilities, in the order they're reported
+    enum struct heap { internal = 0, dma = 1, psram = 2 };
+    constexpr telemetry_view(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+    // false if the counts don't fit the size
+    constexpr bool valid() const {
+        return m_size>=fixed_size && m_size>=fixed_size+stacks()*stack_size+controls()*control_size;
+    }
+    constexpr uint32_t uptime_ms() const { return read_u32(m_data+0); }
+    constexpr uint32_t interval_ms() const { return read_u32(m_data+4); }
+    // screen updates (loop passes that repainted something)
+    constexpr uint32_t frames() const { return read_u32(m_data+8); }
+    constexpr uint16_t fps_x10() const { return read_u16(m_data+12); }
+    // time spent rendering and flushing the frames, each from the start
+    // of its first repaint to the end of its last
+    constexpr uint32_t frame_us() const { return read_u32(m_data+16); }
+    constexpr uint32_t frame_max_us() const { return read_u32(m_data+20); }
+    constexpr uint32_t flushes() const { return read_u32(m_data+24); }
+    constexpr uint32_t flush_pixels() const { return read_u32(m_data+28); }
+    // CPU time to hand flushes off (a DMA runs on after that)
+    constexpr uint32_t flush_us() const { return read_u32(m_data+32); }
+    constexpr uint32_t flush_max_us() const { return read_u32(m_data+36); }
+    // times rendering waited on a transfer buffer, and for how long
+    constexpr uint32_t flush_stalls() const { return read_u32(m_data+40); }
+    constexpr uint32_t flush_stall_us() const { return read_u32(m_data+44); }
+    // flushes the tile cache found already on the panel
+    constexpr uint32_t flush_skipped() const { return read_u32(m_data+48); }
+    constexpr uint32_t rx_bytes() const { return read_u32(m_data+52); }
+    constexpr uint32_t tx_bytes() const { return read_u32(m_data+56); }
+    constexpr uint32_t rx_packets() const { return read_u32(m_data+60); }
+    // unknown commands and short payloads
+    constexpr uint32_t rx_dropped() const { return read_u32(m_data+64); }
+    constexpr uint32_t heap_free(heap caps) const { return read_u32(m_data+68+(size_t)caps*4); }
+    constexpr uint32_t heap_min_free(heap caps) const { return read_u32(m_data+80+(size_t)caps*4); }
+    // percent busy, 0xFF if the build can't tell
+    constexpr uint8_t cpu_load(size_t core) const { return m_data[92+core]; }
+    constexpr uint8_t stacks() const { return m_data[94]; }
+    constexpr uint8_t controls() const { return m_data[95]; }
+    // flushes queued in the transfer buffer ring, and the most that were
+    // on the wire at once. the ring's depth is 0 when it's off
+    constexpr uint32_t flush_ring_flushes() const { return read_u32(m_data+96); }
+    constexpr uint8_t flush_ring_max_queued() const { return m_data[100]; }
+    constexpr uint8_t flush_ring_depth() const { return m_data[101]; }
+    // the task's name, not terminated if it fills the field
+    const char* stack_name(size_t i) const { return (const char*)m_data+fixed_size+i*stack_size; }
+    // the least free stack the task has had, in bytes
+    constexpr uint32_t stack_free(size_t i) const { return read_u32(m_data+fixed_size+i*stack_size+stack_name_size); }
+    constexpr uint32_t control_paint_us(size_t i) const { return read_u32(m_data+control_offset(i)); }
+    // these two saturate at 0xFFFF
+    constexpr uint16_t control_paints(size_t i) const { return read_u16(m_data+control_offset(i)+4); }
+    constexpr uint16_t control_paint_max_us(size_t i) const { return read_u16(m_data+control_offset(i)+6); }
+private:
+    constexpr size_t control_offset(size_t i) const { return fixed_size+stacks()*stack_size+i*control_size; }
+};
+static_assert(telemetry_view::fixed_size+telemetry_view::max_stacks*telemetry_view::stack_size+
+    telemetry_view::max_controls*telemetry_view::control_size<=255,"A telemetry report must fit its size byte");
+
+// trace events, 8 bytes on the wire: u32 cycles, u8 kind, u8 point, u16 arg
+enum struct trace_kind : uint8_t {
+    begin = 0,
+    end = 1,
+    instant = 2
+};
+enum struct trace_point : uint8_t {
+    // serial_read_packet, arg is the command
+    packet = 0,
+    // a refresh_display pass
+    frame = 1,
+    // a control's on_paint, arg is its index in layout order
+    paint = 2,
+    // uix_on_flush, arg is the pixel count (saturated)
+    flush = 3,
+    // a transfer on the wire, from the flush handing it off to the DMA
+    // complete interrupt
+    dma = 4,
+    // update_input
+    input = 5,
+    nvs_commit = 6
+};
+struct trace_event {
+    uint32_t cycles;
+    uint8_t kind;
+    uint8_t id;
+    uint16_t arg;
+};
+// one report of a trace dump. a chunk starts with
+//   u8 core, u8 flags, u8 cores, u8 event count
+// the first chunk for a core (flags bit 0) then has the ring's header
+//   u32 cpu_hz       cycle counter rate
+//   u32 head         events the ring has ever taken
+//   u32 sync_index   the event the sync point was taken at
+//   u32 sync_cycles  the cycle count then
+//   u32 sync_us      and the low 32 bits of the microsecond clock
+// and then the events, oldest first. flags bit 1 marks the last chunk
+class trace_chunk_view {
+    const uint8_t* m_data;
+    size_t m_size;
+public:
+    constexpr static const size_t header_size = 4;
+    constexpr static const size_t ring_size = 20;
+    constexpr static const size_t event_size = 8;
+    constexpr static const size_t max_events = 28;
+    constexpr trace_chunk_view(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+    constexpr bool valid() const {
+        return m_size>=header_size && m_size>=events_offset()+count()*event_size;
+    }
+    constexpr uint8_t core() const { return m_data[0]; }
+    constexpr bool first() const { return 0!=(m_data[1]&1); }
+    constexpr bool last() const { return 0!=(m_data[1]&2); }
+    constexpr uint8_t cores() const { return m_data[2]; }
+    constexpr uint8_t count() const { return m_data[3]; }
+    // only valid when first()
+    constexpr uint32_t cpu_hz() const { return read_u32(m_data+4); }
+    constexpr uint32_t head() const { return read_u32(m_data+8); }
+    constexpr uint32_t sync_index() const { return read_u32(m_data+12); }
+    constexpr uint32_t sync_cycles() const { return read_u32(m_data+16); }
+    constexpr uint32_t sync_us() const { return read_u32(m_data+20); }
+    trace_event event(size_t i) const {
+        const uint8_t* p = m_data+events_offset()+i*event_size;
+        return trace_event{read_u32(p),p[4],p[5],read_u16(p+6)};
+    }
+private:
+    constexpr size_t events_offset() const { return header_size+(first()?ring_size:0); }
+};
+
+// one report of a profile dump. a chunk starts with
+//   u8 core, u8 flags, u8 depth, u8 entry count
+// the first chunk for a core (flags bit 0) then has the core's counters
+//   u16 rate_hz      samples a second
+//   u8 running       1 if it's still sampling
+//   u8 reserved
+//   u32 samples      taken since the counts were cleared
+//   u32 dropped      samples that didn't fit the table
+//   u32 elapsed_us   time spent sampling
+//   u32 isr_us       time spent in the sampling interrupt
+//   u32 isr_max_ns   and its longest run
+// and then the entries: u32 count followed by depth u32 program counters,
+// the interrupted one first and then its callers, 0 past the end of a
+// shallower stack. flags bit 1 marks the last chunk
+class profile_chunk_view {
+    const uint8_t* m_data;
+    size_t m_size;
+public:
+    constexpr static const size_t header_size = 4;
+    constexpr static const size_t counters_size = 24;
+    constexpr static const size_t max_depth = 8;
+    constexpr profile_chunk_view(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+    constexpr bool valid() const {
+        return m_size>=header_size && depth()<=max_depth && m_size>=entries_offset()+count()*entry_size();
+    }
+    constexpr uint8_t core() const { return m_data[0]; }
+    constexpr bool first() const { return 0!=(m_data[1]&1); }
+    constexpr bool last() const { return 0!=(m_data[1]&2); }
+    constexpr uint8_t depth() const { return m_data[2]; }
+    constexpr uint8_t count() const { return m_data[3]; }
+    constexpr size_t entry_size() const { return 4+4*(size_t)depth(); }
+    // only valid when first()
+    constexpr uint16_t rate_hz() const { return read_u16(m_data+4); }
+    constexpr bool running() const { return m_data[6]!=0; }
+    constexpr uint32_t samples() const { return read_u32(m_data+8); }
+    constexpr uint32_t dropped() const { return read_u32(m_data+12); }
+    constexpr uint32_t elapsed_us() const { return read_u32(m_data+16); }
+    constexpr uint32_t isr_us() const { return read_u32(m_data+20); }
+    constexpr uint32_t isr_max_ns() const { return read_u32(m_data+24); }
+    constexpr uint32_t entry_count(size_t i) const { return read_u32(m_data+entries_offset()+i*entry_size()); }
+    constexpr uint32_t entry_pc(size_t i, size_t frame) const { return read_u32(m_data+entries_offset()+i*entry_size()+4+frame*4); }
+private:
+    constexpr size_t entries_offset() const { return header_size+(first()?counters_size:0); }
+};
+static_assert(trace_chunk_view::header_size+trace_chunk_view::ring_size+
+    trace_chunk_view::max_events*trace_chunk_view::event_size<=255,"A trace chunk must fit its size byte");
+// u8 kinds, u8 stages, u16 missed, then for each kind of input action and
+// each stage of it 24 bytes: u32 mean_us, u32 max_us and 8 u16 histogram
+// buckets. a build without inputs sends no kinds
+class latency_view {
+    const uint8_t* m_data;
+    size_t m_size;
+public:
+    constexpr static const size_t header_size = 4;
+    constexpr static const size_t stage_size = 24;
+    constexpr static const size_t histogram_buckets = 8;
+    // what a press did. a short one switches the screen, a long one the theme
+    enum struct kind : uint8_t {
+        screen = 0,
+        theme = 1
+    };
+    constexpr static const size_t max_kinds = 2;
+    // stages of an action, and the whole of it
+    enum struct stage : uint8_t {
+        // from the first edge to the action being taken: debouncing, and
+        // for touch the controller's report
+        detect = 0,
+        // to the state it changes being set. a screen switch waits on the
+        // host's answer
+        apply = 1,
+        // to the first control painting it
+        paint = 2,
+        // to the last transfer of that frame finishing
+        present = 3,
+        total = 4
+    };
+    constexpr static const size_t max_stages = 5;
+    constexpr latency_view(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+    constexpr bool valid() const {
+        return m_size>=header_size && kinds()<=max_kinds && stages()<=max_stages &&
+            m_size>=header_size+(size_t)kinds()*stages()*stage_size;
+    }
+    constexpr uint8_t kinds() const { return m_data[0]; }
+    constexpr uint8_t stages() const { return m_data[1]; }
+    // actions that never made it to the screen
+    constexpr uint16_t missed() const { return read_u16(m_data+2); }
+    constexpr uint32_t mean_us(size_t k, size_t s) const { return read_u32(m_data+offset(k,s)); }
+    constexpr uint32_t max_us(size_t k, size_t s) const { return read_u32(m_data+offset(k,s)+4); }
+    // bucket i counts values under 2ms<<i, the last one everything above
+    constexpr uint16_t histogram(size_t k, size_t s, size_t i) const { return read_u16(m_data+offset(k,s)+8+i*2); }
+private:
+    constexpr size_t offset(size_t k, size_t s) const { return header_size+(k*stages()+s)*stage_size; }
+};
+static_assert(latency_view::header_size+latency_view::max_kinds*latency_view::max_stages*latency_view::stage_size==latency_report_size,"Latency layout doesn't match the report size");
+
+// writers fill a payload in place. the buffer should start zeroed so
+// short text fields are padded
+class value_writer {
+    uint8_t* m_data;
+public:
+    explicit value_writer(uint8_t* data) : m_data(data) {}
+    void color(const uint8_t* rgba) { memcpy(m_data+layout::value_color,rgba,4); }
+    // truncated so there's always a terminator
+    void suffix(const char* sz) { write_text(m_data+layout::value_suffix,layout::value_suffix_size,sz); }
+    void max(uint16_t value) { write_u16(m_data+layout::value_max,value); }
+    static void write_text(uint8_t* dst, size_t capacity, const char* sz) {
+        size_t i = 0;
+        for(;i<capacity-1 && sz[i]!=0;++i) {
+            dst[i] = (uint8_t)sz[i];
+        }
+        memset(dst+i,0,capacity-i);
+    }
+};
+class section_writer {
+    uint8_t* m_data;
+public:
+    explicit section_writer(uint8_t* data) : m_data(data) {}
+    void label(const char* sz) { value_writer::write_text(m_data+layout::label,layout::label_size,sz); }
+    void label_color(const uint8_t* rgba) { memcpy(m_data+layout::label_color,rgba,4); }
+    value_writer value1() { return value_writer(m_data+layout::value1); }
+    value_writer value2() { return value_writer(m_data+layout::value2); }
+};
+class screen_writer {
+    uint8_t* m_data;
+public:
+    constexpr static const size_t size = screen_payload_size;
+    explicit screen_writer(uint8_t* data) : m_data(data) {}
+    void index(int8_t value) { m_data[layout::index] = (uint8_t)value; }
+    void flags(uint8_t value) { m_data[layout::flags] = value; }
+    section_writer top() { return section_writer(m_data+layout::top); }
+    section_writer bottom() { return section_writer(m_data+layout::bottom); }
+};
+class data_writer {
+    uint8_t* m_data;
+public:
+    constexpr static const size_t size = data_payload_size;
+    explicit data_writer(uint8_t* data) : m_data(data) {}
+    void top_value1(uint16_t value) { write_u16(m_data+0,value); }
+    void top_value2(uint16_t value) { write_u16(m_data+2,value); }
+    void bottom_value1(uint16_t value) { write_u16(m_data+4,value); }
+    void bottom_value2(uint16_t value) { write_u16(m_data+6,value); }
+};
+
+class pong_writer {
+    uint8_t* m_data;
+public:
+    constexpr static const size_t size = pong_payload_size;
+    explicit pong_writer(uint8_t* data) : m_data(data) {}
+    void id(uint8_t value) { m_data[0] = value; }
+    void host_receive_us(uint32_t value) { write_u32(m_data+1,value); }
+    void host_send_us(uint32_t value) { write_u32(m_data+5,value); }
+};
+class data_ex_writer {
+    uint8_t* m_data;
+public:
+    constexpr static const size_t size = data_ex_payload_size;
+    explicit data_ex_writer(uint8_t* data) : m_data(data) {
+        write_u16(m_data+10,0);
+    }
+    data_writer data() { return data_writer(m_data); }
+    void seq(uint16_t value) { write_u16(m_data+8,value); }
+    void sample_us(uint32_t value) { write_u32(m_data+12,value); }
+};
+class profile_query_writer {
+    uint8_t* m_data;
+public:
+    constexpr static const size_t size = profile_query_size;
+    explicit profile_query_writer(uint8_t* data) : m_data(data) {}
+    void flags(uint8_t value) { m_data[0] = value; }
+    void depth(uint8_t value) { m_data[1] = value; }
+    void rate_hz(uint16_t value) { write_u16(m_data+2,value); }
+};
+class diagnostics_writer {
+    uint8_t* m_data;
+public:
+    constexpr static const size_t size = diagnostics_report_size;
+    explicit diagnostics_writer(uint8_t* data) : m_data(data) {
+        memset(m_data,0,size);
+    }
+    void flags(uint8_t value) { m_data[0] = value; }
+    void pings(uint16_t value) { write_u16(m_data+2,value); }
+    void pongs(uint16_t value) { write_u16(m_data+4,value); }
+    void seq_gaps(uint16_t value) { write_u16(m_data+6,value); }
+    void rtt_last(uint32_t value) { write_u32(m_data+8,value); }
+    void rtt_min(uint32_t value) { write_u32(m_data+12,value); }
+    void rtt_mean(uint32_t value) { write_u32(m_data+16,value); }
+    void offset(int32_t value) { write_u32(m_data+20,(uint32_t)value); }
+    void jitter(uint32_t value) { write_u32(m_data+24,value); }
+    void age_last(uint32_t value) { write_u32(m_data+28,value); }
+    void age_mean(uint32_t value) { write_u32(m_data+32,value); }
+    void age_max(uint32_t value) { write_u32(m_data+36,value); }
+    void jitter_histogram(size_t i, uint16_t value) { write_u16(m_data+40+i*2,value); }
+    void age_histogram(size_t i, uint16_t value) { write_u16(m_data+56+i*2,value); }
+};
+static_assert(56+diagnostics_view::histogram_buckets*2==diagnostics_report_size,"Diagnostics layout doesn't match the report size");
+class latency_writer {
+    uint8_t* m_data;
+    uint8_t m_stages;
+public:
+    latency_writer(uint8_t* data, uint8_t kinds, uint8_t stages) : m_data(data), m_stages(stages) {
+        memset(m_data,0,latency_view::header_size+(size_t)kinds*stages*latency_view::stage_size);
+        m_data[0] = kinds;
+        m_data[1] = stages;
+    }
+    size_t size() const { return latency_view::header_size+(size_t)m_data[0]*m_stages*latency_view::stage_size; }
+    void missed(uint16_t value) { write_u16(m_data+2,value); }
+    void mean_us(size_t k, size_t s, uint32_t value) { write_u32(m_data+offset(k,s),value); }
+    void max_us(size_t k, size_t s, uint32_t value) { write_u32(m_data+offset(k,s)+4,value); }
+    void histogram(size_t k, size_t s, size_t i, uint16_t value) { write_u16(m_data+offset(k,s)+8+i*2,value); }
+private:
+    size_t offset(size_t k, size_t s) const { return latency_view::header_size+(k*m_stages+s)*latency_view::stage_size; }
+};
+// fill the fixed part, then add stacks, then controls. size() is what to
+// send
+class telemetry_writer {
+    uint8_t* m_data;
+    size_t m_size;
+public:
+    using heap = telemetry_view::heap;
+    explicit telemetry_writer(uint8_t* data) : m_data(data), m_size(telemetry_view::fixed_size) {
+        memset(m_data,0,telemetry_view::fixed_size);
+        m_data[92] = 0xFF;
+        m_data[93] = 0xFF;
+    }
+    size_t size() const { return m_size; }
+    void uptime_ms(uint32_t value) { write_u32(m_data+0,value); }
+    void interval_ms(uint32_t value) { write_u32(m_data+4,value); }
+    void frames(uint32_t value) { write_u32(m_data+8,value); }
+    void fps_x10(uint16_t value) { write_u16(m_data+12,value); }
+    void frame_us(uint32_t value) { write_u32(m_data+16,value); }
+    void frame_max_us(uint32_t value) { write_u32(m_data+20,value); }
+    void flushes(uint32_t value) { write_u32(m_data+24,value); }
+    void flush_pixels(uint32_t value) { write_u32(m_data+28,value); }
+    void flush_us(uint32_t value) { write_u32(m_data+32,value); }
+    void flush_max_us(uint32_t value) { write_u32(m_data+36,value); }
+    void flush_stalls(uint32_t value) { write_u32(m_data+40,value); }
+    void flush_stall_us(uint32_t value) { write_u32(m_data+44,value); }
+    void flush_skipped(uint32_t value) { write_u32(m_data+48,value); }
+    void rx_bytes(uint32_t value) { write_u32(m_data+52,value); }
+    void tx_bytes(uint32_t value) { write_u32(m_data+56,value); }
+    void rx_packets(uint32_t value) { write_u32(m_data+60,value); }
+    void rx_dropped(uint32_t value) { write_u32(m_data+64,value); }
+    void heap_free(heap caps, uint32_t value) { write_u32(m_data+68+(size_t)caps*4,value); }
+    void heap_min_free(heap caps, uint32_t value) { write_u32(m_data+80+(size_t)caps*4,value); }
+    void cpu_load(size_t core, uint8_t percent) { m_data[92+core] = percent; }
+    void flush_ring_flushes(uint32_t value) { write_u32(m_data+96,value); }
+    void flush_ring_max_queued(uint8_t value) { m_data[100] = value; }
+    void flush_ring_depth(uint8_t value) { m_data[101] = value; }
+    // stacks have to be added before any controls
+    bool add_stack(const char* name, uint32_t free_bytes) {
+        if(m_data[94]>=telemetry_view::max_stacks || m_data[95]!=0) {
+            return false;
+        }
+        uint8_t* p = m_data+m_size;
+        memset(p,0,telemetry_view::stack_name_size);
+        strncpy((char*)p,name,telemetry_view::stack_name_size);
+        write_u32(p+telemetry_view::stack_name_size,free_bytes);
+        m_size+=telemetry_view::stack_size;
+        ++m_data[94];
+        return true;
+    }
+    bool add_control(uint32_t paints, uint32_t paint_us, uint32_t paint_max_us) {
+        if(m_data[95]>=telemetry_view::max_controls) {
+            return false;
+        }
+        uint8_t* p = m_data+m_size;
+        write_u32(p,paint_us);
+        write_u16(p+4,(uint16_t)(paints>0xFFFF?0xFFFF:paints));
+        write_u16(p+6,(uint16_t)(paint_max_us>0xFFFF?0xFFFF:paint_max_us));
+        m_size+=telemetry_view::control_size;
+        ++m_data[95];
+        return true;
+    }
+};
+
+class trace_chunk_writer {
+    uint8_t* m_data;
+    size_t m_size;
+public:
+    trace_chunk_writer(uint8_t* data, uint8_t core, uint8_t cores) : m_data(data), m_size(trace_chunk_view::header_size) {
+        m_data[0] = core;
+        m_data[1] = 0;
+        m_data[2] = cores;
+        m_data[3] = 0;
+    }
+    size_t size() const { return m_size; }
+    // makes this the first chunk for its core. call before adding events
+    void ring(uint32_t cpu_hz, uint32_t head, uint32_t sync_index, uint32_t sync_cycles, uint32_t sync_us) {
+        m_data[1]|=1;
+        write_u32(m_data+4,cpu_hz);
+        write_u32(m_data+8,head);
+        write_u32(m_data+12,sync_index);
+        write_u32(m_data+16,sync_cycles);
+        write_u32(m_data+20,sync_us);
+        m_size = trace_chunk_view::header_size+trace_chunk_view::ring_size;
+    }
+    void last() { m_data[1]|=2; }
+    // false once the chunk is full
+    bool add(const trace_event& e) {
+        if(m_data[3]>=trace_chunk_view::max_events) {
+            return false;
+        }
+        uint8_t* p = m_data+m_size;
+        write_u32(p,e.cycles);
+        p[4] = e.kind;
+        p[5] = e.id;
+        write_u16(p+6,e.arg);
+        m_size+=trace_chunk_view::event_size;
+        ++m_data[3];
+        return true;
+    }
+};
+// one report of a profile dump, see profile_chunk_view
+class profile_chunk_writer {
+    uint8_t* m_data;
+    size_t m_size;
+public:
+    profile_chunk_writer(uint8_t* data, uint8_t core, uint8_t depth) : m_data(data), m_size(profile_chunk_view::header_size) {
+        m_data[0] = core;
+        m_data[1] = 0;
+        m_data[2] = depth;
+        m_data[3] = 0;
+    }
+    size_t size() const { return m_size; }
+    // makes this the first chunk for its core. call before adding entries
+    void counters(uint16_t rate_hz, bool running, uint32_t samples, uint32_t dropped, uint32_t elapsed_us, uint32_t isr_us, uint32_t isr_max_ns) {
+        m_data[1]|=1;
+        write_u16(m_data+4,rate_hz);
+        m_data[6] = running?1:0;
+        m_data[7] = 0;
+        write_u32(m_data+8,samples);
+        write_u32(m_data+12,dropped);
+        write_u32(m_data+16,elapsed_us);
+        write_u32(m_data+20,isr_us);
+        write_u32(m_data+24,isr_max_ns);
+        m_size = profile_chunk_view::header_size+profile_chunk_view::counters_size;
+    }
+    void last() { m_data[1]|=2; }
+    // false once the chunk is full. pcs holds depth program counters
+    bool add(uint32_t count, const uint32_t* pcs) {
+        const size_t entry_size = 4+4*(size_t)m_data[2];
+        if(m_data[3]==0xFF || m_size+entry_size>255) {
+            return false;
+        }
+        uint8_t* p = m_data+m_size;
+        write_u32(p,count);
+        for(size_t i = 0;i<m_data[2];++i) {
+            write_u32(p+4+i*4,pcs[i]);
+        }
+        m_size+=entry_size;
+        ++m_data[3];
+        return true;
+    }
+};
+
+// conversions to and from the firmware's structs (serial.hpp). text
+// fields always come out terminated
+static inline void decode_value(const value_view& src, uint8_t* color, char* suffix, uint16_t* max) {
+    memcpy(color,src.color(),4);
+    src.suffix().copy(suffix);
+    *max = src.max();
+}
+static inline void decode_section(const section_view& src, char* label, uint8_t* label_color) {
+    src.label().copy(label);
+    memcpy(label_color,src.label_color(),4);
+}
+static inline void decode(const screen_view& src, response_screen_t* dst) {
+    dst->index = src.index();
+    dst->flags = src.flags();
+    decode_section(src.top(),dst->top_label,dst->top_label_color);
+    decode_value(src.top().value1(),dst->top_color1,dst->top_suffix1,&dst->top_max1);
+    decode_value(src.top().value2(),dst->top_color2,dst->top_suffix2,&dst->top_max2);
+    decode_section(src.bottom(),dst->bottom_label,dst->bottom_label_color);
+    decode_value(src.bottom().value1(),dst->bottom_color1,dst->bottom_suffix1,&dst->bottom_max1);
+    decode_value(src.bottom().value2(),dst->bottom_color2,dst->bottom_suffix2,&dst->bottom_max2);
+}
+static inline void decode(const data_view& src, response_data_t* dst) {
+    dst->top_value1 = src.top_value1();
+    dst->top_value2 = src.top_value2();
+    dst->bottom_value1 = src.bottom_value1();
+    dst->bottom_value2 = src.bottom_value2();
+}
+static inline void decode(const pong_view& src, response_pong_t* dst) {
+    dst->id = src.id();
+    dst->host_receive_us = src.host_receive_us();
+    dst->host_send_us = src.host_send_us();
+}
+static inline void decode(const profile_query_view& src, response_profile_t* dst) {
+    dst->flags = src.flags();
+    dst->depth = src.depth();
+    dst->rate_hz = src.rate_hz();
+}
+static inline void decode(const data_ex_view& src, response_data_ex_t* dst) {
+    decode(src.data(),&dst->data);
+    dst->seq = src.seq();
+    dst->sample_us = src.sample_us();
+}
+static inline void encode(const response_screen_t& src, uint8_t* dst) {
+    memset(dst,0,screen_payload_size);
+    screen_writer w(dst);
+    w.index(src.index);
+    w.flags(src.flags);
+    section_writer top = w.top();
+    top.label(src.top_label);
+    top.label_color(src.top_label_color);
+    top.value1().color(src.top_color1);
+    top.value1().suffix(src.top_suffix1);
+    top.value1().max(src.top_max1);
+    top.value2().color(src.top_color2);
+    top.value2().suffix(src.top_suffix2);
+    top.value2().max(src.top_max2);
+    section_writer bottom = w.bottom();
+    bottom.label(src.bottom_label);
+    bottom.label_color(src.bottom_label_color);
+    bottom.value1().color(src.bottom_color1);
+    bottom.value1().suffix(src.bottom_suffix1);
+    bottom.value1().max(src.bottom_max1);
+    bottom.value2().color(src.bottom_color2);
+    bottom.value2().suffix(src.bottom_suffix2);
+    bottom.value2().max(src.bottom_max2);
+}
+static inline void encode(const response_data_t& src, uint8_t* dst) {
+    data_writer w(dst);
+    w.top_value1(src.top_value1);
+    w.top_value2(src.top_value2);
+    w.bottom_value1(src.bottom_value1);
+    w.bottom_value2(src.bottom_value2);
+}
+static inline void encode(const response_pong_t& src, uint8_t* dst) {
+    pong_writer w(dst);
+    w.id(src.id);
+    w.host_receive_us(src.host_receive_us);
+    w.host_send_us(src.host_send_us);
+}
+static inline void encode(const response_profile_t& src, uint8_t* dst) {
+    profile_query_writer w(dst);
+    w.flags(src.flags);
+    w.depth(src.depth);
+    w.rate_hz(src.rate_hz);
+}
+// the reserved bytes come out zero
+static inline void encode(const response_data_ex_t& src, uint8_t* dst) {
+    data_ex_writer w(dst);
+    encode(src.data,dst);
+    w.seq(src.seq);
+    w.sample_us(src.sample_us);
+}
+
+// splits a byte stream from the host into frames. payloads that arrive
+// whole are handed out in place; ones split across reads are gathered
+// into an internal buffer first
+class frame_reader {
+public:
+    enum struct result {
+        // more bytes are needed
+        none,
+        // a frame is ready, see cmd() and payload()
+        frame,
+        // a byte that isn't a known command was skipped
+        junk
+    };
+private:
+    uint8_t m_buffer[max_payload_size];
+    uint8_t m_cmd;
+    size_t m_needed;
+    size_t m_have;
+    const uint8_t* m_payload;
+public:
+    frame_reader() : m_cmd(0), m_needed(0), m_have(0), m_payload(nullptr) {}
+    // consumes bytes up to and including the end of the next frame. returns
+    // how many were consumed, and what they produced in *out
+    size_t feed(const uint8_t* data, size_t size, result* out) {
+        *out = result::none;
+        size_t used = 0;
+        if(m_needed==0) {
+            if(size==0) {
+                return 0;
+            }
+            m_cmd = data[0];
+            used = 1;
+            m_needed = espmon::payload_size(m_cmd);
+            m_have = 0;
+            if(m_needed==0) {
+                *out = result::junk;
+                return used;
+            }
+        }
+        const size_t left = size-used;
+        if(m_have==0 && left>=m_needed) {
+            // the whole payload is here, no copy
+            m_payload = data+used;
+            used+=m_needed;
+            m_needed = 0;
+            *out = result::frame;
+            return used;
+        }
+        const size_t take = left<m_needed-m_have?left:m_needed-m_have;
+        memcpy(m_buffer+m_have,data+used,take);
+        m_have+=take;
+        used+=take;
+        if(m_have==m_needed) {
+            m_payload = m_buffer;
+            m_needed = 0;
+            *out = result::frame;
+        }
+        return used;
+    }
+    uint8_t cmd() const {
+        return m_cmd;
+    }
+    // valid until the next feed(), and while the data fed is
+    const uint8_t* payload() const {
+        return m_payload;
+    }
+    size_t payload_size() const {
+        return espmon::payload_size(m_cmd);
+    }
+    void reset() {
+        m_needed = 0;
+        m_have = 0;
+        m_payload = nullptr;
+    }
+};
+
+} // namespace espmon
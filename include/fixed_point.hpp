@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+// Q16 fixed point helpers for the value pipeline. 1.0 is 0x10000.
+// everything here is integer only so results are bit exact across the
+// device and a host build, and the FPU-less paths never touch floats
+
+using q16_t = int32_t;
+constexpr static const q16_t q16_one = 1<<16;
+
+// a precomputed reciprocal of a maximum value, so normalizing a sample
+// is a multiply and a shift instead of a divide. it's rounded up so that
+// value==max normalizes to exactly q16_one
+using q16_recip_t = uint64_t;
+
+constexpr static inline q16_recip_t q16_recip(uint16_t max) {
+    return ((((uint64_t)1)<<32)+(max==0?1:max)-1)/(max==0?1:max);
+}
+// normalizes value to 0-q16_one given the reciprocal of its maximum
+constexpr static inline q16_t q16_normalize(uint16_t value, q16_recip_t recip) {
+    const uint64_t result = (value*recip)>>16;
+    return result>(uint64_t)q16_one?q16_one:(q16_t)result;
+}
+constexpr static inline q16_t q16_clamp(q16_t value) {
+    return value<0?0:value>q16_one?q16_one:value;
+}
+// clamped while still a float, since converting one past the range of
+// q16_t, or NaN, is undefined. NaN reads as 0
+constexpr static inline q16_t q16_from_float(float value) {
+    return !(value>0.f)?0:value>=1.f?q16_one:(q16_t)(value*q16_one+.5f);
+}
+constexpr static inline float q16_to_float(q16_t value) {
+    return value/(float)q16_one;
+}
+// maps a normalized value onto extent pixels, rounding to nearest
+constexpr static inline int q16_scale(q16_t value, int extent) {
+    return (int)(((int64_t)value*extent+(q16_one>>1))>>16);
+}
+// quantizes to 0-255 for the history buffers (truncating, like the
+// float cast it replaces)
+constexpr static inline uint8_t q16_to_u8(q16_t value) {
+    return (uint8_t)(((uint32_t)q16_clamp(value)*255)>>16);
+}
+constexpr static inline q16_t q16_from_u8(uint8_t value) {
+    return (q16_t)(((uint32_t)value<<16)/255);
+}
+constexpr static inline q16_t q16_floor_int(q16_t value) {
+    return value>>16;
+}
+constexpr static inline q16_t q16_ceil_int(q16_t value) {
+    return (value+0xFFFF)>>16;
+}
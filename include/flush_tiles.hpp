@@ -0,0 +1,143 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// remembers a hash of what was last sent to each tile of the panel so
+// flushes that would resend identical pixels can be skipped or trimmed.
+// tiles are laid out in screen coordinates. panels with sub-byte pixels
+// use full width tiles (row bands) since their columns aren't byte aligned
+template<uint16_t Width, uint16_t Height, size_t BitsPerPixel, uint16_t TileWidth, uint16_t TileHeight>
+class flush_tile_cache {
+public:
+    using type = flush_tile_cache;
+    constexpr static const uint16_t width = Width;
+    constexpr static const uint16_t height = Height;
+    constexpr static const size_t bits_per_pixel = BitsPerPixel;
+    constexpr static const uint16_t tile_width = BitsPerPixel<8?Width:TileWidth;
+    constexpr static const uint16_t tile_height = TileHeight;
+    constexpr static const size_t columns = (Width+tile_width-1)/tile_width;
+    constexpr static const size_t rows = (Height+tile_height-1)/tile_height;
+private:
+    static_assert(TileWidth>0 && TileHeight>0,"Tile dimensions must be non-zero");
+    uint32_t m_hashes[columns*rows];
+    uint32_t m_hits;
+    uint32_t m_misses;
+    uint32_t m_skipped;
+    uint32_t m_trimmed;
+    static uint32_t mix(uint32_t hash, uint32_t k) {
+        k*=0xCC9E2D51;
+        k=(k<<15)|(k>>17);
+        k*=0x1B873593;
+        hash^=k;
+        hash=(hash<<13)|(hash>>19);
+        return hash*5+0xE6546B64;
+    }
+    static uint32_t hash_bytes(uint32_t hash, const uint8_t* data, size_t size) {
+        uint32_t k;
+        while(size>=4) {
+            memcpy(&k,data,4);
+            hash = mix(hash,k);
+            data+=4;
+            size-=4;
+        }
+        k = 0;
+        while(size--) {
+            k=(k<<8)|*data++;
+        }
+        return mix(hash,k);
+    }
+public:
+    flush_tile_cache() {
+        clear();
+        reset_counters();
+    }
+    // forget what's on the panel, so the next flush of every tile goes out
+    void clear() {
+        // a region's hash always includes its coordinates, so 0 won't
+        // realistically match anything
+        memset(m_hashes,0,sizeof(m_hashes));
+    }
+    // tiles whose contents matched the panel
+    uint32_t hits() const {
+        return m_hits;
+    }
+    // tiles whose contents changed
+    uint32_t misses() const {
+        return m_misses;
+    }
+    // flushes dropped entirely
+    uint32_t skipped() const {
+        return m_skipped;
+    }
+    // flushes reduced to a smaller band of rows
+    uint32_t trimmed() const {
+        return m_trimmed;
+    }
+    void reset_counters() {
+        m_hits = m_misses = m_skipped = m_trimmed = 0;
+    }
+    // updates the tile hashes for a flush of the given screen region and
+    // narrows it to the rows that actually changed. returns false if
+    // nothing changed and the flush can be skipped entirely
+    bool filter(int& x1, int& y1, int& x2, int& y2, const void*& bitmap) {
+        const int w = x2-x1+1;
+        const size_t row_bits = ((size_t)w)*BitsPerPixel;
+        const uint8_t* const data = (const uint8_t*)bitmap;
+        int first_changed = -1;
+        int last_changed = -1;
+        for(int ty = y1/tile_height;ty<=y2/tile_height && ty<(int)rows;++ty) {
+            const int ry1 = ty*tile_height<y1?y1:ty*tile_height;
+            const int ry2 = (ty+1)*tile_height-1>y2?y2:(ty+1)*tile_height-1;
+            bool changed = false;
+            for(int tx = x1/tile_width;tx<=x2/tile_width && tx<(int)columns;++tx) {
+                const int rx1 = tx*tile_width<x1?x1:tx*tile_width;
+                const int rx2 = (tx+1)*tile_width-1>x2?x2:(tx+1)*tile_width-1;
+                uint32_t hash = mix(mix(0x9747B28C,(rx1<<16)|ry1),(rx2<<16)|ry2);
+                if(BitsPerPixel<8) {
+                    // whole rows, including any partial bytes at the ends
+                    const size_t start = ((ry1-y1)*row_bits)>>3;
+                    const size_t end = (((ry2-y1+1)*row_bits)+7)>>3;
+                    hash = hash_bytes(hash,data+start,end-start);
+                } else {
+                    const size_t span = ((size_t)(rx2-rx1+1))*BitsPerPixel/8;
+                    const uint8_t* p = data+((ry1-y1)*row_bits+(rx1-x1)*BitsPerPixel)/8;
+                    for(int y = ry1;y<=ry2;++y) {
+                        hash = hash_bytes(hash,p,span);
+                        p+=row_bits/8;
+                    }
+                }
+                uint32_t& entry = m_hashes[ty*columns+tx];
+                if(entry==hash) {
+                    ++m_hits;
+                } else {
+                    entry = hash;
+                    ++m_misses;
+                    changed = true;
+                }
+            }
+            if(changed) {
+                if(first_changed==-1) {
+                    first_changed = ry1;
+                }
+                last_changed = ry2;
+            }
+        }
+        if(first_changed==-1) {
+            ++m_skipped;
+            return false;
+        }
+        if(first_changed!=y1 || last_changed!=y2) {
+            // rows are contiguous in the transfer buffer, so a band of
+            // them can be sent as long as it starts on a byte
+            const size_t offset_bits = (first_changed-y1)*row_bits;
+            if((offset_bits&7)==0) {
+                bitmap = data+(offset_bits>>3);
+                y1 = first_changed;
+                y2 = last_changed;
+                ++m_trimmed;
+            }
+        }
+        return true;
+    }
+};
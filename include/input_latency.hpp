@@ -0,0 +1,218 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "espmon_protocol.hpp"
+
+// settles the edges an input interrupt sees into one event. the ISR calls
+// edge() on every edge and the loop asks settled() until the line has
+// been quiet for the debounce time, then reads the input once. the time
+// of the first edge is kept as when the event happened.
+//
+// times are the low 32 bits of a microsecond clock, so only differences
+// are meaningful
+class input_debouncer final {
+    std::atomic<uint32_t> m_edges;
+    std::atomic<uint32_t> m_seen;
+    std::atomic<uint32_t> m_first_us;
+    std::atomic<uint32_t> m_last_us;
+    uint32_t m_debounce_us;
+public:
+    explicit input_debouncer(uint32_t debounce_us) : m_edges(0), m_seen(0), m_first_us(0), m_last_us(0), m_debounce_us(debounce_us) {}
+    // from the ISR
+    __attribute__((always_inline)) inline void edge(uint32_t now) {
+        if(m_edges.load(std::memory_order_relaxed)==m_seen.load(std::memory_order_relaxed)) {
+            m_first_us.store(now,std::memory_order_relaxed);
+        }
+        m_last_us.store(now,std::memory_order_relaxed);
+        m_edges.fetch_add(1,std::memory_order_release);
+    }
+    // true if there were edges and they've stopped bouncing. first_us gets
+    // the first of them
+    bool settled(uint32_t now, uint32_t* first_us) {
+        const uint32_t edges = m_edges.load(std::memory_order_acquire);
+        if(edges==m_seen.load(std::memory_order_relaxed) ||
+                now-m_last_us.load(std::memory_order_relaxed)<m_debounce_us) {
+            return false;
+        }
+        *first_us = m_first_us.load(std::memory_order_relaxed);
+        m_seen.store(edges,std::memory_order_relaxed);
+        return true;
+    }
+};
+
+// input to photon latency. an action goes through five timestamps: the
+// input event, the loop handling it, the state it changes being set, the
+// first control painting that, and the last transfer of that frame
+// finishing, and each gap between them is kept as a stage along with the
+// whole. one action is tracked at a time. one that's superseded, or that
+// never reaches the panel, counts as missed.
+//
+// transfer_begin() and transfer_end() bracket every transfer to the
+// panel, the end from the completion ISR, so the last one in flight when
+// the frame is done marks it presented. everything else runs on the loop
+// task. nothing allocates and every call is O(1)
+class input_latency final {
+public:
+    using kind = espmon::latency_view::kind;
+    using stage = espmon::latency_view::stage;
+    constexpr static const size_t kinds = espmon::latency_view::max_kinds;
+    constexpr static const size_t stages = espmon::latency_view::max_stages;
+    constexpr static const size_t histogram_buckets = espmon::latency_view::histogram_buckets;
+    // bucket i counts values under first<<i
+    constexpr static const uint32_t first_bucket = 2000;
+    // an action that hasn't reached the panel by then is given up on
+    constexpr static const uint32_t timeout_us = 2000000;
+private:
+    enum struct state : uint8_t {
+        idle,
+        handled,
+        applied,
+        painted,
+        presenting,
+        presenting_claimed,
+        presented
+    };
+    struct stats {
+        uint64_t sum;
+        uint32_t count;
+        uint32_t max;
+        uint16_t histogram[histogram_buckets];
+    };
+    stats m_stats[kinds][stages];
+    uint16_t m_missed;
+    kind m_kind;
+    std::atomic<state> m_state;
+    std::atomic<int> m_in_flight;
+    // event, handled, applied, painted, presented
+    uint32_t m_times[5];
+    std::atomic<uint32_t> m_presented_us;
+    static size_t bucket(uint32_t value) {
+        size_t i = 0;
+        while(i<histogram_buckets-1 && value>=(first_bucket<<i)) {
+            ++i;
+        }
+        return i;
+    }
+    void miss() {
+        if(m_missed!=0xFFFF) {
+            ++m_missed;
+        }
+    }
+    void add(stage s, uint32_t value) {
+        stats& st = m_stats[(size_t)m_kind][(size_t)s];
+        st.sum+=value;
+        ++st.count;
+        if(value>st.max) {
+            st.max = value;
+        }
+        uint16_t& count = st.histogram[bucket(value)];
+        if(count!=0xFFFF) {
+            ++count;
+        }
+    }
+    // the loop and the ISR can both get here for the same frame, so only
+    // the first one to claim it writes the time
+    __attribute__((always_inline)) inline void present(uint32_t now) {
+        state expected = state::presenting;
+        if(m_state.compare_exchange_strong(expected,state::presenting_claimed,std::memory_order_acq_rel,std::memory_order_relaxed)) {
+            m_presented_us.store(now,std::memory_order_relaxed);
+            m_state.store(state::presented,std::memory_order_release);
+        }
+    }
+public:
+    input_latency() : m_missed(0), m_kind(kind::screen), m_state(state::idle), m_in_flight(0), m_presented_us(0) {
+        clear();
+    }
+    void clear() {
+        for(size_t k = 0;k<kinds;++k) {
+            for(size_t s = 0;s<stages;++s) {
+                stats& st = m_stats[k][s];
+                st.sum = 0;
+                st.count = 0;
+                st.max = 0;
+                for(size_t i = 0;i<histogram_buckets;++i) {
+                    st.histogram[i] = 0;
+                }
+            }
+        }
+        m_missed = 0;
+    }
+    // the loop is acting on an input event that happened at event_us
+    void begin(kind k, uint32_t event_us, uint32_t now) {
+        if(m_state.load(std::memory_order_relaxed)!=state::idle) {
+            miss();
+        }
+        m_kind = k;
+        m_times[0] = event_us;
+        m_times[1] = now;
+        m_state.store(state::handled,std::memory_order_relaxed);
+    }
+    // the state the action changes was just set
+    void applied(uint32_t now) {
+        if(m_state.load(std::memory_order_relaxed)==state::handled) {
+            m_times[2] = now;
+            m_state.store(state::applied,std::memory_order_relaxed);
+        }
+    }
+    // a control painted
+    void painted(uint32_t now) {
+        if(m_state.load(std::memory_order_relaxed)==state::applied) {
+            m_times[3] = now;
+            m_state.store(state::painted,std::memory_order_relaxed);
+        }
+    }
+    // a frame has been rendered and flushed. it's presented once the
+    // transfers for it are done, which may be now
+    void frame_end(uint32_t now) {
+        if(m_state.load(std::memory_order_relaxed)!=state::painted) {
+            return;
+        }
+        m_state.store(state::presenting,std::memory_order_seq_cst);
+        if(m_in_flight.load(std::memory_order_seq_cst)==0) {
+            present(now);
+        }
+    }
+    __attribute__((always_inline)) inline void transfer_begin() {
+        m_in_flight.fetch_add(1,std::memory_order_seq_cst);
+    }
+    // from the ISR
+    __attribute__((always_inline)) inline void transfer_end(uint32_t now) {
+        if(m_in_flight.fetch_sub(1,std::memory_order_seq_cst)==1 &&
+                m_state.load(std::memory_order_seq_cst)==state::presenting) {
+            present(now);
+        }
+    }
+    // call from the loop. books a presented action, or gives up on a stuck
+    // one
+    void update(uint32_t now) {
+        const state st = m_state.load(std::memory_order_acquire);
+        if(st==state::presented) {
+            m_times[4] = m_presented_us.load(std::memory_order_relaxed);
+            for(size_t s = 0;s<4;++s) {
+                add((stage)s,m_times[s+1]-m_times[s]);
+            }
+            add(stage::total,m_times[4]-m_times[0]);
+            m_state.store(state::idle,std::memory_order_relaxed);
+        } else if(st!=state::idle && st!=state::presenting_claimed && now-m_times[0]>=timeout_us) {
+            miss();
+            m_state.store(state::idle,std::memory_order_relaxed);
+        }
+    }
+    // fills a latency report (espmon_protocol.hpp) and returns its size
+    size_t encode(uint8_t* payload) const {
+        espmon::latency_writer w(payload,(uint8_t)kinds,(uint8_t)stages);
+        w.missed(m_missed);
+        for(size_t k = 0;k<kinds;++k) {
+            for(size_t s = 0;s<stages;++s) {
+                const stats& st = m_stats[k][s];
+                w.mean_us(k,s,st.count==0?0:(uint32_t)(st.sum/st.count));
+                w.max_us(k,s,st.max);
+                for(size_t i = 0;i<histogram_buckets;++i) {
+                    w.histogram(k,s,i,st.histogram[i]);
+                }
+            }
+        }
+        return w.size();
+    }
+};
@@ -0,0 +1,219 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "espmon_protocol.hpp"
+
+// end to end timing for the serial link. the device pings, the host
+// answers with when it got the ping and when it sent the pong, and the
+// usual NTP arithmetic gives the round trip and the offset between the
+// clocks. data_ex frames carry the host time their values were sampled,
+// so with the offset known the device can tell how stale a sample was by
+// the time it was on screen.
+//
+// host times are the low 32 bits of a microsecond clock, so all the
+// arithmetic is modular and only differences are meaningful. nothing
+// allocates and every call is O(1)
+class link_stats final {
+public:
+    constexpr static const size_t histogram_buckets = espmon::diagnostics_view::histogram_buckets;
+    // bucket i counts values under first<<i
+    constexpr static const uint32_t jitter_first_bucket = 250;
+    constexpr static const uint32_t age_first_bucket = 5000;
+private:
+    // the offset is taken from the quickest of the last few exchanges,
+    // since a slow one was probably held up on one leg and not the other
+    constexpr static const size_t sync_window = 8;
+    struct sync_sample {
+        uint32_t rtt;
+        uint32_t offset;
+    };
+    sync_sample m_sync[sync_window];
+    size_t m_sync_count;
+    size_t m_sync_head;
+    uint8_t m_ping_id;
+    bool m_ping_pending;
+    uint32_t m_ping_time;
+    uint16_t m_pings;
+    uint16_t m_pongs;
+    uint32_t m_rtt_last;
+    uint32_t m_rtt_min;
+    uint32_t m_rtt_mean;
+    uint32_t m_offset;
+    bool m_has_seq;
+    uint16_t m_seq;
+    uint16_t m_seq_gaps;
+    uint32_t m_last_arrival;
+    uint32_t m_last_sample;
+    uint32_t m_jitter;
+    bool m_sample_pending;
+    uint32_t m_age_last;
+    uint32_t m_age_mean;
+    uint32_t m_age_max;
+    uint16_t m_jitter_histogram[histogram_buckets];
+    uint16_t m_age_histogram[histogram_buckets];
+    static size_t bucket(uint32_t value, uint32_t first) {
+        size_t i = 0;
+        while(i<histogram_buckets-1 && value>=(first<<i)) {
+            ++i;
+        }
+        return i;
+    }
+    static void count(uint16_t* histogram, size_t i) {
+        if(histogram[i]!=0xFFFF) {
+            ++histogram[i];
+        }
+    }
+    static uint32_t ema(uint32_t value, uint32_t sample) {
+        return (uint32_t)((int32_t)value+(((int32_t)sample-(int32_t)value)>>3));
+    }
+public:
+    link_stats() {
+        reset();
+    }
+    void reset() {
+        m_sync_count = 0;
+        m_sync_head = 0;
+        m_ping_id = 0;
+        m_ping_pending = false;
+        m_ping_time = 0;
+        m_pings = 0;
+        m_pongs = 0;
+        m_rtt_last = 0;
+        m_rtt_min = 0;
+        m_rtt_mean = 0;
+        m_offset = 0;
+        m_has_seq = false;
+        m_seq = 0;
+        m_seq_gaps = 0;
+        m_last_arrival = 0;
+        m_last_sample = 0;
+        m_jitter = 0;
+        m_sample_pending = false;
+        m_age_last = 0;
+        m_age_mean = 0;
+        m_age_max = 0;
+        for(size_t i = 0;i<histogram_buckets;++i) {
+            m_jitter_histogram[i] = 0;
+            m_age_histogram[i] = 0;
+        }
+    }
+    // true once a pong has come back, so the offset means something
+    bool synced() const {
+        return m_sync_count>0;
+    }
+    // true if the last ping hasn't been answered
+    bool ping_pending() const {
+        return m_ping_pending;
+    }
+    // call just before sending a ping. returns the id to send with it
+    uint8_t ping_begin(uint32_t now) {
+        m_ping_time = now;
+        m_ping_pending = true;
+        if(m_pings!=0xFFFF) {
+            ++m_pings;
+        }
+        return ++m_ping_id;
+    }
+    // a pong for the last ping. host_receive and host_send are the host's
+    // clock, now is the device's. returns false for a stale pong
+    bool pong(uint8_t id, uint32_t host_receive, uint32_t host_send, uint32_t now) {
+        if(!m_ping_pending || id!=m_ping_id) {
+            return false;
+        }
+        m_ping_pending = false;
+        if(m_pongs!=0xFFFF) {
+            ++m_pongs;
+        }
+        const uint32_t held = host_send-host_receive;
+        uint32_t rtt = now-m_ping_time;
+        rtt = held<rtt?rtt-held:0;
+        // ((t2-t1)+(t3-t4))/2, kept modular by halving the difference
+        // between the two legs rather than their sum
+        const uint32_t out = host_receive-m_ping_time;
+        const uint32_t back = host_send-now;
+        const uint32_t offset = out+(uint32_t)((int32_t)(back-out)/2);
+        m_sync[m_sync_head] = {rtt,offset};
+        m_sync_head = (m_sync_head+1)%sync_window;
+        if(m_sync_count<sync_window) {
+            ++m_sync_count;
+        }
+        size_t best = 0;
+        for(size_t i = 1;i<m_sync_count;++i) {
+            if(m_sync[i].rtt<m_sync[best].rtt) {
+                best = i;
+            }
+        }
+        m_offset = m_sync[best].offset;
+        m_rtt_last = rtt;
+        if(m_pongs==1 || rtt<m_rtt_min) {
+            m_rtt_min = rtt;
+        }
+        m_rtt_mean = m_pongs==1?rtt:ema(m_rtt_mean,rtt);
+        return true;
+    }
+    // a data_ex frame arrived. sample is the host time it was sampled
+    void data(uint16_t seq, uint32_t sample, uint32_t now) {
+        if(m_has_seq) {
+            const uint16_t missing = (uint16_t)(seq-m_seq-1);
+            // anything "behind" is a host that restarted its count
+            if(missing<0x8000) {
+                m_seq_gaps = (uint16_t)(missing>0xFFFF-m_seq_gaps?0xFFFF:m_seq_gaps+missing);
+            }
+            // RFC 3550 interarrival jitter, in microseconds
+            const int32_t d = (int32_t)((now-m_last_arrival)-(sample-m_last_sample));
+            const uint32_t ad = (uint32_t)(d<0?-d:d);
+            m_jitter = (uint32_t)((int32_t)m_jitter+(((int32_t)ad-(int32_t)m_jitter)>>4));
+            count(m_jitter_histogram,bucket(ad,jitter_first_bucket));
+        }
+        m_has_seq = true;
+        m_seq = seq;
+        m_last_arrival = now;
+        m_last_sample = sample;
+        m_sample_pending = true;
+    }
+    // the values from the last data_ex frame are now on screen
+    void displayed(uint32_t now) {
+        if(!m_sample_pending || !synced()) {
+            return;
+        }
+        m_sample_pending = false;
+        const int32_t age = (int32_t)(now+m_offset-m_last_sample);
+        const uint32_t a = age<0?0:(uint32_t)age;
+        const bool first = m_age_mean==0 && m_age_max==0;
+        m_age_last = a;
+        m_age_mean = first?a:ema(m_age_mean,a);
+        if(a>m_age_max) {
+            m_age_max = a;
+        }
+        count(m_age_histogram,bucket(a,age_first_bucket));
+    }
+    uint32_t rtt_last() const { return m_rtt_last; }
+    uint32_t rtt_min() const { return m_rtt_min; }
+    uint32_t rtt_mean() const { return m_rtt_mean; }
+    int32_t offset() const { return (int32_t)m_offset; }
+    uint32_t jitter() const { return m_jitter; }
+    uint32_t age_last() const { return m_age_last; }
+    uint32_t age_mean() const { return m_age_mean; }
+    uint32_t age_max() const { return m_age_max; }
+    uint16_t seq_gaps() const { return m_seq_gaps; }
+    // fills a diagnostics report (espmon_protocol.hpp)
+    void encode(uint8_t* payload, bool overlay) const {
+        espmon::diagnostics_writer w(payload);
+        w.flags((synced()?1:0)|(overlay?2:0));
+        w.pings(m_pings);
+        w.pongs(m_pongs);
+        w.seq_gaps(m_seq_gaps);
+        w.rtt_last(m_rtt_last);
+        w.rtt_min(m_rtt_min);
+        w.rtt_mean(m_rtt_mean);
+        w.offset((int32_t)m_offset);
+        w.jitter(m_jitter);
+        w.age_last(m_age_last);
+        w.age_mean(m_age_mean);
+        w.age_max(m_age_max);
+        for(size_t i = 0;i<histogram_buckets;++i) {
+            w.jitter_histogram(i,m_jitter_histogram[i]);
+            w.age_histogram(i,m_age_histogram[i]);
+        }
+    }
+};
@@ -0,0 +1,285 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include "fixed_point.hpp"
+
+// streaming statistics for a single metric. everything is fixed size so
+// nothing allocates, and every add() is O(1) (amortized O(1) for the
+// windowed min/max deques). values are expected to be normalized to the
+// range 0 to stats_traits<T>::full_scale
+
+// selects a statistic so a label or graph can be bound to any of them
+enum struct stat_kind {
+    last = 0,
+    ema,
+    window_mean,
+    window_min,
+    window_max,
+    mean,
+    stddev,
+    p95,
+    p99
+};
+
+template<typename T>
+struct stats_traits;
+
+template<>
+struct stats_traits<float> {
+    using acc_type = double;
+    static constexpr const float full_scale = 1.f;
+    static float div(acc_type value, size_t count) {
+        return (float)(value/count);
+    }
+    static acc_type mul(acc_type lhs, acc_type rhs) {
+        return lhs*rhs;
+    }
+    static float ema_step(float value, float sample, int shift) {
+        return value + (sample-value)/(float)(1<<shift);
+    }
+    static float sqrt(float value) {
+        return sqrtf(value);
+    }
+};
+
+// Q16 values (see fixed_point.hpp). integer only, so the results are
+// identical on the device and on a host build
+template<>
+struct stats_traits<q16_t> {
+    using acc_type = int64_t;
+    static constexpr const q16_t full_scale = q16_one;
+    static q16_t div(acc_type value, size_t count) {
+        return (q16_t)(value/(acc_type)count);
+    }
+    static acc_type mul(acc_type lhs, acc_type rhs) {
+        return (lhs*rhs)>>16;
+    }
+    static q16_t ema_step(q16_t value, q16_t sample, int shift) {
+        return value + ((sample-value)>>shift);
+    }
+    static q16_t sqrt(q16_t value) {
+        // integer square root of value<<16 keeps the result in Q16
+        uint64_t op = ((uint64_t)value)<<16;
+        uint64_t result = 0;
+        uint64_t one = ((uint64_t)1)<<62;
+        while(one>op) {
+            one>>=2;
+        }
+        while(one!=0) {
+            if(op>=result+one) {
+                op-=result+one;
+                result=(result>>1)+one;
+            } else {
+                result>>=1;
+            }
+            one>>=2;
+        }
+        return (q16_t)result;
+    }
+};
+
+template<typename T, size_t Window = 5, size_t Bins = 64, int EmaShift = 3>
+class metric_stats {
+    static_assert(Window>0,"Window must be at least 1");
+    static_assert(Bins>1,"Bins must be at least 2");
+public:
+    using type = metric_stats;
+    using value_type = T;
+    using traits_type = stats_traits<T>;
+    using acc_type = typename traits_type::acc_type;
+    constexpr static const size_t window_size = Window;
+    constexpr static const size_t bins = Bins;
+    // when the running totals reach this many samples they're halved
+    // so they keep favoring recent data and can't overflow
+    constexpr static const uint32_t decay_limit = 1<<15;
+private:
+    // the last Window samples, indexed by sequence number
+    T m_window[Window];
+    acc_type m_window_sum;
+    // monotonic deques of sequence numbers for the windowed min and max
+    uint32_t m_min_q[Window];
+    uint32_t m_max_q[Window];
+    size_t m_min_head, m_min_count;
+    size_t m_max_head, m_max_count;
+    uint32_t m_seq;
+    T m_last;
+    T m_ema;
+    uint32_t m_count;
+    acc_type m_sum;
+    acc_type m_sum_sq;
+    // coarse histogram used as the quantile sketch
+    uint16_t m_bins[Bins];
+    uint32_t m_bins_total;
+    T sample(uint32_t seq) const {
+        return m_window[seq%Window];
+    }
+    size_t window_count() const {
+        return m_seq<Window?m_seq:Window;
+    }
+    void decay() {
+        m_count>>=1;
+        m_sum/=2;
+        m_sum_sq/=2;
+        m_bins_total = 0;
+        for(size_t i = 0;i<Bins;++i) {
+            m_bins[i]>>=1;
+            m_bins_total+=m_bins[i];
+        }
+    }
+public:
+    metric_stats() {
+        clear();
+    }
+    void clear() {
+        m_window_sum = 0;
+        m_min_head = m_min_count = 0;
+        m_max_head = m_max_count = 0;
+        m_seq = 0;
+        m_last = 0;
+        m_ema = 0;
+        m_count = 0;
+        m_sum = 0;
+        m_sum_sq = 0;
+        for(size_t i = 0;i<Bins;++i) {
+            m_bins[i]=0;
+        }
+        m_bins_total = 0;
+    }
+    void add(T value) {
+        if(value<0) {
+            value = 0;
+        } else if(value>traits_type::full_scale) {
+            value = traits_type::full_scale;
+        }
+        // windowed sum
+        if(m_seq>=Window) {
+            m_window_sum-=sample(m_seq);
+        }
+        m_window[m_seq%Window]=value;
+        m_window_sum+=value;
+        // expire anything that slid out of the window
+        const uint32_t oldest = m_seq<Window?0:m_seq-Window+1;
+        if(m_min_count && m_min_q[m_min_head]<oldest) {
+            m_min_head=(m_min_head+1)%Window;
+            --m_min_count;
+        }
+        if(m_max_count && m_max_q[m_max_head]<oldest) {
+            m_max_head=(m_max_head+1)%Window;
+            --m_max_count;
+        }
+        // drop everything the new sample dominates
+        while(m_min_count && sample(m_min_q[(m_min_head+m_min_count-1)%Window])>=value) {
+            --m_min_count;
+        }
+        m_min_q[(m_min_head+m_min_count++)%Window]=m_seq;
+        while(m_max_count && sample(m_max_q[(m_max_head+m_max_count-1)%Window])<=value) {
+            --m_max_count;
+        }
+        m_max_q[(m_max_head+m_max_count++)%Window]=m_seq;
+        // ema, seeded with the first sample
+        m_ema = (m_seq==0)?value:traits_type::ema_step(m_ema,value,EmaShift);
+        m_last = value;
+        ++m_seq;
+        // running totals
+        if(m_count==decay_limit) {
+            decay();
+        }
+        ++m_count;
+        m_sum+=value;
+        m_sum_sq+=traits_type::mul(value,value);
+        // quantile sketch
+        size_t bin = (size_t)(((acc_type)value)*Bins/traits_type::full_scale);
+        if(bin>=Bins) {
+            bin = Bins-1;
+        }
+        ++m_bins[bin];
+        ++m_bins_total;
+    }
+    size_t count() const {
+        return m_seq;
+    }
+    T last() const {
+        return m_last;
+    }
+    T ema() const {
+        return m_ema;
+    }
+    T window_mean() const {
+        if(m_seq==0) {
+            return 0;
+        }
+        return traits_type::div(m_window_sum,window_count());
+    }
+    T window_min() const {
+        if(m_min_count==0) {
+            return 0;
+        }
+        return sample(m_min_q[m_min_head]);
+    }
+    T window_max() const {
+        if(m_max_count==0) {
+            return 0;
+        }
+        return sample(m_max_q[m_max_head]);
+    }
+    T mean() const {
+        if(m_count==0) {
+            return 0;
+        }
+        return traits_type::div(m_sum,m_count);
+    }
+    T variance() const {
+        if(m_count==0) {
+            return 0;
+        }
+        const acc_type v = m_sum_sq-traits_type::mul(m_sum,m_sum)/m_count;
+        return v<0?0:traits_type::div(v,m_count);
+    }
+    T stddev() const {
+        return traits_type::sqrt(variance());
+    }
+    // approximate quantile (0-100) from the histogram. the result is
+    // the upper edge of the bin containing the quantile
+    T quantile(unsigned int percent) const {
+        if(m_bins_total==0) {
+            return 0;
+        }
+        // at least one sample, so 0 is the minimum's bin and not bin 0
+        uint64_t target = ((uint64_t)m_bins_total*percent+99)/100;
+        if(target==0) {
+            target = 1;
+        }
+        uint64_t running = 0;
+        size_t i = 0;
+        for(;i<Bins-1;++i) {
+            running+=m_bins[i];
+            if(running>=target) {
+                break;
+            }
+        }
+        return (T)(((acc_type)traits_type::full_scale)*(i+1)/Bins);
+    }
+    T get(stat_kind kind) const {
+        switch(kind) {
+            case stat_kind::ema:
+                return ema();
+            case stat_kind::window_mean:
+                return window_mean();
+            case stat_kind::window_min:
+                return window_min();
+            case stat_kind::window_max:
+                return window_max();
+            case stat_kind::mean:
+                return mean();
+            case stat_kind::stddev:
+                return stddev();
+            case stat_kind::p95:
+                return quantile(95);
+            case stat_kind::p99:
+                return quantile(99);
+            default:
+                return last();
+        }
+    }
+};
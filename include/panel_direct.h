@@ -0,0 +1,22 @@
+#pragma once
+#include <stdbool.h>
+// direct access to an RGB panel's framebuffer, for LCD_DIRECT_FRAMEBUFFER.
+// htcw_esp_panel keeps its panel handle to itself, so panel_direct.cpp
+// picks the panel up as it's created (the build wraps
+// esp_lcd_new_rgb_panel, see src/CMakeLists.txt). on other panels these
+// do nothing
+#ifdef __cplusplus
+extern "C" {
+#endif
+// the framebuffer being scanned out, or null if the panel isn't an RGB
+// panel with exactly one
+void* panel_lcd_frame_buffer(void);
+// waits for the panel to start scanning out the next frame. returns
+// false if it never signaled one
+bool panel_lcd_vsync_wait(void);
+// how far the panel is through scanning out the current frame, scaled to
+// rows, or -1 if that isn't known yet
+int panel_lcd_scan_row(int rows);
+#ifdef __cplusplus
+}
+#endif
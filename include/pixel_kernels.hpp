@@ -0,0 +1,226 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// raw fill kernels for the packed pixel formats the panels use. a pixel
+// is passed as the bytes it's stored as, so byte order and palettes are
+// already handled by whatever encoded it. the specializations work a
+// 32-bit word at a time and the primary template is the portable
+// fallback they're checked against (linux/pixel_kernels_test.cpp).
+//
+// fills need the bitmap's raw memory, so they only touch bitmaps the
+// firmware owns, like the static layer. controls paint through uix
+// control surfaces, which only take fills of a single color, so they use
+// the blend kernels to work out that color (see dashboard_controls.hpp)
+
+// fills count whole-byte pixels. the portable fallback
+template<size_t BitDepth>
+struct pixel_kernels {
+    static_assert(BitDepth%8==0,"Only whole byte pixels use the fallback");
+    constexpr static const bool specialized = false;
+    constexpr static const size_t bytes = BitDepth/8;
+    static void fill(uint8_t* dst, size_t count, const uint8_t* px) {
+        while(count--) {
+            memcpy(dst,px,bytes);
+            dst+=bytes;
+        }
+    }
+};
+
+template<>
+struct pixel_kernels<8> {
+    constexpr static const bool specialized = true;
+    constexpr static const size_t bytes = 1;
+    static void fill(uint8_t* dst, size_t count, const uint8_t* px) {
+        memset(dst,*px,count);
+    }
+};
+
+template<>
+struct pixel_kernels<16> {
+    constexpr static const bool specialized = true;
+    constexpr static const size_t bytes = 2;
+    static void fill(uint8_t* dst, size_t count, const uint8_t* px) {
+        // get to a word boundary
+        while(count && (((uintptr_t)dst)&3)) {
+            dst[0] = px[0];
+            dst[1] = px[1];
+            dst+=2;
+            --count;
+        }
+        uint8_t pattern[4] = {px[0],px[1],px[0],px[1]};
+        uint32_t w;
+        memcpy(&w,pattern,4);
+        uint32_t* p = (uint32_t*)dst;
+        size_t words = count>>1;
+        while(words>=4) {
+            p[0] = w; p[1] = w; p[2] = w; p[3] = w;
+            p+=4;
+            words-=4;
+        }
+        while(words--) {
+            *p++ = w;
+        }
+        if(count&1) {
+            dst = (uint8_t*)p;
+            dst[0] = px[0];
+            dst[1] = px[1];
+        }
+    }
+};
+
+template<>
+struct pixel_kernels<24> {
+    constexpr static const bool specialized = true;
+    constexpr static const size_t bytes = 3;
+    static void fill(uint8_t* dst, size_t count, const uint8_t* px) {
+        while(count && (((uintptr_t)dst)&3)) {
+            memcpy(dst,px,3);
+            dst+=3;
+            --count;
+        }
+        // four pixels are exactly three words
+        uint8_t pattern[12];
+        for(int i = 0;i<4;++i) {
+            memcpy(pattern+i*3,px,3);
+        }
+        uint32_t w[3];
+        memcpy(w,pattern,12);
+        uint32_t* p = (uint32_t*)dst;
+        while(count>=4) {
+            p[0] = w[0]; p[1] = w[1]; p[2] = w[2];
+            p+=3;
+            count-=4;
+        }
+        dst = (uint8_t*)p;
+        while(count--) {
+            memcpy(dst,px,3);
+            dst+=3;
+        }
+    }
+};
+
+// monochrome rows are packed MSB first with no padding between rows, so
+// fills work on bit ranges
+struct pixel_kernels_1bit {
+    // sets or clears count bits starting at bit offset
+    static void fill(uint8_t* buffer, size_t offset, size_t count, bool set) {
+        if(count==0) {
+            return;
+        }
+        uint8_t* p = buffer+(offset>>3);
+        const size_t lead = offset&7;
+        if(lead+count<=8) {
+            const uint8_t mask = (uint8_t)((0xFF>>lead)&(0xFF<<(8-lead-count)));
+            *p = set?(*p|mask):(*p&~mask);
+            return;
+        }
+        if(lead) {
+            const uint8_t mask = 0xFF>>lead;
+            *p = set?(*p|mask):(*p&~mask);
+            ++p;
+            count-=8-lead;
+        }
+        memset(p,set?0xFF:0,count>>3);
+        p+=count>>3;
+        count&=7;
+        if(count) {
+            const uint8_t mask = (uint8_t)(0xFF<<(8-count));
+            *p = set?(*p|mask):(*p&~mask);
+        }
+    }
+};
+
+// fills a rectangle of a packed bitmap whose rows are width pixels wide.
+// full width rectangles are one contiguous run, otherwise the first row
+// is filled and copied down
+template<size_t BitDepth>
+void pixel_kernels_fill_rect(uint8_t* buffer, size_t width, size_t x1, size_t y1, size_t x2, size_t y2, const uint8_t* px) {
+    using k = pixel_kernels<BitDepth>;
+    const size_t w = x2-x1+1;
+    const size_t stride = width*k::bytes;
+    uint8_t* row = buffer+y1*stride+x1*k::bytes;
+    if(w==width) {
+        k::fill(row,w*(y2-y1+1),px);
+        return;
+    }
+    k::fill(row,w,px);
+    for(size_t y = y1+1;y<=y2;++y) {
+        memcpy(row+stride,row,w*k::bytes);
+        row+=stride;
+    }
+}
+template<>
+inline void pixel_kernels_fill_rect<1>(uint8_t* buffer, size_t width, size_t x1, size_t y1, size_t x2, size_t y2, const uint8_t* px) {
+    const bool set = (px[0]&0x80)!=0;
+    const size_t w = x2-x1+1;
+    if(w==width) {
+        pixel_kernels_1bit::fill(buffer,y1*width,w*(y2-y1+1),set);
+        return;
+    }
+    for(size_t y = y1;y<=y2;++y) {
+        pixel_kernels_1bit::fill(buffer,y*width+x1,w,set);
+    }
+}
+
+// alpha blending for RGB565, with every channel rounded to nearest:
+// (fg*alpha+bg*(255-alpha)+127)/255. R and B ride in the two 16-bit lanes
+// of one word, so they're blended with one multiply and one divide
+struct pixel_kernels_565 {
+    // R in the high lane and B in the low one
+    static inline uint32_t rb_lanes(uint16_t value) {
+        return (((uint32_t)(value>>11))<<16)|(value&0x1F);
+    }
+    // divides each lane by 255. exact for lanes below 0xFF00, and a
+    // blended 5-bit channel is at most 31*255+127
+    static inline uint32_t div255_lanes(uint32_t lanes) {
+        return ((lanes+0x00010001+((lanes>>8)&0x00FF00FF))>>8)&0x00FF00FF;
+    }
+    static inline uint16_t blend(uint16_t fg, uint16_t bg, uint8_t alpha) {
+        const uint32_t inv = 255-alpha;
+        const uint32_t rb = div255_lanes(rb_lanes(fg)*alpha+rb_lanes(bg)*inv+0x007F007F);
+        uint32_t g = ((fg>>5)&0x3F)*alpha+((bg>>5)&0x3F)*inv+127;
+        g = (g+1+(g>>8))>>8;
+        return (uint16_t)(((rb>>16)<<11)|(g<<5)|(rb&0x1F));
+    }
+    // blends fg over count pixels in place. pixels are stored big endian,
+    // the way gfx keeps them and the panels take them. the fg side of
+    // each channel only has to be worked out once
+    static void blend_span(uint8_t* dst, size_t count, uint16_t fg, uint8_t alpha) {
+        if(alpha==255) {
+            const uint8_t px[2] = {(uint8_t)(fg>>8),(uint8_t)fg};
+            pixel_kernels<16>::fill(dst,count,px);
+            return;
+        }
+        const uint32_t inv = 255-alpha;
+        const uint32_t rb_fg = rb_lanes(fg)*alpha+0x007F007F;
+        const uint32_t g_fg = ((fg>>5)&0x3F)*alpha+127;
+        while(count--) {
+            const uint16_t bg = (uint16_t)((dst[0]<<8)|dst[1]);
+            const uint32_t rb = div255_lanes(rb_fg+rb_lanes(bg)*inv);
+            uint32_t g = g_fg+((bg>>5)&0x3F)*inv;
+            g = (g+1+(g>>8))>>8;
+            const uint16_t out = (uint16_t)(((rb>>16)<<11)|(g<<5)|(rb&0x1F));
+            dst[0] = (uint8_t)(out>>8);
+            dst[1] = (uint8_t)out;
+            dst+=2;
+        }
+    }
+};
+
+// blends fg over a rectangle of an RGB565 bitmap whose rows are width
+// pixels wide
+inline void pixel_kernels_blend_rect_565(uint8_t* buffer, size_t width, size_t x1, size_t y1, size_t x2, size_t y2, uint16_t fg, uint8_t alpha) {
+    const size_t w = x2-x1+1;
+    const size_t stride = width*2;
+    uint8_t* row = buffer+y1*stride+x1*2;
+    if(w==width) {
+        pixel_kernels_565::blend_span(row,w*(y2-y1+1),fg,alpha);
+        return;
+    }
+    for(size_t y = y1;y<=y2;++y) {
+        pixel_kernels_565::blend_span(row,w,fg,alpha);
+        row+=stride;
+    }
+}
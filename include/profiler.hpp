@@ -0,0 +1,12 @@
+#pragma once
+#include "serial.hpp"
+
+// a sampling profiler. a timer interrupt on each core records the code it
+// interrupted, and up to PROFILER_DEPTH frames of its backtrace, into the
+// tables in sample_histogram.hpp. build with PROFILER_SLOTS set to the
+// stacks kept per core (a power of two) to turn it on; without it a
+// profile query gets an empty dump. see src/profiler.cpp
+
+// answers a profile query (espmon_protocol.hpp) with a dump, then starts,
+// retunes or stops the sampling as it asks
+void profiler_query(const response_profile_t& query);
@@ -0,0 +1,142 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "espmon_protocol.hpp"
+
+// the counts behind the sampling profiler: a hash table per core of the
+// stacks that were sampled and how many times each was. a core's sampling
+// interrupt only ever touches that core's table, so nothing locks, but a
+// dump or a clear needs the sampling stopped first. a stack that doesn't
+// fit is counted as dropped instead of evicting anything, so the counts
+// that are there stay exact.
+//
+// stacks are Depth program counters, the interrupted one first and then
+// its callers, with 0 past the end of a shallower one
+template<size_t Slots, size_t Depth, size_t Cores>
+class sample_histograms final {
+    static_assert(Slots>0 && (Slots&(Slots-1))==0,"The slot count must be a power of two");
+    static_assert(Depth>0 && Depth<=espmon::profile_chunk_view::max_depth,"The depth doesn't fit a profile chunk");
+    // give up on a stack after this many taken slots, to bound the
+    // interrupt's time once the table fills
+    constexpr static const size_t max_probes = 8;
+    struct entry {
+        uint32_t count;
+        uint32_t pcs[Depth];
+    };
+    struct table {
+        entry entries[Slots];
+        uint32_t samples;
+        uint32_t dropped;
+        uint64_t isr_cycles;
+        uint32_t isr_max_cycles;
+    };
+    table m_tables[Cores];
+    __attribute__((always_inline)) static inline size_t hash(const uint32_t* pcs) {
+        uint32_t h = 2166136261U;
+        for(size_t i = 0;i<Depth;++i) {
+            h = (h^pcs[i])*16777619U;
+        }
+        return (h^(h>>15))&(Slots-1);
+    }
+public:
+    constexpr static const size_t slots = Slots;
+    constexpr static const size_t depth = Depth;
+    constexpr static const size_t cores = Cores;
+    sample_histograms() {
+        clear();
+    }
+    void clear() {
+        for(size_t c = 0;c<Cores;++c) {
+            table& t = m_tables[c];
+            for(size_t i = 0;i<Slots;++i) {
+                t.entries[i].count = 0;
+            }
+            t.samples = 0;
+            t.dropped = 0;
+            t.isr_cycles = 0;
+            t.isr_max_cycles = 0;
+        }
+    }
+    __attribute__((always_inline)) inline void add(size_t core, const uint32_t* pcs) {
+        table& t = m_tables[core];
+        ++t.samples;
+        size_t slot = hash(pcs);
+        for(size_t probe = 0;probe<max_probes;++probe) {
+            entry& e = t.entries[slot];
+            if(e.count==0) {
+                for(size_t i = 0;i<Depth;++i) {
+                    e.pcs[i] = pcs[i];
+                }
+                e.count = 1;
+                return;
+            }
+            size_t i = 0;
+            while(i<Depth && e.pcs[i]==pcs[i]) {
+                ++i;
+            }
+            if(i==Depth) {
+                ++e.count;
+                return;
+            }
+            slot = (slot+1)&(Slots-1);
+        }
+        ++t.dropped;
+    }
+    // how long the sampling interrupt ran, for the overhead
+    __attribute__((always_inline)) inline void account(size_t core, uint32_t cycles) {
+        table& t = m_tables[core];
+        t.isr_cycles+=cycles;
+        if(cycles>t.isr_max_cycles) {
+            t.isr_max_cycles = cycles;
+        }
+    }
+    uint32_t samples(size_t core) const {
+        return m_tables[core].samples;
+    }
+    uint32_t dropped(size_t core) const {
+        return m_tables[core].dropped;
+    }
+    // walks the tables a chunk at a time for a dump
+    class dump_cursor {
+        friend class sample_histograms;
+        size_t m_core;
+        size_t m_next;
+        bool m_started;
+        bool m_done;
+    public:
+        dump_cursor() : m_core(0), m_next(0), m_started(false), m_done(false) {}
+        bool done() const {
+            return m_done;
+        }
+    };
+    // writes the next chunk (espmon_protocol.hpp) and returns its size.
+    // only the first depth program counters of each stack go out
+    size_t dump(dump_cursor& cursor, uint8_t depth, uint16_t rate_hz, bool running, uint32_t elapsed_us, uint32_t cpu_mhz, uint8_t* out) const {
+        const table& t = m_tables[cursor.m_core];
+        espmon::profile_chunk_writer w(out,(uint8_t)cursor.m_core,depth>Depth?(uint8_t)Depth:depth);
+        if(!cursor.m_started) {
+            const uint32_t mhz = cpu_mhz==0?1:cpu_mhz;
+            w.counters(rate_hz,running,t.samples,t.dropped,elapsed_us,(uint32_t)(t.isr_cycles/mhz),
+                (uint32_t)((uint64_t)t.isr_max_cycles*1000/mhz));
+            cursor.m_next = 0;
+            cursor.m_started = true;
+        }
+        while(cursor.m_next<Slots) {
+            const entry& e = t.entries[cursor.m_next];
+            if(e.count!=0 && !w.add(e.count,e.pcs)) {
+                break;
+            }
+            ++cursor.m_next;
+        }
+        if(cursor.m_next>=Slots) {
+            if(cursor.m_core+1<Cores) {
+                ++cursor.m_core;
+                cursor.m_started = false;
+            } else {
+                w.last();
+                cursor.m_done = true;
+            }
+        }
+        return w.size();
+    }
+};
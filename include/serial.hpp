@@ -29,11 +29,64 @@ typedef struct { // 74 bytes on the wire
     uint16_t bottom_max2;
 } response_screen_t;
 
+typedef struct { // 9 bytes on the wire
+    uint8_t id;
+    uint32_t host_receive_us;
+    uint32_t host_send_us;
+} response_pong_t;
+
+typedef struct { // 16 bytes on the wire
+    response_data_t data;
+    uint16_t seq;
+    uint32_t sample_us;
+} response_data_ex_t;
+
+typedef struct { // 1 byte on the wire
+    uint8_t flags; // bit 0 shows the diagnostics overlay
+} response_diagnostics_t;
+
+typedef struct { // 1 byte on the wire
+    uint8_t flags; // reserved, 0
+} response_telemetry_t;
+
+typedef struct { // 1 byte on the wire
+    uint8_t flags; // bit 0 keeps the events after the dump
+} response_trace_t;
+
+typedef struct { // 4 bytes on the wire
+    uint8_t flags; // bit 0 keeps sampling, bit 1 clears the counts after the dump
+    uint8_t depth; // 0 keeps the current depth
+    uint16_t rate_hz; // 0 keeps the current rate
+} response_profile_t;
+
+typedef struct { // 1 byte on the wire
+    uint8_t flags; // bit 0 clears the counts after the report
+} response_latency_t;
+
 typedef union {
     response_data_t data;
     response_screen_t screen;
+    response_pong_t pong;
+    response_data_ex_t data_ex;
+    response_diagnostics_t diagnostics;
+    response_telemetry_t telemetry;
+    response_trace_t trace;
+    response_profile_t profile;
+    response_latency_t latency;
 } response_t;
 
+typedef struct {
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t rx_packets;
+    // unknown commands and payloads that never arrived
+    uint32_t rx_dropped;
+} serial_stats_t;
+
 bool serial_init();
 void serial_write(int8_t cmd,uint8_t screen_index);
+// writes a request with a payload after it (a diagnostics report)
+void serial_write_frame(int8_t cmd,const uint8_t* payload,uint8_t size);
+// copies out the counters and starts them over
+void serial_take_stats(serial_stats_t* out_stats);
 int8_t serial_read_packet(response_t* out_resp);
@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// converts packed row-major 1bpp bitmaps (MSB first, rows not padded)
+// into SSD1306 page format, where each byte is a column of 8 rows with
+// the top row in the LSB. it works on 8x8 blocks with a word-wise bit
+// matrix transpose instead of moving one bit at a time
+
+// transposes an 8x8 block. in[0] is the bottom row of the block, so
+// out[n] holds column n with the top row in the LSB
+static inline void ssd1306_transpose8(const uint8_t* in, uint8_t* out) {
+    uint32_t x = ((uint32_t)in[0]<<24)|((uint32_t)in[1]<<16)|((uint32_t)in[2]<<8)|in[3];
+    uint32_t y = ((uint32_t)in[4]<<24)|((uint32_t)in[5]<<16)|((uint32_t)in[6]<<8)|in[7];
+    uint32_t t;
+    t = (x^(x>>7))&0x00AA00AA; x = x^t^(t<<7);
+    t = (y^(y>>7))&0x00AA00AA; y = y^t^(t<<7);
+    t = (x^(x>>14))&0x0000CCCC; x = x^t^(t<<14);
+    t = (y^(y>>14))&0x0000CCCC; y = y^t^(t<<14);
+    t = (x&0xF0F0F0F0)|((y>>4)&0x0F0F0F0F);
+    y = ((x<<4)&0xF0F0F0F0)|(y&0x0F0F0F0F);
+    x = t;
+    out[0] = x>>24; out[1] = x>>16; out[2] = x>>8; out[3] = x;
+    out[4] = y>>24; out[5] = y>>16; out[6] = y>>8; out[7] = y;
+}
+// reads the 8 pixels starting at bit offset, MSB first
+static inline uint8_t ssd1306_read8(const uint8_t* src, uint32_t offset, uint32_t total_bits) {
+    const uint32_t index = offset>>3;
+    const uint32_t shift = offset&7;
+    if(shift==0) {
+        return src[index];
+    }
+    // don't read past the end of the bitmap
+    const uint16_t next = ((index+1)<<3)<total_bits?src[index+1]:0;
+    return (uint8_t)(((((uint16_t)src[index])<<8)|next)>>(8-shift));
+}
+// converts a width x height bitmap. height must be a multiple of 8.
+// dst receives width bytes per page
+static inline void ssd1306_rows_to_pages(const uint8_t* src, int width, int height, uint8_t* dst) {
+    const uint32_t total_bits = (uint32_t)width*height;
+    uint8_t rows[8];
+    uint8_t cols[8];
+    for(int page = 0;page<(height>>3);++page) {
+        const uint32_t page_bit = (uint32_t)(page<<3)*width;
+        uint8_t* out = dst+page*width;
+        for(int x = 0;x<width;x+=8) {
+            if((width&7)==0) {
+                // rows are byte aligned
+                const uint8_t* p = src+((page_bit+x)>>3)+(width>>3)*7;
+                for(int r = 0;r<8;++r) {
+                    rows[r] = *p;
+                    p-=width>>3;
+                }
+            } else {
+                for(int r = 0;r<8;++r) {
+                    rows[r] = ssd1306_read8(src,page_bit+(uint32_t)(7-r)*width+x,total_bits);
+                }
+            }
+            const int count = width-x<8?width-x:8;
+            if(count==8) {
+                ssd1306_transpose8(rows,out+x);
+            } else {
+                ssd1306_transpose8(rows,cols);
+                memcpy(out+x,cols,count);
+            }
+        }
+    }
+}
@@ -0,0 +1,205 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <gfx.hpp>
+
+// a writable palette for rendering the dashboard into indexed pixels.
+// controls always render in the dark theme's colors (the "logical"
+// colors), and a separate display LUT holds what the panel actually shows
+// for each index, so switching themes is a LUT swap and a repaint.
+//
+// with 8 bits the first 16 entries are slots for the screen's own colors,
+// followed by a 6x6x6 color cube and a 24 step gray ramp so gradients and
+// antialiased text still resolve. with 4 bits only the slots exist.
+template<size_t Bits, typename NativePixelType>
+class theme_palette {
+    static_assert(Bits==4 || Bits==8,"Bits must be 4 or 8");
+public:
+    using type = theme_palette;
+    using pixel_type = gfx::indexed_pixel<Bits>;
+    using mapped_pixel_type = gfx::rgb_pixel<24>;
+    using native_pixel_type = NativePixelType;
+    constexpr static const bool writable = true;
+    constexpr static const size_t size = 1<<Bits;
+    constexpr static const size_t slots = 16;
+    constexpr static const size_t cube_start = 16;
+    constexpr static const size_t gray_start = 16+216;
+    static_assert(native_pixel_type::bit_depth==16,"The native pixel must be 16-bit");
+private:
+    mapped_pixel_type m_entries[size];
+    size_t m_slot_count;
+    bool m_light;
+    // the bytes the panel gets for each index, as they'd be stored in a
+    // native bitmap
+    uint8_t m_lut[size][2];
+    mutable mapped_pixel_type m_last_mapped;
+    mutable uint8_t m_last_index;
+    static uint8_t cube_level(uint8_t value) {
+        return (value*5+127)/255;
+    }
+    static mapped_pixel_type invert_luma(mapped_pixel_type px) {
+        return mapped_pixel_type(255-px.template channel<gfx::channel_name::R>(),
+                                    255-px.template channel<gfx::channel_name::G>(),
+                                    255-px.template channel<gfx::channel_name::B>());
+    }
+    void build_lut_entry(size_t index) {
+        mapped_pixel_type px = m_entries[index];
+        // the light theme inverts the neutral colors: black, white and
+        // the grays. colored entries stay as they are
+        if(m_light) {
+            const int r = px.template channel<gfx::channel_name::R>();
+            const int g = px.template channel<gfx::channel_name::G>();
+            const int b = px.template channel<gfx::channel_name::B>();
+            if(r==g && g==b) {
+                px = invert_luma(px);
+            }
+        }
+        native_pixel_type npx;
+        gfx::convert(px,&npx);
+        uint8_t buf[2];
+        gfx::bitmap<native_pixel_type> bmp({1,1},buf);
+        bmp.point({0,0},npx);
+        m_lut[index][0]=buf[0];
+        m_lut[index][1]=buf[1];
+    }
+    static uint32_t distance(mapped_pixel_type lhs, mapped_pixel_type rhs) {
+        const int r = (int)lhs.template channel<gfx::channel_name::R>()-(int)rhs.template channel<gfx::channel_name::R>();
+        const int g = (int)lhs.template channel<gfx::channel_name::G>()-(int)rhs.template channel<gfx::channel_name::G>();
+        const int b = (int)lhs.template channel<gfx::channel_name::B>()-(int)rhs.template channel<gfx::channel_name::B>();
+        return r*r*2+g*g*4+b*b*3;
+    }
+public:
+    theme_palette() : m_slot_count(0), m_light(false), m_last_index(0) {
+        for(size_t i = 0;i<size;++i) {
+            m_entries[i]=mapped_pixel_type(0,0,0);
+        }
+        if(Bits==8) {
+            for(size_t i = 0;i<216;++i) {
+                m_entries[cube_start+i]=mapped_pixel_type((i/36)*51,((i/6)%6)*51,(i%6)*51);
+            }
+            for(size_t i = 0;i<24;++i) {
+                const uint8_t v = 8+i*10;
+                m_entries[gray_start+i]=mapped_pixel_type(v,v,v);
+            }
+        }
+        rebuild_lut();
+        m_last_mapped = m_entries[0];
+    }
+    // rebuilds the display LUT from the logical entries
+    void rebuild_lut() {
+        for(size_t i = 0;i<size;++i) {
+            build_lut_entry(i);
+        }
+    }
+    // clears the screen specific slots
+    void clear_slots() {
+        m_slot_count = 0;
+        m_last_mapped = m_entries[0];
+        m_last_index = 0;
+    }
+    // adds a logical color to the slots, if it's not already present.
+    // returns false if the slots are full
+    bool add_slot(gfx::rgba_pixel<32> color) {
+        mapped_pixel_type px;
+        gfx::convert(color,&px);
+        for(size_t i = 0;i<m_slot_count;++i) {
+            if(m_entries[i].native_value==px.native_value) {
+                return true;
+            }
+        }
+        if(m_slot_count==slots) {
+            return false;
+        }
+        m_entries[m_slot_count]=px;
+        build_lut_entry(m_slot_count++);
+        return true;
+    }
+    bool light() const {
+        return m_light;
+    }
+    // swaps the display colors. the logical colors don't change
+    void light(bool value) {
+        if(value!=m_light) {
+            m_light = value;
+            rebuild_lut();
+        }
+    }
+    gfx::gfx_result map(pixel_type pixel, mapped_pixel_type* mapped_pixel) const {
+        *mapped_pixel = m_entries[pixel.template channel<gfx::channel_name::index>()];
+        return gfx::gfx_result::success;
+    }
+    gfx::gfx_result nearest(mapped_pixel_type mapped_pixel, pixel_type* resolved) const {
+        // fills and runs tend to ask for the same color over and over
+        if(mapped_pixel.native_value==m_last_mapped.native_value) {
+            resolved->template channel<gfx::channel_name::index>(m_last_index);
+            return gfx::gfx_result::success;
+        }
+        size_t best = 0;
+        uint32_t best_dist = 0xFFFFFFFF;
+        for(size_t i = 0;i<m_slot_count;++i) {
+            const uint32_t d = distance(m_entries[i],mapped_pixel);
+            if(d<best_dist) {
+                best = i;
+                best_dist = d;
+                if(d==0) {
+                    break;
+                }
+            }
+        }
+        if(Bits==8 && best_dist!=0) {
+            // the cube and gray ramp are regular, so their closest entries
+            // can be computed instead of searched
+            const uint8_t r = mapped_pixel.template channel<gfx::channel_name::R>();
+            const uint8_t g = mapped_pixel.template channel<gfx::channel_name::G>();
+            const uint8_t b = mapped_pixel.template channel<gfx::channel_name::B>();
+            size_t i = cube_start+cube_level(r)*36+cube_level(g)*6+cube_level(b);
+            uint32_t d = distance(m_entries[i],mapped_pixel);
+            if(d<best_dist) {
+                best = i;
+                best_dist = d;
+            }
+            const int avg = (r+g+b)/3;
+            const int level = avg<8?0:avg>238?23:(avg-8+5)/10;
+            i = gray_start+level;
+            d = distance(m_entries[i],mapped_pixel);
+            if(d<best_dist) {
+                best = i;
+                best_dist = d;
+            }
+        }
+        m_last_mapped = mapped_pixel;
+        m_last_index = (uint8_t)best;
+        resolved->template channel<gfx::channel_name::index>(best);
+        return gfx::gfx_result::success;
+    }
+    // expands pixel_count indexed pixels at in into native pixels at out.
+    // in has to start on a byte
+    void expand(uint8_t* out, const uint8_t* in, size_t pixel_count) const {
+        if(Bits==8) {
+            const uint8_t* const end = in+pixel_count;
+            while(in!=end) {
+                const uint8_t* e = m_lut[*in++];
+                out[0] = e[0];
+                out[1] = e[1];
+                out+=2;
+            }
+        } else {
+            for(size_t i = 0;i+1<pixel_count;i+=2) {
+                const uint8_t packed = *in++;
+                const uint8_t* hi = m_lut[packed>>4];
+                const uint8_t* lo = m_lut[packed&0x0F];
+                out[0] = hi[0];
+                out[1] = hi[1];
+                out[2] = lo[0];
+                out[3] = lo[1];
+                out+=4;
+            }
+            if(pixel_count&1) {
+                const uint8_t* hi = m_lut[*in>>4];
+                out[0] = hi[0];
+                out[1] = hi[1];
+            }
+        }
+    }
+};
@@ -0,0 +1,49 @@
+#pragma once
+// the firmware's trace points. build with TRACE_RING_SIZE set to the
+// events kept per core (a power of two, 8 bytes each) to turn tracing on;
+// without it every TRACE_ macro compiles to nothing
+#ifdef TRACE_RING_SIZE
+#include "esp_idf_version.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#if ESP_IDF_VERSION_MAJOR >= 5
+#include "esp_cpu.h"
+#else
+#include "hal/cpu_hal.h"
+#endif
+#include "freertos/FreeRTOS.h"
+#include "trace_ring.hpp"
+
+struct trace_clock {
+    __attribute__((always_inline)) static inline uint32_t cycles() {
+#if ESP_IDF_VERSION_MAJOR >= 5
+        return (uint32_t)esp_cpu_get_cycle_count();
+#else
+        return cpu_hal_get_cycle_count();
+#endif
+    }
+    __attribute__((always_inline)) static inline uint32_t micros() {
+        return (uint32_t)esp_timer_get_time();
+    }
+    __attribute__((always_inline)) static inline size_t core() {
+        return (size_t)xPortGetCoreID();
+    }
+    static uint32_t hz() {
+        return esp_rom_get_cpu_ticks_per_us()*1000000;
+    }
+};
+#ifdef portNUM_PROCESSORS
+using trace_rings_t = trace_rings<trace_clock,TRACE_RING_SIZE,portNUM_PROCESSORS>;
+#else
+using trace_rings_t = trace_rings<trace_clock,TRACE_RING_SIZE,1>;
+#endif
+// defined in main.cpp
+extern trace_rings_t trace_log;
+#define TRACE_BEGIN(point,arg) trace_log.record(espmon::trace_kind::begin,espmon::trace_point::point,(uint16_t)(arg))
+#define TRACE_END(point,arg) trace_log.record(espmon::trace_kind::end,espmon::trace_point::point,(uint16_t)(arg))
+#define TRACE_INSTANT(point,arg) trace_log.record(espmon::trace_kind::instant,espmon::trace_point::point,(uint16_t)(arg))
+#else
+#define TRACE_BEGIN(point,arg)
+#define TRACE_END(point,arg)
+#define TRACE_INSTANT(point,arg)
+#endif
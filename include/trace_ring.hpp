@@ -0,0 +1,120 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "espmon_protocol.hpp"
+
+// event tracing into a ring per core. a trace point is a relaxed atomic
+// add to reserve a slot, a cycle counter read and an 8 byte store, so
+// it's safe from a task and an ISR on the same core at once, and the
+// cores never touch each other's ring. when a ring wraps the oldest events
+// are overwritten.
+//
+// cycle counters are per core and wrap every few seconds, so each time a
+// ring starts a lap its writer also takes a sync point: the cycle count
+// alongside the microsecond clock. a reader unwraps the events from
+// there, which holds as long as a core doesn't go 2^31 cycles between
+// events.
+//
+// Clock supplies the platform: static uint32_t cycles(), uint32_t
+// micros() and size_t core(), all safe to call from an ISR
+template<typename Clock, size_t Size, size_t Cores>
+class trace_rings final {
+    static_assert(Size>0 && (Size&(Size-1))==0,"The ring size must be a power of two");
+    using event = espmon::trace_event;
+    struct ring {
+        std::atomic<uint32_t> head;
+        uint32_t sync_index;
+        uint32_t sync_cycles;
+        uint32_t sync_us;
+        event events[Size];
+    };
+    ring m_rings[Cores];
+    std::atomic<bool> m_enabled;
+public:
+    constexpr static const size_t size = Size;
+    constexpr static const size_t cores = Cores;
+    trace_rings() : m_enabled(true) {
+        clear();
+    }
+    bool enabled() const {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+    void enabled(bool value) {
+        m_enabled.store(value,std::memory_order_relaxed);
+    }
+    void clear() {
+        for(size_t i = 0;i<Cores;++i) {
+            m_rings[i].head.store(0,std::memory_order_relaxed);
+            m_rings[i].sync_index = 0;
+            m_rings[i].sync_cycles = 0;
+            m_rings[i].sync_us = 0;
+        }
+    }
+    __attribute__((always_inline)) inline void record(espmon::trace_kind kind, espmon::trace_point id, uint16_t arg = 0) {
+        record(kind,id,arg,Clock::cycles());
+    }
+    // records an event at an earlier cycle count, for spans that are only
+    // worth keeping once they've ended. readers have to sort by time
+    __attribute__((always_inline)) inline void record(espmon::trace_kind kind, espmon::trace_point id, uint16_t arg, uint32_t cycles) {
+        if(!m_enabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        size_t core = Clock::core();
+        if(core>=Cores) {
+            core = Cores-1;
+        }
+        ring& r = m_rings[core];
+        const uint32_t index = r.head.fetch_add(1,std::memory_order_relaxed);
+        if((index&(Size-1))==0) {
+            // the sync point is its own reading, not the event's
+            r.sync_index = index;
+            r.sync_cycles = Clock::cycles();
+            r.sync_us = Clock::micros();
+        }
+        event& e = r.events[index&(Size-1)];
+        e.cycles = cycles;
+        e.kind = (uint8_t)kind;
+        e.id = (uint8_t)id;
+        e.arg = arg;
+    }
+    // walks the rings a chunk at a time for a dump. pause tracing first
+    // (enabled(false)) or the events may move underneath it
+    class dump_cursor {
+        friend class trace_rings;
+        size_t m_core;
+        uint32_t m_next;
+        bool m_started;
+        bool m_done;
+    public:
+        dump_cursor() : m_core(0), m_next(0), m_started(false), m_done(false) {}
+        bool done() const {
+            return m_done;
+        }
+    };
+    // writes the next chunk (espmon_protocol.hpp) and returns its size
+    size_t dump(dump_cursor& cursor, uint32_t cpu_hz, uint8_t* out) const {
+        const ring& r = m_rings[cursor.m_core];
+        const uint32_t head = r.head.load(std::memory_order_relaxed);
+        const uint32_t first = head>Size?head-(uint32_t)Size:0;
+        espmon::trace_chunk_writer w(out,(uint8_t)cursor.m_core,(uint8_t)Cores);
+        if(!cursor.m_started) {
+            w.ring(cpu_hz,head,r.sync_index,r.sync_cycles,r.sync_us);
+            cursor.m_next = first;
+            cursor.m_started = true;
+        }
+        while(cursor.m_next<head && w.add(r.events[cursor.m_next&(Size-1)])) {
+            ++cursor.m_next;
+        }
+        if(cursor.m_next>=head) {
+            if(cursor.m_core+1<Cores) {
+                ++cursor.m_core;
+                cursor.m_started = false;
+            } else {
+                w.last();
+                cursor.m_done = true;
+            }
+        }
+        return w.size();
+    }
+};
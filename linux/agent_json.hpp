@@ -0,0 +1,271 @@
+#pragma once
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// just enough JSON to read screens.json files. objects keep their keys in
+// order and lookups are linear, which is fine at this size
+struct json_value {
+    enum struct kind {
+        null,
+        boolean,
+        number,
+        string,
+        array,
+        object
+    };
+    kind type = kind::null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<json_value> array;
+    std::vector<std::pair<std::string,json_value>> object;
+
+    // returns nullptr if this isn't an object or doesn't have the key
+    const json_value* get(const char* key) const {
+        if(type!=kind::object) {
+            return nullptr;
+        }
+        for(const auto& member : object) {
+            if(member.first==key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class json_reader {
+    const char* m_pos;
+    const char* m_end;
+    std::string m_error;
+    void skip_ws() {
+        while(m_pos<m_end && (*m_pos==' ' || *m_pos=='\t' || *m_pos=='\r' || *m_pos=='\n')) {
+            ++m_pos;
+        }
+    }
+    bool fail(const char* message) {
+        if(m_error.empty()) {
+            m_error = message;
+        }
+        return false;
+    }
+    bool literal(const char* text) {
+        const char* p = m_pos;
+        while(*text) {
+            if(p==m_end || *p!=*text) {
+                return fail("bad literal");
+            }
+            ++p;
+            ++text;
+        }
+        m_pos = p;
+        return true;
+    }
+    static void append_utf8(std::string& str, unsigned cp) {
+        if(cp<0x80) {
+            str+=(char)cp;
+        } else if(cp<0x800) {
+            str+=(char)(0xC0|(cp>>6));
+            str+=(char)(0x80|(cp&0x3F));
+        } else if(cp<0x10000) {
+            str+=(char)(0xE0|(cp>>12));
+            str+=(char)(0x80|((cp>>6)&0x3F));
+            str+=(char)(0x80|(cp&0x3F));
+        } else {
+            str+=(char)(0xF0|(cp>>18));
+            str+=(char)(0x80|((cp>>12)&0x3F));
+            str+=(char)(0x80|((cp>>6)&0x3F));
+            str+=(char)(0x80|(cp&0x3F));
+        }
+    }
+    bool read_hex4(unsigned* out) {
+        if(m_end-m_pos<4) {
+            return fail("short escape");
+        }
+        unsigned v = 0;
+        for(int i = 0;i<4;++i) {
+            const char c = *m_pos++;
+            v<<=4;
+            if(c>='0' && c<='9') { v|=c-'0'; }
+            else if(c>='a' && c<='f') { v|=c-'a'+10; }
+            else if(c>='A' && c<='F') { v|=c-'A'+10; }
+            else { return fail("bad escape"); }
+        }
+        *out = v;
+        return true;
+    }
+    bool read_string(std::string& out) {
+        // at the opening quote
+        ++m_pos;
+        while(m_pos<m_end && *m_pos!='"') {
+            char c = *m_pos++;
+            if(c!='\\') {
+                out+=c;
+                continue;
+            }
+            if(m_pos==m_end) {
+                return fail("unterminated string");
+            }
+            c = *m_pos++;
+            switch(c) {
+                case 'b': out+='\b'; break;
+                case 'f': out+='\f'; break;
+                case 'n': out+='\n'; break;
+                case 'r': out+='\r'; break;
+                case 't': out+='\t'; break;
+                case 'u': {
+                    unsigned cp;
+                    if(!read_hex4(&cp)) {
+                        return false;
+                    }
+                    if(cp>=0xD800 && cp<0xDC00 && m_end-m_pos>=6 && m_pos[0]=='\\' && m_pos[1]=='u') {
+                        m_pos+=2;
+                        unsigned lo;
+                        if(!read_hex4(&lo)) {
+                            return false;
+                        }
+                        cp = 0x10000+((cp-0xD800)<<10)+(lo-0xDC00);
+                    }
+                    append_utf8(out,cp);
+                    break;
+                }
+                default: out+=c; break;
+            }
+        }
+        if(m_pos==m_end) {
+            return fail("unterminated string");
+        }
+        ++m_pos;
+        return true;
+    }
+    bool read_value(json_value& out, int depth) {
+        if(depth>64) {
+            return fail("too deep");
+        }
+        skip_ws();
+        if(m_pos==m_end) {
+            return fail("unexpected end");
+        }
+        switch(*m_pos) {
+            case 'n':
+                out.type = json_value::kind::null;
+                return literal("null");
+            case 't':
+                out.type = json_value::kind::boolean;
+                out.boolean = true;
+                return literal("true");
+            case 'f':
+                out.type = json_value::kind::boolean;
+                out.boolean = false;
+                return literal("false");
+            case '"':
+                out.type = json_value::kind::string;
+                return read_string(out.string);
+            case '[':
+                out.type = json_value::kind::array;
+                ++m_pos;
+                skip_ws();
+                if(m_pos<m_end && *m_pos==']') {
+                    ++m_pos;
+                    return true;
+                }
+                while(true) {
+                    out.array.emplace_back();
+                    if(!read_value(out.array.back(),depth+1)) {
+                        return false;
+                    }
+                    skip_ws();
+                    if(m_pos<m_end && *m_pos==',') {
+                        ++m_pos;
+                        continue;
+                    }
+                    if(m_pos<m_end && *m_pos==']') {
+                        ++m_pos;
+                        return true;
+                    }
+                    return fail("expected , or ]");
+                }
+            case '{':
+                out.type = json_value::kind::object;
+                ++m_pos;
+                skip_ws();
+                if(m_pos<m_end && *m_pos=='}') {
+                    ++m_pos;
+                    return true;
+                }
+                while(true) {
+                    skip_ws();
+                    if(m_pos==m_end || *m_pos!='"') {
+                        return fail("expected a key");
+                    }
+                    out.object.emplace_back();
+                    if(!read_string(out.object.back().first)) {
+                        return false;
+                    }
+                    skip_ws();
+                    if(m_pos==m_end || *m_pos!=':') {
+                        return fail("expected :");
+                    }
+                    ++m_pos;
+                    if(!read_value(out.object.back().second,depth+1)) {
+                        return false;
+                    }
+                    skip_ws();
+                    if(m_pos<m_end && *m_pos==',') {
+                        ++m_pos;
+                        continue;
+                    }
+                    if(m_pos<m_end && *m_pos=='}') {
+                        ++m_pos;
+                        return true;
+                    }
+                    return fail("expected , or }");
+                }
+            default: {
+                out.type = json_value::kind::number;
+                std::string tmp;
+                while(m_pos<m_end && (strchr("+-.eE",*m_pos)!=nullptr || (*m_pos>='0' && *m_pos<='9'))) {
+                    tmp+=*m_pos++;
+                }
+                if(tmp.empty()) {
+                    return fail("unexpected character");
+                }
+                char* end;
+                out.number = strtod(tmp.c_str(),&end);
+                if(*end!=0) {
+                    return fail("bad number");
+                }
+                return true;
+            }
+        }
+    }
+public:
+    // parses a whole document. a leading UTF-8 BOM is skipped
+    bool parse(const char* data, size_t size, json_value& out) {
+        m_pos = data;
+        m_end = data+size;
+        m_error.clear();
+        if(size>=3 && (unsigned char)data[0]==0xEF && (unsigned char)data[1]==0xBB && (unsigned char)data[2]==0xBF) {
+            m_pos+=3;
+        }
+        if(!read_value(out,0)) {
+            return false;
+        }
+        skip_ws();
+        if(m_pos!=m_end) {
+            return fail("trailing data");
+        }
+        return true;
+    }
+    const std::string& error() const {
+        return m_error;
+    }
+    // how far in the parse got, for error messages
+    size_t offset(const char* data) const {
+        return m_pos-data;
+    }
+};
@@ -0,0 +1,234 @@
+#include "agent_screens.hpp"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "agent_json.hpp"
+#include "espmon_protocol.hpp"
+
+// System.Drawing.Color's named colors, which is what the Windows host
+// looks names up in. note DarkSeaGreen is .NET's value, not CSS's
+struct named_color {
+    const char* name;
+    uint32_t argb;
+};
+static const named_color named_colors[] = {
+    {"aliceblue",0xFFF0F8FF},{"antiquewhite",0xFFFAEBD7},{"aqua",0xFF00FFFF},
+    {"aquamarine",0xFF7FFFD4},{"azure",0xFFF0FFFF},{"beige",0xFFF5F5DC},
+    {"bisque",0xFFFFE4C4},{"black",0xFF000000},{"blanchedalmond",0xFFFFEBCD},
+    {"blue",0xFF0000FF},{"blueviolet",0xFF8A2BE2},{"brown",0xFFA52A2A},
+    {"burlywood",0xFFDEB887},{"cadetblue",0xFF5F9EA0},{"chartreuse",0xFF7FFF00},
+    {"chocolate",0xFFD2691E},{"coral",0xFFFF7F50},{"cornflowerblue",0xFF6495ED},
+    {"cornsilk",0xFFFFF8DC},{"crimson",0xFFDC143C},{"cyan",0xFF00FFFF},
+    {"darkblue",0xFF00008B},{"darkcyan",0xFF008B8B},{"darkgoldenrod",0xFFB8860B},
+    {"darkgray",0xFFA9A9A9},{"darkgreen",0xFF006400},{"darkkhaki",0xFFBDB76B},
+    {"darkmagenta",0xFF8B008B},{"darkolivegreen",0xFF556B2F},{"darkorange",0xFFFF8C00},
+    {"darkorchid",0xFF9932CC},{"darkred",0xFF8B0000},{"darksalmon",0xFFE9967A},
+    {"darkseagreen",0xFF8FBC8B},{"darkslateblue",0xFF483D8B},{"darkslategray",0xFF2F4F4F},
+    {"darkturquoise",0xFF00CED1},{"darkviolet",0xFF9400D3},{"deeppink",0xFFFF1493},
+    {"deepskyblue",0xFF00BFFF},{"dimgray",0xFF696969},{"dodgerblue",0xFF1E90FF},
+    {"firebrick",0xFFB22222},{"floralwhite",0xFFFFFAF0},{"forestgreen",0xFF228B22},
+    {"fuchsia",0xFFFF00FF},{"gainsboro",0xFFDCDCDC},{"ghostwhite",0xFFF8F8FF},
+    {"gold",0xFFFFD700},{"goldenrod",0xFFDAA520},{"gray",0xFF808080},
+    {"green",0xFF008000},{"greenyellow",0xFFADFF2F},{"honeydew",0xFFF0FFF0},
+    {"hotpink",0xFFFF69B4},{"indianred",0xFFCD5C5C},{"indigo",0xFF4B0082},
+    {"ivory",0xFFFFFFF0},{"khaki",0xFFF0E68C},{"lavender",0xFFE6E6FA},
+    {"lavenderblush",0xFFFFF0F5},{"lawngreen",0xFF7CFC00},{"lemonchiffon",0xFFFFFACD},
+    {"lightblue",0xFFADD8E6},{"lightcoral",0xFFF08080},{"lightcyan",0xFFE0FFFF},
+    {"lightgoldenrodyellow",0xFFFAFAD2},{"lightgray",0xFFD3D3D3},{"lightgreen",0xFF90EE90},
+    {"lightpink",0xFFFFB6C1},{"lightsalmon",0xFFFFA07A},{"lightseagreen",0xFF20B2AA},
+    {"lightskyblue",0xFF87CEFA},{"lightslategray",0xFF778899},{"lightsteelblue",0xFFB0C4DE},
+    {"lightyellow",0xFFFFFFE0},{"lime",0xFF00FF00},{"limegreen",0xFF32CD32},
+    {"linen",0xFFFAF0E6},{"magenta",0xFFFF00FF},{"maroon",0xFF800000},
+    {"mediumaquamarine",0xFF66CDAA},{"mediumblue",0xFF0000CD},{"mediumorchid",0xFFBA55D3},
+    {"mediumpurple",0xFF9370DB},{"mediumseagreen",0xFF3CB371},{"mediumslateblue",0xFF7B68EE},
+    {"mediumspringgreen",0xFF00FA9A},{"mediumturquoise",0xFF48D1CC},{"mediumvioletred",0xFFC71585},
+    {"midnightblue",0xFF191970},{"mintcream",0xFFF5FFFA},{"mistyrose",0xFFFFE4E1},
+    {"moccasin",0xFFFFE4B5},{"navajowhite",0xFFFFDEAD},{"navy",0xFF000080},
+    {"oldlace",0xFFFDF5E6},{"olive",0xFF808000},{"olivedrab",0xFF6B8E23},
+    {"orange",0xFFFFA500},{"orangered",0xFFFF4500},{"orchid",0xFFDA70D6},
+    {"palegoldenrod",0xFFEEE8AA},{"palegreen",0xFF98FB98},{"paleturquoise",0xFFAFEEEE},
+    {"palevioletred",0xFFDB7093},{"papayawhip",0xFFFFEFD5},{"peachpuff",0xFFFFDAB9},
+    {"peru",0xFFCD853F},{"pink",0xFFFFC0CB},{"plum",0xFFDDA0DD},
+    {"powderblue",0xFFB0E0E6},{"purple",0xFF800080},{"red",0xFFFF0000},
+    {"rosybrown",0xFFBC8F8F},{"royalblue",0xFF4169E1},{"saddlebrown",0xFF8B4513},
+    {"salmon",0xFFFA8072},{"sandybrown",0xFFF4A460},{"seagreen",0xFF2E8B57},
+    {"seashell",0xFFFFF5EE},{"sienna",0xFFA0522D},{"silver",0xFFC0C0C0},
+    {"skyblue",0xFF87CEEB},{"slateblue",0xFF6A5ACD},{"slategray",0xFF708090},
+    {"snow",0xFFFFFAFA},{"springgreen",0xFF00FF7F},{"steelblue",0xFF4682B4},
+    {"tan",0xFFD2B48C},{"teal",0xFF008080},{"thistle",0xFFD8BFD8},
+    {"tomato",0xFFFF6347},{"transparent",0x00FFFFFF},{"turquoise",0xFF40E0D0},
+    {"violet",0xFFEE82EE},{"wheat",0xFFF5DEB3},{"white",0xFFFFFFFF},
+    {"whitesmoke",0xFFF5F5F5},{"yellow",0xFFFFFF00},{"yellowgreen",0xFF9ACD32}
+};
+
+static bool parse_hex_byte(const char* text, uint8_t* out) {
+    unsigned v = 0;
+    for(int i = 0;i<2;++i) {
+        const char c = text[i];
+        v<<=4;
+        if(c>='0' && c<='9') { v|=c-'0'; }
+        else if(c>='a' && c<='f') { v|=c-'a'+10; }
+        else if(c>='A' && c<='F') { v|=c-'A'+10; }
+        else { return false; }
+    }
+    *out = (uint8_t)v;
+    return true;
+}
+bool agent_parse_color(const char* text, uint8_t* rgba) {
+    if(text[0]=='#') {
+        const size_t len = strlen(text);
+        if(len!=7 && len!=9) {
+            return false;
+        }
+        rgba[3] = 0xFF;
+        return parse_hex_byte(text+1,rgba) && parse_hex_byte(text+3,rgba+1) &&
+            parse_hex_byte(text+5,rgba+2) && (len==7 || parse_hex_byte(text+7,rgba+3));
+    }
+    char name[64];
+    size_t len = 0;
+    for(const char* p = text;*p && len<sizeof(name)-1;++p) {
+        if(isalnum((unsigned char)*p)) {
+            name[len++] = (char)tolower((unsigned char)*p);
+        }
+    }
+    name[len]=0;
+    for(const named_color& c : named_colors) {
+        if(0==strcmp(c.name,name)) {
+            rgba[0] = (uint8_t)(c.argb>>16);
+            rgba[1] = (uint8_t)(c.argb>>8);
+            rgba[2] = (uint8_t)c.argb;
+            rgba[3] = (uint8_t)(c.argb>>24);
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* string_member(const json_value& obj, const char* key) {
+    const json_value* v = obj.get(key);
+    if(v==nullptr || v->type!=json_value::kind::string) {
+        return nullptr;
+    }
+    return v->string.c_str();
+}
+static bool read_color(const json_value& obj, const char* where, uint8_t* rgba, std::string& error) {
+    const char* text = string_member(obj,"color");
+    if(text==nullptr) {
+        error = std::string(where)+": missing color";
+        return false;
+    }
+    if(!agent_parse_color(text,rgba)) {
+        error = std::string(where)+": unknown color \""+text+"\"";
+        return false;
+    }
+    return true;
+}
+static bool read_value(const json_value& obj, const std::string& where, agent_value& out, std::string& error) {
+    if(obj.type!=json_value::kind::object) {
+        error = where+": expected an object";
+        return false;
+    }
+    if(!read_color(obj,where.c_str(),out.color,error)) {
+        return false;
+    }
+    const json_value* v = obj.get("gradient");
+    out.gradient = v!=nullptr && v->type==json_value::kind::boolean && v->boolean;
+    v = obj.get("max");
+    if(v==nullptr || v->type!=json_value::kind::number) {
+        error = where+": missing max";
+        return false;
+    }
+    // Math.Round rounds to even, as does nearbyint in the default mode
+    const double max = nearbyint(v->number);
+    out.max = (uint16_t)(max<0?0:max>65535?65535:max);
+    const char* text = string_member(obj,"suffix");
+    out.suffix = text==nullptr?"":text;
+    text = string_member(obj,"match");
+    out.match = text==nullptr?"":text;
+    return true;
+}
+static bool read_section(const json_value& obj, const std::string& where, agent_section& out, std::string& error) {
+    if(obj.type!=json_value::kind::object) {
+        error = where+": expected an object";
+        return false;
+    }
+    const char* label = string_member(obj,"label");
+    out.label = label==nullptr?"":label;
+    if(!read_color(obj,where.c_str(),out.color,error)) {
+        return false;
+    }
+    const json_value* v1 = obj.get("value1");
+    const json_value* v2 = obj.get("value2");
+    if(v1==nullptr || v2==nullptr) {
+        error = where+": missing value1 or value2";
+        return false;
+    }
+    return read_value(*v1,where+".value1",out.value1,error) &&
+        read_value(*v2,where+".value2",out.value2,error);
+}
+bool agent_load_screens(const char* path, std::vector<agent_screen>& screens, std::string& error) {
+    FILE* f = fopen(path,"rb");
+    if(f==nullptr) {
+        error = std::string(path)+": unable to open";
+        return false;
+    }
+    std::string text;
+    char buf[4096];
+    size_t read;
+    while((read = fread(buf,1,sizeof(buf),f))>0) {
+        text.append(buf,read);
+    }
+    fclose(f);
+    json_value doc;
+    json_reader reader;
+    if(!reader.parse(text.data(),text.size(),doc)) {
+        char msg[64];
+        snprintf(msg,sizeof(msg),": %s at offset %u",reader.error().c_str(),(unsigned)reader.offset(text.data()));
+        error = path+std::string(msg);
+        return false;
+    }
+    if(doc.type!=json_value::kind::array || doc.array.empty()) {
+        error = std::string(path)+": expected an array of screens";
+        return false;
+    }
+    screens.clear();
+    for(size_t i = 0;i<doc.array.size();++i) {
+        const json_value& scr = doc.array[i];
+        const std::string where = std::string(path)+"["+std::to_string(i)+"]";
+        const json_value* top = scr.get("top");
+        const json_value* bottom = scr.get("bottom");
+        if(top==nullptr || bottom==nullptr) {
+            error = where+": missing top or bottom";
+            return false;
+        }
+        agent_screen s;
+        if(!read_section(*top,where+".top",s.top,error) ||
+                !read_section(*bottom,where+".bottom",s.bottom,error)) {
+            return false;
+        }
+        screens.push_back(s);
+    }
+    return true;
+}
+
+static void encode_value(const agent_value& value, espmon::value_writer w) {
+    w.color(value.color);
+    w.suffix(value.suffix.c_str());
+    w.max(value.max);
+}
+static void encode_section(const agent_section& section, espmon::section_writer w) {
+    w.label(section.label.c_str());
+    w.label_color(section.color);
+    encode_value(section.value1,w.value1());
+    encode_value(section.value2,w.value2());
+}
+void agent_encode_screen(const agent_screen& screen, int8_t index, uint8_t* payload) {
+    memset(payload,0,espmon::screen_payload_size);
+    espmon::screen_writer w(payload);
+    w.index(index);
+    w.flags((screen.top.value1.gradient?1:0)|(screen.top.value2.gradient?2:0)|
+        (screen.bottom.value1.gradient?4:0)|(screen.bottom.value2.gradient?8:0)|espmon::screen_pings);
+    encode_section(screen.top,w.top());
+    encode_section(screen.bottom,w.bottom());
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// screen definitions, read from the same screens.json files the Windows
+// host uses (EspMon/default.screens.json)
+struct agent_value {
+    uint8_t color[4];
+    bool gradient;
+    uint16_t max;
+    std::string suffix;
+    // regex the sensor path has to match
+    std::string match;
+};
+struct agent_section {
+    std::string label;
+    uint8_t color[4];
+    agent_value value1;
+    agent_value value2;
+};
+struct agent_screen {
+    agent_section top;
+    agent_section bottom;
+};
+
+// parses "#RRGGBB", "#RRGGBBAA" or a .NET color name into RGBA.
+// punctuation in names is ignored and case doesn't matter, so
+// "light-blue" is LightBlue. returns false if it isn't a color
+bool agent_parse_color(const char* text, uint8_t* rgba);
+// loads a screens.json array. on failure returns false and says why in
+// error
+bool agent_load_screens(const char* path, std::vector<agent_screen>& screens, std::string& error);
+// fills a screen payload (espmon::screen_payload_size bytes)
+void agent_encode_screen(const agent_screen& screen, int8_t index, uint8_t* payload);
@@ -0,0 +1,528 @@
+#include "agent_sensors.hpp"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+static int64_t monotonic_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+// directory entries, sorted so numbering is stable from run to run.
+// hwmon10 sorts after hwmon9
+static std::vector<std::string> list_dir(const std::string& path) {
+    std::vector<std::string> result;
+    DIR* dir = opendir(path.c_str());
+    if(dir==nullptr) {
+        return result;
+    }
+    dirent* ent;
+    while((ent = readdir(dir))!=nullptr) {
+        if(ent->d_name[0]!='.') {
+            result.push_back(ent->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(result.begin(),result.end(),[](const std::string& lhs, const std::string& rhs) {
+        if(lhs.size()!=rhs.size()) {
+            return lhs.size()<rhs.size();
+        }
+        return lhs<rhs;
+    });
+    return result;
+}
+// the first line of a small file, without the newline
+static std::string read_line(const std::string& path) {
+    char buf[256];
+    const int fd = ::open(path.c_str(),O_RDONLY|O_CLOEXEC);
+    if(fd<0) {
+        return "";
+    }
+    const ssize_t len = ::read(fd,buf,sizeof(buf)-1);
+    ::close(fd);
+    if(len<=0) {
+        return "";
+    }
+    buf[len]=0;
+    char* nl = strchr(buf,'\n');
+    if(nl!=nullptr) {
+        *nl=0;
+    }
+    return buf;
+}
+// skips to the next number and parses it
+static const char* parse_u64(const char* p, uint64_t* out) {
+    while(*p==' ' || *p=='\t') {
+        ++p;
+    }
+    uint64_t v = 0;
+    while(*p>='0' && *p<='9') {
+        v = v*10+(*p++-'0');
+    }
+    *out = v;
+    return p;
+}
+static const char* next_line(const char* p) {
+    p = strchr(p,'\n');
+    return p==nullptr?nullptr:p+1;
+}
+
+agent_sensors::agent_sensors() : m_stat_first(-1), m_stat_count(0), m_meminfo_first(-1),
+        m_disk_first(-1), m_cpufreq_first(-1), m_cpufreq_count(0), m_stat_fd(-1),
+        m_meminfo_fd(-1), m_diskstats_fd(-1), m_disk_prev_ms(0) {
+    memset(m_used,0,sizeof(m_used));
+}
+agent_sensors::~agent_sensors() {
+    close();
+}
+int agent_sensors::add_slot(source src, int fd, float scale) {
+    m_slots.push_back(slot{src,false,fd,scale});
+    m_values.push_back(NAN);
+    return (int)m_slots.size()-1;
+}
+void agent_sensors::add_path(const std::string& path, int slot) {
+    m_entries.push_back(entry{path,slot});
+}
+int agent_sensors::add_file(const std::string& file, float scale) {
+    const int fd = ::open(file.c_str(),O_RDONLY|O_CLOEXEC);
+    if(fd<0) {
+        return -1;
+    }
+    return add_slot(source::file,fd,scale);
+}
+size_t agent_sensors::read_fd(int fd) {
+    while(true) {
+        const ssize_t len = pread(fd,m_buffer.data(),m_buffer.size()-1,0);
+        if(len<0) {
+            m_buffer[0]=0;
+            return 0;
+        }
+        if((size_t)len<m_buffer.size()-1) {
+            m_buffer[len]=0;
+            return len;
+        }
+        // didn't fit, which only happens the first time
+        m_buffer.resize(m_buffer.size()*2);
+    }
+}
+
+void agent_sensors::open_cpu() {
+    m_stat_fd = ::open((m_root+"/proc/stat").c_str(),O_RDONLY|O_CLOEXEC);
+    if(m_stat_fd<0) {
+        return;
+    }
+    // one slot for the total and one per core, indexed by core number so
+    // a core going offline doesn't shift the others
+    int max_core = -1;
+    read_fd(m_stat_fd);
+    for(const char* p = m_buffer.data();p!=nullptr && 0==strncmp(p,"cpu",3);p = next_line(p)) {
+        if(p[3]>='0' && p[3]<='9') {
+            max_core = std::max(max_core,atoi(p+3));
+        }
+    }
+    m_stat_count = max_core+2;
+    m_stat_prev.assign(m_stat_count*2,0);
+    m_stat_first = add_slot(source::stat,-1,1);
+    for(int i = 1;i<m_stat_count;++i) {
+        add_slot(source::stat,-1,1);
+    }
+    for(int i = 0;i<m_stat_count;++i) {
+        add_path("/cpu/0/load/"+std::to_string(i),m_stat_first+i);
+    }
+    // kHz to MHz. slot 0 is the fastest core
+    std::vector<int> fds;
+    for(int i = 0;i<=max_core;++i) {
+        fds.push_back(::open((m_root+"/sys/devices/system/cpu/cpu"+std::to_string(i)+"/cpufreq/scaling_cur_freq").c_str(),O_RDONLY|O_CLOEXEC));
+    }
+    if(std::any_of(fds.begin(),fds.end(),[](int fd) { return fd>=0; })) {
+        m_cpufreq_count = max_core+2;
+        m_cpufreq_first = add_slot(source::cpufreq,-1,1);
+        for(int fd : fds) {
+            add_slot(source::cpufreq,fd,.001f);
+        }
+        for(int i = 0;i<m_cpufreq_count;++i) {
+            add_path("/cpu/0/clock/"+std::to_string(i),m_cpufreq_first+i);
+        }
+    }
+}
+void agent_sensors::open_memory() {
+    m_meminfo_fd = ::open((m_root+"/proc/meminfo").c_str(),O_RDONLY|O_CLOEXEC);
+    if(m_meminfo_fd<0) {
+        return;
+    }
+    m_meminfo_first = add_slot(source::meminfo,-1,1);
+    add_slot(source::meminfo,-1,1);
+    add_slot(source::meminfo,-1,1);
+    add_path("/ram/load/0",m_meminfo_first);
+    add_path("/ram/data/0",m_meminfo_first+1);
+    add_path("/ram/data/1",m_meminfo_first+2);
+}
+void agent_sensors::open_disks() {
+    m_diskstats_fd = ::open((m_root+"/proc/diskstats").c_str(),O_RDONLY|O_CLOEXEC);
+    if(m_diskstats_fd<0) {
+        return;
+    }
+    static const char* skip[] = {"loop","ram","zram","fd","sr"};
+    for(const std::string& name : list_dir(m_root+"/sys/block")) {
+        bool skipped = false;
+        for(const char* prefix : skip) {
+            if(0==strncmp(name.c_str(),prefix,strlen(prefix))) {
+                skipped = true;
+                break;
+            }
+        }
+        if(!skipped) {
+            m_disk_names.push_back(name);
+        }
+    }
+    m_disk_prev.assign(m_disk_names.size(),0);
+    for(size_t i = 0;i<m_disk_names.size();++i) {
+        const int s = add_slot(source::diskstats,-1,1);
+        if(i==0) {
+            m_disk_first = s;
+        }
+        add_path("/hdd/"+std::to_string(i)+"/load/0",s);
+    }
+}
+void agent_sensors::open_hwmon(std::vector<entry>& aliases) {
+    static const struct {
+        const char* prefix;
+        const char* kind;
+        int first;
+        float scale;
+    } inputs[] = {
+        {"temp","temperature",1,.001f},
+        {"fan","fan",1,1},
+        {"in","voltage",0,.001f},
+        {"power","power",1,.000001f},
+        {"freq","clock",1,.000001f}
+    };
+    static const char* cpu_chips[] = {"coretemp","k10temp","zenpower","cpu_thermal"};
+    static const char* gpu_chips[] = {"amdgpu","radeon","nouveau"};
+    static const char* disk_chips[] = {"nvme","drivetemp"};
+    std::vector<std::pair<std::string,int>> instances;
+    int gpu_count = 0;
+    bool have_cpu = false;
+    const std::string base = m_root+"/sys/class/hwmon/";
+    for(const std::string& dir : list_dir(base)) {
+        const std::string path = base+dir+"/";
+        std::string name = read_line(path+"name");
+        if(name.empty()) {
+            continue;
+        }
+        std::replace(name.begin(),name.end(),'/','_');
+        int instance = 0;
+        auto it = std::find_if(instances.begin(),instances.end(),[&name](const std::pair<std::string,int>& i) { return i.first==name; });
+        if(it==instances.end()) {
+            instances.emplace_back(name,1);
+        } else {
+            instance = it->second++;
+        }
+        const std::string prefix = "/"+name+"/"+std::to_string(instance)+"/";
+        bool is_cpu = false, is_gpu = false, is_disk = false;
+        for(const char* chip : cpu_chips) { is_cpu = is_cpu || name==chip; }
+        for(const char* chip : gpu_chips) { is_gpu = is_gpu || name==chip; }
+        for(const char* chip : disk_chips) { is_disk = is_disk || name==chip; }
+        // which /hdd/N this chip belongs to: nvme chips hang off the
+        // controller (nvme0 owns nvme0n1), drivetemp off the disk
+        int disk = -1;
+        if(is_disk) {
+            char real[PATH_MAX];
+            std::string controller;
+            if(realpath((path+"device").c_str(),real)!=nullptr) {
+                const char* slash = strrchr(real,'/');
+                controller = slash==nullptr?real:slash+1;
+            }
+            const std::vector<std::string> blocks = list_dir(path+"device/block");
+            for(size_t i = 0;i<m_disk_names.size() && disk<0;++i) {
+                const std::string& dn = m_disk_names[i];
+                if(std::find(blocks.begin(),blocks.end(),dn)!=blocks.end() ||
+                        (!controller.empty() && 0==dn.compare(0,controller.size()+1,controller+"n"))) {
+                    disk = (int)i;
+                }
+            }
+        }
+        const std::string gpu = is_gpu?"/gpu/"+std::to_string(gpu_count++)+"/":"";
+        const std::vector<std::string> files = list_dir(path);
+        for(const auto& input : inputs) {
+            const size_t plen = strlen(input.prefix);
+            std::vector<int> numbers;
+            for(const std::string& file : files) {
+                if(0!=file.compare(0,plen,input.prefix) || file.size()<=plen ||
+                        file[plen]<'0' || file[plen]>'9') {
+                    continue;
+                }
+                const char* end;
+                const int n = (int)strtol(file.c_str()+plen,(char**)&end,10);
+                if(0==strcmp(end,"_input") || (0==strcmp(end,"_average") && 0==strcmp(input.prefix,"power"))) {
+                    if(std::find(numbers.begin(),numbers.end(),n)==numbers.end()) {
+                        numbers.push_back(n);
+                    }
+                }
+            }
+            std::sort(numbers.begin(),numbers.end());
+            for(int n : numbers) {
+                const std::string stem = path+input.prefix+std::to_string(n);
+                int s = add_file(stem+"_input",input.scale);
+                if(s<0) {
+                    s = add_file(stem+"_average",input.scale);
+                }
+                if(s<0) {
+                    continue;
+                }
+                const int index = n-input.first;
+                add_path(prefix+input.kind+"/"+std::to_string(index),s);
+                if(index!=0) {
+                    continue;
+                }
+                if(0==strcmp(input.kind,"temperature")) {
+                    if(is_cpu && !have_cpu) {
+                        have_cpu = true;
+                        aliases.push_back(entry{"/cpu/0/temperature/0",s});
+                    } else if(is_gpu) {
+                        aliases.push_back(entry{gpu+"temperature/0",s});
+                    } else if(disk>=0) {
+                        aliases.push_back(entry{"/hdd/"+std::to_string(disk)+"/temperature/0",s});
+                    }
+                } else if(0==strcmp(input.kind,"clock") && is_gpu) {
+                    aliases.push_back(entry{gpu+"clock/0",s});
+                }
+            }
+        }
+        if(is_gpu) {
+            const int s = add_file(path+"device/gpu_busy_percent",1);
+            if(s>=0) {
+                add_path(prefix+"load/0",s);
+                aliases.push_back(entry{gpu+"load/0",s});
+            }
+        }
+    }
+}
+void agent_sensors::open_thermal(std::vector<entry>& aliases) {
+    bool have_cpu = std::any_of(aliases.begin(),aliases.end(),[](const entry& e) { return e.path=="/cpu/0/temperature/0"; });
+    std::vector<std::pair<std::string,int>> instances;
+    const std::string base = m_root+"/sys/class/thermal/";
+    for(const std::string& dir : list_dir(base)) {
+        if(0!=dir.compare(0,12,"thermal_zone")) {
+            continue;
+        }
+        std::string type = read_line(base+dir+"/type");
+        if(type.empty()) {
+            continue;
+        }
+        std::replace(type.begin(),type.end(),'/','_');
+        const int s = add_file(base+dir+"/temp",.001f);
+        if(s<0) {
+            continue;
+        }
+        int instance = 0;
+        auto it = std::find_if(instances.begin(),instances.end(),[&type](const std::pair<std::string,int>& i) { return i.first==type; });
+        if(it==instances.end()) {
+            instances.emplace_back(type,1);
+        } else {
+            instance = it->second++;
+        }
+        add_path("/"+type+"/"+std::to_string(instance)+"/temperature/0",s);
+        if(!have_cpu && (type=="x86_pkg_temp" || type=="cpu-thermal" || type=="cpu_thermal")) {
+            have_cpu = true;
+            aliases.push_back(entry{"/cpu/0/temperature/0",s});
+        }
+    }
+}
+void agent_sensors::open(const std::string& root) {
+    close();
+    m_root = root;
+    m_buffer.resize(4096);
+    open_cpu();
+    open_memory();
+    open_disks();
+    // the canonical names go last so they win when a screen's pattern
+    // matches a raw input too
+    std::vector<entry> aliases;
+    open_hwmon(aliases);
+    open_thermal(aliases);
+    m_entries.insert(m_entries.end(),aliases.begin(),aliases.end());
+}
+void agent_sensors::close() {
+    for(slot& s : m_slots) {
+        if(s.fd>=0) {
+            ::close(s.fd);
+        }
+    }
+    for(int* fd : {&m_stat_fd,&m_meminfo_fd,&m_diskstats_fd}) {
+        if(*fd>=0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+    m_slots.clear();
+    m_values.clear();
+    m_entries.clear();
+    m_disk_names.clear();
+    m_stat_first = m_meminfo_first = m_disk_first = m_cpufreq_first = -1;
+    m_stat_count = m_cpufreq_count = 0;
+    memset(m_used,0,sizeof(m_used));
+}
+
+int agent_sensors::find(const std::regex& expression) const {
+    int result = -1;
+    for(size_t i = 0;i<m_entries.size();++i) {
+        if(std::regex_search(m_entries[i].path,expression)) {
+            result = (int)i;
+        }
+    }
+    return result;
+}
+void agent_sensors::use(int index) {
+    slot& s = m_slots[m_entries[index].slot];
+    s.used = true;
+    m_used[(int)s.src] = true;
+}
+void agent_sensors::use_all() {
+    for(size_t i = 0;i<m_entries.size();++i) {
+        use((int)i);
+    }
+}
+
+void agent_sensors::sample_stat() {
+    read_fd(m_stat_fd);
+    for(const char* p = m_buffer.data();p!=nullptr && 0==strncmp(p,"cpu",3);p = next_line(p)) {
+        int i = 0;
+        p+=3;
+        if(*p>='0' && *p<='9') {
+            i = atoi(p)+1;
+            while(*p>='0' && *p<='9') {
+                ++p;
+            }
+        }
+        if(i>=m_stat_count) {
+            continue;
+        }
+        // user nice system idle iowait irq softirq steal
+        uint64_t fields[8];
+        for(uint64_t& f : fields) {
+            p = parse_u64(p,&f);
+        }
+        uint64_t total = 0;
+        for(uint64_t f : fields) {
+            total+=f;
+        }
+        const uint64_t busy = total-fields[3]-fields[4];
+        uint64_t* prev = &m_stat_prev[i*2];
+        float& value = m_values[m_stat_first+i];
+        if(prev[1]!=0 && total>prev[1]) {
+            value = (float)(100.0*(double)(busy-prev[0])/(double)(total-prev[1]));
+        }
+        prev[0] = busy;
+        prev[1] = total;
+    }
+}
+void agent_sensors::sample_meminfo() {
+    read_fd(m_meminfo_fd);
+    uint64_t total = 0, available = 0;
+    int found = 0;
+    for(const char* p = m_buffer.data();p!=nullptr && found<2;p = next_line(p)) {
+        if(0==strncmp(p,"MemTotal:",9)) {
+            parse_u64(p+9,&total);
+            ++found;
+        } else if(0==strncmp(p,"MemAvailable:",13)) {
+            parse_u64(p+13,&available);
+            ++found;
+        }
+    }
+    if(total==0) {
+        return;
+    }
+    // kB to GB
+    m_values[m_meminfo_first] = (float)(100.0*(double)(total-available)/(double)total);
+    m_values[m_meminfo_first+1] = (float)((total-available)/1048576.0);
+    m_values[m_meminfo_first+2] = (float)(available/1048576.0);
+}
+void agent_sensors::sample_diskstats() {
+    read_fd(m_diskstats_fd);
+    const int64_t now = monotonic_ms();
+    const int64_t elapsed = now-m_disk_prev_ms;
+    for(const char* p = m_buffer.data();p!=nullptr && *p;p = next_line(p)) {
+        // major minor name, then the stats. io_ticks is the 10th
+        uint64_t skip;
+        p = parse_u64(p,&skip);
+        p = parse_u64(p,&skip);
+        while(*p==' ') {
+            ++p;
+        }
+        const char* name = p;
+        while(*p && *p!=' ') {
+            ++p;
+        }
+        const size_t name_len = p-name;
+        for(size_t i = 0;i<m_disk_names.size();++i) {
+            const std::string& dn = m_disk_names[i];
+            if(dn.size()!=name_len || 0!=memcmp(dn.data(),name,name_len)) {
+                continue;
+            }
+            uint64_t ticks = 0;
+            for(int f = 0;f<10;++f) {
+                p = parse_u64(p,&ticks);
+            }
+            if(m_disk_prev_ms!=0 && elapsed>0) {
+                const double load = 100.0*(double)(ticks-m_disk_prev[i])/(double)elapsed;
+                m_values[m_disk_first+i] = (float)(load>100?100:load);
+            }
+            m_disk_prev[i] = ticks;
+            break;
+        }
+    }
+    m_disk_prev_ms = now;
+}
+void agent_sensors::sample_cpufreq() {
+    float fastest = NAN;
+    for(int i = 1;i<m_cpufreq_count;++i) {
+        const slot& s = m_slots[m_cpufreq_first+i];
+        float& value = m_values[m_cpufreq_first+i];
+        value = NAN;
+        if(s.fd<0 || 0==read_fd(s.fd)) {
+            continue;
+        }
+        value = (float)atoll(m_buffer.data())*s.scale;
+        if(!(fastest>=value)) {
+            fastest = value;
+        }
+    }
+    m_values[m_cpufreq_first] = fastest;
+}
+void agent_sensors::sample() {
+    if(m_used[(int)source::stat]) {
+        sample_stat();
+    }
+    if(m_used[(int)source::meminfo]) {
+        sample_meminfo();
+    }
+    if(m_used[(int)source::diskstats]) {
+        sample_diskstats();
+    }
+    if(m_used[(int)source::cpufreq]) {
+        sample_cpufreq();
+    }
+    if(m_used[(int)source::file]) {
+        char buf[32];
+        for(size_t i = 0;i<m_slots.size();++i) {
+            const slot& s = m_slots[i];
+            if(!s.used || s.src!=source::file) {
+                continue;
+            }
+            const ssize_t len = pread(s.fd,buf,sizeof(buf)-1,0);
+            if(len<=0) {
+                m_values[i] = NAN;
+                continue;
+            }
+            buf[len]=0;
+            m_values[i] = (float)atoll(buf)*s.scale;
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <regex>
+#include <string>
+#include <vector>
+
+// the machine's sensors, published under paths shaped like the
+// OpenHardwareMonitor identifiers the Windows host matches screens
+// against, so the same screens.json files work. the canonical ones are
+//   /cpu/0/load/0 (total), /cpu/0/load/N (core N-1)
+//   /cpu/0/clock/0 (fastest core, MHz), /cpu/0/clock/N (core N-1)
+//   /cpu/0/temperature/0
+//   /ram/load/0, /ram/data/0 (used GB), /ram/data/1 (available GB)
+//   /gpu/N/load/0, /gpu/N/clock/0, /gpu/N/temperature/0
+//   /hdd/N/load/0 (busy time), /hdd/N/temperature/0
+// and every hwmon and thermal zone input is also published raw as
+// /<chip>/<instance>/<temperature|fan|voltage|power|clock>/<index>.
+//
+// every file is opened once up front and re-read with pread, and only the
+// sources something matched are read at all
+class agent_sensors {
+public:
+    enum struct source : uint8_t {
+        stat,
+        meminfo,
+        diskstats,
+        cpufreq,
+        file
+    };
+private:
+    struct slot {
+        source src;
+        bool used;
+        int fd;
+        float scale;
+    };
+    struct entry {
+        std::string path;
+        int slot;
+    };
+    std::string m_root;
+    std::vector<slot> m_slots;
+    std::vector<float> m_values;
+    std::vector<entry> m_entries;
+    // where each multi-value source's slots start
+    int m_stat_first;
+    int m_stat_count;
+    int m_meminfo_first;
+    int m_disk_first;
+    std::vector<std::string> m_disk_names;
+    int m_cpufreq_first;
+    int m_cpufreq_count;
+    int m_stat_fd;
+    int m_meminfo_fd;
+    int m_diskstats_fd;
+    std::vector<char> m_buffer;
+    std::vector<uint64_t> m_stat_prev;
+    std::vector<uint64_t> m_disk_prev;
+    int64_t m_disk_prev_ms;
+    bool m_used[5];
+    int add_slot(source src, int fd, float scale);
+    void add_path(const std::string& path, int slot);
+    int add_file(const std::string& file, float scale);
+    void open_cpu();
+    void open_memory();
+    void open_disks();
+    void open_hwmon(std::vector<entry>& aliases);
+    void open_thermal(std::vector<entry>& aliases);
+    size_t read_fd(int fd);
+    void sample_stat();
+    void sample_meminfo();
+    void sample_diskstats();
+    void sample_cpufreq();
+public:
+    agent_sensors();
+    ~agent_sensors();
+    agent_sensors(const agent_sensors& rhs) = delete;
+    agent_sensors& operator=(const agent_sensors& rhs) = delete;
+    // finds and opens every sensor. root prefixes /proc and /sys, to run
+    // against a copy of another machine's tree
+    void open(const std::string& root = "");
+    void close();
+    size_t size() const { return m_entries.size(); }
+    const std::string& path(size_t index) const { return m_entries[index].path; }
+    float value(size_t index) const { return m_values[m_entries[index].slot]; }
+    // the last sensor whose path the expression finds a match in, the way
+    // the Windows host picks them, or -1
+    int find(const std::regex& expression) const;
+    // marks a sensor as needed by sample()
+    void use(int index);
+    // marks everything as needed
+    void use_all();
+    // refreshes the sensors that are in use. unreadable ones are NaN
+    void sample();
+};
@@ -0,0 +1,56 @@
+// the harness the checks and benchmarks in this directory share: a
+// repeatable generator for the checks, a timing loop and a sink for the
+// benchmarks, and the command line they all take
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <chrono>
+
+using bench_clock = std::chrono::steady_clock;
+
+// keeps the optimizer from throwing the work away
+inline volatile uint64_t bench_sink = 0;
+
+// xorshift, so a failure comes back the same on the next run
+inline uint32_t test_seed = 1;
+inline uint32_t test_random() {
+    test_seed ^= test_seed<<13;
+    test_seed ^= test_seed>>17;
+    test_seed ^= test_seed<<5;
+    return test_seed;
+}
+
+// [iterations] [seconds per bench case], either defaulted if left off
+struct bench_args {
+    long iterations;
+    double seconds;
+};
+inline bench_args bench_parse_args(int argc, char** argv, long iterations, double seconds) {
+    bench_args args;
+    args.iterations = argc>1?atol(argv[1]):iterations;
+    args.seconds = argc>2?atof(argv[2]):seconds;
+    return args;
+}
+
+struct bench_result {
+    uint64_t steps;
+    double seconds;
+};
+// calls step(i) for about seconds, looking at the clock every batch steps
+template<typename Step>
+inline bench_result bench_run(double seconds, int batch, Step step) {
+    uint64_t steps = 0;
+    const auto start = bench_clock::now();
+    const auto end = start+std::chrono::duration<double>(seconds);
+    auto now = start;
+    while(now<end) {
+        for(int i = 0;i<batch;++i) {
+            step(steps++);
+        }
+        now = bench_clock::now();
+    }
+    bench_result result;
+    result.steps = steps;
+    result.seconds = std::chrono::duration<double>(now-start).count();
+    return result;
+}
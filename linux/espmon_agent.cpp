@@ -0,0 +1,794 @@
+// a Linux host for the displays. it samples /proc and /sys and answers the
+// serial protocol on any number of serial ports or ptys from one epoll
+// loop. screens come from the same screens.json files as the Windows host
+// and sensors are picked by the same regex matching, over paths shaped
+// like its OpenHardwareMonitor ones (see agent_sensors.hpp). every
+// pattern is resolved once and one sampling pass serves every display.
+//
+// usage: espmon_agent [options] DEVICE[=SCREENS.json] ...
+//   --screens FILE   screens for devices without their own (default
+//                    default.screens.json). like the Windows host, a
+//                    <device name>.screens.json in the current directory
+//                    is used first if it exists
+//   --interval MS    sampling period (default 100)
+//   --baud N         line rate for real serial ports (default 115200)
+//   --stats SECS     print counters every SECS seconds
+//   --root DIR       read /proc and /sys under DIR
+//   --record DIR     capture each port's session to DIR, for replay with
+//                    espmon_replay
+//   --diag SECS      ask each display for its link timing every SECS
+//                    seconds and print it (see link_stats.hpp)
+//   --overlay        with --diag, show the timing on the displays too
+//   --telemetry SECS ask each display for its frame, heap, stack and CPU
+//                    counters every SECS seconds and print them
+//   --trace SECS     dump each display's trace rings every SECS seconds
+//                    into <device name>.trace under the --record
+//                    directory, or the current one. espmon_trace turns
+//                    those into Chrome traces. the firmware has to be
+//                    built with TRACE_RING_SIZE for there to be any events
+//   --profile SECS   run each display's sampling profiler and save its
+//                    counts every SECS seconds into <device name>.profile
+//                    next to the traces, for espmon_profile. it needs
+//                    firmware built with PROFILER_SLOTS
+//   --profile-rate HZ  samples a second for --profile (default the
+//                    firmware's)
+//   --latency SECS   ask each display how long its button and touch
+//                    presses took to reach the panel every SECS seconds
+//                    and print it (see input_latency.hpp). the counts
+//                    carry on from one report to the next
+//   --paths          print every sensor path and its value, then exit
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include "agent_screens.hpp"
+#include "agent_sensors.hpp"
+#include "espmon_protocol.hpp"
+#include "session_log.hpp"
+
+// a screen with its payload encoded once up front, and its values
+// resolved to the shared match table
+struct port_screen {
+    uint8_t payload[espmon::screen_payload_size];
+    int matches[4];
+};
+struct port {
+    std::string path;
+    std::string screens_path;
+    std::vector<port_screen> screens;
+    int fd = -1;
+    // a request split across reads
+    uint8_t partial[espmon::request_size];
+    size_t partial_size = 0;
+    // a report being gathered after its request
+    uint8_t report_cmd = 0;
+    uint8_t report[255];
+    size_t report_size = 0;
+    size_t report_needed = 0;
+    // when the bytes being handled were read, for pongs
+    int64_t read_ns = 0;
+    uint16_t seq = 0;
+    // a response the port couldn't take all at once
+    std::string pending;
+    // trace and profile chunks go here as they came off the wire
+    FILE* trace_file = nullptr;
+    size_t trace_events = 0;
+    FILE* profile_file = nullptr;
+    size_t profile_entries = 0;
+    uint64_t requests = 0;
+    uint64_t junk = 0;
+    uint64_t dropped = 0;
+    bool warned = false;
+    espmon::session_writer capture;
+};
+// each distinct pattern, shared by all the ports
+struct match_entry {
+    std::string pattern;
+    int sensor;
+};
+
+static agent_sensors sensors;
+static std::vector<match_entry> matches;
+static std::vector<std::unique_ptr<port>> ports;
+static int epoll_fd = -1;
+static int baud_rate = 115200;
+static const char* record_dir = nullptr;
+// when the sensors were last sampled, for data_ex frames
+static int64_t sample_time_ns = 0;
+
+static int64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+static speed_t to_speed(int baud) {
+    switch(baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B115200;
+    }
+}
+// NaN is 0, like the Windows host. it rounds to even too
+static uint16_t to_u16(float value) {
+    if(isnan(value) || value<=0) {
+        return 0;
+    }
+    const float r = nearbyintf(value);
+    return r>65535?65535:(uint16_t)r;
+}
+static int match_index(const std::string& pattern) {
+    for(size_t i = 0;i<matches.size();++i) {
+        if(matches[i].pattern==pattern) {
+            return (int)i;
+        }
+    }
+    matches.push_back(match_entry{pattern,-1});
+    return (int)matches.size()-1;
+}
+// collects every distinct pattern across every port and picks a sensor
+// for each, the way PortDispatcher.RebuildMatchCache and
+// FetchHardwareInfo do
+static void build_matches() {
+    for(match_entry& m : matches) {
+        if(m.pattern.empty()) {
+            continue;
+        }
+        try {
+            const std::regex re(m.pattern,std::regex::ECMAScript|std::regex::optimize);
+            m.sensor = sensors.find(re);
+        } catch(const std::regex_error& ex) {
+            fprintf(stderr,"bad pattern \"%s\": %s\n",m.pattern.c_str(),ex.what());
+            continue;
+        }
+        if(m.sensor<0) {
+            fprintf(stderr,"nothing matches \"%s\"\n",m.pattern.c_str());
+        } else {
+            sensors.use(m.sensor);
+        }
+    }
+}
+static bool load_port_screens(port& p, const char* default_screens) {
+    std::vector<agent_screen> screens;
+    std::string error;
+    if(p.screens_path.empty()) {
+        // <name>.screens.json first, like the Windows host's per port file
+        const char* slash = strrchr(p.path.c_str(),'/');
+        std::string name = slash==nullptr?p.path:slash+1;
+        for(char& c : name) {
+            c = (char)tolower((unsigned char)c);
+        }
+        name+=".screens.json";
+        if(0==access(name.c_str(),R_OK)) {
+            p.screens_path = name;
+        } else {
+            p.screens_path = default_screens;
+        }
+    }
+    if(!agent_load_screens(p.screens_path.c_str(),screens,error)) {
+        fprintf(stderr,"%s\n",error.c_str());
+        return false;
+    }
+    for(size_t i = 0;i<screens.size();++i) {
+        port_screen s;
+        const agent_screen& src = screens[i];
+        agent_encode_screen(src,(int8_t)i,s.payload);
+        const agent_value* values[] = {&src.top.value1,&src.top.value2,&src.bottom.value1,&src.bottom.value2};
+        for(int j = 0;j<4;++j) {
+            s.matches[j] = match_index(values[j]->match);
+        }
+        p.screens.push_back(s);
+    }
+    return true;
+}
+
+static void close_port(port& p, const char* why) {
+    if(p.fd<0) {
+        return;
+    }
+    fprintf(stderr,"%s: %s\n",p.path.c_str(),why);
+    epoll_ctl(epoll_fd,EPOLL_CTL_DEL,p.fd,nullptr);
+    close(p.fd);
+    p.fd = -1;
+    p.partial_size = 0;
+    p.report_needed = 0;
+    p.pending.clear();
+    p.capture.write(espmon::session_record::disconnect,0,why,strlen(why));
+    p.capture.flush();
+}
+// <dir>/<device name>-<start time>.cap, one per port per run
+static void open_capture(port& p) {
+    const char* slash = strrchr(p.path.c_str(),'/');
+    const time_t now = time(nullptr);
+    char stamp[32];
+    strftime(stamp,sizeof(stamp),"%Y%m%d-%H%M%S",localtime(&now));
+    const std::string path = std::string(record_dir)+"/"+(slash==nullptr?p.path.c_str():slash+1)+"-"+stamp+".cap";
+    if(!p.capture.open(path.c_str(),isatty(p.fd)?baud_rate:0)) {
+        fprintf(stderr,"%s: %s\n",path.c_str(),strerror(errno));
+    }
+}
+static bool open_port(port& p) {
+    const int fd = open(p.path.c_str(),O_RDWR|O_NOCTTY|O_NONBLOCK|O_CLOEXEC);
+    if(fd<0) {
+        if(!p.warned) {
+            fprintf(stderr,"%s: %s, retrying\n",p.path.c_str(),strerror(errno));
+            p.warned = true;
+        }
+        return false;
+    }
+    termios tio;
+    if(0==tcgetattr(fd,&tio)) {
+        cfmakeraw(&tio);
+        tio.c_cflag|=CLOCAL|CREAD;
+        cfsetispeed(&tio,to_speed(baud_rate));
+        cfsetospeed(&tio,to_speed(baud_rate));
+        tcsetattr(fd,TCSANOW,&tio);
+        tcflush(fd,TCIOFLUSH);
+    }
+    epoll_event ev;
+    ev.events = EPOLLIN|EPOLLRDHUP;
+    ev.data.ptr = &p;
+    epoll_ctl(epoll_fd,EPOLL_CTL_ADD,fd,&ev);
+    p.fd = fd;
+    p.warned = false;
+    if(record_dir!=nullptr && !p.capture.is_open()) {
+        open_capture(p);
+    }
+    p.capture.write(espmon::session_record::connect,0,p.path.data(),p.path.size());
+    fprintf(stderr,"%s: open, %d screen(s) from %s\n",p.path.c_str(),(int)p.screens.size(),p.screens_path.c_str());
+    return true;
+}
+static void send(port& p, const uint8_t* data, size_t size) {
+    if(!p.pending.empty()) {
+        // the port is backed up. don't queue stale data behind it
+        ++p.dropped;
+        return;
+    }
+    const ssize_t written = write(p.fd,data,size);
+    if(written>0) {
+        p.capture.host_frame(data,size);
+    }
+    if(written==(ssize_t)size) {
+        return;
+    }
+    if(written<0) {
+        if(errno!=EAGAIN) {
+            close_port(p,strerror(errno));
+        } else {
+            ++p.dropped;
+        }
+        return;
+    }
+    p.pending.assign((const char*)data+written,size-written);
+    epoll_event ev;
+    ev.events = EPOLLIN|EPOLLOUT|EPOLLRDHUP;
+    ev.data.ptr = &p;
+    epoll_ctl(epoll_fd,EPOLL_CTL_MOD,p.fd,&ev);
+}
+static void flush_pending(port& p) {
+    const ssize_t written = write(p.fd,p.pending.data(),p.pending.size());
+    if(written<0) {
+        if(errno!=EAGAIN) {
+            close_port(p,strerror(errno));
+        }
+        return;
+    }
+    p.pending.erase(0,written);
+    if(p.pending.empty()) {
+        epoll_event ev;
+        ev.events = EPOLLIN|EPOLLRDHUP;
+        ev.data.ptr = &p;
+        epoll_ctl(epoll_fd,EPOLL_CTL_MOD,p.fd,&ev);
+    }
+}
+static void print_telemetry(const port& p) {
+    using heap = espmon::telemetry_view::heap;
+    const espmon::telemetry_view v(p.report,p.report_size);
+    if(!v.valid()) {
+        fprintf(stderr,"%s: bad telemetry report\n",p.path.c_str());
+        return;
+    }
+    const uint32_t frames = v.frames();
+    printf("telemetry,path=%s,uptime_ms=%u,interval_ms=%u,frames=%u,fps=%.1f,frame_avg_us=%u,frame_max_us=%u,"
+        "flushes=%u,flush_pixels=%u,flush_avg_us=%u,flush_max_us=%u,flush_stalls=%u,flush_stall_us=%u,flush_skipped=%u,"
+        "flush_ring_depth=%u,flush_ring_flushes=%u,flush_ring_max_queued=%u,"
+        "rx_bytes=%u,tx_bytes=%u,rx_packets=%u,rx_dropped=%u,"
+        "heap_internal=%u,heap_internal_min=%u,heap_dma=%u,heap_dma_min=%u,heap_psram=%u,heap_psram_min=%u",
+        p.path.c_str(),v.uptime_ms(),v.interval_ms(),frames,v.fps_x10()/10.0,frames==0?0:v.frame_us()/frames,v.frame_max_us(),
+        v.flushes(),v.flush_pixels(),v.flushes()==0?0:v.flush_us()/v.flushes(),v.flush_max_us(),v.flush_stalls(),v.flush_stall_us(),v.flush_skipped(),
+        v.flush_ring_depth(),v.flush_ring_flushes(),v.flush_ring_max_queued(),
+        v.rx_bytes(),v.tx_bytes(),v.rx_packets(),v.rx_dropped(),
+        v.heap_free(heap::internal),v.heap_min_free(heap::internal),v.heap_free(heap::dma),v.heap_min_free(heap::dma),
+        v.heap_free(heap::psram),v.heap_min_free(heap::psram));
+    for(size_t core = 0;core<2;++core) {
+        if(v.cpu_load(core)!=0xFF) {
+            printf(",cpu%d=%u",(int)core,v.cpu_load(core));
+        }
+    }
+    for(size_t i = 0;i<v.stacks();++i) {
+        char name[espmon::telemetry_view::stack_name_size+1];
+        memcpy(name,v.stack_name(i),espmon::telemetry_view::stack_name_size);
+        name[espmon::telemetry_view::stack_name_size] = '\0';
+        printf(",stack_%s=%u",name,v.stack_free(i));
+    }
+    // paints/total us/max us for each control, in layout order
+    printf(",paints=");
+    for(size_t i = 0;i<v.controls();++i) {
+        printf(i==0?"%u:%u:%u":"/%u:%u:%u",v.control_paints(i),v.control_paint_us(i),v.control_paint_max_us(i));
+    }
+    printf("\n");
+    fflush(stdout);
+}
+static void print_latency(const port& p) {
+    using stage = espmon::latency_view::stage;
+    const espmon::latency_view v(p.report,p.report_size);
+    if(!v.valid()) {
+        fprintf(stderr,"%s: bad latency report\n",p.path.c_str());
+        return;
+    }
+    static const char* kind_names[] = {"screen","theme"};
+    static const char* stage_names[] = {"detect","apply","paint","present","total"};
+    printf("latency,path=%s,missed=%u\n",p.path.c_str(),v.missed());
+    for(size_t k = 0;k<v.kinds();++k) {
+        const size_t total = (size_t)stage::total;
+        if(v.stages()<=total) {
+            break;
+        }
+        unsigned count = 0;
+        for(size_t i = 0;i<espmon::latency_view::histogram_buckets;++i) {
+            count+=v.histogram(k,total,i);
+        }
+        printf("latency,path=%s,kind=%s,count=%u",p.path.c_str(),kind_names[k],count);
+        // average/max in milliseconds
+        for(size_t s = 0;s<v.stages();++s) {
+            printf(",%s_ms=%.1f/%.1f",stage_names[s],v.mean_us(k,s)/1000.0,v.max_us(k,s)/1000.0);
+        }
+        // buckets under 2ms, 4ms, 8ms... and the rest
+        printf(",total_hist=");
+        for(size_t i = 0;i<espmon::latency_view::histogram_buckets;++i) {
+            printf(i==0?"%u":"/%u",v.histogram(k,total,i));
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+// appends a dump chunk to <dir>/<device name><ext>. returns the path, or
+// an empty string if it couldn't be written
+static std::string save_chunk(const port& p, FILE** file, const char* ext) {
+    const char* slash = strrchr(p.path.c_str(),'/');
+    const std::string path = std::string(record_dir==nullptr?".":record_dir)+"/"+(slash==nullptr?p.path.c_str():slash+1)+ext;
+    if(*file==nullptr) {
+        *file = fopen(path.c_str(),"ab");
+        if(*file==nullptr) {
+            fprintf(stderr,"%s: %s\n",path.c_str(),strerror(errno));
+            return std::string();
+        }
+    }
+    const uint8_t header[] = {p.report_cmd,(uint8_t)p.report_size};
+    fwrite(header,1,sizeof(header),*file);
+    fwrite(p.report,1,p.report_size,*file);
+    return path;
+}
+static void save_trace(port& p) {
+    const espmon::trace_chunk_view v(p.report,p.report_size);
+    if(!v.valid()) {
+        fprintf(stderr,"%s: bad trace chunk\n",p.path.c_str());
+        return;
+    }
+    const std::string path = save_chunk(p,&p.trace_file,".trace");
+    p.trace_events+=v.count();
+    if(v.last() && !path.empty()) {
+        fflush(p.trace_file);
+        printf("trace,path=%s,events=%zu,file=%s\n",p.path.c_str(),p.trace_events,path.c_str());
+        fflush(stdout);
+        p.trace_events = 0;
+    }
+}
+static void save_profile(port& p) {
+    const espmon::profile_chunk_view v(p.report,p.report_size);
+    if(!v.valid()) {
+        fprintf(stderr,"%s: bad profile chunk\n",p.path.c_str());
+        return;
+    }
+    const std::string path = save_chunk(p,&p.profile_file,".profile");
+    p.profile_entries+=v.count();
+    if(v.last() && !path.empty()) {
+        fflush(p.profile_file);
+        printf("profile,path=%s,stacks=%zu,file=%s\n",p.path.c_str(),p.profile_entries,path.c_str());
+        fflush(stdout);
+        p.profile_entries = 0;
+    }
+}
+static void print_report(const port& p) {
+    const espmon::diagnostics_view v(p.report);
+    printf("diag,path=%s,synced=%d,overlay=%d,rtt_us=%u,rtt_min_us=%u,rtt_mean_us=%u,offset_us=%d,"
+        "jitter_us=%u,age_us=%u,age_mean_us=%u,age_max_us=%u,gaps=%u,pings=%u,pongs=%u,jitter_hist=",
+        p.path.c_str(),v.flags()&1,(v.flags()>>1)&1,v.rtt_last(),v.rtt_min(),v.rtt_mean(),v.offset(),
+        v.jitter(),v.age_last(),v.age_mean(),v.age_max(),v.seq_gaps(),v.pings(),v.pongs());
+    for(size_t i = 0;i<espmon::diagnostics_view::histogram_buckets;++i) {
+        printf(i==0?"%u":"/%u",v.jitter_histogram(i));
+    }
+    printf(",age_hist=");
+    for(size_t i = 0;i<espmon::diagnostics_view::histogram_buckets;++i) {
+        printf(i==0?"%u":"/%u",v.age_histogram(i));
+    }
+    printf("\n");
+    fflush(stdout);
+}
+static void answer(port& p, const espmon::request& req) {
+    ++p.requests;
+    uint8_t frame[1+espmon::max_payload_size];
+    frame[0] = req.cmd;
+    if(req.cmd==(uint8_t)espmon::command::ping) {
+        // the screen index is the ping's id
+        espmon::pong_writer w(frame+1);
+        w.id(req.screen_index);
+        w.host_receive_us((uint32_t)(p.read_ns/1000));
+        w.host_send_us((uint32_t)(now_ns()/1000));
+        send(p,frame,1+espmon::pong_payload_size);
+        return;
+    }
+    if(req.cmd==(uint8_t)espmon::command::diagnostics || req.cmd==(uint8_t)espmon::command::telemetry ||
+            req.cmd==(uint8_t)espmon::command::trace || req.cmd==(uint8_t)espmon::command::profile ||
+            req.cmd==(uint8_t)espmon::command::latency) {
+        // the report itself is gathered by read_port
+        return;
+    }
+    const size_t index = req.screen_index%p.screens.size();
+    const port_screen& s = p.screens[index];
+    if(req.cmd==(uint8_t)espmon::command::screen) {
+        memcpy(frame+1,s.payload,espmon::screen_payload_size);
+        frame[1+espmon::layout::index] = (uint8_t)index;
+        send(p,frame,1+espmon::screen_payload_size);
+        return;
+    }
+    espmon::data_writer w(frame+1);
+    uint16_t values[4];
+    for(int i = 0;i<4;++i) {
+        const int sensor = matches[s.matches[i]].sensor;
+        values[i] = sensor<0?0:to_u16(sensors.value(sensor));
+    }
+    w.top_value1(values[0]);
+    w.top_value2(values[1]);
+    w.bottom_value1(values[2]);
+    w.bottom_value2(values[3]);
+    if(req.cmd==(uint8_t)espmon::command::data_ex) {
+        espmon::data_ex_writer x(frame+1);
+        x.seq(p.seq++);
+        x.sample_us((uint32_t)(sample_time_ns/1000));
+        send(p,frame,1+espmon::data_ex_payload_size);
+        return;
+    }
+    send(p,frame,1+espmon::data_payload_size);
+}
+static void read_port(port& p) {
+    uint8_t buf[256];
+    while(p.fd>=0) {
+        const ssize_t len = read(p.fd,buf,sizeof(buf));
+        if(len<0) {
+            if(errno!=EAGAIN && errno!=EINTR) {
+                close_port(p,strerror(errno));
+            }
+            return;
+        }
+        if(len==0) {
+            close_port(p,"closed");
+            return;
+        }
+        p.read_ns = now_ns();
+        size_t i = 0;
+        while(i<(size_t)len) {
+            if(p.report_needed>0) {
+                const size_t take = std::min(p.report_needed,(size_t)len-i);
+                memcpy(p.report+p.report_size,buf+i,take);
+                p.report_size+=take;
+                p.report_needed-=take;
+                i+=take;
+                if(p.report_needed==0) {
+                    p.capture.device_request(espmon::request{p.report_cmd,(uint8_t)p.report_size},p.report,p.report_size);
+                    if(p.report_cmd==(uint8_t)espmon::command::telemetry) {
+                        print_telemetry(p);
+                    } else if(p.report_cmd==(uint8_t)espmon::command::trace) {
+                        save_trace(p);
+                    } else if(p.report_cmd==(uint8_t)espmon::command::profile) {
+                        save_profile(p);
+                    } else if(p.report_cmd==(uint8_t)espmon::command::latency) {
+                        print_latency(p);
+                    } else if(p.report_size>=espmon::diagnostics_report_size) {
+                        // a newer device may send more than this host knows about
+                        print_report(p);
+                    }
+                }
+                continue;
+            }
+            p.partial[p.partial_size++] = buf[i++];
+            if(p.partial_size==1 && 0==espmon::payload_size(p.partial[0])) {
+                // the Windows host throws away whatever's buffered when the
+                // command is unknown, which resyncs on the next request
+                ++p.junk;
+                p.capture.write(espmon::session_record::device_junk,0,buf+i-1,len-(i-1));
+                p.partial_size = 0;
+                break;
+            }
+            if(p.partial_size==espmon::request_size) {
+                p.partial_size = 0;
+                const espmon::request req = espmon::request::decode(p.partial);
+                p.report_cmd = req.cmd;
+                p.report_needed = espmon::request_payload_size(req);
+                p.report_size = 0;
+                if(p.report_needed==0) {
+                    p.capture.device_request(req);
+                }
+                answer(p,req);
+                if(p.fd<0) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+static void print_stats(uint64_t samples, int64_t sample_ns) {
+    rusage ru;
+    getrusage(RUSAGE_SELF,&ru);
+    const double cpu_ms = ru.ru_utime.tv_sec*1e3+ru.ru_utime.tv_usec/1e3+ru.ru_stime.tv_sec*1e3+ru.ru_stime.tv_usec/1e3;
+    printf("agent,samples=%llu,sample_us=%.1f,cpu_ms=%.1f\n",(unsigned long long)samples,
+        samples==0?0.0:sample_ns/1e3/samples,cpu_ms);
+    for(const auto& p : ports) {
+        printf("port,path=%s,open=%d,requests=%llu,junk=%llu,dropped=%llu\n",p->path.c_str(),p->fd>=0?1:0,
+            (unsigned long long)p->requests,(unsigned long long)p->junk,(unsigned long long)p->dropped);
+    }
+    fflush(stdout);
+}
+static void print_paths() {
+    sensors.use_all();
+    sensors.sample();
+    usleep(250*1000);
+    sensors.sample();
+    for(size_t i = 0;i<sensors.size();++i) {
+        printf("%s %g\n",sensors.path(i).c_str(),sensors.value(i));
+    }
+}
+static int usage(const char* name) {
+    fprintf(stderr,"usage: %s [--screens FILE] [--interval MS] [--baud N] [--stats SECS] [--root DIR] [--record DIR] [--diag SECS [--overlay]] [--telemetry SECS] [--trace SECS] [--profile SECS [--profile-rate HZ]] [--latency SECS] [--paths] DEVICE[=SCREENS] ...\n",name);
+    return 2;
+}
+int main(int argc, char** argv) {
+    const char* default_screens = "default.screens.json";
+    const char* root = "";
+    int interval_ms = 100;
+    int stats_secs = 0;
+    int diag_secs = 0;
+    int telemetry_secs = 0;
+    int trace_secs = 0;
+    int profile_secs = 0;
+    int profile_rate = 0;
+    int latency_secs = 0;
+    bool overlay = false;
+    bool paths = false;
+    for(int i = 1;i<argc;++i) {
+        if(0==strcmp(argv[i],"--screens") && i+1<argc) {
+            default_screens = argv[++i];
+        } else if(0==strcmp(argv[i],"--interval") && i+1<argc) {
+            interval_ms = atoi(argv[++i]);
+            if(interval_ms<1) {
+                interval_ms = 1;
+            }
+        } else if(0==strcmp(argv[i],"--baud") && i+1<argc) {
+            baud_rate = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--stats") && i+1<argc) {
+            stats_secs = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--record") && i+1<argc) {
+            record_dir = argv[++i];
+        } else if(0==strcmp(argv[i],"--diag") && i+1<argc) {
+            diag_secs = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--telemetry") && i+1<argc) {
+            telemetry_secs = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--trace") && i+1<argc) {
+            trace_secs = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--profile") && i+1<argc) {
+            profile_secs = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--profile-rate") && i+1<argc) {
+            profile_rate = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--latency") && i+1<argc) {
+            latency_secs = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--overlay")) {
+            overlay = true;
+        } else if(0==strcmp(argv[i],"--root") && i+1<argc) {
+            root = argv[++i];
+        } else if(0==strcmp(argv[i],"--paths")) {
+            paths = true;
+        } else if(argv[i][0]=='-') {
+            return usage(argv[0]);
+        } else {
+            std::unique_ptr<port> p(new port());
+            const char* eq = strchr(argv[i],'=');
+            if(eq!=nullptr) {
+                p->path.assign(argv[i],eq-argv[i]);
+                p->screens_path = eq+1;
+            } else {
+                p->path = argv[i];
+            }
+            ports.push_back(std::move(p));
+        }
+    }
+    sensors.open(root);
+    if(paths) {
+        print_paths();
+        return 0;
+    }
+    if(ports.empty()) {
+        return usage(argv[0]);
+    }
+    for(auto& p : ports) {
+        if(!load_port_screens(*p,default_screens)) {
+            return 1;
+        }
+    }
+    build_matches();
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask,SIGINT);
+    sigaddset(&mask,SIGTERM);
+    sigprocmask(SIG_BLOCK,&mask,nullptr);
+    const int signal_fd = signalfd(-1,&mask,SFD_CLOEXEC);
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+    itimerspec its;
+    its.it_value.tv_sec = interval_ms/1000;
+    its.it_value.tv_nsec = (interval_ms%1000)*1000000;
+    its.it_interval = its.it_value;
+    timerfd_settime(timer_fd,0,&its,nullptr);
+    // the timer and signal fds are told apart from ports by these
+    static int timer_tag, signal_tag;
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &timer_tag;
+    epoll_ctl(epoll_fd,EPOLL_CTL_ADD,timer_fd,&ev);
+    ev.data.ptr = &signal_tag;
+    epoll_ctl(epoll_fd,EPOLL_CTL_ADD,signal_fd,&ev);
+
+    sample_time_ns = now_ns();
+    sensors.sample();
+    for(auto& p : ports) {
+        open_port(*p);
+    }
+    uint64_t samples = 0;
+    int64_t sample_ns = 0;
+    int64_t last_retry = now_ns();
+    int64_t last_stats = last_retry;
+    int64_t last_diag = last_retry;
+    int64_t last_telemetry = last_retry;
+    int64_t last_trace = last_retry;
+    int64_t last_profile = last_retry;
+    int64_t last_latency = last_retry;
+    bool running = true;
+    while(running) {
+        epoll_event events[16];
+        const int count = epoll_wait(epoll_fd,events,16,-1);
+        if(count<0) {
+            if(errno==EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        for(int i = 0;i<count;++i) {
+            void* tag = events[i].data.ptr;
+            if(tag==&signal_tag) {
+                running = false;
+            } else if(tag==&timer_tag) {
+                uint64_t expirations;
+                if(read(timer_fd,&expirations,sizeof(expirations))<0) {
+                    continue;
+                }
+                const int64_t start = now_ns();
+                sample_time_ns = start;
+                sensors.sample();
+                const int64_t end = now_ns();
+                sample_ns+=end-start;
+                ++samples;
+                for(auto& p : ports) {
+                    p->capture.flush();
+                }
+                if(end-last_retry>=1000000000) {
+                    last_retry = end;
+                    for(auto& p : ports) {
+                        if(p->fd<0) {
+                            open_port(*p);
+                        }
+                    }
+                }
+                if(diag_secs>0 && end-last_diag>=(int64_t)diag_secs*1000000000) {
+                    last_diag = end;
+                    const uint8_t query[] = {(uint8_t)espmon::command::diagnostics,(uint8_t)(overlay?1:0)};
+                    for(auto& p : ports) {
+                        if(p->fd>=0) {
+                            send(*p,query,sizeof(query));
+                        }
+                    }
+                }
+                if(telemetry_secs>0 && end-last_telemetry>=(int64_t)telemetry_secs*1000000000) {
+                    last_telemetry = end;
+                    const uint8_t query[] = {(uint8_t)espmon::command::telemetry,0};
+                    for(auto& p : ports) {
+                        if(p->fd>=0) {
+                            send(*p,query,sizeof(query));
+                        }
+                    }
+                }
+                if(trace_secs>0 && end-last_trace>=(int64_t)trace_secs*1000000000) {
+                    last_trace = end;
+                    const uint8_t query[] = {(uint8_t)espmon::command::trace,0};
+                    for(auto& p : ports) {
+                        if(p->fd>=0) {
+                            send(*p,query,sizeof(query));
+                        }
+                    }
+                }
+                if(profile_secs>0 && end-last_profile>=(int64_t)profile_secs*1000000000) {
+                    // each dump covers the time since the last. the first
+                    // one starts the sampling, and comes back empty
+                    last_profile = end;
+                    uint8_t query[1+espmon::profile_query_size];
+                    query[0] = (uint8_t)espmon::command::profile;
+                    espmon::profile_query_writer w(query+1);
+                    w.flags(espmon::profile_run|espmon::profile_clear);
+                    w.depth(0);
+                    w.rate_hz((uint16_t)std::max(0,std::min(65535,profile_rate)));
+                    for(auto& p : ports) {
+                        if(p->fd>=0) {
+                            send(*p,query,sizeof(query));
+                        }
+                    }
+                }
+                if(latency_secs>0 && end-last_latency>=(int64_t)latency_secs*1000000000) {
+                    last_latency = end;
+                    const uint8_t query[] = {(uint8_t)espmon::command::latency,0};
+                    for(auto& p : ports) {
+                        if(p->fd>=0) {
+                            send(*p,query,sizeof(query));
+                        }
+                    }
+                }
+                if(stats_secs>0 && end-last_stats>=(int64_t)stats_secs*1000000000) {
+                    last_stats = end;
+                    print_stats(samples,sample_ns);
+                }
+            } else {
+                port& p = *(port*)tag;
+                if(events[i].events&EPOLLIN) {
+                    read_port(p);
+                }
+                if(p.fd>=0 && (events[i].events&EPOLLOUT)) {
+                    flush_pending(p);
+                }
+                if(p.fd>=0 && (events[i].events&(EPOLLHUP|EPOLLRDHUP|EPOLLERR))) {
+                    close_port(p,"hung up");
+                }
+            }
+        }
+    }
+    print_stats(samples,sample_ns);
+    return 0;
+}
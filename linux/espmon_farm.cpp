@@ -0,0 +1,439 @@
+// a farm of virtual displays on ptys, for load testing a host. each one
+// behaves like the firmware's serial loop: it asks for a screen until it
+// gets one, then for data every 100ms, switches screens now and then the
+// way a tap does, and shows itself disconnected after a second of
+// silence. everything runs from one epoll loop.
+//
+// the pty paths are printed one per line on stdout (and written to --list)
+// so the host can be pointed at them, e.g.
+//   espmon_farm --devices 200 --list farm.txt &
+//   espmon_agent $(cat farm.txt)
+//
+// for each display it measures response latency (request written to the
+// whole answer read), jitter (RFC 3550 style, smoothed over consecutive
+// latencies) and throughput. with --step the farm starts small and wakes
+// more displays every --step-secs, printing a line per step, so where
+// latency takes off is where the host stops scaling.
+//
+// usage: espmon_farm [--devices N] [--start N] [--step N] [--step-secs S]
+//                    [--duration S] [--switch-secs S] [--list FILE]
+//                    [--link-dir DIR] [--per-device] [--seed N]
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "espmon_protocol.hpp"
+
+static const int64_t request_period_us = 100*1000;
+static const int64_t disconnect_us = 1000*1000;
+// a request this old is written off as unanswered
+static const int64_t unanswered_us = 1000*1000;
+
+struct latency_stats {
+    std::vector<float> samples;
+    double jitter_ms = 0;
+    double last_ms = -1;
+    void add(double ms) {
+        samples.push_back((float)ms);
+        if(last_ms>=0) {
+            jitter_ms+=(fabs(ms-last_ms)-jitter_ms)/16;
+        }
+        last_ms = ms;
+    }
+};
+struct device {
+    int index;
+    int master = -1;
+    int slave = -1;
+    std::string path;
+    bool active = false;
+    bool populated = false;
+    int8_t screen_index = 0;
+    int64_t next_request_us = 0;
+    int64_t next_switch_us = 0;
+    int64_t last_frame_us = 0;
+    // when each unanswered request went out, by command
+    std::deque<int64_t> outstanding[2];
+    espmon::frame_reader reader;
+    // totals
+    uint64_t requests = 0;
+    uint64_t screens = 0;
+    uint64_t data = 0;
+    uint64_t junk = 0;
+    uint64_t unanswered = 0;
+    uint64_t disconnects = 0;
+    uint64_t switches = 0;
+    uint64_t bytes_in = 0;
+    uint64_t write_errors = 0;
+    latency_stats latency;
+    // since the last report
+    size_t report_first = 0;
+};
+
+static std::vector<std::unique_ptr<device>> devices;
+static uint32_t rng_state = 1;
+static int64_t switch_us = 10*1000*1000;
+
+static int64_t now_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+static uint32_t next_random() {
+    // xorshift32
+    rng_state^=rng_state<<13;
+    rng_state^=rng_state>>17;
+    rng_state^=rng_state<<5;
+    return rng_state;
+}
+static bool create_pty(device& d, const char* link_dir) {
+    d.master = posix_openpt(O_RDWR|O_NOCTTY|O_NONBLOCK|O_CLOEXEC);
+    if(d.master<0 || 0!=grantpt(d.master) || 0!=unlockpt(d.master)) {
+        perror("posix_openpt");
+        return false;
+    }
+    d.path = ptsname(d.master);
+    // holding the slave open keeps the master from reading EIO while no
+    // host has it open, and lets it be put in raw mode for the host
+    d.slave = open(d.path.c_str(),O_RDWR|O_NOCTTY|O_CLOEXEC);
+    if(d.slave<0) {
+        perror(d.path.c_str());
+        return false;
+    }
+    termios tio;
+    tcgetattr(d.slave,&tio);
+    cfmakeraw(&tio);
+    cfsetispeed(&tio,B115200);
+    cfsetospeed(&tio,B115200);
+    tcsetattr(d.slave,TCSANOW,&tio);
+    if(link_dir!=nullptr) {
+        const std::string link = std::string(link_dir)+"/espmon"+std::to_string(d.index);
+        unlink(link.c_str());
+        if(0!=symlink(d.path.c_str(),link.c_str())) {
+            perror(link.c_str());
+            return false;
+        }
+        d.path = link;
+    }
+    return true;
+}
+static void activate(device& d, int64_t now) {
+    d.active = true;
+    // real displays aren't in step with each other
+    d.next_request_us = now+next_random()%request_period_us;
+    d.next_switch_us = switch_us>0?now+switch_us/2+next_random()%switch_us:INT64_MAX;
+    d.last_frame_us = now;
+}
+static void send_request(device& d, uint8_t cmd, int64_t now) {
+    uint8_t ba[espmon::request_size];
+    espmon::request{cmd,(uint8_t)d.screen_index}.encode(ba);
+    if(sizeof(ba)!=write(d.master,ba,sizeof(ba))) {
+        ++d.write_errors;
+        return;
+    }
+    ++d.requests;
+    d.outstanding[cmd].push_back(now);
+}
+static void on_frame(device& d, uint8_t cmd, const uint8_t* payload, int64_t now) {
+    d.last_frame_us = now;
+    std::deque<int64_t>& pending = d.outstanding[cmd];
+    if(d.screens+d.data==0 && pending.size()>1) {
+        // requests made before the host attached were flushed by it, so
+        // the first answer is to the latest one
+        d.unanswered+=pending.size()-1;
+        pending.erase(pending.begin(),pending.end()-1);
+    }
+    if(!pending.empty()) {
+        d.latency.add((now-pending.front())/1000.0);
+        pending.pop_front();
+    }
+    if(cmd==(uint8_t)espmon::command::screen) {
+        ++d.screens;
+        d.populated = true;
+        d.screen_index = espmon::screen_view(payload).index();
+    } else {
+        ++d.data;
+    }
+}
+static void read_device(device& d) {
+    uint8_t buf[1024];
+    while(true) {
+        const ssize_t len = read(d.master,buf,sizeof(buf));
+        if(len<=0) {
+            return;
+        }
+        const int64_t now = now_us();
+        d.bytes_in+=len;
+        if(!d.active) {
+            continue;
+        }
+        size_t offset = 0;
+        while(offset<(size_t)len) {
+            espmon::frame_reader::result result;
+            offset+=d.reader.feed(buf+offset,len-offset,&result);
+            if(result==espmon::frame_reader::result::frame) {
+                on_frame(d,d.reader.cmd(),d.reader.payload(),now);
+            } else if(result==espmon::frame_reader::result::junk) {
+                ++d.junk;
+            }
+        }
+    }
+}
+// the firmware's loop, once per due request
+static void tick(device& d, int64_t now) {
+    for(std::deque<int64_t>& pending : d.outstanding) {
+        while(!pending.empty() && now-pending.front()>unanswered_us) {
+            pending.pop_front();
+            ++d.unanswered;
+        }
+    }
+    if(d.populated && now-d.last_frame_us>=disconnect_us) {
+        // the "[ disconnected ]" screen, which goes back to asking for
+        // the screen
+        d.populated = false;
+        ++d.disconnects;
+    }
+    if(d.populated && now>=d.next_switch_us) {
+        ++d.switches;
+        ++d.screen_index;
+        send_request(d,(uint8_t)espmon::command::screen,now);
+        d.next_switch_us = now+switch_us/2+next_random()%switch_us;
+    }
+    if(now>=d.next_request_us) {
+        send_request(d,(uint8_t)(d.populated?espmon::command::data:espmon::command::screen),now);
+        d.next_request_us+=request_period_us;
+        if(d.next_request_us<=now) {
+            // we fell behind. don't burst to catch up, the firmware doesn't
+            d.next_request_us = now+request_period_us;
+        }
+    }
+}
+
+struct summary {
+    int active = 0;
+    uint64_t requests = 0;
+    uint64_t responses = 0;
+    uint64_t unanswered = 0;
+    uint64_t disconnects = 0;
+    uint64_t bytes = 0;
+    std::vector<float> latency;
+    double jitter_ms = 0;
+};
+static void print_latency(const char* prefix, std::vector<float>& values) {
+    if(values.empty()) {
+        printf("%s,latency_count=0",prefix);
+        return;
+    }
+    std::sort(values.begin(),values.end());
+    const auto at = [&values](double p) {
+        return values[std::min(values.size()-1,(size_t)(p*(values.size()-1)+.5))];
+    };
+    printf("%s,latency_count=%u,p50_ms=%.2f,p95_ms=%.2f,p99_ms=%.2f,max_ms=%.2f",prefix,
+        (unsigned)values.size(),at(.5),at(.95),at(.99),values.back());
+}
+// a line for everything since the last report
+static void report(const char* what, double seconds, summary& totals) {
+    summary s;
+    for(auto& dp : devices) {
+        device& d = *dp;
+        if(!d.active) {
+            continue;
+        }
+        ++s.active;
+        s.latency.insert(s.latency.end(),d.latency.samples.begin()+d.report_first,d.latency.samples.end());
+        d.report_first = d.latency.samples.size();
+        s.jitter_ms+=d.latency.jitter_ms;
+    }
+    for(auto& dp : devices) {
+        const device& d = *dp;
+        s.requests+=d.requests;
+        s.responses+=d.screens+d.data;
+        s.unanswered+=d.unanswered;
+        s.disconnects+=d.disconnects;
+        s.bytes+=d.bytes_in;
+    }
+    char prefix[64];
+    snprintf(prefix,sizeof(prefix),"farm,report=%s,devices=%d",what,s.active);
+    print_latency(prefix,s.latency);
+    printf(",jitter_ms=%.2f,responses_per_s=%.1f,bytes_per_s=%.0f,unanswered=%llu,disconnects=%llu\n",
+        s.active==0?0.0:s.jitter_ms/s.active,
+        seconds>0?(s.responses-totals.responses)/seconds:0.0,
+        seconds>0?(s.bytes-totals.bytes)/seconds:0.0,
+        (unsigned long long)(s.unanswered-totals.unanswered),
+        (unsigned long long)(s.disconnects-totals.disconnects));
+    fflush(stdout);
+    totals = s;
+}
+static void report_devices(double seconds) {
+    for(auto& dp : devices) {
+        device& d = *dp;
+        if(!d.active) {
+            continue;
+        }
+        char prefix[128];
+        snprintf(prefix,sizeof(prefix),"farm,device=%d,path=%s",d.index,d.path.c_str());
+        std::vector<float> values = d.latency.samples;
+        print_latency(prefix,values);
+        printf(",jitter_ms=%.2f,requests=%llu,screens=%llu,data=%llu,unanswered=%llu,disconnects=%llu,"
+            "switches=%llu,junk=%llu,bytes_per_s=%.0f\n",d.latency.jitter_ms,
+            (unsigned long long)d.requests,(unsigned long long)d.screens,(unsigned long long)d.data,
+            (unsigned long long)d.unanswered,(unsigned long long)d.disconnects,(unsigned long long)d.switches,
+            (unsigned long long)d.junk,seconds>0?d.bytes_in/seconds:0.0);
+    }
+}
+
+static int usage(const char* name) {
+    fprintf(stderr,"usage: %s [--devices N] [--start N] [--step N] [--step-secs S] [--duration S]\n"
+        "          [--switch-secs S] [--list FILE] [--link-dir DIR] [--per-device] [--seed N]\n",name);
+    return 2;
+}
+int main(int argc, char** argv) {
+    int count = 8;
+    int start = -1;
+    int step = 0;
+    double step_secs = 10;
+    double duration = 0;
+    bool per_device = false;
+    const char* list_path = nullptr;
+    const char* link_dir = nullptr;
+    for(int i = 1;i<argc;++i) {
+        if(0==strcmp(argv[i],"--devices") && i+1<argc) {
+            count = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--start") && i+1<argc) {
+            start = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--step") && i+1<argc) {
+            step = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--step-secs") && i+1<argc) {
+            step_secs = atof(argv[++i]);
+        } else if(0==strcmp(argv[i],"--duration") && i+1<argc) {
+            duration = atof(argv[++i]);
+        } else if(0==strcmp(argv[i],"--switch-secs") && i+1<argc) {
+            switch_us = (int64_t)(atof(argv[++i])*1e6);
+        } else if(0==strcmp(argv[i],"--list") && i+1<argc) {
+            list_path = argv[++i];
+        } else if(0==strcmp(argv[i],"--link-dir") && i+1<argc) {
+            link_dir = argv[++i];
+        } else if(0==strcmp(argv[i],"--per-device")) {
+            per_device = true;
+        } else if(0==strcmp(argv[i],"--seed") && i+1<argc) {
+            rng_state = (uint32_t)strtoul(argv[++i],nullptr,10);
+            if(rng_state==0) {
+                rng_state = 1;
+            }
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if(count<1 || step_secs<=0) {
+        return usage(argv[0]);
+    }
+    if(start<0 || start>count) {
+        start = step>0?std::min(step,count):count;
+    }
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    FILE* list = list_path==nullptr?nullptr:fopen(list_path,"w");
+    for(int i = 0;i<count;++i) {
+        std::unique_ptr<device> d(new device());
+        d->index = i;
+        if(!create_pty(*d,link_dir)) {
+            return 1;
+        }
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = d.get();
+        epoll_ctl(epoll_fd,EPOLL_CTL_ADD,d->master,&ev);
+        printf("%s\n",d->path.c_str());
+        if(list!=nullptr) {
+            fprintf(list,"%s\n",d->path.c_str());
+        }
+        devices.push_back(std::move(d));
+    }
+    if(list!=nullptr) {
+        fclose(list);
+    }
+    fflush(stdout);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask,SIGINT);
+    sigaddset(&mask,SIGTERM);
+    sigprocmask(SIG_BLOCK,&mask,nullptr);
+    const int signal_fd = signalfd(-1,&mask,SFD_CLOEXEC);
+    static int signal_tag;
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &signal_tag;
+    epoll_ctl(epoll_fd,EPOLL_CTL_ADD,signal_fd,&ev);
+
+    const int64_t begin = now_us();
+    int active = 0;
+    for(;active<start;++active) {
+        activate(*devices[active],begin);
+    }
+    const int64_t step_us = (int64_t)(step_secs*1e6);
+    const int64_t end = duration>0?begin+(int64_t)(duration*1e6):INT64_MAX;
+    int64_t next_step = begin+step_us;
+    int64_t last_report = begin;
+    summary totals;
+    bool running = true;
+    while(running) {
+        int64_t now = now_us();
+        // the soonest any display is due
+        int64_t due = std::min(end,next_step);
+        for(int i = 0;i<active;++i) {
+            due = std::min(due,devices[i]->next_request_us);
+        }
+        const int timeout = due<=now?0:(int)((due-now+999)/1000);
+        epoll_event events[64];
+        const int n = epoll_wait(epoll_fd,events,64,timeout);
+        for(int i = 0;i<n;++i) {
+            if(events[i].data.ptr==&signal_tag) {
+                running = false;
+            } else {
+                read_device(*(device*)events[i].data.ptr);
+            }
+        }
+        now = now_us();
+        for(int i = 0;i<active;++i) {
+            device& d = *devices[i];
+            if(now>=d.next_request_us) {
+                tick(d,now);
+            }
+        }
+        if(now>=next_step) {
+            // a line per step: the load it ran at and how the host did
+            report("step",(now-last_report)/1e6,totals);
+            last_report = now;
+            next_step+=step_us;
+            if(step>0 && active<count) {
+                const int target = std::min(count,active+step);
+                for(;active<target;++active) {
+                    activate(*devices[active],now);
+                }
+            }
+        }
+        if(now>=end) {
+            running = false;
+        }
+    }
+    const int64_t finish = now_us();
+    report("final",(finish-last_report)/1e6,totals);
+    if(per_device) {
+        report_devices((finish-begin)/1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,517 @@
+// symbolizes the firmware's sampling profiler (see profiler.hpp) against
+// its ELF and prints flat and call graph profiles.
+//
+// given a serial port or pty it starts the profiler, waits, then stops it
+// and reads the counts back. with nothing answering the device it sits on
+// its disconnected screen, so for a real workload run espmon_agent
+// --profile instead and point this at the .profile file it writes, which
+// holds one or more dumps back to back. the dumps are summed.
+//
+// functions come from the ELF's symbol table, so no toolchain is needed.
+// with --addr2line set to the toolchain's addr2line (say
+// xtensa-esp32s3-elf-addr2line) the hottest addresses get file:line too.
+//
+// it prints a line per core with the sampling counters and the overhead:
+//   profile,core=N,rate_hz=N,depth=N,samples=N,dropped=N,elapsed_s=N,
+//           isr_avg_us=N,isr_max_us=N,overhead_pct=N
+// the overhead is the time spent in the sampling interrupt's handler over
+// the time spent sampling. interrupt entry and exit aren't counted, so on
+// the device it's a floor.
+//
+// usage: espmon_profile --elf FILE [--addr2line TOOL] [--top N]
+//                       [--seconds N] [--rate HZ] [--depth N] [--baud N]
+//                       [--save FILE] DEVICE
+//        espmon_profile --elf FILE [--addr2line TOOL] [--top N] DUMP
+#include <cxxabi.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "espmon_protocol.hpp"
+
+struct core_counters {
+    uint16_t rate_hz = 0;
+    uint8_t depth = 0;
+    uint64_t samples = 0;
+    uint64_t dropped = 0;
+    uint64_t elapsed_us = 0;
+    uint64_t isr_us = 0;
+    uint32_t isr_max_ns = 0;
+};
+struct symbol {
+    uint32_t addr;
+    uint32_t size;
+    // a typed function, rather than a bare label like a ROM entry point
+    bool function;
+    std::string name;
+};
+
+static std::map<uint8_t,core_counters> counters;
+// each distinct stack and how often it was sampled, all cores together
+static std::map<std::vector<uint32_t>,uint64_t> stacks;
+static std::vector<symbol> symbols;
+
+static int64_t now_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+static speed_t to_speed(int baud) {
+    switch(baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B115200;
+    }
+}
+static std::string demangle(const char* name) {
+    int status = 0;
+    char* result = abi::__cxa_demangle(name,nullptr,nullptr,&status);
+    if(result==nullptr) {
+        return name;
+    }
+    std::string s(result);
+    free(result);
+    return s;
+}
+// pulls the functions and labels out of an ELF's symbol table
+template<typename Ehdr, typename Shdr, typename Sym>
+static bool load_symbols(const std::vector<uint8_t>& elf) {
+    if(elf.size()<sizeof(Ehdr)) {
+        return false;
+    }
+    const Ehdr* eh = (const Ehdr*)elf.data();
+    if(eh->e_shoff==0 || eh->e_shoff+(uint64_t)eh->e_shnum*sizeof(Shdr)>elf.size()) {
+        return false;
+    }
+    const Shdr* sections = (const Shdr*)(elf.data()+eh->e_shoff);
+    for(size_t i = 0;i<eh->e_shnum;++i) {
+        const Shdr& sh = sections[i];
+        if(sh.sh_type!=SHT_SYMTAB || sh.sh_link>=eh->e_shnum) {
+            continue;
+        }
+        const Shdr& strings = sections[sh.sh_link];
+        if(sh.sh_offset+sh.sh_size>elf.size() || strings.sh_offset+strings.sh_size>elf.size()) {
+            return false;
+        }
+        const Sym* syms = (const Sym*)(elf.data()+sh.sh_offset);
+        const size_t count = sh.sh_size/sizeof(Sym);
+        const char* names = (const char*)elf.data()+strings.sh_offset;
+        for(size_t j = 0;j<count;++j) {
+            const Sym& s = syms[j];
+            const unsigned type = s.st_info&0xF;
+            if(s.st_name>=strings.sh_size || s.st_value==0 || (type!=STT_FUNC && type!=STT_NOTYPE)) {
+                continue;
+            }
+            const char* name = names+s.st_name;
+            if(*name=='\0' || *name=='$' || *name=='.') {
+                continue;
+            }
+            symbols.push_back(symbol{(uint32_t)s.st_value,(uint32_t)s.st_size,type==STT_FUNC,demangle(name)});
+        }
+    }
+    std::sort(symbols.begin(),symbols.end(),[](const symbol& a, const symbol& b) {
+        return a.addr<b.addr || (a.addr==b.addr && a.function>b.function);
+    });
+    return true;
+}
+static bool load_elf(const char* path) {
+    FILE* f = fopen(path,"rb");
+    if(f==nullptr) {
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        return false;
+    }
+    std::vector<uint8_t> elf;
+    uint8_t buf[65536];
+    size_t len;
+    while((len = fread(buf,1,sizeof(buf),f))>0) {
+        elf.insert(elf.end(),buf,buf+len);
+    }
+    fclose(f);
+    bool ok = false;
+    if(elf.size()>=EI_NIDENT && 0==memcmp(elf.data(),ELFMAG,SELFMAG) && elf[EI_DATA]==ELFDATA2LSB) {
+        ok = elf[EI_CLASS]==ELFCLASS32?load_symbols<Elf32_Ehdr,Elf32_Shdr,Elf32_Sym>(elf):
+            load_symbols<Elf64_Ehdr,Elf64_Shdr,Elf64_Sym>(elf);
+    }
+    if(!ok || symbols.empty()) {
+        fprintf(stderr,"%s: no symbols (a little endian ELF with a symbol table is needed)\n",path);
+        return false;
+    }
+    return true;
+}
+// the function containing pc. failing that, the closest label under it,
+// which is how ROM code shows up
+static std::string symbolize(uint32_t pc) {
+    auto it = std::upper_bound(symbols.begin(),symbols.end(),pc,[](uint32_t value, const symbol& s) {
+        return value<s.addr;
+    });
+    const symbol* label = nullptr;
+    while(it!=symbols.begin()) {
+        --it;
+        if(it->function && pc<it->addr+it->size) {
+            return it->name;
+        }
+        if(label==nullptr && !it->function && pc-it->addr<0x1000) {
+            label = &*it;
+        }
+        // nothing this far back could contain it
+        if(pc-it->addr>=0x100000) {
+            break;
+        }
+    }
+    char name[32];
+    if(label!=nullptr) {
+        snprintf(name,sizeof(name),"+0x%x",(unsigned)(pc-label->addr));
+        return label->name+name;
+    }
+    snprintf(name,sizeof(name),"0x%08x",(unsigned)pc);
+    return name;
+}
+// reads back to back report frames, summing the profile chunks
+static bool parse(const uint8_t* data, size_t size) {
+    size_t pos = 0;
+    while(pos+espmon::request_size<=size) {
+        const espmon::request req = espmon::request::decode(data+pos);
+        pos+=espmon::request_size;
+        const size_t len = espmon::request_payload_size(req);
+        if(pos+len>size) {
+            break;
+        }
+        const uint8_t* payload = data+pos;
+        pos+=len;
+        if(req.cmd!=(uint8_t)espmon::command::profile) {
+            continue;
+        }
+        const espmon::profile_chunk_view v(payload,len);
+        if(!v.valid()) {
+            fprintf(stderr,"bad profile chunk\n");
+            return false;
+        }
+        if(v.first()) {
+            core_counters& c = counters[v.core()];
+            c.rate_hz = v.rate_hz();
+            c.depth = v.depth();
+            c.samples+=v.samples();
+            c.dropped+=v.dropped();
+            c.elapsed_us+=v.elapsed_us();
+            c.isr_us+=v.isr_us();
+            c.isr_max_ns = std::max(c.isr_max_ns,v.isr_max_ns());
+        }
+        for(size_t i = 0;i<v.count();++i) {
+            std::vector<uint32_t> pcs;
+            for(size_t f = 0;f<v.depth() && v.entry_pc(i,f)!=0;++f) {
+                pcs.push_back(v.entry_pc(i,f));
+            }
+            if(!pcs.empty()) {
+                stacks[pcs]+=v.entry_count(i);
+            }
+        }
+    }
+    return true;
+}
+static bool read_file(const char* path, std::vector<uint8_t>* out) {
+    FILE* f = fopen(path,"rb");
+    if(f==nullptr) {
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t len;
+    while((len = fread(buf,1,sizeof(buf),f))>0) {
+        out->insert(out->end(),buf,buf+len);
+    }
+    fclose(f);
+    return true;
+}
+// sends a profile query and reads its dump back, skipping anything else
+// the device sends. out gets the chunks as they came off the wire
+static bool query_device(int fd, const char* path, uint8_t flags, uint8_t depth, uint16_t rate_hz, std::vector<uint8_t>* out) {
+    uint8_t query[1+espmon::profile_query_size];
+    query[0] = (uint8_t)espmon::command::profile;
+    espmon::profile_query_writer w(query+1);
+    w.flags(flags);
+    w.depth(depth);
+    w.rate_hz(rate_hz);
+    if(write(fd,query,sizeof(query))!=(ssize_t)sizeof(query)) {
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        return false;
+    }
+    std::vector<uint8_t> stream;
+    size_t pos = 0;
+    int64_t give_up = now_us()+3*1000*1000;
+    while(now_us()<give_up) {
+        pollfd pfd = {fd,POLLIN,0};
+        if(poll(&pfd,1,100)<=0) {
+            continue;
+        }
+        uint8_t buf[512];
+        const ssize_t len = read(fd,buf,sizeof(buf));
+        if(len<=0) {
+            if(len<0 && (errno==EAGAIN || errno==EINTR)) {
+                continue;
+            }
+            break;
+        }
+        stream.insert(stream.end(),buf,buf+len);
+        give_up = now_us()+3*1000*1000;
+        while(pos+espmon::request_size<=stream.size()) {
+            const uint8_t* frame = stream.data()+pos;
+            const espmon::request req = espmon::request::decode(frame);
+            const size_t size = espmon::request_payload_size(req);
+            if(pos+espmon::request_size+size>stream.size()) {
+                break;
+            }
+            if(req.cmd==(uint8_t)espmon::command::profile) {
+                const uint8_t* payload = frame+espmon::request_size;
+                out->insert(out->end(),frame,payload+size);
+                const espmon::profile_chunk_view v(payload,size);
+                if(v.valid() && v.last()) {
+                    return true;
+                }
+            }
+            pos+=espmon::request_size+size;
+        }
+    }
+    fprintf(stderr,"%s: the profile dump didn't finish\n",path);
+    return false;
+}
+// runs the profiler for a while and reads back what it counted
+static bool profile_device(const char* path, int baud, int seconds, uint8_t depth, uint16_t rate_hz, std::vector<uint8_t>* out) {
+    const int fd = open(path,O_RDWR|O_NOCTTY|O_CLOEXEC);
+    if(fd<0) {
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        return false;
+    }
+    termios tio;
+    if(0==tcgetattr(fd,&tio)) {
+        cfmakeraw(&tio);
+        tio.c_cflag|=CLOCAL|CREAD;
+        cfsetispeed(&tio,to_speed(baud));
+        cfsetospeed(&tio,to_speed(baud));
+        tcsetattr(fd,TCSANOW,&tio);
+        tcflush(fd,TCIOFLUSH);
+    }
+    // whatever it had counted before is thrown away
+    std::vector<uint8_t> stale;
+    bool ok = query_device(fd,path,espmon::profile_run|espmon::profile_clear,depth,rate_hz,&stale);
+    if(ok) {
+        fprintf(stderr,"%s: sampling for %d seconds\n",path,seconds);
+        const int64_t end = now_us()+(int64_t)seconds*1000000;
+        while(now_us()<end) {
+            // keep the device's requests from piling up
+            uint8_t buf[256];
+            pollfd pfd = {fd,POLLIN,0};
+            if(poll(&pfd,1,100)>0 && read(fd,buf,sizeof(buf))<0 && errno!=EAGAIN && errno!=EINTR) {
+                break;
+            }
+        }
+        ok = query_device(fd,path,0,0,0,out);
+    }
+    close(fd);
+    return ok;
+}
+struct edge_count {
+    std::string name;
+    uint64_t count;
+};
+static std::vector<edge_count> sorted(const std::map<std::string,uint64_t>& counts) {
+    std::vector<edge_count> result;
+    for(const auto& entry : counts) {
+        result.push_back(edge_count{entry.first,entry.second});
+    }
+    std::sort(result.begin(),result.end(),[](const edge_count& a, const edge_count& b) {
+        return a.count>b.count || (a.count==b.count && a.name<b.name);
+    });
+    return result;
+}
+static void print_lines(const char* addr2line, const char* elf, const std::map<uint32_t,uint64_t>& leaves, uint64_t total, size_t top) {
+    std::vector<std::pair<uint32_t,uint64_t>> hot(leaves.begin(),leaves.end());
+    std::sort(hot.begin(),hot.end(),[](const std::pair<uint32_t,uint64_t>& a, const std::pair<uint32_t,uint64_t>& b) {
+        return a.second>b.second;
+    });
+    if(hot.size()>top) {
+        hot.resize(top);
+    }
+    std::string command = std::string(addr2line)+" -e '"+elf+"'";
+    for(const auto& h : hot) {
+        char addr[16];
+        snprintf(addr,sizeof(addr)," 0x%x",(unsigned)h.first);
+        command+=addr;
+    }
+    FILE* p = popen(command.c_str(),"r");
+    if(p==nullptr) {
+        fprintf(stderr,"%s: %s\n",addr2line,strerror(errno));
+        return;
+    }
+    printf("\nhot addresses\n  samples      %%  address     line  function\n");
+    char line[1024];
+    for(const auto& h : hot) {
+        if(fgets(line,sizeof(line),p)==nullptr) {
+            strcpy(line,"??");
+        }
+        line[strcspn(line,"\r\n")] = '\0';
+        printf("%9llu %5.1f%%  0x%08x  %s  %s\n",(unsigned long long)h.second,100.0*h.second/total,(unsigned)h.first,line,symbolize(h.first).c_str());
+    }
+    pclose(p);
+}
+static void print_profile(const char* elf, const char* addr2line, size_t top) {
+    uint8_t depth = 1;
+    for(const auto& entry : counters) {
+        const core_counters& c = entry.second;
+        depth = std::max(depth,c.depth);
+        printf("profile,core=%u,rate_hz=%u,depth=%u,samples=%llu,dropped=%llu,elapsed_s=%.2f,isr_avg_us=%.2f,isr_max_us=%.2f,overhead_pct=%.3f\n",
+            entry.first,c.rate_hz,c.depth,(unsigned long long)c.samples,(unsigned long long)c.dropped,c.elapsed_us/1e6,
+            c.samples==0?0.0:(double)c.isr_us/c.samples,c.isr_max_ns/1e3,c.elapsed_us==0?0.0:100.0*c.isr_us/c.elapsed_us);
+    }
+    uint64_t total = 0;
+    std::map<std::string,uint64_t> self, inclusive;
+    std::map<std::string,std::map<std::string,uint64_t>> callers, callees;
+    std::map<uint32_t,uint64_t> leaves;
+    for(const auto& entry : stacks) {
+        const std::vector<uint32_t>& pcs = entry.first;
+        const uint64_t count = entry.second;
+        total+=count;
+        leaves[pcs[0]]+=count;
+        std::vector<std::string> names;
+        for(uint32_t pc : pcs) {
+            names.push_back(symbolize(pc));
+        }
+        self[names[0]]+=count;
+        // recursion only counts once toward a function's total
+        std::set<std::string> seen(names.begin(),names.end());
+        for(const std::string& name : seen) {
+            inclusive[name]+=count;
+        }
+        for(size_t i = 0;i+1<names.size();++i) {
+            callers[names[i]][names[i+1]]+=count;
+            callees[names[i+1]][names[i]]+=count;
+        }
+    }
+    if(total==0) {
+        printf("no samples\n");
+        return;
+    }
+    printf("\nflat profile, %llu samples\n",(unsigned long long)total);
+    printf(depth>1?"    self%%      self   total%%     total  function\n":"    self%%      self  function\n");
+    const std::vector<edge_count> flat = sorted(self);
+    for(size_t i = 0;i<flat.size() && i<top;++i) {
+        const edge_count& f = flat[i];
+        if(depth>1) {
+            const uint64_t t = inclusive[f.name];
+            printf("  %6.2f%% %9llu  %6.2f%% %9llu  %s\n",100.0*f.count/total,(unsigned long long)f.count,
+                100.0*t/total,(unsigned long long)t,f.name.c_str());
+        } else {
+            printf("  %6.2f%% %9llu  %s\n",100.0*f.count/total,(unsigned long long)f.count,f.name.c_str());
+        }
+    }
+    if(depth>1) {
+        // only as deep as the samples went, so callers of callers thin out
+        printf("\ncall graph, by total. <- callers and -> callees, as a share of the function's samples\n");
+        const std::vector<edge_count> graph = sorted(inclusive);
+        for(size_t i = 0;i<graph.size() && i<top;++i) {
+            const edge_count& f = graph[i];
+            printf("\n  %6.2f%% total  %6.2f%% self  %s\n",100.0*f.count/total,100.0*self[f.name]/total,f.name.c_str());
+            for(const edge_count& e : sorted(callers[f.name])) {
+                printf("            <- %6.2f%%  %s\n",100.0*e.count/f.count,e.name.c_str());
+            }
+            for(const edge_count& e : sorted(callees[f.name])) {
+                printf("            -> %6.2f%%  %s\n",100.0*e.count/f.count,e.name.c_str());
+            }
+        }
+    }
+    if(addr2line!=nullptr) {
+        print_lines(addr2line,elf,leaves,total,top);
+    }
+}
+static int usage(const char* name) {
+    fprintf(stderr,"usage: %s --elf FILE [--addr2line TOOL] [--top N] [--seconds N] [--rate HZ] [--depth N] [--baud N] [--save FILE] DEVICE\n"
+        "       %s --elf FILE [--addr2line TOOL] [--top N] DUMP\n",name,name);
+    return 2;
+}
+int main(int argc, char** argv) {
+    const char* elf = nullptr;
+    const char* addr2line = nullptr;
+    const char* save = nullptr;
+    const char* input = nullptr;
+    size_t top = 30;
+    int seconds = 10;
+    int rate_hz = 0;
+    int depth = 0;
+    int baud = 115200;
+    for(int i = 1;i<argc;++i) {
+        if(0==strcmp(argv[i],"--elf") && i+1<argc) {
+            elf = argv[++i];
+        } else if(0==strcmp(argv[i],"--addr2line") && i+1<argc) {
+            addr2line = argv[++i];
+        } else if(0==strcmp(argv[i],"--top") && i+1<argc) {
+            top = (size_t)std::max(1,atoi(argv[++i]));
+        } else if(0==strcmp(argv[i],"--seconds") && i+1<argc) {
+            seconds = std::max(1,atoi(argv[++i]));
+        } else if(0==strcmp(argv[i],"--rate") && i+1<argc) {
+            rate_hz = std::max(0,std::min(65535,atoi(argv[++i])));
+        } else if(0==strcmp(argv[i],"--depth") && i+1<argc) {
+            depth = std::max(0,std::min((int)espmon::profile_chunk_view::max_depth,atoi(argv[++i])));
+        } else if(0==strcmp(argv[i],"--baud") && i+1<argc) {
+            baud = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--save") && i+1<argc) {
+            save = argv[++i];
+        } else if(argv[i][0]=='-' || input!=nullptr) {
+            return usage(argv[0]);
+        } else {
+            input = argv[i];
+        }
+    }
+    if(elf==nullptr || input==nullptr) {
+        return usage(argv[0]);
+    }
+    if(!load_elf(elf)) {
+        return 1;
+    }
+    struct stat st;
+    if(0!=stat(input,&st)) {
+        fprintf(stderr,"%s: %s\n",input,strerror(errno));
+        return 1;
+    }
+    std::vector<uint8_t> dump;
+    if(S_ISCHR(st.st_mode)) {
+        if(!profile_device(input,baud,seconds,(uint8_t)depth,(uint16_t)rate_hz,&dump)) {
+            return 1;
+        }
+        if(save!=nullptr) {
+            FILE* f = fopen(save,"wb");
+            if(f==nullptr || dump.size()!=fwrite(dump.data(),1,dump.size(),f)) {
+                fprintf(stderr,"%s: %s\n",save,strerror(errno));
+            }
+            if(f!=nullptr) {
+                fclose(f);
+            }
+        }
+    } else if(!read_file(input,&dump)) {
+        return 1;
+    }
+    if(!parse(dump.data(),dump.size())) {
+        return 1;
+    }
+    if(counters.empty()) {
+        fprintf(stderr,"%s: no profile in the dump. is the firmware built with PROFILER_SLOTS?\n",input);
+        return 1;
+    }
+    print_profile(elf,addr2line,top);
+    return 0;
+}
@@ -0,0 +1,460 @@
+// replays a session capture (see session_log.hpp, espmon_agent --record)
+// against a display, real or the simulator's pty, and reports how the
+// device kept up.
+//
+// by default the host's frames are sent on the capture's timeline, scaled
+// by --speed, whether or not the device asked for them, which is how a
+// faster host or a burst is reproduced. with --respond each request the
+// device makes is answered with the capture's next frame of that kind
+// instead, so the device sets the pace.
+//
+// the device loop requests every 100ms and renders whatever has arrived
+// in between, so what the host can see of rendering is that cadence
+// stretching. it reports:
+//   interval_ms    time between device requests
+//   stall_ms       how far each interval ran past the 100ms tick
+//   turnaround_ms  a frame written to the device's next request
+//   late           frames written more than --late-ms behind schedule
+//   dropped        frames the port wouldn't take
+//   disconnects    the device went back to asking for a screen after
+//                  getting data, which it does when it timed out
+//   silences       over a second without a request
+//   hangups        the port closed under us
+//
+// usage: espmon_replay [--speed N] [--respond] [--repeat N] [--baud N]
+//                      [--late-ms N] [--verbose] CAPTURE DEVICE
+//        espmon_replay --dump CAPTURE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "espmon_protocol.hpp"
+#include "session_log.hpp"
+
+struct frame {
+    uint64_t time_us;
+    uint8_t cmd;
+    uint8_t data[1+espmon::max_payload_size];
+    size_t size;
+};
+static std::vector<frame> frames;
+
+static int64_t now_us() {
+    return (int64_t)espmon::session_monotonic_us();
+}
+static speed_t to_speed(int baud) {
+    switch(baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B115200;
+    }
+}
+static const char* record_name(espmon::session_record type) {
+    switch(type) {
+        case espmon::session_record::host_frame: return "host_frame";
+        case espmon::session_record::device_request: return "device_request";
+        case espmon::session_record::host_junk: return "host_junk";
+        case espmon::session_record::device_junk: return "device_junk";
+        case espmon::session_record::connect: return "connect";
+        case espmon::session_record::disconnect: return "disconnect";
+        default: return "unknown";
+    }
+}
+static int dump(const char* path) {
+    espmon::session_reader reader;
+    if(!reader.open(path)) {
+        fprintf(stderr,"%s: not a capture\n",path);
+        return 1;
+    }
+    const time_t wall = (time_t)(reader.wall_us()/1000000);
+    char stamp[64];
+    strftime(stamp,sizeof(stamp),"%Y-%m-%d %H:%M:%S",localtime(&wall));
+    printf("# started %s, baud %u\n",stamp,(unsigned)reader.baud());
+    static espmon::session_entry e;
+    while(reader.next(&e)) {
+        printf("%10.3f %-14s",e.time_us/1000.0,record_name(e.type));
+        if(e.type==espmon::session_record::host_frame && e.cmd==(uint8_t)espmon::command::data &&
+                e.size==espmon::data_payload_size) {
+            const espmon::data_view v(e.data);
+            printf(" data %u %u %u %u",v.top_value1(),v.top_value2(),v.bottom_value1(),v.bottom_value2());
+        } else if(e.type==espmon::session_record::host_frame && e.cmd==(uint8_t)espmon::command::screen &&
+                e.size==espmon::screen_payload_size) {
+            const espmon::screen_view v(e.data);
+            char top[espmon::layout::label_size], bottom[espmon::layout::label_size];
+            v.top().label().copy(top);
+            v.bottom().label().copy(bottom);
+            printf(" screen %d \"%s\" \"%s\"",v.index(),top,bottom);
+        } else if(e.type==espmon::session_record::device_request && e.size>=1 && e.cmd<=(uint8_t)espmon::command::latency) {
+            static const char* names[] = {"screen","data","ping","data_ex","diagnostics","telemetry","trace","profile","latency"};
+            printf(" %s %u",names[e.cmd],e.data[0]);
+        } else if(e.type==espmon::session_record::connect || e.type==espmon::session_record::disconnect) {
+            printf(" %.*s",(int)e.size,(const char*)e.data);
+        } else {
+            printf(" cmd=%u size=%u",e.cmd,e.size);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+static bool load(const char* path) {
+    espmon::session_reader reader;
+    if(!reader.open(path)) {
+        fprintf(stderr,"%s: not a capture\n",path);
+        return false;
+    }
+    static espmon::session_entry e;
+    while(reader.next(&e)) {
+        if(e.type!=espmon::session_record::host_frame || e.size!=espmon::payload_size(e.cmd)) {
+            continue;
+        }
+        frame f;
+        f.time_us = e.time_us;
+        f.cmd = e.cmd;
+        f.data[0] = e.cmd;
+        memcpy(f.data+1,e.data,e.size);
+        f.size = 1+e.size;
+        if(f.cmd==(uint8_t)espmon::command::screen) {
+            // the agent answered pings, but the replay doesn't
+            f.data[1+espmon::layout::flags]&=~espmon::screen_pings;
+        }
+        frames.push_back(f);
+    }
+    if(frames.empty()) {
+        fprintf(stderr,"%s: no host frames\n",path);
+        return false;
+    }
+    return true;
+}
+
+static const char* device_path;
+static int baud_rate = 115200;
+static int fd = -1;
+static bool verbose = false;
+static struct {
+    std::vector<double> interval_ms;
+    std::vector<double> stall_ms;
+    std::vector<double> turnaround_ms;
+    uint64_t sent = 0;
+    uint64_t screens = 0;
+    uint64_t data = 0;
+    uint64_t late = 0;
+    uint64_t dropped = 0;
+    uint64_t requests = 0;
+    uint64_t junk = 0;
+    uint64_t disconnects = 0;
+    uint64_t silences = 0;
+    uint64_t hangups = 0;
+} stats;
+// request tracking
+static int64_t last_request_us = 0;
+static int64_t last_write_us = 0;
+static bool awaiting_turnaround = false;
+static bool populated = false;
+static uint8_t partial[espmon::request_size];
+static size_t partial_size = 0;
+// bytes of a diagnostics report still to skip
+static size_t report_left = 0;
+
+static bool open_device(int64_t wait_us) {
+    const int64_t give_up = now_us()+wait_us;
+    while(true) {
+        fd = open(device_path,O_RDWR|O_NOCTTY|O_NONBLOCK|O_CLOEXEC);
+        if(fd>=0) {
+            break;
+        }
+        if(now_us()>=give_up) {
+            fprintf(stderr,"%s: %s\n",device_path,strerror(errno));
+            return false;
+        }
+        usleep(50*1000);
+    }
+    termios tio;
+    if(0==tcgetattr(fd,&tio)) {
+        cfmakeraw(&tio);
+        tio.c_cflag|=CLOCAL|CREAD;
+        cfsetispeed(&tio,to_speed(baud_rate));
+        cfsetospeed(&tio,to_speed(baud_rate));
+        tcsetattr(fd,TCSANOW,&tio);
+        tcflush(fd,TCIOFLUSH);
+    }
+    partial_size = 0;
+    report_left = 0;
+    return true;
+}
+static void hangup() {
+    ++stats.hangups;
+    if(verbose) {
+        fprintf(stderr,"%s: hung up\n",device_path);
+    }
+    close(fd);
+    fd = -1;
+    open_device(5*1000*1000);
+    last_request_us = 0;
+    populated = false;
+}
+static bool write_frame(const uint8_t* data, size_t size) {
+    size_t done = 0;
+    const int64_t give_up = now_us()+100*1000;
+    while(done<size) {
+        const ssize_t written = write(fd,data+done,size-done);
+        if(written>0) {
+            done+=written;
+            continue;
+        }
+        if(written<0 && errno!=EAGAIN && errno!=EINTR) {
+            hangup();
+            return false;
+        }
+        // a started frame has to finish or the stream desyncs, so wait
+        // a little for room. an unstarted one is just dropped
+        if(done==0 || now_us()>=give_up) {
+            ++stats.dropped;
+            return false;
+        }
+        pollfd pfd = {fd,POLLOUT,0};
+        poll(&pfd,1,10);
+    }
+    ++stats.sent;
+    if(data[0]==(uint8_t)espmon::command::screen) {
+        ++stats.screens;
+    } else {
+        ++stats.data;
+    }
+    last_write_us = now_us();
+    awaiting_turnaround = true;
+    return true;
+}
+static void on_request(const espmon::request& req, int64_t at);
+// reads whatever the device sent. calls on_request for each request
+static void read_device() {
+    uint8_t buf[256];
+    while(fd>=0) {
+        const ssize_t len = read(fd,buf,sizeof(buf));
+        if(len<0) {
+            if(errno!=EAGAIN && errno!=EINTR) {
+                hangup();
+            }
+            return;
+        }
+        if(len==0) {
+            hangup();
+            return;
+        }
+        const int64_t at = now_us();
+        for(ssize_t i = 0;i<len;++i) {
+            if(report_left>0) {
+                --report_left;
+                continue;
+            }
+            partial[partial_size++] = buf[i];
+            if(partial_size==1 && 0==espmon::payload_size(partial[0])) {
+                // boot messages and the like
+                ++stats.junk;
+                partial_size = 0;
+                continue;
+            }
+            if(partial_size==espmon::request_size) {
+                partial_size = 0;
+                const espmon::request req = espmon::request::decode(partial);
+                report_left = espmon::request_payload_size(req);
+                on_request(req,at);
+            }
+        }
+    }
+}
+// waits until the deadline, handling requests as they come in
+static void pump_until(int64_t deadline) {
+    while(true) {
+        const int64_t now = now_us();
+        if(last_request_us!=0 && now-last_request_us>1000*1000) {
+            ++stats.silences;
+            if(verbose) {
+                fprintf(stderr,"silent for a second\n");
+            }
+            // don't count the same silence twice
+            last_request_us = 0;
+        }
+        if(now>=deadline) {
+            return;
+        }
+        if(fd<0 && !open_device(deadline-now)) {
+            return;
+        }
+        int64_t wait_ms = (deadline-now+999)/1000;
+        if(wait_ms>100) {
+            wait_ms = 100;
+        }
+        pollfd pfd = {fd,POLLIN,0};
+        const int result = poll(&pfd,1,(int)wait_ms);
+        if(result>0) {
+            if(pfd.revents&POLLIN) {
+                read_device();
+            } else if(pfd.revents&(POLLHUP|POLLERR)) {
+                hangup();
+            }
+        }
+    }
+}
+
+// --respond: the next frame of each kind, cycling through the capture
+static bool respond = false;
+static size_t next_screen = 0;
+static size_t next_data = 0;
+static bool next_frame(uint8_t cmd, size_t* cursor) {
+    for(size_t n = 0;n<frames.size();++n) {
+        const frame& f = frames[*cursor];
+        *cursor = (*cursor+1)%frames.size();
+        if(f.cmd==cmd) {
+            write_frame(f.data,f.size);
+            return true;
+        }
+    }
+    return false;
+}
+static void on_request(const espmon::request& req, int64_t at) {
+    // pings and reports aren't part of the 100ms cadence
+    if(req.cmd==(uint8_t)espmon::command::ping || req.cmd==(uint8_t)espmon::command::diagnostics ||
+            req.cmd==(uint8_t)espmon::command::telemetry || req.cmd==(uint8_t)espmon::command::trace ||
+            req.cmd==(uint8_t)espmon::command::profile || req.cmd==(uint8_t)espmon::command::latency) {
+        return;
+    }
+    ++stats.requests;
+    if(last_request_us!=0) {
+        const double interval = (at-last_request_us)/1000.0;
+        stats.interval_ms.push_back(interval);
+        stats.stall_ms.push_back(interval>100?interval-100:0);
+    }
+    last_request_us = at;
+    if(awaiting_turnaround) {
+        stats.turnaround_ms.push_back((at-last_write_us)/1000.0);
+        awaiting_turnaround = false;
+    }
+    if(req.cmd==(uint8_t)espmon::command::screen) {
+        if(populated) {
+            ++stats.disconnects;
+            if(verbose) {
+                fprintf(stderr,"device asked for a screen again\n");
+            }
+        }
+        populated = false;
+    } else {
+        populated = true;
+    }
+    if(respond) {
+        if(req.cmd==(uint8_t)espmon::command::screen) {
+            next_frame(req.cmd,&next_screen);
+        } else {
+            next_frame(req.cmd,&next_data);
+        }
+    }
+}
+
+static void print_distribution(const char* name, std::vector<double>& values) {
+    if(values.empty()) {
+        printf("replay,metric=%s,count=0\n",name);
+        return;
+    }
+    std::sort(values.begin(),values.end());
+    const auto at = [&values](double p) {
+        return values[std::min(values.size()-1,(size_t)(p*(values.size()-1)+.5))];
+    };
+    double sum = 0;
+    for(double v : values) {
+        sum+=v;
+    }
+    printf("replay,metric=%s,count=%u,mean=%.2f,p50=%.2f,p95=%.2f,p99=%.2f,max=%.2f\n",name,
+        (unsigned)values.size(),sum/values.size(),at(.5),at(.95),at(.99),values.back());
+}
+static int usage(const char* name) {
+    fprintf(stderr,"usage: %s [--speed N] [--respond] [--repeat N] [--baud N] [--late-ms N] [--verbose] CAPTURE DEVICE\n"
+        "       %s --dump CAPTURE\n",name,name);
+    return 2;
+}
+int main(int argc, char** argv) {
+    double speed = 1;
+    int repeat = 1;
+    int late_ms = 20;
+    const char* capture = nullptr;
+    for(int i = 1;i<argc;++i) {
+        if(0==strcmp(argv[i],"--dump") && i+1<argc) {
+            return dump(argv[i+1]);
+        } else if(0==strcmp(argv[i],"--speed") && i+1<argc) {
+            speed = atof(argv[++i]);
+            if(!(speed>0)) {
+                return usage(argv[0]);
+            }
+        } else if(0==strcmp(argv[i],"--respond")) {
+            respond = true;
+        } else if(0==strcmp(argv[i],"--repeat") && i+1<argc) {
+            repeat = std::max(1,atoi(argv[++i]));
+        } else if(0==strcmp(argv[i],"--baud") && i+1<argc) {
+            baud_rate = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--late-ms") && i+1<argc) {
+            late_ms = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--verbose")) {
+            verbose = true;
+        } else if(argv[i][0]=='-') {
+            return usage(argv[0]);
+        } else if(capture==nullptr) {
+            capture = argv[i];
+        } else if(device_path==nullptr) {
+            device_path = argv[i];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if(capture==nullptr || device_path==nullptr) {
+        return usage(argv[0]);
+    }
+    if(!load(capture) || !open_device(5*1000*1000)) {
+        return 1;
+    }
+    const int64_t start = now_us();
+    const uint64_t span_us = frames.back().time_us-frames.front().time_us;
+    if(respond) {
+        // the device drives, so run for as long as the capture did
+        pump_until(start+(int64_t)(span_us*repeat)+1000*1000);
+    } else {
+        for(int r = 0;r<repeat;++r) {
+            const int64_t base = start+(int64_t)(r*(span_us/speed+100*1000/speed));
+            for(const frame& f : frames) {
+                const int64_t due = base+(int64_t)((f.time_us-frames.front().time_us)/speed);
+                pump_until(due);
+                if(fd<0) {
+                    break;
+                }
+                if(now_us()-due>late_ms*1000) {
+                    ++stats.late;
+                }
+                write_frame(f.data,f.size);
+            }
+        }
+        // let the device catch up and ask again
+        pump_until(now_us()+1000*1000);
+    }
+    const double elapsed_ms = (now_us()-start)/1000.0;
+    printf("replay,mode=%s,speed=%g,frames=%u,sent=%llu,screens=%llu,data=%llu,late=%llu,dropped=%llu,"
+        "requests=%llu,junk=%llu,disconnects=%llu,silences=%llu,hangups=%llu,elapsed_ms=%.0f\n",
+        respond?"respond":"timeline",respond?1.0:speed,(unsigned)frames.size(),
+        (unsigned long long)stats.sent,(unsigned long long)stats.screens,(unsigned long long)stats.data,
+        (unsigned long long)stats.late,(unsigned long long)stats.dropped,(unsigned long long)stats.requests,
+        (unsigned long long)stats.junk,(unsigned long long)stats.disconnects,(unsigned long long)stats.silences,
+        (unsigned long long)stats.hangups,elapsed_ms);
+    print_distribution("interval_ms",stats.interval_ms);
+    print_distribution("stall_ms",stats.stall_ms);
+    print_distribution("turnaround_ms",stats.turnaround_ms);
+    return 0;
+}
@@ -0,0 +1,389 @@
+// pulls the trace rings off a display (see trace_ring.hpp) and turns them
+// into a Chrome trace, for chrome://tracing or ui.perfetto.dev.
+//
+// given a serial port or pty it asks for a dump and reads the chunks
+// back. given a file it reads a dump saved with --save or by
+// espmon_agent --trace, which is the chunks as they came off the wire, one
+// or more dumps back to back. don't point it at a port the agent has open.
+//
+// each core's events are unwrapped from its ring's sync point, then put on
+// the device's microsecond clock, so the cores line up. spans are B/E
+// events on a thread per core, except DMA transfers, which start on one
+// side of an interrupt and end on the other and are async events instead.
+// ends whose begin was overwritten are dropped.
+//
+// it also prints a line per kind of span:
+//   span,name=NAME,count=N,avg_us=N,max_us=N
+//
+// usage: espmon_trace [--baud N] [--keep] [--save FILE] [--out FILE] DEVICE
+//        espmon_trace [--out FILE] DUMP
+//   --keep   leave the events on the device after the dump
+//   --save   write the raw dump to FILE as well
+//   --out    where the trace goes (default trace.json)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "espmon_protocol.hpp"
+
+struct event {
+    double ts;
+    uint8_t core;
+    uint8_t kind;
+    uint8_t id;
+    uint16_t arg;
+};
+// one core's share of a dump, as it arrives
+struct ring {
+    uint32_t cpu_hz = 0;
+    uint32_t head = 0;
+    uint32_t sync_index = 0;
+    uint32_t sync_cycles = 0;
+    uint32_t sync_us = 0;
+    std::vector<espmon::trace_event> events;
+};
+
+static std::vector<event> events;
+static size_t dumps = 0;
+// device microseconds, unwrapped across dumps
+static bool have_base = false;
+static uint32_t last_sync_us = 0;
+static double last_sync_abs = 0;
+
+static int64_t now_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+static speed_t to_speed(int baud) {
+    switch(baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B115200;
+    }
+}
+static const char* point_name(uint8_t id) {
+    static const char* names[] = {"packet","frame","paint","flush","dma","input","nvs_commit"};
+    return id<sizeof(names)/sizeof(names[0])?names[id]:"unknown";
+}
+static const char* arg_name(uint8_t id) {
+    switch((espmon::trace_point)id) {
+        case espmon::trace_point::packet: return "cmd";
+        case espmon::trace_point::paint: return "control";
+        case espmon::trace_point::flush: return "pixels";
+        case espmon::trace_point::input: return "active";
+        default: return nullptr;
+    }
+}
+// puts a ring's events on the device clock
+static void unwrap(const ring& r, uint8_t core) {
+    if(r.events.empty() || r.cpu_hz==0) {
+        return;
+    }
+    const double cycles_per_us = r.cpu_hz/1e6;
+    if(!have_base) {
+        have_base = true;
+        last_sync_abs = 0;
+        last_sync_us = r.sync_us;
+    }
+    const double sync_abs = last_sync_abs+(int32_t)(r.sync_us-last_sync_us);
+    last_sync_abs = sync_abs;
+    last_sync_us = r.sync_us;
+    // the ring holds indices head-size through head-1
+    const uint32_t first = r.head-(uint32_t)r.events.size();
+    size_t anchor = 0;
+    if(r.sync_index-first<r.events.size()) {
+        anchor = r.sync_index-first;
+    }
+    // cycles from the sync point, walking out from the anchor both ways
+    // one signed step at a time so the counter can wrap in between
+    std::vector<int64_t> t(r.events.size());
+    t[anchor] = (int32_t)(r.events[anchor].cycles-r.sync_cycles);
+    for(size_t i = anchor+1;i<r.events.size();++i) {
+        t[i] = t[i-1]+(int32_t)(r.events[i].cycles-r.events[i-1].cycles);
+    }
+    for(size_t i = anchor;i>0;--i) {
+        t[i-1] = t[i]-(int32_t)(r.events[i].cycles-r.events[i-1].cycles);
+    }
+    for(size_t i = 0;i<r.events.size();++i) {
+        const espmon::trace_event& e = r.events[i];
+        events.push_back(event{sync_abs+t[i]/cycles_per_us,core,e.kind,e.id,e.arg});
+    }
+}
+// reads back to back report frames, keeping the trace chunks
+static bool parse(const uint8_t* data, size_t size) {
+    std::map<uint8_t,ring> rings;
+    size_t pos = 0;
+    while(pos+espmon::request_size<=size) {
+        const espmon::request req = espmon::request::decode(data+pos);
+        pos+=espmon::request_size;
+        const size_t len = espmon::request_payload_size(req);
+        if(pos+len>size) {
+            break;
+        }
+        const uint8_t* payload = data+pos;
+        pos+=len;
+        if(req.cmd!=(uint8_t)espmon::command::trace) {
+            continue;
+        }
+        const espmon::trace_chunk_view v(payload,len);
+        if(!v.valid()) {
+            fprintf(stderr,"bad trace chunk\n");
+            return false;
+        }
+        ring& r = rings[v.core()];
+        if(v.first()) {
+            r = ring();
+            r.cpu_hz = v.cpu_hz();
+            r.head = v.head();
+            r.sync_index = v.sync_index();
+            r.sync_cycles = v.sync_cycles();
+            r.sync_us = v.sync_us();
+        }
+        for(size_t i = 0;i<v.count();++i) {
+            r.events.push_back(v.event(i));
+        }
+        if(v.last()) {
+            for(auto& entry : rings) {
+                unwrap(entry.second,entry.first);
+            }
+            rings.clear();
+            ++dumps;
+        }
+    }
+    return true;
+}
+static bool read_file(const char* path, std::vector<uint8_t>* out) {
+    FILE* f = fopen(path,"rb");
+    if(f==nullptr) {
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t len;
+    while((len = fread(buf,1,sizeof(buf),f))>0) {
+        out->insert(out->end(),buf,buf+len);
+    }
+    fclose(f);
+    return true;
+}
+// asks the device for a dump and reads it back. anything else the device
+// sends in the meantime, like its screen requests, is skipped
+static bool read_device(const char* path, int baud, bool keep, std::vector<uint8_t>* out) {
+    const int fd = open(path,O_RDWR|O_NOCTTY|O_CLOEXEC);
+    if(fd<0) {
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        return false;
+    }
+    termios tio;
+    if(0==tcgetattr(fd,&tio)) {
+        cfmakeraw(&tio);
+        tio.c_cflag|=CLOCAL|CREAD;
+        cfsetispeed(&tio,to_speed(baud));
+        cfsetospeed(&tio,to_speed(baud));
+        tcsetattr(fd,TCSANOW,&tio);
+        tcflush(fd,TCIOFLUSH);
+    }
+    const uint8_t query[] = {(uint8_t)espmon::command::trace,(uint8_t)(keep?espmon::trace_keep:0)};
+    if(write(fd,query,sizeof(query))!=(ssize_t)sizeof(query)) {
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        close(fd);
+        return false;
+    }
+    std::vector<uint8_t> stream;
+    size_t pos = 0;
+    int64_t give_up = now_us()+3*1000*1000;
+    while(now_us()<give_up) {
+        pollfd pfd = {fd,POLLIN,0};
+        if(poll(&pfd,1,100)<=0) {
+            continue;
+        }
+        uint8_t buf[512];
+        const ssize_t len = read(fd,buf,sizeof(buf));
+        if(len<=0) {
+            if(len<0 && (errno==EAGAIN || errno==EINTR)) {
+                continue;
+            }
+            break;
+        }
+        stream.insert(stream.end(),buf,buf+len);
+        // keep going as long as chunks keep coming
+        give_up = now_us()+3*1000*1000;
+        while(pos+espmon::request_size<=stream.size()) {
+            const uint8_t* frame = stream.data()+pos;
+            const espmon::request req = espmon::request::decode(frame);
+            const size_t size = espmon::request_payload_size(req);
+            if(pos+espmon::request_size+size>stream.size()) {
+                break;
+            }
+            if(req.cmd==(uint8_t)espmon::command::trace) {
+                const uint8_t* payload = frame+espmon::request_size;
+                out->insert(out->end(),frame,payload+size);
+                const espmon::trace_chunk_view v(payload,size);
+                if(v.valid() && v.last()) {
+                    close(fd);
+                    return true;
+                }
+            }
+            pos+=espmon::request_size+size;
+        }
+    }
+    close(fd);
+    fprintf(stderr,"%s: the dump didn't finish\n",path);
+    return false;
+}
+struct span_stats {
+    size_t count = 0;
+    double total_us = 0;
+    double max_us = 0;
+};
+static bool write_trace(const char* path) {
+    std::stable_sort(events.begin(),events.end(),[](const event& a, const event& b) {
+        return a.ts<b.ts;
+    });
+    FILE* f = fopen(path,"w");
+    if(f==nullptr) {
+        fprintf(stderr,"%s: %s\n",path,strerror(errno));
+        return false;
+    }
+    const double base = events.empty()?0:events.front().ts;
+    fprintf(f,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f,"{\"ph\":\"M\",\"pid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"espmon\"}}");
+    uint8_t cores = 0;
+    for(const event& e : events) {
+        cores = std::max(cores,(uint8_t)(e.core+1));
+    }
+    for(uint8_t c = 0;c<cores;++c) {
+        fprintf(f,",\n{\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"core %u\"}}",c,c);
+    }
+    // begins still open, per core and point
+    std::map<std::pair<uint8_t,uint8_t>,std::vector<double>> open;
+    // DMA transfers finish in the order they started
+    std::deque<std::pair<size_t,double>> dma;
+    size_t dma_id = 0;
+    size_t orphans = 0;
+    std::map<uint8_t,span_stats> spans;
+    for(const event& e : events) {
+        const double ts = e.ts-base;
+        const char* name = point_name(e.id);
+        const char* arg = arg_name(e.id);
+        char args[64] = "";
+        if(arg!=nullptr) {
+            snprintf(args,sizeof(args),",\"args\":{\"%s\":%u}",arg,e.arg);
+        }
+        if(e.id==(uint8_t)espmon::trace_point::dma && e.kind!=(uint8_t)espmon::trace_kind::instant) {
+            if(e.kind==(uint8_t)espmon::trace_kind::begin) {
+                dma.push_back({++dma_id,ts});
+                fprintf(f,",\n{\"ph\":\"b\",\"cat\":\"dma\",\"id\":%zu,\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"}",dma_id,e.core,ts,name);
+            } else if(dma.empty()) {
+                ++orphans;
+            } else {
+                span_stats& s = spans[e.id];
+                ++s.count;
+                s.total_us+=ts-dma.front().second;
+                s.max_us = std::max(s.max_us,ts-dma.front().second);
+                fprintf(f,",\n{\"ph\":\"e\",\"cat\":\"dma\",\"id\":%zu,\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"}",dma.front().first,e.core,ts,name);
+                dma.pop_front();
+            }
+            continue;
+        }
+        std::vector<double>& stack = open[{e.core,e.id}];
+        if(e.kind==(uint8_t)espmon::trace_kind::begin) {
+            stack.push_back(ts);
+            fprintf(f,",\n{\"ph\":\"B\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"%s}",e.core,ts,name,args);
+        } else if(e.kind==(uint8_t)espmon::trace_kind::end) {
+            if(stack.empty()) {
+                ++orphans;
+                continue;
+            }
+            span_stats& s = spans[e.id];
+            ++s.count;
+            s.total_us+=ts-stack.back();
+            s.max_us = std::max(s.max_us,ts-stack.back());
+            stack.pop_back();
+            fprintf(f,",\n{\"ph\":\"E\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"%s}",e.core,ts,name,args);
+        } else {
+            fprintf(f,",\n{\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"%s}",e.core,ts,name,args);
+        }
+    }
+    fprintf(f,"\n]}\n");
+    fclose(f);
+    for(const auto& entry : spans) {
+        const span_stats& s = entry.second;
+        printf("span,name=%s,count=%zu,avg_us=%.1f,max_us=%.1f\n",point_name(entry.first),s.count,s.total_us/s.count,s.max_us);
+    }
+    fprintf(stderr,"%s: %zu events from %zu dump(s) on %u core(s), %.1f ms, %zu unmatched ends dropped\n",path,events.size(),dumps,cores,
+        events.empty()?0.0:(events.back().ts-base)/1000.0,orphans);
+    return true;
+}
+static int usage(const char* name) {
+    fprintf(stderr,"usage: %s [--baud N] [--keep] [--save FILE] [--out FILE] DEVICE\n       %s [--out FILE] DUMP\n",name,name);
+    return 2;
+}
+int main(int argc, char** argv) {
+    int baud = 115200;
+    bool keep = false;
+    const char* save = nullptr;
+    const char* out = "trace.json";
+    const char* input = nullptr;
+    for(int i = 1;i<argc;++i) {
+        if(0==strcmp(argv[i],"--baud") && i+1<argc) {
+            baud = atoi(argv[++i]);
+        } else if(0==strcmp(argv[i],"--keep")) {
+            keep = true;
+        } else if(0==strcmp(argv[i],"--save") && i+1<argc) {
+            save = argv[++i];
+        } else if(0==strcmp(argv[i],"--out") && i+1<argc) {
+            out = argv[++i];
+        } else if(argv[i][0]=='-' || input!=nullptr) {
+            return usage(argv[0]);
+        } else {
+            input = argv[i];
+        }
+    }
+    if(input==nullptr) {
+        return usage(argv[0]);
+    }
+    struct stat st;
+    if(0!=stat(input,&st)) {
+        fprintf(stderr,"%s: %s\n",input,strerror(errno));
+        return 1;
+    }
+    std::vector<uint8_t> dump;
+    if(S_ISCHR(st.st_mode)) {
+        if(!read_device(input,baud,keep,&dump)) {
+            return 1;
+        }
+        if(save!=nullptr) {
+            FILE* f = fopen(save,"wb");
+            if(f==nullptr || dump.size()!=fwrite(dump.data(),1,dump.size(),f)) {
+                fprintf(stderr,"%s: %s\n",save,strerror(errno));
+            }
+            if(f!=nullptr) {
+                fclose(f);
+            }
+        }
+    } else if(!read_file(input,&dump)) {
+        return 1;
+    }
+    if(!parse(dump.data(),dump.size())) {
+        return 1;
+    }
+    return write_trace(out)?0:1;
+}
@@ -0,0 +1,60 @@
+// checks fixed_point.hpp's float conversion: in range it rounds like the
+// float path it replaced, and out of range, infinite or NaN input clamps
+// instead of converting past the range of q16_t
+//
+// usage: fixed_point_test [iterations]
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench_util.hpp"
+#include "fixed_point.hpp"
+
+static long failures = 0;
+
+static void check(float value, q16_t want) {
+    const q16_t got = q16_from_float(value);
+    if(got!=want) {
+        if(failures<10) {
+            fprintf(stderr,"fixed_point_test: q16_from_float(%g) is %d, want %d\n",(double)value,(int)got,(int)want);
+        }
+        ++failures;
+    }
+}
+static float float_from_bits(uint32_t bits) {
+    float f;
+    memcpy(&f,&bits,sizeof(f));
+    return f;
+}
+
+int main(int argc, char** argv) {
+    const long iterations = bench_parse_args(argc,argv,1000000,0).iterations;
+    check(0.f,0);
+    check(-0.f,0);
+    check(1.f,q16_one);
+    check(.5f,q16_one/2);
+    check(-1.f,0);
+    check(32768.f,q16_one);
+    check(-32768.f,0);
+    check(1e30f,q16_one);
+    check(-1e30f,0);
+    check(INFINITY,q16_one);
+    check(-INFINITY,0);
+    check(NAN,0);
+    check(-NAN,0);
+    check(1.f/q16_one,1);
+    check(nextafterf(1.f,0.f),q16_one);
+    for(long i = 0;i<iterations;++i) {
+        // in range against the old rounding in doubles, then any bit
+        // pattern at all against the clamp
+        const float in_range = (test_random()%(q16_one+1))/(float)q16_one;
+        check(in_range,(q16_t)((double)in_range*q16_one+.5));
+        const float any = float_from_bits(test_random());
+        if(any!=any) {
+            check(any,0);
+        } else {
+            check(any,any<=0?0:any>=1?q16_one:(q16_t)((double)any*q16_one+.5));
+        }
+    }
+    printf("check,iterations=%ld,failures=%ld,result=%s\n",iterations,failures,failures==0?"pass":"fail");
+    return failures==0?0:1;
+}
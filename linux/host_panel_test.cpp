@@ -0,0 +1,102 @@
+// checks the host panel (src/host/panel.cpp) the renderer bench and the
+// simulator run on. random flushes go to the panel and to a reference
+// frame kept here, and the two frames have to match, along with the
+// flush counters and, for async builds, one completion per flush in
+// order. built once per transfer mode and pixel size, see CMakeLists.txt
+//
+// usage: host_panel_test [iterations]
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "bench_util.hpp"
+#include "panel.h"
+
+#if LCD_SYNC_TRANSFER == 0
+static std::atomic<uint32_t> completions(0);
+void panel_lcd_flush_complete(void) {
+    ++completions;
+}
+#endif
+static const size_t frame_size = ((size_t)LCD_WIDTH*LCD_HEIGHT*LCD_BIT_DEPTH+7)/8;
+static uint8_t reference_frame[frame_size];
+// one pixel at a time, the simplest reading of the packed formats
+static void reference_flush(int x1, int y1, int x2, int y2, const uint8_t* src) {
+    size_t src_bit = 0;
+    for(int y = y1;y<=y2;++y) {
+        for(int x = x1;x<=x2;++x) {
+            size_t dst_bit = ((size_t)y*LCD_WIDTH+x)*LCD_BIT_DEPTH;
+            for(int b = 0;b<LCD_BIT_DEPTH;++b) {
+                const uint8_t mask = 0x80>>(dst_bit&7);
+                if(src[src_bit>>3]&(0x80>>(src_bit&7))) {
+                    reference_frame[dst_bit>>3]|=mask;
+                } else {
+                    reference_frame[dst_bit>>3]&=~mask;
+                }
+                ++src_bit;
+                ++dst_bit;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const long iterations = bench_parse_args(argc,argv,2000,0).iterations;
+    panel_lcd_init();
+    uint8_t* buffers[2] = {(uint8_t*)panel_lcd_transfer_buffer(),(uint8_t*)panel_lcd_transfer_buffer2()};
+    if(buffers[0]==nullptr || buffers[1]==nullptr || panel_lcd_host_frame_size()!=frame_size) {
+        printf("check,config=%dx%dx%d,result=fail\n",(int)LCD_WIDTH,(int)LCD_HEIGHT,(int)LCD_BIT_DEPTH);
+        return 1;
+    }
+    long failures = 0;
+    uint64_t pixels = 0;
+    for(long it = 0;it<iterations;++it) {
+        // a band that fits the transfer buffer, like uix hands out
+        const int w = 1+(int)(test_random()%LCD_WIDTH);
+        int max_rows = (int)((size_t)LCD_TRANSFER_SIZE*8/((size_t)w*LCD_BIT_DEPTH));
+        if(max_rows>LCD_HEIGHT) {
+            max_rows = LCD_HEIGHT;
+        }
+        const int h = 1+(int)(test_random()%max_rows);
+        const int x1 = (int)(test_random()%(LCD_WIDTH-w+1));
+        const int y1 = (int)(test_random()%(LCD_HEIGHT-h+1));
+        uint8_t* buf = buffers[it&1];
+#if LCD_SYNC_TRANSFER == 0
+        // a buffer is only reused once the flush before last is done,
+        // the way uix waits on two buffers
+        while(completions+1<(uint32_t)it) {
+            std::this_thread::yield();
+        }
+#endif
+        const size_t bytes = ((size_t)w*h*LCD_BIT_DEPTH+7)/8;
+        for(size_t i = 0;i<bytes;++i) {
+            buf[i] = (uint8_t)test_random();
+        }
+        reference_flush(x1,y1,x1+w-1,y1+h-1,buf);
+        panel_lcd_flush(x1,y1,x1+w-1,y1+h-1,buf);
+        pixels+=(uint64_t)w*h;
+    }
+#if LCD_SYNC_TRANSFER == 0
+    const auto deadline = std::chrono::steady_clock::now()+std::chrono::seconds(10);
+    while(completions<(uint32_t)iterations && std::chrono::steady_clock::now()<deadline) {
+        std::this_thread::yield();
+    }
+    if(completions!=(uint32_t)iterations) {
+        fprintf(stderr,"host_panel_test: %u of %ld flushes completed\n",(unsigned)completions,iterations);
+        ++failures;
+    }
+#endif
+    if(0!=memcmp(reference_frame,panel_lcd_host_frame(),frame_size)) {
+        fprintf(stderr,"host_panel_test: the frame doesn't match the reference\n");
+        ++failures;
+    }
+    if(panel_lcd_host_flush_count()!=(uint32_t)iterations || panel_lcd_host_flush_pixels()!=pixels) {
+        fprintf(stderr,"host_panel_test: counted %u flushes and %llu pixels\n",
+            (unsigned)panel_lcd_host_flush_count(),(unsigned long long)panel_lcd_host_flush_pixels());
+        ++failures;
+    }
+    printf("check,config=%dx%dx%d,sync=%d,iterations=%ld,result=%s\n",(int)LCD_WIDTH,(int)LCD_HEIGHT,(int)LCD_BIT_DEPTH,
+        (int)LCD_SYNC_TRANSFER,iterations,failures==0?"pass":"fail");
+    return failures==0?0:1;
+}
@@ -0,0 +1,178 @@
+// checks metric_stats.hpp against a naive reference that keeps every
+// sample, then measures what add() and the getters cost per sample.
+// the checks cover the EMA, the window mean/min/max through many wraps,
+// the decayed mean and variance past the decay limit, and the histogram
+// quantiles, including an empty histogram
+//
+// usage: metric_stats_test [samples] [seconds per bench case]
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "bench_util.hpp"
+#include "metric_stats.hpp"
+
+static int failures = 0;
+static int checks = 0;
+
+static void check(bool ok, const char* what, size_t sample, double got, double want) {
+    ++checks;
+    if(!ok) {
+        if(failures<20) {
+            fprintf(stderr,"metric_stats_test: %s at sample %zu: got %f, want %f\n",what,sample,got,want);
+        }
+        ++failures;
+    }
+}
+// the reference: every sample, and the running totals recomputed with the
+// same halving schedule but in doubles
+struct reference {
+    std::vector<double> samples;
+    double weight_count = 0;
+    double weight_sum = 0;
+    double weight_sum_sq = 0;
+    uint32_t count = 0;
+};
+template<typename Stats>
+static double to_double(typename Stats::value_type value) {
+    return (double)value/(double)Stats::traits_type::full_scale;
+}
+// a sample in 0-1, with runs of repeats so the min/max deques see ties
+static double next_sample(size_t i) {
+    if(i%7<2 && i>0) {
+        return -1;
+    }
+    return (test_random()%10001)/10000.0;
+}
+template<typename Stats>
+static typename Stats::value_type from_double(double value) {
+    return (typename Stats::value_type)(value*Stats::traits_type::full_scale);
+}
+template<typename Stats>
+static void check_stats(const char* name, size_t samples, double tolerance) {
+    using T = typename Stats::value_type;
+    const size_t window = Stats::window_size;
+    Stats stats;
+    reference ref;
+    // an empty one reads as zero throughout
+    check(stats.quantile(50)==0,"empty quantile",0,to_double<Stats>(stats.quantile(50)),0);
+    check(stats.window_min()==0 && stats.window_max()==0,"empty window",0,0,0);
+    check(stats.mean()==0 && stats.variance()==0,"empty totals",0,0,0);
+    T value = 0;
+    for(size_t i = 0;i<samples;++i) {
+        const double next = next_sample(i);
+        if(next>=0) {
+            value = from_double<Stats>(next);
+        }
+        const T prev_ema = stats.ema();
+        stats.add(value);
+        const double v = to_double<Stats>(value);
+        ref.samples.push_back(v);
+        if(ref.count==Stats::decay_limit) {
+            ref.count>>=1;
+            ref.weight_count/=2;
+            ref.weight_sum/=2;
+            ref.weight_sum_sq/=2;
+        }
+        ++ref.count;
+        ref.weight_count+=1;
+        ref.weight_sum+=v;
+        ref.weight_sum_sq+=v*v;
+        // the EMA is one exact step in the traits' own arithmetic
+        const T want_ema = i==0?value:Stats::traits_type::ema_step(prev_ema,value,3);
+        check(stats.ema()==want_ema,"ema",i,to_double<Stats>(stats.ema()),to_double<Stats>(want_ema));
+        check(stats.last()==value,"last",i,to_double<Stats>(stats.last()),v);
+        // the window, straight off the tail of the samples
+        const size_t n = std::min(window,ref.samples.size());
+        double lo = 2, hi = -1, sum = 0;
+        for(size_t j = ref.samples.size()-n;j<ref.samples.size();++j) {
+            lo = std::min(lo,ref.samples[j]);
+            hi = std::max(hi,ref.samples[j]);
+            sum+=ref.samples[j];
+        }
+        check(to_double<Stats>(stats.window_min())==lo,"window_min",i,to_double<Stats>(stats.window_min()),lo);
+        check(to_double<Stats>(stats.window_max())==hi,"window_max",i,to_double<Stats>(stats.window_max()),hi);
+        check(fabs(to_double<Stats>(stats.window_mean())-sum/n)<=tolerance,"window_mean",i,to_double<Stats>(stats.window_mean()),sum/n);
+        if(i%97==0 || i+1==samples) {
+            const double mean = ref.weight_sum/ref.weight_count;
+            const double variance = std::max(0.0,ref.weight_sum_sq/ref.weight_count-mean*mean);
+            check(fabs(to_double<Stats>(stats.mean())-mean)<=tolerance,"mean",i,to_double<Stats>(stats.mean()),mean);
+            check(fabs(to_double<Stats>(stats.variance())-variance)<=tolerance,"variance",i,to_double<Stats>(stats.variance()),variance);
+            check(fabs(to_double<Stats>(stats.stddev())-sqrt(variance))<=sqrt(tolerance)*2,"stddev",i,to_double<Stats>(stats.stddev()),sqrt(variance));
+        }
+        // before the first halving the histogram holds every sample, so the
+        // quantile is exactly the upper edge of the bin the target lands in
+        if(ref.samples.size()<Stats::decay_limit && (i%251==0 || i<64)) {
+            std::vector<T> sorted;
+            for(double s : ref.samples) {
+                sorted.push_back(from_double<Stats>(s));
+            }
+            std::sort(sorted.begin(),sorted.end());
+            for(unsigned percent : {0u,1u,50u,95u,99u,100u}) {
+                size_t target = (sorted.size()*percent+99)/100;
+                if(target==0) {
+                    target = 1;
+                }
+                size_t bin = (size_t)(((typename Stats::acc_type)sorted[target-1])*Stats::bins/Stats::traits_type::full_scale);
+                if(bin>=Stats::bins) {
+                    bin = Stats::bins-1;
+                }
+                const double want = (double)(bin+1)/Stats::bins;
+                const double got = to_double<Stats>(stats.quantile(percent));
+                check(fabs(got-want)<=tolerance,"quantile",i,got,want);
+            }
+        }
+    }
+    stats.clear();
+    check(stats.count()==0 && stats.quantile(99)==0 && stats.window_max()==0,"clear",samples,0,0);
+    printf("check,name=%s,samples=%zu,window=%zu\n",name,samples,window);
+}
+template<typename Step>
+static void bench(const char* name, double seconds, Step step) {
+    // check the clock every so often, not every sample
+    const bench_result r = bench_run(seconds,4096,step);
+    printf("bench,name=%s,samples=%llu,ns_per_sample=%.2f\n",name,(unsigned long long)r.steps,r.seconds*1e9/r.steps);
+}
+
+int main(int argc, char** argv) {
+    const bench_args args = bench_parse_args(argc,argv,100000,0.5);
+    const double seconds = args.seconds;
+    // q16 is what the firmware runs. one step of rounding in each total
+    const double q16_tolerance = 4.0/q16_one;
+    check_stats<metric_stats<q16_t,5>>("q16_window5",(size_t)args.iterations,q16_tolerance);
+    check_stats<metric_stats<q16_t,1>>("q16_window1",2000,q16_tolerance);
+    check_stats<metric_stats<q16_t,16,32,3>>("q16_window16",70000,q16_tolerance);
+    check_stats<metric_stats<float,5>>("float_window5",70000,1e-4);
+    if(failures!=0) {
+        printf("check,checks=%d,failures=%d,result=fail\n",checks,failures);
+        return 1;
+    }
+    printf("check,checks=%d,result=pass\n",checks);
+
+    static q16_t values[4096];
+    static float float_values[4096];
+    for(size_t i = 0;i<4096;++i) {
+        values[i] = (q16_t)(test_random()%(q16_one+1));
+        float_values[i] = values[i]/(float)q16_one;
+    }
+    metric_stats<q16_t,5> q16_stats;
+    bench("add_q16",seconds,[&](uint64_t i) {
+        q16_stats.add(values[i&4095]);
+    });
+    bench("add_get_window_mean_q16",seconds,[&](uint64_t i) {
+        q16_stats.add(values[i&4095]);
+        bench_sink = bench_sink+q16_stats.get(stat_kind::window_mean);
+    });
+    bench("get_p95_q16",seconds,[&](uint64_t i) {
+        bench_sink = bench_sink+q16_stats.quantile(95);
+    });
+    bench("get_stddev_q16",seconds,[&](uint64_t i) {
+        bench_sink = bench_sink+q16_stats.stddev();
+    });
+    metric_stats<float,5> float_stats;
+    bench("add_float",seconds,[&](uint64_t i) {
+        float_stats.add(float_values[i&4095]);
+    });
+    bench_sink = bench_sink+q16_stats.get(stat_kind::window_max)+(int64_t)float_stats.get(stat_kind::ema);
+    return 0;
+}
@@ -0,0 +1,243 @@
+// checks pixel_kernels.hpp against a pixel at a time reference, over
+// random rectangles in buffers at every alignment for each pixel size,
+// checks the RGB565 blend against a channel at a time reference for every
+// channel value and alpha, then times full screen and partial fills and
+// blends against the references
+//
+// usage: pixel_kernels_test [iterations] [seconds per bench case]
+#include <stdio.h>
+#include <string.h>
+#include "bench_util.hpp"
+#include "pixel_kernels.hpp"
+
+// one pixel at a time, the way a plain bitmap would
+static void reference_fill_rect(size_t bit_depth, uint8_t* buffer, size_t width, size_t x1, size_t y1, size_t x2, size_t y2, const uint8_t* px) {
+    for(size_t y = y1;y<=y2;++y) {
+        for(size_t x = x1;x<=x2;++x) {
+            if(bit_depth==1) {
+                const size_t bit = y*width+x;
+                const uint8_t mask = 0x80>>(bit&7);
+                if(px[0]&0x80) {
+                    buffer[bit>>3]|=mask;
+                } else {
+                    buffer[bit>>3]&=~mask;
+                }
+            } else {
+                const size_t bytes = bit_depth/8;
+                memcpy(buffer+(y*width+x)*bytes,px,bytes);
+            }
+        }
+    }
+}
+// one channel at a time, rounded to nearest
+static uint16_t reference_blend_565(uint16_t fg, uint16_t bg, uint8_t alpha) {
+    const int shifts[3] = {11,5,0};
+    const int masks[3] = {0x1F,0x3F,0x1F};
+    uint16_t result = 0;
+    for(int i = 0;i<3;++i) {
+        const int f = (fg>>shifts[i])&masks[i];
+        const int b = (bg>>shifts[i])&masks[i];
+        result|=(uint16_t)(((f*alpha+b*(255-alpha)+127)/255)<<shifts[i]);
+    }
+    return result;
+}
+static void reference_blend_rect_565(uint8_t* buffer, size_t width, size_t x1, size_t y1, size_t x2, size_t y2, uint16_t fg, uint8_t alpha) {
+    for(size_t y = y1;y<=y2;++y) {
+        for(size_t x = x1;x<=x2;++x) {
+            uint8_t* p = buffer+(y*width+x)*2;
+            const uint16_t out = reference_blend_565(fg,(uint16_t)((p[0]<<8)|p[1]),alpha);
+            p[0] = (uint8_t)(out>>8);
+            p[1] = (uint8_t)out;
+        }
+    }
+}
+constexpr static const size_t max_width = 330;
+constexpr static const size_t max_height = 64;
+// room for the largest bitmap at any offset, plus a guard at the end
+constexpr static const size_t arena_size = max_width*max_height*4+8;
+
+// random bytes to start each arena from, at a random offset
+static uint8_t noise[arena_size*2];
+
+template<size_t BitDepth>
+static long check_depth(long iterations) {
+    static uint8_t want[arena_size];
+    static uint8_t got[arena_size];
+    long failures = 0;
+    for(long it = 0;it<iterations;++it) {
+        const size_t width = 1+test_random()%max_width;
+        const size_t height = 1+test_random()%max_height;
+        // start the bitmap anywhere in a word so every lead in is covered
+        const size_t offset = test_random()&3;
+        size_t x1 = test_random()%width, x2 = test_random()%width;
+        size_t y1 = test_random()%height, y2 = test_random()%height;
+        if(x1>x2) {
+            const size_t t = x1;
+            x1 = x2;
+            x2 = t;
+        }
+        if(y1>y2) {
+            const size_t t = y1;
+            y1 = y2;
+            y2 = t;
+        }
+        // full width rectangles take the contiguous path
+        if((it&3)==0) {
+            x1 = 0;
+            x2 = width-1;
+        }
+        const uint8_t* start = noise+test_random()%arena_size;
+        memcpy(want,start,arena_size);
+        memcpy(got,start,arena_size);
+        uint8_t px[4];
+        const uint32_t r = test_random();
+        memcpy(px,&r,4);
+        reference_fill_rect(BitDepth,want+offset,width,x1,y1,x2,y2,px);
+        pixel_kernels_fill_rect<BitDepth>(got+offset,width,x1,y1,x2,y2,px);
+        if(0!=memcmp(want,got,arena_size)) {
+            if(failures<10) {
+                fprintf(stderr,"pixel_kernels_test: %d-bit mismatch at %zux%zu+%zu (%zu,%zu)-(%zu,%zu)\n",
+                    (int)BitDepth,width,height,offset,x1,y1,x2,y2);
+            }
+            ++failures;
+        }
+    }
+    printf("check,bit_depth=%d,iterations=%ld,failures=%ld\n",(int)BitDepth,iterations,failures);
+    return failures;
+}
+// every pair of channel values at every alpha, with all three channels
+// carrying the same value so R, G and B are all covered at once
+static long check_blend_channels() {
+    long failures = 0;
+    long count = 0;
+    for(int alpha = 0;alpha<256;++alpha) {
+        for(int f = 0;f<64;++f) {
+            for(int b = 0;b<64;++b) {
+                const uint16_t fg = (uint16_t)(((f&0x1F)<<11)|(f<<5)|(f&0x1F));
+                const uint16_t bg = (uint16_t)(((b&0x1F)<<11)|(b<<5)|(b&0x1F));
+                const uint16_t want = reference_blend_565(fg,bg,(uint8_t)alpha);
+                const uint16_t got = pixel_kernels_565::blend(fg,bg,(uint8_t)alpha);
+                if(want!=got) {
+                    if(failures<10) {
+                        fprintf(stderr,"pixel_kernels_test: blend of %04X over %04X at %d is %04X, not %04X\n",
+                            fg,bg,alpha,got,want);
+                    }
+                    ++failures;
+                }
+                ++count;
+            }
+        }
+    }
+    printf("check,blend=channels,iterations=%ld,failures=%ld\n",count,failures);
+    return failures;
+}
+static long check_blend_rect(long iterations) {
+    static uint8_t want[arena_size];
+    static uint8_t got[arena_size];
+    long failures = 0;
+    for(long it = 0;it<iterations;++it) {
+        const size_t width = 1+test_random()%max_width;
+        const size_t height = 1+test_random()%max_height;
+        // pixels only have to start on a byte
+        const size_t offset = test_random()&3;
+        size_t x1 = test_random()%width, x2 = test_random()%width;
+        size_t y1 = test_random()%height, y2 = test_random()%height;
+        if(x1>x2) {
+            const size_t t = x1;
+            x1 = x2;
+            x2 = t;
+        }
+        if(y1>y2) {
+            const size_t t = y1;
+            y1 = y2;
+            y2 = t;
+        }
+        if((it&3)==0) {
+            x1 = 0;
+            x2 = width-1;
+        }
+        const uint8_t* start = noise+test_random()%arena_size;
+        memcpy(want,start,arena_size);
+        memcpy(got,start,arena_size);
+        const uint16_t fg = (uint16_t)test_random();
+        // opaque takes the fill path
+        const uint8_t alpha = (it&7)==1?255:(uint8_t)test_random();
+        reference_blend_rect_565(want+offset,width,x1,y1,x2,y2,fg,alpha);
+        pixel_kernels_blend_rect_565(got+offset,width,x1,y1,x2,y2,fg,alpha);
+        if(0!=memcmp(want,got,arena_size)) {
+            if(failures<10) {
+                fprintf(stderr,"pixel_kernels_test: blend mismatch at %zux%zu+%zu (%zu,%zu)-(%zu,%zu) alpha %d\n",
+                    width,height,offset,x1,y1,x2,y2,(int)alpha);
+            }
+            ++failures;
+        }
+    }
+    printf("check,blend=rect,iterations=%ld,failures=%ld\n",iterations,failures);
+    return failures;
+}
+template<typename Step>
+static void bench(const char* name, double seconds, size_t pixels, Step step) {
+    const bench_result r = bench_run(seconds,16,step);
+    printf("bench,name=%s,fills=%llu,us_per_fill=%.3f,ns_per_pixel=%.3f\n",name,(unsigned long long)r.steps,
+        r.seconds*1e6/r.steps,r.seconds*1e9/r.steps/pixels);
+}
+template<size_t BitDepth>
+static void bench_depth(const char* reference_name, const char* kernel_name, const char* partial_name, double seconds) {
+    static uint8_t buffer[320*240*4];
+    uint8_t px[4] = {0x12,0x34,0x56,0x78};
+    bench(reference_name,seconds,320*240,[&](uint64_t i) {
+        px[0] = (uint8_t)i;
+        reference_fill_rect(BitDepth,buffer,320,0,0,319,239,px);
+        bench_sink = bench_sink+buffer[i%sizeof(buffer)];
+    });
+    bench(kernel_name,seconds,320*240,[&](uint64_t i) {
+        px[0] = (uint8_t)i;
+        pixel_kernels_fill_rect<BitDepth>(buffer,320,0,0,319,239,px);
+        bench_sink = bench_sink+buffer[i%sizeof(buffer)];
+    });
+    // a bar sized rectangle that isn't full width
+    bench(partial_name,seconds,150*20,[&](uint64_t i) {
+        px[0] = (uint8_t)i;
+        pixel_kernels_fill_rect<BitDepth>(buffer,320,5,100,154,119,px);
+        bench_sink = bench_sink+buffer[i%sizeof(buffer)];
+    });
+}
+
+int main(int argc, char** argv) {
+    const bench_args args = bench_parse_args(argc,argv,5000,0.5);
+    const long iterations = args.iterations;
+    const double seconds = args.seconds;
+    for(size_t i = 0;i<sizeof(noise);++i) {
+        noise[i] = (uint8_t)test_random();
+    }
+    long failures = 0;
+    failures+=check_depth<1>(iterations);
+    failures+=check_depth<8>(iterations);
+    failures+=check_depth<16>(iterations);
+    failures+=check_depth<24>(iterations);
+    // the fallback itself
+    failures+=check_depth<32>(iterations);
+    failures+=check_blend_channels();
+    failures+=check_blend_rect(iterations);
+    if(failures!=0) {
+        printf("check,failures=%ld,result=fail\n",failures);
+        return 1;
+    }
+    printf("check,result=pass\n");
+
+    bench_depth<1>("reference_320x240x1","kernel_320x240x1","kernel_150x20x1",seconds);
+    bench_depth<8>("reference_320x240x8","kernel_320x240x8","kernel_150x20x8",seconds);
+    bench_depth<16>("reference_320x240x16","kernel_320x240x16","kernel_150x20x16",seconds);
+    bench_depth<24>("reference_320x240x24","kernel_320x240x24","kernel_150x20x24",seconds);
+    // a translucent bar segment
+    static uint8_t blend_buffer[320*240*2];
+    bench("reference_blend_150x20x16",seconds,150*20,[&](uint64_t i) {
+        reference_blend_rect_565(blend_buffer,320,5,100,154,119,(uint16_t)i,95);
+        bench_sink = bench_sink+blend_buffer[i%sizeof(blend_buffer)];
+    });
+    bench("kernel_blend_150x20x16",seconds,150*20,[&](uint64_t i) {
+        pixel_kernels_blend_rect_565(blend_buffer,320,5,100,154,119,(uint16_t)i,95);
+        bench_sink = bench_sink+blend_buffer[i%sizeof(blend_buffer)];
+    });
+    return 0;
+}
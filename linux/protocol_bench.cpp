@@ -0,0 +1,105 @@
+// measures how many frames a second the protocol library encodes and
+// decodes, for screens, data and a mixed stream through frame_reader
+//
+// usage: protocol_bench [seconds per case]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench_util.hpp"
+#include "espmon_protocol.hpp"
+
+using namespace espmon;
+
+static response_screen_t make_screen() {
+    response_screen_t scr;
+    memset(&scr,0,sizeof(scr));
+    scr.index = 1;
+    scr.flags = (1<<1)|(1<<3);
+    strcpy(scr.top_label,"CPU");
+    strcpy(scr.top_suffix1,"%");
+    strcpy(scr.top_suffix2,"\xC2\xB0");
+    scr.top_max1 = 100;
+    scr.top_max2 = 90;
+    strcpy(scr.bottom_label,"GPU");
+    strcpy(scr.bottom_suffix1,"%");
+    strcpy(scr.bottom_suffix2,"\xC2\xB0");
+    scr.bottom_max1 = 100;
+    scr.bottom_max2 = 85;
+    for(int i = 0;i<4;++i) {
+        scr.top_color1[i] = (uint8_t)(i*60);
+        scr.bottom_color2[i] = (uint8_t)(255-i*60);
+    }
+    return scr;
+}
+template<typename Step>
+static void bench(const char* name, double seconds, Step step) {
+    // check the clock every so often, not every frame
+    const bench_result r = bench_run(seconds,4096,step);
+    printf("bench,name=%s,frames=%llu,frames_per_sec=%.0f,ns_per_frame=%.2f\n",
+        name,(unsigned long long)r.steps,r.steps/r.seconds,r.seconds*1e9/r.steps);
+}
+
+int main(int argc, char** argv) {
+    const double seconds = argc>1?atof(argv[1]):1.0;
+    const response_screen_t screen = make_screen();
+    uint8_t screen_payload[screen_payload_size];
+    encode(screen,screen_payload);
+    response_data_t data = {50,30,15,35};
+    uint8_t data_payload[data_payload_size];
+    encode(data,data_payload);
+
+    bench("encode_screen",seconds,[&](uint64_t i) {
+        encode(screen,screen_payload);
+        bench_sink = bench_sink+screen_payload[i%screen_payload_size];
+    });
+    bench("decode_screen",seconds,[&](uint64_t i) {
+        response_screen_t out;
+        decode(screen_view(screen_payload),&out);
+        bench_sink = bench_sink+out.top_max2;
+    });
+    bench("view_screen",seconds,[&](uint64_t i) {
+        const screen_view v(screen_payload);
+        bench_sink = bench_sink+v.top().value2().max()+v.bottom().label().length();
+    });
+    bench("encode_data",seconds,[&](uint64_t i) {
+        data.top_value1 = (uint16_t)i;
+        encode(data,data_payload);
+        bench_sink = bench_sink+data_payload[0];
+    });
+    bench("decode_data",seconds,[&](uint64_t i) {
+        response_data_t out;
+        decode(data_view(data_payload),&out);
+        bench_sink = bench_sink+out.top_value1;
+    });
+    // a host stream: a screen then data frames, fed in serial sized chunks
+    static uint8_t stream[(1+screen_payload_size)+(1+data_payload_size)*63];
+    size_t stream_size = 0;
+    stream[stream_size++] = (uint8_t)command::screen;
+    memcpy(stream+stream_size,screen_payload,screen_payload_size);
+    stream_size+=screen_payload_size;
+    for(int i = 0;i<63;++i) {
+        stream[stream_size++] = (uint8_t)command::data;
+        memcpy(stream+stream_size,data_payload,data_payload_size);
+        stream_size+=data_payload_size;
+    }
+    frame_reader reader;
+    uint64_t stream_frames = 0;
+    bench("frame_reader_stream",seconds,[&](uint64_t i) {
+        // the bench counts one per call, so each call is one frame
+        static size_t pos = 0;
+        static size_t chunk_end = 0;
+        frame_reader::result r = frame_reader::result::none;
+        while(r!=frame_reader::result::frame) {
+            if(pos==chunk_end) {
+                if(pos==stream_size) {
+                    pos = 0;
+                }
+                chunk_end = pos+(stream_size-pos<64?stream_size-pos:64);
+            }
+            pos+=reader.feed(stream+pos,chunk_end-pos,&r);
+        }
+        bench_sink = bench_sink+reader.payload()[0];
+        ++stream_frames;
+    });
+    return bench_sink==0xFFFFFFFF && stream_frames==0;
+}
@@ -0,0 +1,179 @@
+// fuzzes the protocol decoders. every input is fed through frame_reader
+// in uneven chunks, and each frame it produces is decoded, re-encoded and
+// checked against the bytes it came from.
+//
+// built with -DESPMON_LIBFUZZER=ON this is a libFuzzer target. otherwise
+// it runs standalone: protocol_fuzz [iterations] [seed], or with file
+// arguments it replays those inputs
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "espmon_protocol.hpp"
+
+using namespace espmon;
+
+static void fuzz_fail(const char* what) {
+    fprintf(stderr,"protocol_fuzz: %s\n",what);
+    abort();
+}
+static void check_frame(uint8_t cmd, const uint8_t* payload) {
+    if(cmd==(uint8_t)command::screen) {
+        response_screen_t scr;
+        decode(screen_view(payload),&scr);
+        if(strlen(scr.top_label)>=sizeof(scr.top_label) || strlen(scr.bottom_suffix2)>=sizeof(scr.bottom_suffix2)) {
+            fuzz_fail("unterminated text");
+        }
+        uint8_t encoded[screen_payload_size];
+        encode(scr,encoded);
+        // decoding again must give back the same struct
+        response_screen_t again;
+        decode(screen_view(encoded),&again);
+        if(0!=memcmp(&scr,&again,sizeof(scr))) {
+            fuzz_fail("screen round trip mismatch");
+        }
+        // numbers and colors survive untouched
+        const screen_view in(payload), out(encoded);
+        if(in.index()!=out.index() || in.flags()!=out.flags() ||
+                in.top().value1().max()!=out.top().value1().max() ||
+                in.bottom().value2().max()!=out.bottom().value2().max() ||
+                0!=memcmp(in.bottom().label_color(),out.bottom().label_color(),4)) {
+            fuzz_fail("screen field mismatch");
+        }
+    } else if(cmd==(uint8_t)command::data) {
+        response_data_t data;
+        decode(data_view(payload),&data);
+        uint8_t encoded[data_payload_size];
+        encode(data,encoded);
+        if(0!=memcmp(payload,encoded,data_payload_size)) {
+            fuzz_fail("data round trip mismatch");
+        }
+    } else if(cmd==(uint8_t)command::ping) {
+        response_pong_t pong;
+        decode(pong_view(payload),&pong);
+        uint8_t encoded[pong_payload_size];
+        encode(pong,encoded);
+        if(0!=memcmp(payload,encoded,pong_payload_size)) {
+            fuzz_fail("pong round trip mismatch");
+        }
+    } else if(cmd==(uint8_t)command::data_ex) {
+        response_data_ex_t data;
+        decode(data_ex_view(payload),&data);
+        uint8_t encoded[data_ex_payload_size];
+        encode(data,encoded);
+        // everything but the reserved bytes
+        if(0!=memcmp(payload,encoded,10) || 0!=memcmp(payload+12,encoded+12,4)) {
+            fuzz_fail("data_ex round trip mismatch");
+        }
+    } else if(cmd==(uint8_t)command::profile) {
+        response_profile_t query;
+        decode(profile_query_view(payload),&query);
+        uint8_t encoded[profile_query_size];
+        encode(query,encoded);
+        if(0!=memcmp(payload,encoded,profile_query_size)) {
+            fuzz_fail("profile query round trip mismatch");
+        }
+    } else if(cmd!=(uint8_t)command::diagnostics && cmd!=(uint8_t)command::telemetry &&
+            cmd!=(uint8_t)command::trace && cmd!=(uint8_t)command::latency) {
+        fuzz_fail("frame with an unknown command");
+    }
+}
+static void fuzz_one(const uint8_t* data, size_t size) {
+    if(size==0) {
+        return;
+    }
+    // the first byte picks the chunking so splits land everywhere
+    const size_t chunk = 1+data[0]%17;
+    ++data;
+    --size;
+    frame_reader reader;
+    size_t pos = 0;
+    while(pos<size) {
+        const size_t end = pos+(size-pos<chunk?size-pos:chunk);
+        while(pos<end) {
+            frame_reader::result r;
+            const size_t used = reader.feed(data+pos,end-pos,&r);
+            if(used==0 || used>end-pos) {
+                fuzz_fail("feed consumed a bad count");
+            }
+            pos+=used;
+            if(r==frame_reader::result::frame) {
+                if(reader.payload_size()!=payload_size(reader.cmd())) {
+                    fuzz_fail("payload size mismatch");
+                }
+                check_frame(reader.cmd(),reader.payload());
+            }
+        }
+    }
+    for(size_t i = 0;i+request_size<=size;i+=request_size) {
+        uint8_t encoded[request_size];
+        request::decode(data+i).encode(encoded);
+        if(0!=memcmp(encoded,data+i,request_size)) {
+            fuzz_fail("request round trip mismatch");
+        }
+    }
+}
+
+#ifdef ESPMON_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    fuzz_one(data,size);
+    return 0;
+}
+#else
+static uint32_t fuzz_seed = 1;
+static uint32_t fuzz_random() {
+    fuzz_seed ^= fuzz_seed<<13;
+    fuzz_seed ^= fuzz_seed>>17;
+    fuzz_seed ^= fuzz_seed<<5;
+    return fuzz_seed;
+}
+int main(int argc, char** argv) {
+    if(argc>1 && (argv[1][0]<'0' || argv[1][0]>'9')) {
+        // replay files
+        static uint8_t buf[1<<20];
+        for(int i = 1;i<argc;++i) {
+            FILE* f = fopen(argv[i],"rb");
+            if(f==nullptr) {
+                perror(argv[i]);
+                return 1;
+            }
+            const size_t size = fread(buf,1,sizeof(buf),f);
+            fclose(f);
+            fuzz_one(buf,size);
+        }
+        printf("fuzz,replayed=%d\n",argc-1);
+        return 0;
+    }
+    const long iterations = argc>1?atol(argv[1]):100000;
+    fuzz_seed = argc>2?(uint32_t)strtoul(argv[2],nullptr,10):1;
+    if(fuzz_seed==0) {
+        fuzz_seed = 1;
+    }
+    static uint8_t buf[4096];
+    for(long it = 0;it<iterations;++it) {
+        // mostly well formed streams with some bytes flipped, and some noise
+        size_t size = 1;
+        buf[0] = (uint8_t)fuzz_random();
+        const int frames = fuzz_random()%8;
+        for(int f = 0;f<frames && size<sizeof(buf)-1-max_payload_size;++f) {
+            // 9 stands in for junk
+            const uint8_t cmd = (uint8_t)(fuzz_random()%10);
+            buf[size++] = cmd;
+            const size_t n = cmd==9?fuzz_random()%16:payload_size(cmd);
+            for(size_t i = 0;i<n;++i) {
+                buf[size++] = (uint8_t)fuzz_random();
+            }
+        }
+        const int flips = fuzz_random()%4;
+        for(int i = 0;i<flips;++i) {
+            buf[fuzz_random()%size] = (uint8_t)fuzz_random();
+        }
+        // and sometimes cut it short
+        if(fuzz_random()%4==0) {
+            size = 1+fuzz_random()%size;
+        }
+        fuzz_one(buf,size);
+    }
+    printf("fuzz,iterations=%ld,result=pass\n",iterations);
+    return 0;
+}
+#endif
@@ -0,0 +1,231 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "espmon_protocol.hpp"
+
+// serial session captures. a capture is a header followed by timestamped
+// records, each one a whole frame in one direction or a link event, so a
+// capture can be replayed frame by frame without re-splitting the stream.
+//
+// header (24 bytes):
+//   char magic[8]      "ESPMCAP1"
+//   uint32_t baud      line rate the session ran at, 0 if unknown
+//   uint32_t reserved
+//   uint64_t wall_us   wall clock time at the start, unix microseconds
+// record (8 byte header, then size bytes):
+//   uint32_t time_us   since the start of the capture (wraps after 71 min,
+//                      readers unwrap it)
+//   uint8_t type       a session_record
+//   uint8_t cmd        the frame's command byte, or 0
+//   uint16_t size      bytes that follow
+// everything is little endian
+namespace espmon {
+
+enum struct session_record : uint8_t {
+    // the host sent cmd followed by a payload
+    host_frame = 0,
+    // the device sent a request: cmd, then the screen index as the payload.
+    // a diagnostics report follows its size byte
+    device_request = 1,
+    // bytes from the host that weren't a known command
+    host_junk = 2,
+    // bytes from the device that weren't a known command
+    device_junk = 3,
+    // the port was opened
+    connect = 4,
+    // the port closed or hung up
+    disconnect = 5
+};
+
+constexpr static const char session_magic[8] = {'E','S','P','M','C','A','P','1'};
+constexpr static const size_t session_header_size = 24;
+constexpr static const size_t session_record_header_size = 8;
+constexpr static const size_t session_max_record_size = 1024;
+
+static inline uint64_t session_monotonic_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+// appends records to a capture file. it's buffered by stdio; call flush()
+// now and then so a crash loses at most the last moment
+class session_writer {
+    FILE* m_file;
+    uint64_t m_start_us;
+public:
+    session_writer() : m_file(nullptr), m_start_us(0) {}
+    ~session_writer() {
+        close();
+    }
+    session_writer(const session_writer& rhs) = delete;
+    session_writer& operator=(const session_writer& rhs) = delete;
+    bool open(const char* path, uint32_t baud) {
+        close();
+        m_file = fopen(path,"wb");
+        if(m_file==nullptr) {
+            return false;
+        }
+        m_start_us = session_monotonic_us();
+        timespec wall;
+        clock_gettime(CLOCK_REALTIME,&wall);
+        const uint64_t wall_us = (uint64_t)wall.tv_sec*1000000+wall.tv_nsec/1000;
+        uint8_t header[session_header_size];
+        memset(header,0,sizeof(header));
+        memcpy(header,session_magic,8);
+        for(int i = 0;i<4;++i) {
+            header[8+i] = (uint8_t)(baud>>(i*8));
+        }
+        for(int i = 0;i<8;++i) {
+            header[16+i] = (uint8_t)(wall_us>>(i*8));
+        }
+        return 1==fwrite(header,sizeof(header),1,m_file);
+    }
+    bool is_open() const {
+        return m_file!=nullptr;
+    }
+    void write(session_record type, uint8_t cmd, const void* data, size_t size) {
+        if(m_file==nullptr) {
+            return;
+        }
+        if(size>session_max_record_size) {
+            size = session_max_record_size;
+        }
+        const uint32_t t = (uint32_t)(session_monotonic_us()-m_start_us);
+        uint8_t header[session_record_header_size];
+        header[0] = (uint8_t)t;
+        header[1] = (uint8_t)(t>>8);
+        header[2] = (uint8_t)(t>>16);
+        header[3] = (uint8_t)(t>>24);
+        header[4] = (uint8_t)type;
+        header[5] = cmd;
+        write_u16(header+6,(uint16_t)size);
+        fwrite(header,sizeof(header),1,m_file);
+        if(size>0) {
+            fwrite(data,size,1,m_file);
+        }
+    }
+    // a host frame: the command byte followed by its payload
+    void host_frame(const uint8_t* frame, size_t size) {
+        write(session_record::host_frame,frame[0],frame+1,size-1);
+    }
+    void device_request(const request& req) {
+        write(session_record::device_request,req.cmd,&req.screen_index,1);
+    }
+    // a request and the payload that came after it
+    void device_request(const request& req, const uint8_t* payload, size_t size) {
+        uint8_t record[1+255];
+        record[0] = req.screen_index;
+        if(size>sizeof(record)-1) {
+            size = sizeof(record)-1;
+        }
+        memcpy(record+1,payload,size);
+        write(session_record::device_request,req.cmd,record,1+size);
+    }
+    void flush() {
+        if(m_file!=nullptr) {
+            fflush(m_file);
+        }
+    }
+    void close() {
+        if(m_file!=nullptr) {
+            fclose(m_file);
+            m_file = nullptr;
+        }
+    }
+};
+
+struct session_entry {
+    // since the start of the capture, unwrapped
+    uint64_t time_us;
+    session_record type;
+    uint8_t cmd;
+    uint16_t size;
+    uint8_t data[session_max_record_size];
+};
+
+// reads a capture back a record at a time
+class session_reader {
+    FILE* m_file;
+    uint32_t m_baud;
+    uint64_t m_wall_us;
+    uint64_t m_epoch;
+    uint32_t m_last;
+public:
+    session_reader() : m_file(nullptr), m_baud(0), m_wall_us(0), m_epoch(0), m_last(0) {}
+    ~session_reader() {
+        close();
+    }
+    session_reader(const session_reader& rhs) = delete;
+    session_reader& operator=(const session_reader& rhs) = delete;
+    bool open(const char* path) {
+        close();
+        m_file = fopen(path,"rb");
+        if(m_file==nullptr) {
+            return false;
+        }
+        uint8_t header[session_header_size];
+        if(1!=fread(header,sizeof(header),1,m_file) || 0!=memcmp(header,session_magic,8)) {
+            close();
+            return false;
+        }
+        m_baud = 0;
+        for(int i = 0;i<4;++i) {
+            m_baud|=(uint32_t)header[8+i]<<(i*8);
+        }
+        m_wall_us = 0;
+        for(int i = 0;i<8;++i) {
+            m_wall_us|=(uint64_t)header[16+i]<<(i*8);
+        }
+        m_epoch = 0;
+        m_last = 0;
+        return true;
+    }
+    // starts over from the first record
+    void rewind() {
+        if(m_file!=nullptr) {
+            fseek(m_file,session_header_size,SEEK_SET);
+            m_epoch = 0;
+            m_last = 0;
+        }
+    }
+    uint32_t baud() const {
+        return m_baud;
+    }
+    uint64_t wall_us() const {
+        return m_wall_us;
+    }
+    // false at the end, or if the rest is truncated
+    bool next(session_entry* out) {
+        if(m_file==nullptr) {
+            return false;
+        }
+        uint8_t header[session_record_header_size];
+        if(1!=fread(header,sizeof(header),1,m_file)) {
+            return false;
+        }
+        const uint32_t t = header[0]|(header[1]<<8)|(header[2]<<16)|((uint32_t)header[3]<<24);
+        if(t<m_last) {
+            m_epoch+=(uint64_t)1<<32;
+        }
+        m_last = t;
+        out->time_us = m_epoch+t;
+        out->type = (session_record)header[4];
+        out->cmd = header[5];
+        out->size = read_u16(header+6);
+        if(out->size>session_max_record_size) {
+            return false;
+        }
+        return out->size==0 || 1==fread(out->data,out->size,1,m_file);
+    }
+    void close() {
+        if(m_file!=nullptr) {
+            fclose(m_file);
+            m_file = nullptr;
+        }
+    }
+};
+
+} // namespace espmon
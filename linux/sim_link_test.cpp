@@ -0,0 +1,190 @@
+// a stand-in for main.cpp's app_main, so the simulator's runtime
+// (src/host/simulator.cpp and the shims in src/host/shim), serial.cpp,
+// profiler.cpp and the host panel build and run without gfx/uix. it keeps
+// the firmware's loop: it asks for a screen, then for data every 100ms
+// and pings about once a second if the screen says the host answers,
+// answers telemetry queries, keeps the screen in NVS and paints four
+// bands per data packet through the panel's transfer thread. once the host has answered enough of each it stops the
+// simulator. sim_link_test.sh runs it against espmon_agent on its pty
+//
+// usage: see sim_link_test.sh
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "panel.h"
+#include "serial.hpp"
+#include "espmon_protocol.hpp"
+
+// data packets, pongs and telemetry queries to see before passing
+#ifndef SIM_LINK_DATA
+#define SIM_LINK_DATA 30
+#endif
+#ifndef SIM_LINK_PONGS
+#define SIM_LINK_PONGS 2
+#endif
+#ifndef SIM_LINK_TELEMETRY
+#define SIM_LINK_TELEMETRY 1
+#endif
+#ifndef SIM_LINK_TIMEOUT_MS
+#define SIM_LINK_TIMEOUT_MS 20000
+#endif
+
+static SemaphoreHandle_t flush_done = nullptr;
+static nvs_handle_t storage_handle;
+static int screen_index = -1;
+static bool screen_populated = false;
+static bool link_extended = false;
+static bool link_host_pings = false;
+static uint8_t ping_id = 0;
+static uint32_t screens = 0, data = 0, pongs = 0, telemetry = 0;
+static uint32_t frames = 0, frame_us = 0, frame_max_us = 0;
+static int64_t start_us = 0;
+static uint8_t band_color = 0;
+// the loop keeps running until the simulator notices the signal
+static bool finished = false;
+
+void panel_lcd_flush_complete(void) {
+    xSemaphoreGiveFromISR(flush_done,nullptr);
+}
+// fills the top four bands of the screen from the data, one flush each
+static void paint(const response_data_t& d) {
+    const int64_t start = esp_timer_get_time();
+    const int rows = LCD_HEIGHT/LCD_DIVISOR;
+    uint8_t* buf = (uint8_t*)panel_lcd_transfer_buffer();
+    const uint16_t values[] = {d.top_value1,d.top_value2,d.bottom_value1,d.bottom_value2};
+    for(int band = 0;band<4;++band) {
+        memset(buf,(uint8_t)(band_color+(values[band]>>8)),LCD_TRANSFER_SIZE);
+        panel_lcd_flush(0,band*rows,LCD_WIDTH-1,band*rows+rows-1,buf);
+        xSemaphoreTake(flush_done,portMAX_DELAY);
+    }
+    ++band_color;
+    const uint32_t us = (uint32_t)(esp_timer_get_time()-start);
+    ++frames;
+    frame_us+=us;
+    if(us>frame_max_us) {
+        frame_max_us = us;
+    }
+}
+static size_t telemetry_report(uint8_t* report) {
+    using heap = espmon::telemetry_view::heap;
+    espmon::telemetry_writer w(report);
+    w.uptime_ms((uint32_t)(esp_timer_get_time()/1000));
+    w.frames(frames);
+    w.frame_us(frames==0?0:frame_us/frames);
+    w.frame_max_us(frame_max_us);
+    w.flushes(panel_lcd_host_flush_count());
+    w.flush_pixels((uint32_t)panel_lcd_host_flush_pixels());
+    serial_stats_t serial;
+    serial_take_stats(&serial);
+    w.rx_bytes(serial.rx_bytes);
+    w.tx_bytes(serial.tx_bytes);
+    w.rx_packets(serial.rx_packets);
+    w.rx_dropped(serial.rx_dropped);
+    w.heap_free(heap::internal,heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    w.heap_min_free(heap::internal,heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    w.heap_free(heap::dma,heap_caps_get_free_size(MALLOC_CAP_DMA));
+    w.heap_min_free(heap::dma,heap_caps_get_minimum_free_size(MALLOC_CAP_DMA));
+    return w.size();
+}
+static void finish() {
+    finished = true;
+    const bool pass = data>=SIM_LINK_DATA && pongs>=SIM_LINK_PONGS && telemetry>=SIM_LINK_TELEMETRY;
+    uint8_t stored = 0xFF;
+    nvs_get_u8(storage_handle,"screen",&stored);
+    printf("check,screens=%u,data=%u,pongs=%u,telemetry=%u,frames=%u,flushes=%u,nvs_screen=%d,result=%s\n",
+        (unsigned)screens,(unsigned)data,(unsigned)pongs,(unsigned)telemetry,(unsigned)frames,
+        (unsigned)panel_lcd_host_flush_count(),(int)stored,pass && stored==(uint8_t)screen_index?"pass":"fail");
+    fflush(stdout);
+    if(!pass) {
+        _exit(1);
+    }
+    // the simulator prints its own counters on the way out
+    raise(SIGTERM);
+}
+static void loop() {
+    static TickType_t ts = 0;
+    static int ping_ticks = 0;
+    response_t resp;
+    if(finished) {
+        return;
+    }
+    int cmd = serial_read_packet(&resp);
+    while(cmd!=-1) {
+        if(cmd==0) { // new screen
+            screen_populated = true;
+            screen_index = resp.screen.index;
+            link_host_pings = 0!=(resp.screen.flags&espmon::screen_pings);
+            nvs_set_u8(storage_handle,"screen",(uint8_t)screen_index);
+            nvs_commit(storage_handle);
+            ++screens;
+        } else if(cmd==1 || cmd==3) { // data
+            paint(cmd==3?resp.data_ex.data:resp.data);
+            ++data;
+        } else if(cmd==2) { // pong
+            if(resp.pong.id==ping_id) {
+                link_extended = true;
+                ++pongs;
+            }
+        } else if(cmd==5) { // telemetry query
+            uint8_t report[255];
+            const size_t size = telemetry_report(report);
+            serial_write_frame(5,report,(uint8_t)size);
+            ++telemetry;
+        }
+        cmd = serial_read_packet(&resp);
+    }
+    if(data>=SIM_LINK_DATA && pongs>=SIM_LINK_PONGS && telemetry>=SIM_LINK_TELEMETRY) {
+        finish();
+        return;
+    }
+    if(esp_timer_get_time()-start_us>(int64_t)SIM_LINK_TIMEOUT_MS*1000) {
+        finish();
+        return;
+    }
+    if(xTaskGetTickCount()>=ts+pdMS_TO_TICKS(100)) {
+        ts = xTaskGetTickCount();
+        if(!screen_populated) {
+            serial_write(0,screen_index==-1?0:screen_index);
+        } else {
+            serial_write(link_extended?3:1,screen_index);
+            if(link_host_pings && ++ping_ticks>=10) {
+                ping_ticks = 0;
+                serial_write(2,++ping_id);
+            }
+        }
+    }
+}
+static void loop_task(void* arg) {
+    while(1) {
+        loop();
+        vTaskDelay(1);
+    }
+}
+extern "C" void app_main() {
+    start_us = esp_timer_get_time();
+    if(ESP_OK!=nvs_flash_init() || ESP_OK!=nvs_open("espmon",NVS_READWRITE,&storage_handle)) {
+        printf("check,nvs=failed,result=fail\n");
+        _exit(1);
+    }
+    uint8_t stored;
+    if(ESP_OK==nvs_get_u8(storage_handle,"screen",&stored)) {
+        screen_index = (int8_t)stored;
+    }
+    flush_done = xSemaphoreCreateBinary();
+    panel_lcd_init();
+    if(!serial_init()) {
+        printf("check,serial=failed,result=fail\n");
+        _exit(1);
+    }
+    TaskHandle_t loop_handle;
+    xTaskCreate(loop_task,"loop_task",4096,nullptr,20,&loop_handle);
+}
@@ -0,0 +1,45 @@
+#!/bin/sh
+# runs sim_link_test on its pty against espmon_agent, the way
+# "pio run -e native-sim -t exec" runs the firmware, and passes if the
+# stand-in saw enough of the host and the simulator shut down cleanly
+#
+# usage: sim_link_test.sh SIM_LINK_TEST ESPMON_AGENT SCREENS.json
+sim=$1
+agent=$2
+screens=$3
+dir=$(mktemp -d)
+agent_pid=
+cleanup() {
+    if [ -n "$agent_pid" ]; then
+        kill "$agent_pid" 2>/dev/null
+        wait "$agent_pid" 2>/dev/null
+    fi
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+"$sim" --nvs "$dir/nvs" >"$dir/sim.log" &
+sim_pid=$!
+pty=
+tries=0
+while [ -z "$pty" ] && [ $tries -lt 50 ]; do
+    sleep 0.1
+    pty=$(sed -n 's/^sim,pty=//p' "$dir/sim.log")
+    tries=$((tries+1))
+done
+if [ -z "$pty" ]; then
+    echo "sim_link_test.sh: the simulator never opened its pty" >&2
+    kill "$sim_pid" 2>/dev/null
+    exit 1
+fi
+# the agent reads screens.json next to it, so run it in the temp dir
+(cd "$dir" && exec "$agent" --screens "$screens" --interval 50 --telemetry 1 "$pty") >"$dir/agent.log" 2>&1 &
+agent_pid=$!
+wait "$sim_pid"
+status=$?
+cat "$dir/sim.log"
+grep '^telemetry,' "$dir/agent.log" | tail -n 1
+if [ $status -ne 0 ] || ! grep -q 'result=pass' "$dir/sim.log" || ! grep -q '^sim,uptime_us=' "$dir/sim.log"; then
+    cat "$dir/agent.log" >&2
+    exit 1
+fi
+exit 0
@@ -0,0 +1,103 @@
+// checks ssd1306_pages.h against the per-bit conversion it replaced in
+// custom_panel.h, over random bitmaps of every width from 1 to 130 and 1
+// to 8 pages, then times both on full 128x64 and 128x32 frames
+//
+// usage: ssd1306_pages_test [iterations] [seconds per bench case]
+#include <stdio.h>
+#include <string.h>
+#include "bench_util.hpp"
+#include "ssd1306_pages.h"
+
+// the old LCD_TRANSLATE loop, one bit at a time
+static void reference_rows_to_pages(const uint8_t* bitmap, int src_width, int height, uint8_t* dst) {
+    const int dst_height_pages = height>>3;
+    for(int page = 0;page<dst_height_pages;++page) {
+        for(int x = 0;x<src_width;++x) {
+            uint8_t dst_byte = 0;
+            for(int bit = 0;bit<8;++bit) {
+                const int src_y = page*8+bit;
+                const int total_bit_offset = src_y*src_width+x;
+                const int src_byte_index = total_bit_offset>>3;
+                const int src_bit = 7-(total_bit_offset&7);
+                if(bitmap[src_byte_index]&(1<<src_bit)) {
+                    dst_byte|=(1<<bit);
+                }
+            }
+            dst[page*src_width+x] = dst_byte;
+        }
+    }
+}
+template<typename Step>
+static void bench(const char* name, double seconds, Step step) {
+    const bench_result r = bench_run(seconds,64,step);
+    printf("bench,name=%s,frames=%llu,us_per_frame=%.3f\n",name,(unsigned long long)r.steps,r.seconds*1e6/r.steps);
+}
+
+int main(int argc, char** argv) {
+    const bench_args args = bench_parse_args(argc,argv,20000,0.5);
+    const long iterations = args.iterations;
+    const double seconds = args.seconds;
+    static uint8_t src[130*64/8+1];
+    static uint8_t want[130*8];
+    // one guard byte past the end catches overruns
+    static uint8_t got[130*8+1];
+    long failures = 0;
+    for(long it = 0;it<iterations;++it) {
+        const int width = 1+(int)(it%130);
+        const int height = 8*(1+(int)(test_random()%8));
+        const size_t src_size = ((size_t)width*height+7)/8;
+        for(size_t i = 0;i<src_size;++i) {
+            // runs of solid bytes as well as noise
+            const uint32_t r = test_random();
+            src[i] = (r&0x300)==0?0x00:(r&0x300)==0x100?0xFF:(uint8_t)r;
+        }
+        reference_rows_to_pages(src,width,height,want);
+        const size_t dst_size = (size_t)width*(height>>3);
+        memset(got,0xA5,dst_size+1);
+        ssd1306_rows_to_pages(src,width,height,got);
+        if(0!=memcmp(want,got,dst_size) || got[dst_size]!=0xA5) {
+            if(failures<10) {
+                fprintf(stderr,"ssd1306_pages_test: mismatch at %dx%d\n",width,height);
+            }
+            ++failures;
+        }
+    }
+    if(failures!=0) {
+        printf("check,iterations=%ld,failures=%ld,result=fail\n",iterations,failures);
+        return 1;
+    }
+    printf("check,iterations=%ld,result=pass\n",iterations);
+
+    static uint8_t frame[128*64/8];
+    for(size_t i = 0;i<sizeof(frame);++i) {
+        frame[i] = (uint8_t)test_random();
+    }
+    static uint8_t pages[128*8];
+    bench("reference_128x64",seconds,[&](uint64_t i) {
+        frame[i%sizeof(frame)]^=1;
+        reference_rows_to_pages(frame,128,64,pages);
+        bench_sink = bench_sink+pages[i%sizeof(pages)];
+    });
+    bench("transpose_128x64",seconds,[&](uint64_t i) {
+        frame[i%sizeof(frame)]^=1;
+        ssd1306_rows_to_pages(frame,128,64,pages);
+        bench_sink = bench_sink+pages[i%sizeof(pages)];
+    });
+    bench("reference_128x32",seconds,[&](uint64_t i) {
+        frame[i%sizeof(frame)]^=1;
+        reference_rows_to_pages(frame,128,32,pages);
+        bench_sink = bench_sink+pages[i%sizeof(pages)];
+    });
+    bench("transpose_128x32",seconds,[&](uint64_t i) {
+        frame[i%sizeof(frame)]^=1;
+        ssd1306_rows_to_pages(frame,128,32,pages);
+        bench_sink = bench_sink+pages[i%sizeof(pages)];
+    });
+    // an unaligned window, like a partial flush
+    bench("transpose_61x16",seconds,[&](uint64_t i) {
+        frame[i%sizeof(frame)]^=1;
+        ssd1306_rows_to_pages(frame,61,16,pages);
+        bench_sink = bench_sink+pages[i%sizeof(pages)];
+    });
+    return 0;
+}
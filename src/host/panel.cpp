@@ -0,0 +1,141 @@
+#include "panel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#if LCD_SYNC_TRANSFER == 0
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#endif
+// the host panel. flushes copy into an offscreen framebuffer. with
+// LCD_SYNC_TRANSFER 0 they're queued to a transfer thread that completes
+// them in order, the way the DMA does on the device
+
+#define PANEL_FRAME_BITS ((size_t)LCD_WIDTH*LCD_HEIGHT*LCD_BIT_DEPTH)
+static uint8_t* panel_frame = nullptr;
+static uint8_t* panel_transfer[2] = {nullptr,nullptr};
+static std::atomic<uint32_t> panel_flush_count(0);
+static std::atomic<uint64_t> panel_flush_pixels(0);
+static std::atomic<uint32_t> panel_bus_rate(0);
+static std::atomic<uint64_t> panel_busy_us(0);
+
+static void panel_copy(int x1, int y1, int x2, int y2, const uint8_t* src) {
+    const size_t w = x2-x1+1;
+#if LCD_BIT_DEPTH >= 8
+    const size_t bytes = (LCD_BIT_DEPTH+7)/8;
+    for(int y = y1;y<=y2;++y) {
+        memcpy(panel_frame+((size_t)y*LCD_WIDTH+x1)*bytes,src,w*bytes);
+        src+=w*bytes;
+    }
+#else
+    // sub byte pixels are packed MSB first without row padding
+    size_t src_bit = 0;
+    for(int y = y1;y<=y2;++y) {
+        size_t dst_bit = ((size_t)y*LCD_WIDTH+x1)*LCD_BIT_DEPTH;
+        for(size_t i = 0;i<w*LCD_BIT_DEPTH;++i) {
+            const uint8_t mask = 0x80>>(dst_bit&7);
+            if(src[src_bit>>3]&(0x80>>(src_bit&7))) {
+                panel_frame[dst_bit>>3]|=mask;
+            } else {
+                panel_frame[dst_bit>>3]&=~mask;
+            }
+            ++src_bit;
+            ++dst_bit;
+        }
+    }
+#endif
+}
+// holds the bus for as long as the transfer would take
+static void panel_bus_wait(int x1, int y1, int x2, int y2) {
+    const uint32_t rate = panel_bus_rate;
+    if(rate==0) {
+        return;
+    }
+    const uint64_t bytes = ((uint64_t)(x2-x1+1)*(y2-y1+1)*LCD_BIT_DEPTH+7)/8;
+    const uint64_t us = bytes*1000000/rate;
+    panel_busy_us+=us;
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+#if LCD_SYNC_TRANSFER == 0
+struct panel_job {
+    int x1, y1, x2, y2;
+    const uint8_t* bitmap;
+};
+struct panel_queue {
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<panel_job> jobs;
+};
+// never destroyed. the transfer thread is still waiting on it when the
+// process exits, and destroying a condition variable with a waiter hangs
+static panel_queue* panel_jobs = nullptr;
+static void panel_transfer_thread() {
+    while(true) {
+        panel_job job;
+        {
+            std::unique_lock<std::mutex> lock(panel_jobs->lock);
+            panel_jobs->ready.wait(lock,[] { return !panel_jobs->jobs.empty(); });
+            job = panel_jobs->jobs.front();
+            panel_jobs->jobs.pop_front();
+        }
+        panel_copy(job.x1,job.y1,job.x2,job.y2,job.bitmap);
+        panel_bus_wait(job.x1,job.y1,job.x2,job.y2);
+        panel_lcd_flush_complete();
+    }
+}
+#endif
+
+void panel_lcd_init(void) {
+    if(panel_frame!=nullptr) {
+        return;
+    }
+    panel_frame = (uint8_t*)calloc(1,(PANEL_FRAME_BITS+7)/8);
+    // the device's buffers are word aligned for DMA, match that so
+    // alignment sensitive paths behave the same
+    panel_transfer[0] = (uint8_t*)aligned_alloc(64,((LCD_TRANSFER_SIZE+63)/64)*64);
+    panel_transfer[1] = (uint8_t*)aligned_alloc(64,((LCD_TRANSFER_SIZE+63)/64)*64);
+#if LCD_SYNC_TRANSFER == 0
+    panel_jobs = new panel_queue();
+    std::thread(panel_transfer_thread).detach();
+#endif
+}
+void* panel_lcd_transfer_buffer(void) {
+    return panel_transfer[0];
+}
+void* panel_lcd_transfer_buffer2(void) {
+    return panel_transfer[1];
+}
+void panel_lcd_flush(int x1, int y1, int x2, int y2, void* bitmap) {
+    ++panel_flush_count;
+    panel_flush_pixels += (uint64_t)(x2-x1+1)*(y2-y1+1);
+#if LCD_SYNC_TRANSFER == 0
+    {
+        std::lock_guard<std::mutex> lock(panel_jobs->lock);
+        panel_jobs->jobs.push_back({x1,y1,x2,y2,(const uint8_t*)bitmap});
+    }
+    panel_jobs->ready.notify_one();
+#else
+    panel_copy(x1,y1,x2,y2,(const uint8_t*)bitmap);
+    panel_bus_wait(x1,y1,x2,y2);
+#endif
+}
+const uint8_t* panel_lcd_host_frame(void) {
+    return panel_frame;
+}
+size_t panel_lcd_host_frame_size(void) {
+    return (PANEL_FRAME_BITS+7)/8;
+}
+uint32_t panel_lcd_host_flush_count(void) {
+    return panel_flush_count;
+}
+uint64_t panel_lcd_host_flush_pixels(void) {
+    return panel_flush_pixels;
+}
+void panel_lcd_host_bus_rate(uint32_t bytes_per_second) {
+    panel_bus_rate = bytes_per_second;
+}
+uint64_t panel_lcd_host_busy_us(void) {
+    return panel_busy_us;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+// a stand-in for htcw_esp_panel's panel.h on Linux. the "panel" is an
+// offscreen framebuffer that flushes are copied into, so frames can be
+// hashed and inspected. the geometry can be overridden with -D flags
+#ifndef LCD_COLOR_RGB
+#define LCD_COLOR_RGB 0
+#define LCD_COLOR_BGR 1
+#define LCD_COLOR_GSC 2
+#endif
+#ifndef LCD_HRES
+#define LCD_HRES 320
+#endif
+#ifndef LCD_VRES
+#define LCD_VRES 240
+#endif
+#ifndef LCD_BIT_DEPTH
+#define LCD_BIT_DEPTH 16
+#endif
+#ifndef LCD_COLOR_SPACE
+#if LCD_BIT_DEPTH == 1
+#define LCD_COLOR_SPACE LCD_COLOR_GSC
+#else
+#define LCD_COLOR_SPACE LCD_COLOR_RGB
+#endif
+#endif
+#define LCD_WIDTH LCD_HRES
+#define LCD_HEIGHT LCD_VRES
+#ifndef LCD_X_ALIGN
+#define LCD_X_ALIGN 1
+#endif
+#ifndef LCD_Y_ALIGN
+#define LCD_Y_ALIGN 1
+#endif
+#ifndef LCD_DIVISOR
+#define LCD_DIVISOR 10
+#endif
+#define LCD_TRANSFER_SIZE ((LCD_WIDTH*LCD_HEIGHT*LCD_BIT_DEPTH+7)/8/LCD_DIVISOR)
+#ifndef LCD_SYNC_TRANSFER
+#define LCD_SYNC_TRANSFER 1
+#endif
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+#ifdef __cplusplus
+extern "C" {
+#endif
+void panel_lcd_init(void);
+void panel_lcd_flush(int x1, int y1, int x2, int y2, void* bitmap);
+void* panel_lcd_transfer_buffer(void);
+void* panel_lcd_transfer_buffer2(void);
+// host only. the offscreen framebuffer is LCD_WIDTH x LCD_HEIGHT packed
+// pixels in the format the panel was flushed with
+const uint8_t* panel_lcd_host_frame(void);
+size_t panel_lcd_host_frame_size(void);
+// host only. counts flushes and the pixels in them
+uint32_t panel_lcd_host_flush_count(void);
+uint64_t panel_lcd_host_flush_pixels(void);
+// host only. models the bus: each flush keeps the panel busy for its size
+// over this many bytes a second. 0 (the default) makes transfers instant
+void panel_lcd_host_bus_rate(uint32_t bytes_per_second);
+// host only. the total time the modeled bus spent transferring
+uint64_t panel_lcd_host_busy_us(void);
+#if LCD_SYNC_TRANSFER == 0
+// the application defines this. it's called from the transfer thread
+// when a flush is done, like the DMA completion interrupt on the device
+void panel_lcd_flush_complete(void);
+#endif
+#ifdef __cplusplus
+}
+#endif
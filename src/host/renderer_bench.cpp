@@ -0,0 +1,295 @@
+// renders the dashboard on Linux into the host panel's offscreen
+// framebuffer. it times paints per control and per full frame, and checks
+// hashes of a few scripted frames against recorded goldens. a frame with
+// no golden for the geometry fails the check, --update-golden records it
+//
+// usage: renderer_bench [--iterations N] [--golden FILE] [--update-golden]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "panel.h"
+#include <gfx.hpp>
+#include <uix.hpp>
+#include "fixed_point.hpp"
+#include "dashboard_controls.hpp"
+#include "dashboard_layout.hpp"
+#define BUNGEE_IMPLEMENTATION
+#include "assets/bungee.h"
+
+using namespace gfx;
+using namespace uix;
+using namespace dashboard;
+
+#if LCD_COLOR_SPACE == LCD_COLOR_GSC
+#define PIXEL gsc_pixel
+#else
+#define PIXEL rgb_pixel
+#endif
+using pixel_t = PIXEL<LCD_BIT_DEPTH>;
+using screen_t = screen_ex<bitmap<pixel_t>,LCD_X_ALIGN,LCD_Y_ALIGN>;
+using view_t = dashboard_view<screen_t::control_surface_type>;
+using uix_color_t = color<uix_pixel>;
+
+static uix::display disp;
+static screen_t main_screen;
+static view_t main_view;
+static const_buffer_stream text_font_stm(bungee,sizeof(bungee));
+
+static void uix_on_flush(const rect16& bounds, const void* bitmap, void* state) {
+    panel_lcd_flush(bounds.x1,bounds.y1,bounds.x2,bounds.y2,(void*)bitmap);
+    disp.flush_complete();
+}
+static void refresh_display() {
+    while(disp.dirty()) {
+        disp.update();
+    }
+}
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the screen TEST_NO_SERIAL shows on the device: CPU and GPU, gradients
+// on the temperature bars
+static void apply_test_screen() {
+    main_view.value1_label.text("CPU");
+    main_view.value1_label.color(uix_pixel(173,216,230,255));
+    main_view.top_value1_label.suffix("%");
+    main_view.top_value2_label.suffix("\xC2\xB0");
+    main_view.top_value1_bar.color(uix_pixel(0,255,0,255));
+    main_view.top_value1_bar.back_color(main_view.top_value1_bar.color().blend(uix_color_t::black,.25));
+    main_view.top_value2_bar.color(uix_pixel(255,127,0,255));
+    main_view.top_value2_bar.back_color(main_view.top_value2_bar.color().blend(uix_color_t::black,.25));
+    main_view.top_value2_bar.is_gradient(true);
+    main_view.value2_label.text("GPU");
+    main_view.value2_label.color(uix_pixel(255,160,122,255));
+    main_view.bottom_value1_label.suffix("%");
+    main_view.bottom_value2_label.suffix("\xC2\xB0");
+    main_view.bottom_value1_bar.color(uix_pixel(255,255,255,255));
+    main_view.bottom_value1_bar.back_color(main_view.bottom_value1_bar.color().blend(uix_color_t::black,.25));
+    main_view.bottom_value2_bar.color(uix_pixel(255,0,255,255));
+    main_view.bottom_value2_bar.back_color(main_view.bottom_value2_bar.color().blend(uix_color_t::black,.25));
+    main_view.bottom_value2_bar.is_gradient(true);
+#if LCD_HEIGHT > 128
+    main_view.history_graph.clear_data();
+    main_view.history_graph.set_line(0,main_view.top_value1_bar.color());
+    main_view.history_graph.set_line(1,main_view.top_value2_bar.color());
+    main_view.history_graph.set_line(2,main_view.bottom_value1_bar.color());
+    main_view.history_graph.set_line(3,main_view.bottom_value2_bar.color());
+#endif
+}
+// deterministic values, so frames hash the same from run to run
+static uint32_t value_seed = 1;
+static unsigned int next_value(unsigned int max) {
+    value_seed = value_seed*1664525+1013904223;
+    return (value_seed>>16)%(max+1);
+}
+static void apply_values(unsigned int v1, unsigned int v2, unsigned int v3, unsigned int v4) {
+    main_view.top_value1_label.value(v1);
+    main_view.top_value1_bar.value_q16(q16_normalize(v1,q16_recip(100)));
+    main_view.top_value2_label.value(v2);
+    main_view.top_value2_bar.value_q16(q16_normalize(v2,q16_recip(90)));
+    main_view.bottom_value1_label.value(v3);
+    main_view.bottom_value1_bar.value_q16(q16_normalize(v3,q16_recip(100)));
+    main_view.bottom_value2_label.value(v4);
+    main_view.bottom_value2_bar.value_q16(q16_normalize(v4,q16_recip(85)));
+#if LCD_HEIGHT > 128
+    main_view.history_graph.add_data_q16(0,q16_normalize(v1,q16_recip(100)));
+    main_view.history_graph.add_data_q16(1,q16_normalize(v2,q16_recip(90)));
+    main_view.history_graph.add_data_q16(2,q16_normalize(v3,q16_recip(100)));
+    main_view.history_graph.add_data_q16(3,q16_normalize(v4,q16_recip(85)));
+#endif
+}
+static void apply_random_values() {
+    apply_values(next_value(100),next_value(90),next_value(100),next_value(85));
+}
+
+// micro benchmarks. each one repeats a change and the refresh it causes
+template<typename Step>
+static void bench(const char* name, int iterations, Step step) {
+    const uint32_t flushes = panel_lcd_host_flush_count();
+    const uint64_t pixels = panel_lcd_host_flush_pixels();
+    const int64_t start = now_ns();
+    for(int i = 0;i<iterations;++i) {
+        step(i);
+        refresh_display();
+    }
+    const int64_t elapsed = now_ns()-start;
+    printf("bench,name=%s,iterations=%d,ns_per_paint=%lld,flushes=%u,pixels=%llu\n",
+        name,iterations,(long long)(elapsed/iterations),
+        (unsigned)(panel_lcd_host_flush_count()-flushes),
+        (unsigned long long)(panel_lcd_host_flush_pixels()-pixels));
+}
+template<typename Control>
+static void bench_control(const char* name, int iterations, Control& control) {
+    bench(name,iterations,[&control](int i) { control.invalidate(); });
+}
+static void run_benchmarks(int iterations) {
+    bench_control("value1_label",iterations,main_view.value1_label);
+    bench_control("top_value1_label",iterations,main_view.top_value1_label);
+    bench_control("top_value1_bar",iterations,main_view.top_value1_bar);
+    bench_control("top_value2_bar_gradient",iterations,main_view.top_value2_bar);
+#if LCD_HEIGHT > 128
+    bench_control("history_graph",iterations,main_view.history_graph);
+#endif
+    bench("label_value",iterations,[](int i) {
+        main_view.top_value1_label.value(i%100);
+    });
+    bench("bar_value",iterations,[](int i) {
+        main_view.top_value1_bar.value_q16(q16_normalize(i%101,q16_recip(100)));
+    });
+    bench("gradient_bar_value",iterations,[](int i) {
+        main_view.top_value2_bar.value_q16(q16_normalize(i%91,q16_recip(90)));
+    });
+    bench("data_packet",iterations,[](int i) {
+        apply_random_values();
+    });
+    bench("full_frame",iterations,[](int i) {
+        main_screen.invalidate();
+    });
+}
+
+// golden frames. the file has one "<scene> <config> <hash>" line per
+// frame, where config is the geometry and bit depth the hash is for.
+// lines starting with # are comments, and saving writes golden_header
+// back out ahead of the hashes
+static const char* golden_header =
+    "# renderer_bench's golden frames: <scene> <config> <FNV-1a hash>\n"
+    "# regenerate with:\n"
+    "#   pio run -e native-bench && .pio/build/native-bench/program --update-golden\n";
+static uint64_t frame_hash() {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const uint8_t* p = panel_lcd_host_frame();
+    for(size_t i = 0;i<panel_lcd_host_frame_size();++i) {
+        hash = (hash^p[i])*0x100000001b3ULL;
+    }
+    return hash;
+}
+struct golden_entry {
+    char scene[32];
+    char config[32];
+    unsigned long long hash;
+};
+static golden_entry goldens[64];
+static int golden_count = 0;
+static bool goldens_changed = false;
+static char golden_config[32];
+static void golden_load(const char* path) {
+    FILE* f = fopen(path,"r");
+    if(f==nullptr) {
+        return;
+    }
+    char line[128];
+    while(golden_count<(int)(sizeof(goldens)/sizeof(goldens[0])) && fgets(line,sizeof(line),f)!=nullptr) {
+        golden_entry e;
+        if(line[0]!='#' && 3==sscanf(line,"%31s %31s %llx",e.scene,e.config,&e.hash)) {
+            goldens[golden_count++] = e;
+        }
+    }
+    fclose(f);
+}
+static bool golden_save(const char* path) {
+    FILE* f = fopen(path,"w");
+    if(f==nullptr) {
+        return false;
+    }
+    fputs(golden_header,f);
+    for(int i = 0;i<golden_count;++i) {
+        fprintf(f,"%s %s %016llx\n",goldens[i].scene,goldens[i].config,goldens[i].hash);
+    }
+    fclose(f);
+    return true;
+}
+// returns false on a mismatch
+static bool golden_check(const char* scene, bool update) {
+    refresh_display();
+    const unsigned long long hash = frame_hash();
+    golden_entry* found = nullptr;
+    for(int i = 0;i<golden_count;++i) {
+        if(0==strcmp(goldens[i].scene,scene) && 0==strcmp(goldens[i].config,golden_config)) {
+            found = &goldens[i];
+            break;
+        }
+    }
+    if(found==nullptr && !update) {
+        printf("golden,scene=%s,config=%s,hash=%016llx,result=missing\n",scene,golden_config,hash);
+        return false;
+    }
+    if(update) {
+        if(found==nullptr) {
+            if(golden_count==(int)(sizeof(goldens)/sizeof(goldens[0]))) {
+                printf("golden,scene=%s,hash=%016llx,result=full\n",scene,hash);
+                return false;
+            }
+            found = &goldens[golden_count++];
+            strncpy(found->scene,scene,sizeof(found->scene)-1);
+            found->scene[sizeof(found->scene)-1]=0;
+            strcpy(found->config,golden_config);
+        }
+        found->hash = hash;
+        goldens_changed = true;
+        printf("golden,scene=%s,hash=%016llx,result=recorded\n",scene,hash);
+        return true;
+    }
+    const bool match = found->hash==hash;
+    printf("golden,scene=%s,hash=%016llx,expected=%016llx,result=%s\n",scene,hash,found->hash,match?"pass":"fail");
+    return match;
+}
+static bool run_goldens(bool update) {
+    bool ok = true;
+    // the device starts out disconnected
+    main_screen.invalidate();
+    ok = golden_check("startup",update) && ok;
+    main_view.disconnected_label.visible(false);
+    apply_test_screen();
+    value_seed = 1;
+    for(int i = 0;i<32;++i) {
+        apply_random_values();
+    }
+    ok = golden_check("populated",update) && ok;
+    main_view.disconnected_label.visible(true);
+    ok = golden_check("disconnected",update) && ok;
+    main_view.disconnected_label.visible(false);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 200;
+    const char* golden_path = "src/host/golden_frames.txt";
+    bool update = false;
+    for(int i = 1;i<argc;++i) {
+        if(0==strcmp(argv[i],"--iterations") && i+1<argc) {
+            iterations = atoi(argv[++i]);
+            if(iterations<1) {
+                iterations = 1;
+            }
+        } else if(0==strcmp(argv[i],"--golden") && i+1<argc) {
+            golden_path = argv[++i];
+        } else if(0==strcmp(argv[i],"--update-golden")) {
+            update = true;
+        } else {
+            fprintf(stderr,"usage: %s [--iterations N] [--golden FILE] [--update-golden]\n",argv[0]);
+            return 2;
+        }
+    }
+    snprintf(golden_config,sizeof(golden_config),"%dx%dx%d",(int)LCD_WIDTH,(int)LCD_HEIGHT,(int)LCD_BIT_DEPTH);
+    panel_lcd_init();
+    disp.buffer_size(LCD_TRANSFER_SIZE);
+    disp.buffer1((uint8_t*)panel_lcd_transfer_buffer());
+    disp.on_flush_callback(uix_on_flush);
+    main_screen.dimensions({LCD_WIDTH,LCD_HEIGHT});
+    main_screen.background_color(color<pixel_t>::black);
+    main_view.layout(main_screen,text_font_stm,uix_color_t::black);
+    disp.active_screen(main_screen);
+    golden_load(golden_path);
+    const bool ok = run_goldens(update);
+    if(goldens_changed && !golden_save(golden_path)) {
+        fprintf(stderr,"unable to write %s\n",golden_path);
+        return 1;
+    }
+    printf("bench,config=%s,transfer_size=%d\n",golden_config,(int)LCD_TRANSFER_SIZE);
+    run_benchmarks(iterations);
+    return ok?0:1;
+}
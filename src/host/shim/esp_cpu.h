@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+// the simulator's cycle counter runs at esp_rom_get_cpu_ticks_per_us()
+// off the host's monotonic clock
+typedef uint32_t esp_cpu_cycle_count_t;
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdio.h>
+// the simulator's logging goes to stderr, so stdout stays machine readable
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+static inline void esp_log_level_set(const char* tag, esp_log_level_t level) {
+}
+#define ESP_LOGE(tag, format, ...) fprintf(stderr,"E (%s) " format "\n",tag,##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr,"W (%s) " format "\n",tag,##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) fprintf(stderr,"I (%s) " format "\n",tag,##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do {} while(0)
+#define ESP_LOGV(tag, format, ...) do {} while(0)
@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+// microseconds since the simulator started
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+// the simulator's FreeRTOS. tasks are threads, ticks run at the IDF's
+// default 100Hz so delays and timeouts match the device, and critical
+// sections share one lock
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000/configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms)*configTICK_RATE_HZ)/1000))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+void sim_critical_enter(void);
+void sim_critical_exit(void);
+#define portENTER_CRITICAL(mux) sim_critical_enter()
+#define portEXIT_CRITICAL(mux) sim_critical_exit()
+#define portNUM_PROCESSORS 1
+#define xPortGetCoreID() 0
+#define portENTER_CRITICAL_ISR(mux) sim_critical_enter()
+#define portEXIT_CRITICAL_ISR(mux) sim_critical_exit()
+// the transfer thread wakes waiters directly
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
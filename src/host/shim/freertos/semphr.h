@@ -0,0 +1,8 @@
+#pragma once
+#include "FreeRTOS.h"
+// binary semaphores only, which is all the firmware uses
+typedef void* SemaphoreHandle_t;
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_priority_task_woken);
@@ -0,0 +1,9 @@
+#pragma once
+#include "FreeRTOS.h"
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+void sim_task_yield(void);
+#define taskYIELD() sim_task_yield()
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters, UBaseType_t priority, TaskHandle_t* created_task);
@@ -0,0 +1,443 @@
+// runs the firmware on Linux. main.cpp and serial.cpp are compiled as they
+// are against the shims in src/host/shim: FreeRTOS tasks are threads,
+// UART0 is a pseudo-terminal and the panel is the host panel's offscreen
+// framebuffer.
+//
+// usage: simulator [--link PATH] [--nvs FILE] [--bus-bps N] [--no-pace]
+//                  [--frame FILE]
+//
+// the pty's path is printed as "sim,pty=..." on startup (--link also
+// symlinks it somewhere stable). SIGUSR1 writes the current frame to the
+// --frame file and SIGINT prints the panel counters and exits
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "panel.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_sys.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+extern "C" void app_main();
+
+static const std::chrono::steady_clock::time_point sim_start = std::chrono::steady_clock::now();
+
+// timer and tasks
+int64_t esp_timer_get_time(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now()-sim_start).count();
+}
+// a 240MHz part
+uint32_t esp_rom_get_cpu_ticks_per_us(void) {
+    return 240;
+}
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+    return (esp_cpu_cycle_count_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now()-sim_start).count()*6/25);
+}
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time()/(1000*portTICK_PERIOD_MS));
+}
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds((uint64_t)ticks*portTICK_PERIOD_MS));
+}
+void sim_task_yield(void) {
+    std::this_thread::yield();
+}
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters, UBaseType_t priority, TaskHandle_t* created_task) {
+    std::thread* task = new std::thread(code,parameters);
+    task->detach();
+    if(created_task!=nullptr) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+// critical sections keep out the transfer thread, which stands in for
+// the DMA interrupt
+static std::recursive_mutex sim_critical_lock;
+void sim_critical_enter(void) {
+    sim_critical_lock.lock();
+}
+void sim_critical_exit(void) {
+    sim_critical_lock.unlock();
+}
+struct sim_semaphore {
+    std::mutex lock;
+    std::condition_variable given;
+    bool full = false;
+};
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return new sim_semaphore();
+}
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+    sim_semaphore& s = *(sim_semaphore*)semaphore;
+    std::unique_lock<std::mutex> lock(s.lock);
+    if(ticks_to_wait==portMAX_DELAY) {
+        s.given.wait(lock,[&s]{ return s.full; });
+    } else if(!s.given.wait_for(lock,std::chrono::milliseconds((uint64_t)ticks_to_wait*portTICK_PERIOD_MS),[&s]{ return s.full; })) {
+        return pdFALSE;
+    }
+    s.full = false;
+    return pdTRUE;
+}
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    sim_semaphore& s = *(sim_semaphore*)semaphore;
+    std::lock_guard<std::mutex> lock(s.lock);
+    if(s.full) {
+        return pdFALSE;
+    }
+    s.full = true;
+    s.given.notify_one();
+    return pdTRUE;
+}
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_priority_task_woken) {
+    if(higher_priority_task_woken!=nullptr) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+    return xSemaphoreGive(semaphore);
+}
+uint32_t esp_random(void) {
+    static std::mt19937 engine(1);
+    return engine();
+}
+
+// heap
+#ifndef SIM_HEAP_SIZE
+#define SIM_HEAP_SIZE (300*1024)
+#endif
+static std::atomic<size_t> sim_heap_used(0);
+static std::atomic<size_t> sim_heap_peak(0);
+static void* sim_heap_track(void* ptr) {
+    if(ptr!=nullptr) {
+        const size_t used = (sim_heap_used+=malloc_usable_size(ptr));
+        size_t peak = sim_heap_peak;
+        while(used>peak && !sim_heap_peak.compare_exchange_weak(peak,used)) {}
+    }
+    return ptr;
+}
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+    if((caps&MALLOC_CAP_SPIRAM) || sim_heap_used+size>SIM_HEAP_SIZE) {
+        return nullptr;
+    }
+    return sim_heap_track(malloc(size));
+}
+void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+    if((caps&MALLOC_CAP_SPIRAM) || sim_heap_used+size>SIM_HEAP_SIZE) {
+        return nullptr;
+    }
+    return sim_heap_track(aligned_alloc(alignment,((size+alignment-1)/alignment)*alignment));
+}
+void heap_caps_free(void* ptr) {
+    if(ptr!=nullptr) {
+        sim_heap_used-=malloc_usable_size(ptr);
+        free(ptr);
+    }
+}
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return (caps&MALLOC_CAP_SPIRAM)?0:SIM_HEAP_SIZE-sim_heap_used;
+}
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return (caps&MALLOC_CAP_SPIRAM)?0:SIM_HEAP_SIZE-sim_heap_peak;
+}
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return heap_caps_get_free_size(caps);
+}
+
+// nvs. the firmware only stores bytes
+struct sim_nvs_entry {
+    char key[16];
+    uint8_t value;
+};
+static sim_nvs_entry sim_nvs[32];
+static size_t sim_nvs_count = 0;
+static const char* sim_nvs_path = nullptr;
+static std::mutex sim_nvs_lock;
+esp_err_t nvs_flash_init(void) {
+    std::lock_guard<std::mutex> lock(sim_nvs_lock);
+    sim_nvs_count = 0;
+    if(sim_nvs_path==nullptr) {
+        return ESP_OK;
+    }
+    FILE* f = fopen(sim_nvs_path,"r");
+    if(f==nullptr) {
+        return ESP_OK;
+    }
+    unsigned int value;
+    while(sim_nvs_count<sizeof(sim_nvs)/sizeof(sim_nvs[0]) &&
+            2==fscanf(f,"%15s %u",sim_nvs[sim_nvs_count].key,&value)) {
+        sim_nvs[sim_nvs_count++].value = (uint8_t)value;
+    }
+    fclose(f);
+    return ESP_OK;
+}
+esp_err_t nvs_flash_erase(void) {
+    std::lock_guard<std::mutex> lock(sim_nvs_lock);
+    sim_nvs_count = 0;
+    return ESP_OK;
+}
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    *out_handle = 1;
+    return ESP_OK;
+}
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value) {
+    std::lock_guard<std::mutex> lock(sim_nvs_lock);
+    for(size_t i = 0;i<sim_nvs_count;++i) {
+        if(0==strcmp(sim_nvs[i].key,key)) {
+            *out_value = sim_nvs[i].value;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value) {
+    std::lock_guard<std::mutex> lock(sim_nvs_lock);
+    for(size_t i = 0;i<sim_nvs_count;++i) {
+        if(0==strcmp(sim_nvs[i].key,key)) {
+            sim_nvs[i].value = value;
+            return ESP_OK;
+        }
+    }
+    if(sim_nvs_count==sizeof(sim_nvs)/sizeof(sim_nvs[0]) || strlen(key)>=sizeof(sim_nvs[0].key)) {
+        return ESP_ERR_NO_MEM;
+    }
+    strcpy(sim_nvs[sim_nvs_count].key,key);
+    sim_nvs[sim_nvs_count++].value = value;
+    return ESP_OK;
+}
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(sim_nvs_lock);
+    if(sim_nvs_path==nullptr) {
+        return ESP_OK;
+    }
+    FILE* f = fopen(sim_nvs_path,"w");
+    if(f==nullptr) {
+        return ESP_FAIL;
+    }
+    for(size_t i = 0;i<sim_nvs_count;++i) {
+        fprintf(f,"%s %u\n",sim_nvs[i].key,(unsigned)sim_nvs[i].value);
+    }
+    fclose(f);
+    return ESP_OK;
+}
+void nvs_close(nvs_handle_t handle) {
+}
+
+// uart0 on a pty
+static int sim_uart_fd = -1;
+static int sim_uart_baud = 115200;
+static bool sim_uart_pace = true;
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t* uart_queue, int intr_alloc_flags) {
+    return (uart_num==UART_NUM_0 && sim_uart_fd!=-1)?ESP_OK:ESP_FAIL;
+}
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t* uart_config) {
+    if(uart_config->baud_rate>0) {
+        sim_uart_baud = uart_config->baud_rate;
+    }
+    return ESP_OK;
+}
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num) {
+    return ESP_OK;
+}
+int uart_read_bytes(uart_port_t uart_num, void* buf, uint32_t length, TickType_t ticks_to_wait) {
+    uint8_t* p = (uint8_t*)buf;
+    uint32_t read_count = 0;
+    const int64_t deadline = ticks_to_wait==portMAX_DELAY?-1:
+        esp_timer_get_time()+(int64_t)ticks_to_wait*portTICK_PERIOD_MS*1000;
+    while(read_count<length) {
+        int timeout_ms = -1;
+        if(deadline>=0) {
+            const int64_t left = deadline-esp_timer_get_time();
+            timeout_ms = left>0?(int)((left+999)/1000):0;
+        }
+        pollfd pfd = {sim_uart_fd,POLLIN,0};
+        const int ready = poll(&pfd,1,timeout_ms);
+        if(ready<0 && errno==EINTR) {
+            continue;
+        }
+        if(ready<=0) {
+            break;
+        }
+        if(pfd.revents&POLLHUP) {
+            // nobody has the other end open. that looks like a quiet line
+            if(deadline>=0 && esp_timer_get_time()>=deadline) {
+                break;
+            }
+            vTaskDelay(1);
+            continue;
+        }
+        const ssize_t r = read(sim_uart_fd,p+read_count,length-read_count);
+        if(r<=0) {
+            if(r<0 && (errno==EINTR || errno==EAGAIN)) {
+                continue;
+            }
+            break;
+        }
+        read_count+=r;
+    }
+    return (int)read_count;
+}
+int uart_write_bytes(uart_port_t uart_num, const void* src, size_t size) {
+    pollfd pfd = {sim_uart_fd,POLLOUT,0};
+    if(poll(&pfd,1,0)>=0 && (pfd.revents&POLLHUP)) {
+        // nobody's listening, so the bytes go nowhere like they would on
+        // a real line
+        return (int)size;
+    }
+    const uint8_t* p = (const uint8_t*)src;
+    size_t written = 0;
+    while(written<size) {
+        const ssize_t w = write(sim_uart_fd,p+written,size-written);
+        if(w<0) {
+            if(errno==EINTR) {
+                continue;
+            }
+            if(errno==EAGAIN) {
+                vTaskDelay(1);
+                continue;
+            }
+            return -1;
+        }
+        written+=w;
+    }
+    if(sim_uart_pace) {
+        // 10 bits a byte on the wire
+        std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)size*10*1000000/sim_uart_baud));
+    }
+    return (int)size;
+}
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait) {
+    return ESP_OK;
+}
+static bool sim_uart_open(const char* link_path) {
+    sim_uart_fd = posix_openpt(O_RDWR|O_NOCTTY|O_NONBLOCK);
+    if(sim_uart_fd==-1 || grantpt(sim_uart_fd)!=0 || unlockpt(sim_uart_fd)!=0) {
+        perror("pty");
+        return false;
+    }
+    const char* name = ptsname(sim_uart_fd);
+    // raw mode, so the protocol's bytes pass through untouched
+    int slave = open(name,O_RDWR|O_NOCTTY);
+    if(slave!=-1) {
+        termios tio;
+        if(0==tcgetattr(slave,&tio)) {
+            cfmakeraw(&tio);
+            tcsetattr(slave,TCSANOW,&tio);
+        }
+        close(slave);
+    }
+    if(link_path!=nullptr) {
+        unlink(link_path);
+        if(0!=symlink(name,link_path)) {
+            perror("symlink");
+            return false;
+        }
+    }
+    printf("sim,pty=%s\n",name);
+    fflush(stdout);
+    return true;
+}
+
+// frames are written as PPM for 16-bit panels and raw otherwise
+static bool sim_write_frame(const char* path) {
+    FILE* f = fopen(path,"wb");
+    if(f==nullptr) {
+        return false;
+    }
+    const uint8_t* frame = panel_lcd_host_frame();
+#if LCD_BIT_DEPTH == 16 && LCD_COLOR_SPACE != LCD_COLOR_GSC
+    fprintf(f,"P6\n%d %d\n255\n",(int)LCD_WIDTH,(int)LCD_HEIGHT);
+    for(size_t i = 0;i<(size_t)LCD_WIDTH*LCD_HEIGHT;++i) {
+        // gfx stores RGB565 big endian unless the build swaps it
+#ifdef HTCW_GFX_NO_SWAP
+        const uint16_t v = frame[i*2]|(frame[i*2+1]<<8);
+#else
+        const uint16_t v = (frame[i*2]<<8)|frame[i*2+1];
+#endif
+        const uint8_t rgb[3] = {(uint8_t)(((v>>11)&31)*255/31),(uint8_t)(((v>>5)&63)*255/63),(uint8_t)((v&31)*255/31)};
+        fwrite(rgb,1,3,f);
+    }
+#else
+    fwrite(frame,1,panel_lcd_host_frame_size(),f);
+#endif
+    fclose(f);
+    return true;
+}
+
+static volatile sig_atomic_t sim_frame_requested = 0;
+static volatile sig_atomic_t sim_exit_requested = 0;
+static void sim_on_signal(int sig) {
+    if(sig==SIGUSR1) {
+        sim_frame_requested = 1;
+    } else {
+        sim_exit_requested = 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* link_path = nullptr;
+    const char* frame_path = "espmon_sim_frame.ppm";
+    for(int i = 1;i<argc;++i) {
+        if(0==strcmp(argv[i],"--link") && i+1<argc) {
+            link_path = argv[++i];
+        } else if(0==strcmp(argv[i],"--nvs") && i+1<argc) {
+            sim_nvs_path = argv[++i];
+        } else if(0==strcmp(argv[i],"--bus-bps") && i+1<argc) {
+            panel_lcd_host_bus_rate((uint32_t)strtoul(argv[++i],nullptr,10));
+        } else if(0==strcmp(argv[i],"--no-pace")) {
+            sim_uart_pace = false;
+        } else if(0==strcmp(argv[i],"--frame") && i+1<argc) {
+            frame_path = argv[++i];
+        } else {
+            fprintf(stderr,"usage: %s [--link PATH] [--nvs FILE] [--bus-bps N] [--no-pace] [--frame FILE]\n",argv[0]);
+            return 2;
+        }
+    }
+    signal(SIGPIPE,SIG_IGN);
+    signal(SIGUSR1,sim_on_signal);
+    signal(SIGINT,sim_on_signal);
+    signal(SIGTERM,sim_on_signal);
+    if(!sim_uart_open(link_path)) {
+        return 1;
+    }
+    app_main();
+    while(!sim_exit_requested) {
+        if(sim_frame_requested) {
+            sim_frame_requested = 0;
+            printf("sim,frame=%s,result=%s\n",frame_path,sim_write_frame(frame_path)?"ok":"failed");
+            fflush(stdout);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    printf("sim,uptime_us=%lld,flushes=%u,pixels=%llu,bus_busy_us=%llu,heap_free=%u,heap_min=%u\n",
+        (long long)esp_timer_get_time(),
+        (unsigned)panel_lcd_host_flush_count(),
+        (unsigned long long)panel_lcd_host_flush_pixels(),
+        (unsigned long long)panel_lcd_host_busy_us(),
+        (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+    if(link_path!=nullptr) {
+        unlink(link_path);
+    }
+    fflush(stdout);
+    // the firmware's tasks never return, so don't wait on them
+    _exit(0);
+}
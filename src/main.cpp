@@ -3,36 +3,176 @@
 #include "freertos/task.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_idf_version.h"
+#include "esp_freertos_hooks.h"
+#ifdef LCD_DIRECT_FRAMEBUFFER
+#include "panel_direct.h"
+#if __has_include("esp_cache.h")
+#include "esp_cache.h"
+#define DIRECT_CACHE_SYNC
+#endif
+#endif
 #include <memory.h>
 #include <stdio.h>
 #include "panel.h"
+#if defined(TOUCH_BUS) || defined(BUTTON)
+#include "driver/gpio.h"
+#endif
 #include <gfx.hpp>
 #include <uix.hpp>
 #include "serial.hpp"
+#include "espmon_protocol.hpp"
+#include "fixed_point.hpp"
+#include "metric_stats.hpp"
+#include "flush_tiles.hpp"
+#include "dashboard_controls.hpp"
+#include "dashboard_layout.hpp"
+#ifndef NO_LINK_STATS
+#include "link_stats.hpp"
+#endif
+#include "trace_points.hpp"
+#include "profiler.hpp"
+#if defined(TOUCH_BUS) || defined(BUTTON)
+#include "input_latency.hpp"
+#ifndef NO_INPUT_LATENCY
+#define INPUT_LATENCY
+#endif
+#endif
+#ifdef LCD_INDEXED_BITS
+#include "theme_palette.hpp"
+#endif
+#if __has_include("board_tuning.h")
+// per board transfer buffer settings measured with display_test.cpp,
+// generated into the build by board_tuning.py
+#include "board_tuning.h"
+#endif
 #define BUNGEE_IMPLEMENTATION
 #include "assets/bungee.h"
 
 using namespace gfx;
 using namespace uix;
+using namespace dashboard;
 
 static uix::display disp;
+#ifdef TRACE_RING_SIZE
+trace_rings_t trace_log;
+#endif
+#ifdef INPUT_LATENCY
+static input_latency input_timing;
+#endif
+#if defined(LCD_INDEXED_BITS) && LCD_SYNC_TRANSFER == 0
+// the panel's transfer buffers only hold expanded lines. the completion
+// ISR gives one back as each goes out
+static SemaphoreHandle_t indexed_lines_free = nullptr;
+// lines still on the wire
+static volatile int indexed_lines_pending = 0;
+static portMUX_TYPE indexed_lines_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+#ifdef LCD_PAGE_FORMAT
+// transfers still outstanding for the current flush
+static volatile int page_windows_pending = 0;
+#endif
+#if defined(LCD_FLUSH_RING_DEPTH) && LCD_FLUSH_RING_DEPTH > 2 && LCD_SYNC_TRANSFER == 0
+#if defined(LCD_INDEXED_BITS) || defined(LCD_PAGE_FORMAT)
+#error "LCD_FLUSH_RING_DEPTH can't be combined with LCD_INDEXED_BITS or page format panels"
+#endif
+// rendering runs ahead of the DMA. uix renders into two buffers of its
+// own, and each flush is copied into the next free buffer of a ring of
+// DMA buffers and queued, so uix gets its buffer back right away. no
+// board turns it on until it has been run on hardware
+#define FLUSH_RING
+// board_tuning.py sets both from a display_test sweep
+#ifdef LCD_TUNED_BUFFER_SIZE
+#define FLUSH_RING_SIZE LCD_TUNED_BUFFER_SIZE
+#else
+#define FLUSH_RING_SIZE LCD_TRANSFER_SIZE
+#endif
+static uint8_t* flush_ring[LCD_FLUSH_RING_DEPTH];
+static uint8_t* flush_ring_render[2];
+// 0 if the render buffers couldn't be allocated, and flushes go straight
+// out of the panel's buffers like usual
+static size_t flush_ring_count = 0;
+static size_t flush_ring_next = 0;
+// one count per ring buffer that isn't on the wire. transfers finish in
+// the order they're queued, so the next buffer round is always the free
+// one
+static SemaphoreHandle_t flush_ring_free = nullptr;
+static volatile size_t flush_ring_queued = 0;
+static portMUX_TYPE flush_ring_lock = portMUX_INITIALIZER_UNLOCKED;
+// metrics
+static uint32_t flush_ring_flushes = 0;
+static uint32_t flush_ring_stalls = 0;
+static uint64_t flush_ring_stall_us = 0;
+static size_t flush_ring_max_queued = 0;
+#endif
+#if LCD_BIT_DEPTH == 18 && !defined(LCD_INDEXED_BITS) && !defined(NO_WIDEN_FLUSH) && \
+        !defined(FLUSH_RING) && LCD_SYNC_TRANSFER == 0
+// widened flushes go out as two bands, and the first band to go is
+// on the wire while the second is being widened
+#define WIDEN_BANDS
+// transfers still outstanding for the current flush
+static volatile int widen_pending = 0;
+#endif
 #if LCD_SYNC_TRANSFER == 0
 // indicates the LCD DMA transfer is complete
 IRAM_ATTR void panel_lcd_flush_complete(void) {
-    disp.flush_complete();
-}
+#ifdef FLUSH_RING
+    if(flush_ring_count>0) {
+        // uix was already told when the flush was copied into the ring
+        portENTER_CRITICAL_ISR(&flush_ring_lock);
+        if(flush_ring_queued>0) {
+            --flush_ring_queued;
+        }
+        portEXIT_CRITICAL_ISR(&flush_ring_lock);
+        BaseType_t woken = pdFALSE;
+        xSemaphoreGiveFromISR(flush_ring_free,&woken);
+        TRACE_END(dma,0);
+#ifdef INPUT_LATENCY
+        input_timing.transfer_end((uint32_t)esp_timer_get_time());
 #endif
-// flush a bitmap to the display
-static void uix_on_flush(const rect16& bounds,const void *bitmap, void* state) {
-    //printf("flush (%d, %d)-(%d, %d)\n",bounds.x1, bounds.y1, bounds.x2, bounds.y2);
-    panel_lcd_flush(bounds.x1, bounds.y1, bounds.x2, bounds.y2,
-                              (void *)bitmap);
-#if LCD_SYNC_TRANSFER > 0
-    disp.flush_complete();
+        portYIELD_FROM_ISR(woken);
+        return;
+    }
+#endif
+#ifdef LCD_PAGE_FORMAT
+    if(page_windows_pending>0 && --page_windows_pending>0) {
+        return;
+    }
+#endif
+#ifdef WIDEN_BANDS
+    if(widen_pending>0 && --widen_pending>0) {
+        return;
+    }
+#endif
+#ifdef LCD_INDEXED_BITS
+    // uix got its buffer back when the lines were expanded
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(indexed_lines_free,&woken);
+    portENTER_CRITICAL_ISR(&indexed_lines_lock);
+    const bool last = indexed_lines_pending>0 && --indexed_lines_pending==0;
+    portEXIT_CRITICAL_ISR(&indexed_lines_lock);
+    if(last) {
+        TRACE_END(dma,0);
+#ifdef INPUT_LATENCY
+        input_timing.transfer_end((uint32_t)esp_timer_get_time());
+#endif
+    }
+    portYIELD_FROM_ISR(woken);
+    return;
+#endif
+    TRACE_END(dma,0);
+#ifdef INPUT_LATENCY
+    input_timing.transfer_end((uint32_t)esp_timer_get_time());
 #endif
+    disp.flush_complete();
 }
+#endif
 #if defined(TOUCH_BUS) || defined(BUTTON)
-static TickType_t pressed = 0;
+static bool pressed = false;
+// when the press started
+static uint32_t pressed_us = 0;
 static bool dark_mode = true;
 #else
 static const bool dark_mode = true;
@@ -45,8 +185,25 @@ const_buffer_stream text_font_stm(bungee,sizeof(bungee));
 #elif (LCD_COLOR_SPACE == LCD_COLOR_RGB || LCD_COLOR_SPACE == LCD_COLOR_BGR) 
 #define PIXEL rgb_pixel
 #endif
+#ifdef LCD_INDEXED_BITS
+#if LCD_BIT_DEPTH != 16 || LCD_COLOR_SPACE == LCD_COLOR_GSC
+#error "LCD_INDEXED_BITS requires a 16-bit color panel"
+#endif
+// render into palette indexes and expand them to the panel's pixels at
+// flush time. see theme_palette.hpp
+using palette_t = theme_palette<LCD_INDEXED_BITS,PIXEL<LCD_BIT_DEPTH>>;
+using pixel_t = palette_t::pixel_type;
+static palette_t screen_palette;
+// rows of 4-bit pixels have to start and end on a byte
+#if LCD_INDEXED_BITS == 4 && (LCD_X_ALIGN & 1)
+#define SCREEN_X_ALIGN (LCD_X_ALIGN*2)
+#else
+#define SCREEN_X_ALIGN LCD_X_ALIGN
+#endif
+using screen_t = screen_ex<bitmap<pixel_t,palette_t>,SCREEN_X_ALIGN,LCD_Y_ALIGN>;
+#else
 #if LCD_BIT_DEPTH==18
-using pixel_t = pixel<
+using panel_pixel_t = pixel<
     channel_traits<channel_name::nop,2>,
     channel_traits<channel_name::R,6>,
     channel_traits<channel_name::nop,2>,
@@ -54,575 +211,1105 @@ using pixel_t = pixel<
     channel_traits<channel_name::nop,2>,
     channel_traits<channel_name::B,6>
 >;
+#ifndef NO_WIDEN_FLUSH
+// render in 16-bit and widen to the panel's format at flush time
+#define WIDEN_FLUSH
+using pixel_t = rgb_pixel<16>;
+#else
+using pixel_t = panel_pixel_t;
+#endif
 #else 
 using pixel_t = PIXEL<LCD_BIT_DEPTH>;
 #endif
 using screen_t = screen_ex<bitmap<pixel_t>,LCD_X_ALIGN,LCD_Y_ALIGN>;
+#endif
 
 using color_t = color<screen_t::pixel_type>;
 using uix_color_t = color<uix_pixel>;
 using vcolor_t = color<vector_pixel>;
 
-template<typename ControlSurfaceType>
-class vvert_label : public canvas_control<ControlSurfaceType> {
-    using base_type = canvas_control<ControlSurfaceType>;
-public:
-    using type = vvert_label;
-    using control_surface_type = ControlSurfaceType;
-private:
-    canvas_text_info m_label_text;
-    canvas_path m_label_text_path;
-    rectf m_label_text_bounds;
-    bool m_label_text_dirty;
-    vector_pixel m_color;
-    uix_pixel m_background_color;
-    void build_label_path_untransformed() {
-        const float target_width = this->dimensions().height;
-        float fsize = this->dimensions().width;
-        if(m_label_text_path.initialized()) {
-            m_label_text_path.clear();
-        } else {
-            m_label_text_path.initialize();
-        }
-        do {
-            m_label_text_path.clear();
-            m_label_text.font_size = fsize;
-            m_label_text_path.text({0.f,0.f},m_label_text);
-            m_label_text_bounds = m_label_text_path.bounds(true);
-            --fsize;
-            
-        } while(fsize>0.f && m_label_text_bounds.width()>=target_width);
-    }
-public:
-    vvert_label() : base_type() ,m_label_text_dirty(true) {
-        m_label_text.ttf_font = &text_font_stm;
-        m_label_text.text_sz("Label");
-        m_label_text.encoding = &text_encoding::utf8;
-        m_label_text.ttf_font_face = 0;
-        m_color = vector_pixel(255,255,255,255);
-    }
-    virtual ~vvert_label() {
-
-    }
-    text_handle text() const {
-        return m_label_text.text;
+#ifndef NO_FLUSH_TILES
+// tiles are kept aligned to the panel's own alignment requirements
+#ifndef FLUSH_TILE_WIDTH
+#define FLUSH_TILE_WIDTH (((32+LCD_X_ALIGN-1)/LCD_X_ALIGN)*LCD_X_ALIGN)
+#endif
+#ifndef FLUSH_TILE_HEIGHT
+#define FLUSH_TILE_HEIGHT (((16+LCD_Y_ALIGN-1)/LCD_Y_ALIGN)*LCD_Y_ALIGN)
+#endif
+using flush_tiles_t = flush_tile_cache<LCD_WIDTH,LCD_HEIGHT,pixel_t::bit_depth,FLUSH_TILE_WIDTH,FLUSH_TILE_HEIGHT>;
+static flush_tiles_t flush_tiles;
+#endif
+#ifdef WIDEN_FLUSH
+// finds the start of the transfer buffer a flush was rendered into. the
+// flush may have been trimmed to a band further into it
+static uint8_t* transfer_buffer_base(const void* bitmap) {
+#ifdef FLUSH_RING
+    for(size_t i = 0;i<2 && flush_ring_count>0;++i) {
+        if((const uint8_t*)bitmap>=flush_ring_render[i] && (const uint8_t*)bitmap<flush_ring_render[i]+FLUSH_RING_SIZE) {
+            return flush_ring_render[i];
+        }
     }
-    void text(text_handle text, size_t text_byte_count) {
-        m_label_text.text=text;
-        m_label_text.text_byte_count = text_byte_count;
-        m_label_text_dirty = true;
-        this->invalidate();
+#endif
+#if LCD_SYNC_TRANSFER == 0
+    uint8_t* base2 = (uint8_t*)panel_lcd_transfer_buffer2();
+    if((const uint8_t*)bitmap>=base2 && (const uint8_t*)bitmap<base2+LCD_TRANSFER_SIZE) {
+        return base2;
     }
-    void text(const char* sz) {
-        m_label_text.text_sz(sz);
-        m_label_text_dirty = true;
-        this->invalidate();
+#endif
+    return (uint8_t*)panel_lcd_transfer_buffer();
+}
+#endif
+#ifdef WIDEN_FLUSH
+// the panel bytes for each channel value. every channel lands in its own
+// byte, so a panel pixel is the OR of three entries
+static uint8_t widen_r[32][3];
+static uint8_t widen_g[64][3];
+static uint8_t widen_b[32][3];
+// the byte order gfx stores 16-bit pixels in
+static bool widen_big_endian;
+static void widen_init() {
+    uint8_t buf[3];
+    bitmap<panel_pixel_t> bmp({1,1},buf);
+    panel_pixel_t ppx;
+    for(int i = 0;i<64;++i) {
+        if(i<32) {
+            convert(pixel_t(i,0,0),&ppx);
+            bmp.point({0,0},ppx);
+            memcpy(widen_r[i],buf,3);
+            convert(pixel_t(0,0,i),&ppx);
+            bmp.point({0,0},ppx);
+            memcpy(widen_b[i],buf,3);
+        }
+        convert(pixel_t(0,i,0),&ppx);
+        bmp.point({0,0},ppx);
+        memcpy(widen_g[i],buf,3);
     }
-    rgba_pixel<32> color() const {
-        rgba_pixel<32> result;
-        convert(m_color,&result);
-        return result;
+    uint8_t buf16[2];
+    bitmap<pixel_t> bmp16({1,1},buf16);
+    bmp16.point({0,0},pixel_t(31,0,0));
+    widen_big_endian = buf16[0]==0xF8;
+}
+// widens 16-bit pixels at in to panel pixels ending at out. it works
+// back to front, so in and out may overlap as long as out isn't before in
+static void widen_pixels(uint8_t* out, const uint8_t* in, size_t pixel_count) {
+    const uint8_t* in_end = in;
+    in+=pixel_count*2;
+    out+=pixel_count*3;
+    while(in!=in_end) {
+        in-=2;
+        out-=3;
+        const uint16_t v = widen_big_endian?((in[0]<<8)|in[1]):((in[1]<<8)|in[0]);
+        const uint8_t* r = widen_r[v>>11];
+        const uint8_t* g = widen_g[(v>>5)&0x3F];
+        const uint8_t* b = widen_b[v&0x1F];
+        out[0] = r[0]|g[0]|b[0];
+        out[1] = r[1]|g[1]|b[1];
+        out[2] = r[2]|g[2]|b[2];
     }
-    void color(rgba_pixel<32> value) {
-        convert(value,&m_color);
-        this->invalidate();
+}
+#ifdef WIDEN_BANDS
+// the rows at the bottom of a flush that can be widened past the end of
+// the 16-bit pixels without touching any of them. that's at most a third
+// of the rows, kept on the panel's row alignment and with the band
+// starting on a 4 byte boundary for the DMA
+static int widen_tail_rows(int width, int height) {
+    int rows = height/3;
+    rows-=rows%LCD_Y_ALIGN;
+    while(rows>0 && (((size_t)width*(height-rows))&3)!=0) {
+        rows-=LCD_Y_ALIGN;
     }
-    gfx::rgba_pixel<32> background_color() const {
-        return m_background_color;
+    return rows;
+}
+// widens and sends a flush as two bands. the bottom band lands past the
+// 16-bit pixels, so it goes out first, and the top band is widened in
+// place while it's on the wire. returns false if the flush is too small
+// to split, and nothing was sent
+static bool widen_bands_flush(int x1, int y1, int x2, int y2, const void* bitmap) {
+    const int width = x2-x1+1;
+    const int height = y2-y1+1;
+    const int tail = widen_tail_rows(width,height);
+    if(tail==0) {
+        return false;
     }
-    void background_color(gfx::rgba_pixel<32> value) {
-        m_background_color = value;
-        this->invalidate();
+    uint8_t* base = transfer_buffer_base(bitmap);
+    const size_t pixel_count = (size_t)width*height;
+    if(base!=bitmap) {
+        memmove(base,bitmap,pixel_count*2);
     }
-    
-protected:
-    virtual void on_before_paint() override {
-        if(m_label_text_dirty) {
-            build_label_path_untransformed();
-            m_label_text_dirty = false;
-        }
-    }
-    virtual void on_paint(control_surface_type& destination, const gfx::srect16& clip) {
-        if(m_background_color.opacity()!=0) {
-            gfx::draw::filled_rectangle(destination,destination.bounds(),m_background_color);
-        }
-        base_type::on_paint(destination,clip);
-    }
-    virtual void on_paint(canvas& destination, const srect16& clip) override {
-        canvas_style si = destination.style();
-        si.fill_paint_type = paint_type::solid;
-        si.stroke_paint_type = paint_type::none;
-        si.fill_color = m_color;
-        destination.style(si);
-        // save the current transform
-        matrix old = destination.transform();
-        matrix m = old.rotate(math::deg2rad(-90));
-        
-        m=m.translate(-m_label_text_bounds.width()-((destination.dimensions().height-m_label_text_bounds.width())*0.5f),m_label_text_bounds.height());
-        destination.transform(m);
-        destination.path(m_label_text_path);
-        destination.render();
-        destination.clear_path();
-        // restore the old transform
-        destination.transform(old);
+    const size_t head_count = (size_t)width*(height-tail);
+    widen_pixels(base+head_count*3,base+head_count*2,pixel_count-head_count);
+    widen_pending = 2;
+    panel_lcd_flush(x1,y2-tail+1,x2,y2,base+head_count*3);
+    widen_pixels(base,base,head_count);
+    panel_lcd_flush(x1,y1,x2,y2-tail,base);
+    return true;
+}
+#endif
+static void* widen_prepare(int x1, int y1, int x2, int y2, const void* bitmap) {
+    uint8_t* base = transfer_buffer_base(bitmap);
+    const size_t pixel_count = ((size_t)(x2-x1+1))*(y2-y1+1);
+    if(base!=bitmap) {
+        memmove(base,bitmap,pixel_count*2);
     }
-};
-using vert_label_t = vvert_label<screen_t::control_surface_type>;
-
-using label_t = vlabel<screen_t::control_surface_type>;
-
-template<typename ControlSurfaceType>
-class bar : public control<ControlSurfaceType> {
-    using base_type = control<ControlSurfaceType>;
-public:
-    using type = bar;
-    using control_surface_type = ControlSurfaceType;
-#if LCD_HEIGHT < 128
-    using buffer_t = data::circular_buffer<uint8_t,100>;
+    widen_pixels(base,base,pixel_count);
+    return base;
+}
 #endif
-private:
-    rgba_pixel<32> m_color;
-    rgba_pixel<32> m_back_color;
-    bool m_is_gradient;
-    float m_value;
-#if LCD_HEIGHT < 128
-    buffer_t m_buffer;
+#ifdef FLUSH_RING
+#ifdef WIDEN_FLUSH
+// flushes have already been widened to the panel's 3 bytes
+#define FLUSH_RING_PIXEL_BYTES 3
+#else
+#define FLUSH_RING_PIXEL_BYTES ((pixel_t::bit_depth+7)/8)
 #endif
-public:
-    bar() : base_type(), m_is_gradient(false), m_value(0) {
-        static constexpr const rgb_pixel<24> px(0,255,0);
-        static constexpr const rgb_pixel<24> black(0,0,0);
-        convert(px,&m_color);
-        rgba_pixel<32> px2;
-        convert(black,&px2);
-        m_back_color = m_color.blend(px2,.125f);
-    }
-    
-    virtual ~bar() {
-
+static void flush_ring_init() {
+    // uix doesn't DMA out of its buffers any more, so they can come from
+    // PSRAM when there is some
+#if CONFIG_SPIRAM && (!defined(LCD_TUNED_BUFFER_PSRAM) || LCD_TUNED_BUFFER_PSRAM)
+    const uint32_t render_caps = MALLOC_CAP_SPIRAM;
+#else
+    const uint32_t render_caps = MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT;
+#endif
+    for(size_t i = 0;i<2;++i) {
+        flush_ring_render[i] = (uint8_t*)heap_caps_aligned_alloc(4,FLUSH_RING_SIZE,render_caps);
+        if(flush_ring_render[i]==nullptr) {
+            if(i==1) {
+                free(flush_ring_render[0]);
+            }
+            flush_ring_render[0] = nullptr;
+            return;
+        }
     }
-    float value() const {
-        return m_value;
+    flush_ring_count = 0;
+    if(FLUSH_RING_SIZE<=LCD_TRANSFER_SIZE) {
+        // the panel's own buffers are already DMA capable
+        flush_ring[0] = (uint8_t*)panel_lcd_transfer_buffer();
+        flush_ring[1] = (uint8_t*)panel_lcd_transfer_buffer2();
+        flush_ring_count = 2;
     }
-    void value(float value) {
-        value = math::clamp(0.f,value,1.f);
-        if(value!=m_value) {
-            m_value = value;
-            this->invalidate();
+    while(flush_ring_count<LCD_FLUSH_RING_DEPTH) {
+        uint8_t* buf = (uint8_t*)heap_caps_malloc(FLUSH_RING_SIZE,MALLOC_CAP_DMA);
+        if(buf==nullptr) {
+            // run with however many we got
+            break;
         }
-#if LCD_HEIGHT < 128
-        if(m_buffer.size()==m_buffer.capacity) {
-            uint8_t tmp;
-            m_buffer.get(&tmp);
+        flush_ring[flush_ring_count++] = buf;
+    }
+    if(flush_ring_count<2) {
+        // not enough to run ahead of anything
+        if(flush_ring_count==1) {
+            heap_caps_free(flush_ring[0]);
         }
-        m_buffer.put((uint8_t)(value*255));
-        this->invalidate();
+        flush_ring_count = 0;
+        free(flush_ring_render[0]);
+        free(flush_ring_render[1]);
+        return;
+    }
+    flush_ring_free = xSemaphoreCreateCounting(flush_ring_count,flush_ring_count);
+#ifdef WIDEN_FLUSH
+    // widening works in place, so leave room for a third byte per pixel
+    disp.buffer_size(FLUSH_RING_SIZE/3*2);
+#else
+    disp.buffer_size(FLUSH_RING_SIZE);
 #endif
-
+    disp.buffer1(flush_ring_render[0]);
+    disp.buffer2(flush_ring_render[1]);
+}
+// copies a flush into the next ring buffer and queues it, waiting for the
+// DMA to finish one if they're all on the wire. uix can have its buffer
+// back as soon as this returns
+static void flush_ring_flush(int x1, int y1, int x2, int y2, const void* bitmap) {
+    if(flush_ring_count==0) {
+        panel_lcd_flush(x1,y1,x2,y2,(void*)bitmap);
+        return;
     }
-#if LCD_HEIGHT < 128
-    void clear() {
-        m_buffer.clear();
-        this->invalidate();
-    }
-#endif
-    bool is_gradient() const {
-        return m_is_gradient;
-    }
-    void is_gradient(bool value) {
-        m_is_gradient= value;
-        this->invalidate();
-    }
-    rgba_pixel<32> color() const {
-        return m_color;
-    }
-    void color(rgba_pixel<32> value) {
-        m_color=value;
-        this->invalidate();
-    }
-    rgba_pixel<32> back_color() const {
-        return m_back_color;
-    }
-    void back_color(rgba_pixel<32> value) {
-        m_back_color  = value;
-        this->invalidate();
-    }
-protected:
-    virtual void on_paint(control_surface_type& destination, const srect16& clip) {
-        typename control_surface_type::pixel_type scr_bg;
-        destination.point({0,0},&scr_bg);
-        uint16_t x_end = roundf(m_value*destination.dimensions().width-1);
-        uint16_t y_end = destination.dimensions().height-1;
-        if(m_is_gradient) {
-            y_end=destination.dimensions().height*.6666;
-            // two reference points for the ends of the graph
-            hsva_pixel<32> px = gfx::color<gfx::hsva_pixel<32>>::red;
-            hsva_pixel<32> px2 = gfx::color<gfx::hsva_pixel<32>>::green;
-            auto h1 = px.channel<channel_name::H>();
-            auto h2 = px2.channel<channel_name::H>();
-            // adjust so we don't overshoot
-            h2 -= 64;
-            // the actual range we're drawing
-            auto range = abs(h2 - h1) + 1;
-            // the width of each gradient segment
-            int w = (int)ceilf(destination.dimensions().width / 
-                                (float)range) + 1;                
-            // the step of each segment - default 1
-            int s = 1;
-            // if the gradient is larger than the control
-            if (destination.dimensions().width < range) {
-                // change the segment to width 1
-                w = 1;
-                // and make its step larger
-                s = range / (float)destination.dimensions().width;  
-            } 
-            int x = 0;
-            // c is the current color offset
-            // it increases by s (step)
-            int c = 0;
-            // for each color in the range
-            for (auto j = 0; j < range; ++j) {
-                // adjust the H value (inverted and offset)
-                px.channel<channel_name::H>(range - c - 1 + h1);
-                // if we're drawing the filled part
-                // it's fully opaque
-                // otherwise it's semi-transparent
-                int sw = w;
-                int diff=0;
-                if (m_value==0||x> x_end) {
-                    px.channel<channel_name::A>(95);
-                    if((x-w)<=x_end) {
-                        sw = x_end-x+1;
-                        diff = w-sw;
-                    }
-                } else {
-                    px.channel<channel_name::A>(255);
-                }
-                // create the rect for our segment
-                srect16 r(x, y_end+1, x + sw , destination.dimensions().height-1);
-                
-                // black out the area underneath so alpha blending
-                // works correctly
-                draw::filled_rectangle(destination, 
-                                    r, 
-                                    scr_bg
-                                    );
-                // draw the segment
-                draw::filled_rectangle(destination, 
-                                    r, 
-                                    px 
-                                    );
-                if(diff>0) {
-                    r=srect16(x+sw,y_end+1,x+w,destination.dimensions().height-1);
-                    draw::filled_rectangle(destination, 
-                                    r, 
-                                    scr_bg
-                                    );
-                    // draw the segment
-                    draw::filled_rectangle(destination, 
-                                    r, 
-                                    px 
-                                    );
-                }
-                // increment
-                x += w;
-                c += s;
-            }
-        } 
-        if(m_value>0) {
-            draw::filled_rectangle(destination,srect16(0,0,x_end,y_end),m_color);
-            draw::filled_rectangle(destination,srect16(x_end+1,0,destination.dimensions().width-1,y_end),m_back_color);
-        } else {
-            draw::filled_rectangle(destination,srect16(0,0,destination.dimensions().width-1,y_end),m_back_color);
-        }
-#if LCD_HEIGHT < 128
-        if(m_buffer.size()>0) {
-            float x_step = (destination.dimensions().width-1)/(float)(buffer_t::capacity-1);
-            float x = x_step;
-            point16 opt(0,y_end);
-            size_t i = 0;
-            auto px = (m_value==0)?m_color:dark_mode?uix_color_t::black:uix_color_t::white;
-            while(i<m_buffer.size()) {
-                uint8_t v=255-*m_buffer.peek(i);
-                point16 pt(x,v*(y_end)/255);
-                draw::line(destination,rect16(opt,pt),px);
-                if(x>x_end) {
-                    px=m_color;
-                }
-                opt=pt;
-                x+=x_step;
-                ++i;           
+    if(pdTRUE!=xSemaphoreTake(flush_ring_free,0)) {
+        const int64_t stall_start = esp_timer_get_time();
+        xSemaphoreTake(flush_ring_free,portMAX_DELAY);
+        ++flush_ring_stalls;
+        flush_ring_stall_us+=esp_timer_get_time()-stall_start;
+    }
+    uint8_t* buf = flush_ring[flush_ring_next];
+    flush_ring_next = (flush_ring_next+1)%flush_ring_count;
+    memcpy(buf,bitmap,((size_t)(x2-x1+1))*(y2-y1+1)*FLUSH_RING_PIXEL_BYTES);
+    portENTER_CRITICAL(&flush_ring_lock);
+    ++flush_ring_queued;
+    if(flush_ring_queued>flush_ring_max_queued) {
+        flush_ring_max_queued = flush_ring_queued;
+    }
+    portEXIT_CRITICAL(&flush_ring_lock);
+    ++flush_ring_flushes;
+    panel_lcd_flush(x1,y1,x2,y2,buf);
+    disp.flush_complete();
+}
+#endif
+#if defined(LCD_TUNED_BUFFER_SIZE) && !defined(LCD_INDEXED_BITS) && !defined(WIDEN_FLUSH) && !defined(FLUSH_RING)
+// the modes above work in place in the panel's own buffers, so they
+// keep them
+#define TUNED_BUFFERS
+#ifndef LCD_TUNED_BUFFER_COUNT
+#define LCD_TUNED_BUFFER_COUNT 2
+#endif
+#ifndef LCD_TUNED_BUFFER_PSRAM
+#define LCD_TUNED_BUFFER_PSRAM 0
+#endif
+static void tuned_buffers_init() {
+#if LCD_TUNED_BUFFER_PSRAM && CONFIG_SPIRAM
+    const uint32_t caps = MALLOC_CAP_SPIRAM|MALLOC_CAP_8BIT;
+#else
+    const uint32_t caps = MALLOC_CAP_DMA|MALLOC_CAP_INTERNAL;
+#endif
+#if LCD_SYNC_TRANSFER == 0
+    const int count = LCD_TUNED_BUFFER_COUNT;
+#else
+    const int count = 1;
+#endif
+    uint8_t* buffers[2] = {nullptr,nullptr};
+    for(int i = 0;i<count && i<2;++i) {
+        buffers[i] = (uint8_t*)heap_caps_aligned_alloc(64,LCD_TUNED_BUFFER_SIZE,caps);
+        if(buffers[i]==nullptr) {
+            // keep the panel's buffers
+            if(i>0) {
+                heap_caps_free(buffers[0]);
             }
+            return;
         }
+    }
+    disp.buffer_size(LCD_TUNED_BUFFER_SIZE);
+    disp.buffer1(buffers[0]);
+    disp.buffer2(buffers[1]);
+}
+#endif
+#ifdef LCD_DIRECT_FRAMEBUFFER
+#if defined(LCD_INDEXED_BITS) || defined(WIDEN_FLUSH) || defined(FLUSH_RING) || defined(LCD_PAGE_FORMAT)
+#error "LCD_DIRECT_FRAMEBUFFER is for plain RGB panels"
 #endif
+// RGB panels keep the whole frame in memory, so flushes are copied
+// straight into it instead of going through the driver's draw call. see
+// panel_direct.h
+static uint8_t* direct_frame = nullptr;
+static void direct_init() {
+    direct_frame = (uint8_t*)panel_lcd_frame_buffer();
+}
+// returns false if there's no framebuffer to copy into
+static bool direct_flush(int x1, int y1, int x2, int y2, const void* bitmap) {
+    if(direct_frame==nullptr) {
+        return false;
+    }
+    constexpr static const size_t bytes = pixel_t::bit_depth/8;
+    const size_t stride = LCD_WIDTH*bytes;
+    const size_t row = (x2-x1+1)*bytes;
+    const uint8_t* src = (const uint8_t*)bitmap;
+    uint8_t* dst = direct_frame+y1*stride+x1*bytes;
+    // don't write rows the panel is about to scan out. the copy runs at
+    // about the speed of the scan, so a band the scan is in, or is within
+    // a band's height of, waits for the next frame to start
+    const int scan = panel_lcd_scan_row(LCD_HEIGHT);
+    if(scan>=0 && scan>=y1-(y2-y1+1) && scan<=y2) {
+        panel_lcd_vsync_wait();
+    }
+    if(row==stride) {
+        // full width bands are contiguous in the framebuffer too
+        memcpy(dst,src,row*(y2-y1+1));
+    } else {
+        for(int y = y1;y<=y2;++y) {
+            memcpy(dst,src,row);
+            dst+=stride;
+            src+=row;
+        }
     }
+#ifdef DIRECT_CACHE_SYNC
+    // the panel's DMA reads memory, not the cache
+    esp_cache_msync(direct_frame+y1*stride,stride*(y2-y1+1),ESP_CACHE_MSYNC_FLAG_DIR_C2M|ESP_CACHE_MSYNC_FLAG_UNALIGNED);
+#endif
+    return true;
+}
+#endif
+#ifdef LCD_PAGE_FORMAT
+// the panel wants columns of 8 rows per byte, and on these boards every
+// byte costs bus time, so each page of a flush is narrowed to the columns
+// that differ from what the panel already holds
+#ifndef PAGE_WINDOW_OVERHEAD
+// roughly the bytes it takes to address a new window on the bus
+#define PAGE_WINDOW_OVERHEAD 8
+#endif
+#define PAGE_COUNT (LCD_HEIGHT/8)
+// a copy of the panel's page memory
+static uint8_t page_shadow[LCD_WIDTH*PAGE_COUNT];
+// pages are unknown until they've been sent once
+static bool page_known[PAGE_COUNT];
+// the flush converted to pages, and the windows packed for sending
+static uint8_t page_converted[LCD_TRANSFER_SIZE];
+static uint8_t page_send[LCD_TRANSFER_SIZE];
+struct page_window {
+    int page1, page2;
+    int x1, x2;
 };
-using bar_t = bar<screen_t::control_surface_type>;
-
-#if LCD_HEIGHT>128
-template<typename ControlSurfaceType>
-class vgraph : public control<ControlSurfaceType> {
-    using base_type = control<ControlSurfaceType>;
-    using buffer_t = data::circular_buffer<uint8_t,100>;
-public:
-    using type = vgraph;
-    using control_surface_type = ControlSurfaceType;
-private:
-    struct data_line {
-        rgba_pixel<32> color;
-        buffer_t buffer;
-        data_line* next;
-    };
-    data_line* m_first;
-    void clear_lines() {
-        data_line*entry=m_first;
-        while(entry!=nullptr) {
-            data_line* n = entry->next;
-            delete entry;
-            entry = n;
-        }
-        m_first = nullptr;
-    }
-public:
-    vgraph() : base_type(), m_first(nullptr) {
-    }
-    virtual ~vgraph() {
-        clear_lines();
-    }
-    void remove_lines() {
-        clear_lines();
-        this->invalidate();
-    }
-    size_t add_line(rgba_pixel<32> color) {
-        data_line* n;
-        if(m_first==nullptr) {
-            n = new data_line();
-            if(n==nullptr) {
-                return 0; // out of memory
+// sends the changed parts of a row major flush. returns the number of
+// transfers started
+static int page_windows_flush(int x1, int y1, int x2, int y2, const void* bitmap) {
+    const int width = x2-x1+1;
+    const int first_page = y1/8;
+    const int pages = (y2-y1+1)/8;
+    ssd1306_rows_to_pages((const uint8_t*)bitmap,width,pages*8,page_converted);
+    // find each page's changed columns and fold them into windows
+    page_window windows[PAGE_COUNT];
+    int window_count = 0;
+    page_window* cur = nullptr;
+    int cur_cost = 0;
+    for(int i = 0;i<pages;++i) {
+        const int page = first_page+i;
+        const uint8_t* src = page_converted+i*width;
+        uint8_t* shadow = page_shadow+page*LCD_WIDTH+x1;
+        int c1 = 0, c2 = width-1;
+        if(page_known[page]) {
+            while(c1<width && src[c1]==shadow[c1]) {
+                ++c1;
             }
-            n->color = color;
-            n->next = nullptr;
-            m_first = n;
-            return 1;
-        }
-        size_t result = 0;
-        data_line*entry=m_first;
-        while(entry!=nullptr) {
-            n = entry->next;
-            if(n==nullptr) {
-                n = new data_line();
-                if(n==nullptr) {
-                    return 0; // out of memory
-                }
-                n->color =color;
-                n->next = nullptr;
-                entry->next = n;
-                break;
+            if(c1==width) {
+                continue;
             }
-            entry = n;
-            ++result;
-        }
-        this->invalidate();
-        return result+1;
-    }
-    bool set_line(size_t index, rgba_pixel<32> color) {
-        if(m_first==nullptr) {
-            return false;
-        }
-        data_line*entry=m_first;
-        while(entry!=nullptr && index-->0) {
-            entry = entry->next;
-            if(entry==nullptr) {
-                return false;
+            while(src[c2]==shadow[c2]) {
+                --c2;
             }
         }
-        entry->color = color;
-        this->invalidate();
-        return true;
-    }
-    bool add_data(size_t line_index,float value) {
-        uint8_t v = math::clamp(0.f,value,1.f)*255;
-        size_t i = 0;
-        for(data_line* entry = m_first;entry!=nullptr;entry=entry->next) {
-            if(i==line_index) {
-                if(entry->buffer.size()==entry->buffer.capacity) {
-                    uint8_t tmp;
-                    entry->buffer.get(&tmp);
-                }
-                entry->buffer.put(v);
-                this->invalidate();
-                return true;
+        memcpy(shadow+c1,src+c1,c2-c1+1);
+        page_known[page] = true;
+        c1+=x1;
+        c2+=x1;
+        if(cur!=nullptr) {
+            // merge with the previous window if sending the extra bytes
+            // is cheaper than addressing another window
+            const int mx1 = c1<cur->x1?c1:cur->x1;
+            const int mx2 = c2>cur->x2?c2:cur->x2;
+            const int merged_cost = (mx2-mx1+1)*(page-cur->page1+1);
+            if(merged_cost<=cur_cost+(c2-c1+1)+PAGE_WINDOW_OVERHEAD) {
+                cur->x1 = mx1;
+                cur->x2 = mx2;
+                cur->page2 = page;
+                cur_cost = merged_cost;
+                continue;
             }
-            ++i;
         }
-        return false;
+        cur = &windows[window_count++];
+        cur->page1 = cur->page2 = page;
+        cur->x1 = c1;
+        cur->x2 = c2;
+        cur_cost = c2-c1+1;
     }
-    void clear_data() {
-        for(data_line* entry = m_first;entry!=nullptr;entry=entry->next) {
-            entry->buffer.clear();
-        }
-        this->invalidate();
-    }
-protected:
-    void on_paint(control_surface_type& destination, const srect16& clip) {
-        srect16 b = (srect16)destination.bounds();
-        auto px = gfx::color<typename control_surface_type::pixel_type>::gray;
-        draw::rectangle(destination,b,px);
-        b.inflate_inplace(-1,-1);
-        const float tenth_x = ((float)b.width())/10.f;
-        for(float x = b.x1;x<=b.x2;x+=tenth_x) {
-            destination.fill(rect16(x,b.y1,x,b.y2),px);
-        }
-        const float tenth_y = ((float)b.height())/10.f;
-        for(float y = b.y1;y<=b.y2;y+=tenth_y) {
-            destination.fill(rect16(b.x1,y,b.x2,y),px);
-        }
-        for(data_line* entry = m_first;entry!=nullptr;entry=entry->next) {
-            if(entry->buffer.size()) {
-                uint8_t v = *entry->buffer.peek(0);
-                float fv = v/255.f;
-                float y = (1.0-fv)*(tenth_y*10);
-                pointf pt(b.x1,y);
-                for(int i = 1;i<entry->buffer.size();++i) {
-                    v = *entry->buffer.peek(i);
-                    fv = v/255.f;
-                    pointf pt2=pt;
-                    pt2.x+=(tenth_x*.1f);
-                    y = (1.f-fv)*(tenth_y*10);
-                    pt2.y =y;
-                    draw::filled_rectangle(destination,srect16(floorf(pt.x),floorf(pt.y),ceilf(pt2.x),ceilf(pt2.y)),entry->color);
-                    draw::filled_rectangle(destination,srect16(floorf(pt.x-1),floorf(pt.y-1),ceilf(pt2.x-1),ceilf(pt2.y-1)),entry->color);
-                    pt=pt2;
-                }
-            }
+    if(window_count==0) {
+        return 0;
+    }
+    // pack each window so its pages are contiguous
+    uint8_t* out = page_send;
+    uint8_t* starts[PAGE_COUNT];
+    for(int i = 0;i<window_count;++i) {
+        const page_window& w = windows[i];
+        const int ww = w.x2-w.x1+1;
+        starts[i] = out;
+        for(int page = w.page1;page<=w.page2;++page) {
+            memcpy(out,page_shadow+page*LCD_WIDTH+w.x1,ww);
+            out+=ww;
         }
     }
-};
-using graph_t = vgraph<screen_t::control_surface_type>;
+#if LCD_SYNC_TRANSFER == 0
+    page_windows_pending = window_count;
+#endif
+    for(int i = 0;i<window_count;++i) {
+        const page_window& w = windows[i];
+        panel_lcd_flush(w.x1,w.page1*8,w.x2,w.page2*8+7,starts[i]);
+    }
+    return window_count;
+}
+#endif
+#ifdef LCD_INDEXED_BITS
+#define INDEXED_ROW_BYTES(width) ((((size_t)(width))*LCD_INDEXED_BITS+7)/8)
+// uix renders into these instead of the transfer buffers, which only
+// have to hold a few expanded lines
+#ifndef LCD_INDEXED_DIVISOR
+#define LCD_INDEXED_DIVISOR 10
+#endif
+#define INDEXED_BUFFER_SIZE (INDEXED_ROW_BYTES(LCD_WIDTH)*((LCD_HEIGHT+LCD_INDEXED_DIVISOR-1)/LCD_INDEXED_DIVISOR))
+static_assert(LCD_TRANSFER_SIZE>=LCD_WIDTH*2*LCD_Y_ALIGN,"LCD_INDEXED_BITS needs transfer buffers of at least LCD_Y_ALIGN expanded lines");
+#if LCD_SYNC_TRANSFER == 0
+alignas(4) static uint8_t indexed_buffers[2][INDEXED_BUFFER_SIZE];
+static int indexed_line_next = 0;
+#else
+alignas(4) static uint8_t indexed_buffers[1][INDEXED_BUFFER_SIZE];
+#endif
+// expands the indexed pixels a band of lines at a time into the transfer
+// buffers and sends them. in async mode one band is expanded while the
+// last is on the wire. the indexed buffer is free again on return
+static void indexed_flush(int x1, int y1, int x2, int y2, const void* bitmap) {
+    const size_t width = x2-x1+1;
+    int rows = (int)(LCD_TRANSFER_SIZE/(width*2));
+    rows -= rows%LCD_Y_ALIGN;
+    const uint8_t* src = (const uint8_t*)bitmap;
+    for(int y = y1;y<=y2;y+=rows) {
+        const int band_y2 = y+rows-1<y2?y+rows-1:y2;
+        const size_t pixels = width*(band_y2-y+1);
+#if LCD_SYNC_TRANSFER == 0
+        xSemaphoreTake(indexed_lines_free,portMAX_DELAY);
+        uint8_t* line = (uint8_t*)(indexed_line_next==0?panel_lcd_transfer_buffer():panel_lcd_transfer_buffer2());
+        indexed_line_next ^= 1;
+        screen_palette.expand(line,src,pixels);
+        portENTER_CRITICAL(&indexed_lines_lock);
+        const bool first = indexed_lines_pending++==0;
+        portEXIT_CRITICAL(&indexed_lines_lock);
+        if(first) {
+            // ends in panel_lcd_flush_complete()
+            TRACE_BEGIN(dma,0);
+#ifdef INPUT_LATENCY
+            input_timing.transfer_begin();
+#endif
+        }
+#else
+        uint8_t* line = (uint8_t*)panel_lcd_transfer_buffer();
+        screen_palette.expand(line,src,pixels);
+#endif
+        panel_lcd_flush(x1,y,x2,band_y2,line);
+        src += INDEXED_ROW_BYTES(width)*(band_y2-y+1);
+    }
+}
+static void indexed_init() {
+#if LCD_SYNC_TRANSFER == 0
+    indexed_lines_free = xSemaphoreCreateCounting(2,2);
+#endif
+}
+#endif
+#ifndef NO_TELEMETRY
+// counters for the telemetry report (espmon_protocol.hpp), since the last
+// one. they're only touched from the loop task
+static uint32_t telemetry_start_ms = 0;
+static uint32_t telemetry_frames = 0;
+static uint32_t telemetry_frame_us = 0;
+static uint32_t telemetry_frame_max_us = 0;
+// a data packet repaints each control in turn, so a frame is every
+// repaint in one loop pass, from the start of the first to the end of
+// the last
+static bool telemetry_frame_open = false;
+static uint32_t telemetry_frame_start = 0;
+static uint32_t telemetry_frame_end = 0;
+static uint32_t telemetry_flushes = 0;
+static uint32_t telemetry_flush_pixels = 0;
+static uint32_t telemetry_flush_us = 0;
+static uint32_t telemetry_flush_max_us = 0;
+#ifdef portNUM_PROCESSORS
+#define TELEMETRY_CORES (portNUM_PROCESSORS>2?2:portNUM_PROCESSORS)
+#else
+#define TELEMETRY_CORES 1
+#endif
+#ifndef NO_TELEMETRY_LOAD
+// per core load, from idle hooks so it doesn't need FreeRTOS's run time
+// stats. the hook is called over and over while its core has nothing
+// else to do, so short gaps between calls are idle time and longer ones
+// are something else running. keeping the hook busy means the idle task
+// no longer waits for interrupts, which costs some power
+#define TELEMETRY_IDLE_GAP_US 50
+static volatile int64_t telemetry_idle_call_us[TELEMETRY_CORES];
+// wraps, so the report only looks at the difference
+static volatile uint32_t telemetry_idle_us[TELEMETRY_CORES];
+static uint32_t telemetry_idle_seen[TELEMETRY_CORES];
+static inline bool telemetry_idle(int core) {
+    const int64_t now = esp_timer_get_time();
+    const int64_t gap = now-telemetry_idle_call_us[core];
+    if(gap<TELEMETRY_IDLE_GAP_US) {
+        telemetry_idle_us[core] = telemetry_idle_us[core]+(uint32_t)gap;
+    }
+    telemetry_idle_call_us[core] = now;
+    // keep calling
+    return false;
+}
+static bool telemetry_idle_core0() {
+    return telemetry_idle(0);
+}
+#if TELEMETRY_CORES > 1
+static bool telemetry_idle_core1() {
+    return telemetry_idle(1);
+}
+#endif
+static void telemetry_load_init() {
+    esp_register_freertos_idle_hook_for_cpu(telemetry_idle_core0,0);
+#if TELEMETRY_CORES > 1
+    esp_register_freertos_idle_hook_for_cpu(telemetry_idle_core1,1);
+#endif
+}
+#endif
+#if defined(configUSE_TRACE_FACILITY) && configUSE_TRACE_FACILITY
+// CONFIG_FREERTOS_USE_TRACE_FACILITY gives every task's stack. without it
+// only the tasks found by name are reported
+#define TELEMETRY_TASK_STATS
+static TaskStatus_t telemetry_tasks[24];
+#endif
+static uint32_t paint_clock_us() {
+    return (uint32_t)esp_timer_get_time();
+}
+#endif
+// flush a bitmap to the display
+static void uix_flush_bitmap(const rect16& bounds,const void *bitmap) {
+    //printf("flush (%d, %d)-(%d, %d)\n",bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+    int x1 = bounds.x1, y1 = bounds.y1, x2 = bounds.x2, y2 = bounds.y2;
+#ifndef NO_FLUSH_TILES
+    if(!flush_tiles.filter(x1,y1,x2,y2,bitmap)) {
+        // the panel already shows exactly these pixels
+        disp.flush_complete();
+        return;
+    }
+#endif
+#ifdef LCD_DIRECT_FRAMEBUFFER
+    if(direct_flush(x1,y1,x2,y2,bitmap)) {
+        // the copy is done, so the buffer is free again
+        disp.flush_complete();
+        return;
+    }
+#endif
+#ifdef LCD_INDEXED_BITS
+    indexed_flush(x1,y1,x2,y2,bitmap);
+    disp.flush_complete();
+    return;
+#endif
+#if LCD_SYNC_TRANSFER == 0
+    // ends in panel_lcd_flush_complete()
+    TRACE_BEGIN(dma,0);
+#ifdef INPUT_LATENCY
+    input_timing.transfer_begin();
+#endif
+#endif
+#ifdef WIDEN_BANDS
+    if(widen_bands_flush(x1,y1,x2,y2,bitmap)) {
+        return;
+    }
 #endif
+#ifdef WIDEN_FLUSH
+    bitmap = widen_prepare(x1,y1,x2,y2,bitmap);
+#endif
+#ifdef LCD_PAGE_FORMAT
+    if(0==page_windows_flush(x1,y1,x2,y2,bitmap)) {
+#if LCD_SYNC_TRANSFER == 0
+        TRACE_END(dma,0);
+#ifdef INPUT_LATENCY
+        input_timing.transfer_end((uint32_t)esp_timer_get_time());
+#endif
+#endif
+        disp.flush_complete();
+        return;
+    }
+#elif defined(FLUSH_RING)
+    flush_ring_flush(x1,y1,x2,y2,bitmap);
+#else
+    panel_lcd_flush(x1, y1, x2, y2, (void *)bitmap);
+#endif
+#if LCD_SYNC_TRANSFER > 0
+    disp.flush_complete();
+#endif
+}
+static void uix_on_flush(const rect16& bounds,const void *bitmap, void* state) {
+#ifdef TRACE_RING_SIZE
+    const uint32_t pixels = (uint32_t)bounds.width()*bounds.height();
+    TRACE_BEGIN(flush,pixels>0xFFFF?0xFFFF:pixels);
+#endif
+#ifndef NO_TELEMETRY
+    const uint32_t start = (uint32_t)esp_timer_get_time();
+    uix_flush_bitmap(bounds,bitmap);
+    const uint32_t elapsed = (uint32_t)esp_timer_get_time()-start;
+    ++telemetry_flushes;
+    telemetry_flush_pixels+=bounds.width()*bounds.height();
+    telemetry_flush_us+=elapsed;
+    if(elapsed>telemetry_flush_max_us) {
+        telemetry_flush_max_us = elapsed;
+    }
+#else
+    uix_flush_bitmap(bounds,bitmap);
+#endif
+    TRACE_END(flush,0);
+}
+#if defined(TRACE_RING_SIZE) || defined(INPUT_LATENCY)
+// dashboard_controls.hpp calls this around each control's paint
+static void paint_hook(bool end, uint8_t index) {
+    if(end) {
+        TRACE_END(paint,index);
+#ifdef INPUT_LATENCY
+        input_timing.painted((uint32_t)esp_timer_get_time());
+#endif
+    } else {
+        TRACE_BEGIN(paint,index);
+    }
+}
+#endif
+
+using view_t = dashboard_view<screen_t::control_surface_type>;
+using layer_t = vlayer<screen_t::control_surface_type>;
 
+#ifdef LCD_INDEXED_BITS
+static screen_t main_screen(&screen_palette);
+#else
 static screen_t main_screen;
-static vert_label_t value1_label;
-static vert_label_t value2_label;
+#endif
+static view_t main_view;
+static view_t::vert_label_type& value1_label = main_view.value1_label;
+static view_t::vert_label_type& value2_label = main_view.value2_label;
 
-static label_t top_value1_label;
-static label_t top_value2_label;
+static view_t::numeric_label_type& top_value1_label = main_view.top_value1_label;
+static view_t::numeric_label_type& top_value2_label = main_view.top_value2_label;
 
-static bar_t top_value1_bar;
-static bar_t top_value2_bar;
+static view_t::bar_type& top_value1_bar = main_view.top_value1_bar;
+static view_t::bar_type& top_value2_bar = main_view.top_value2_bar;
 
-static label_t bottom_value1_label;
-static label_t bottom_value2_label;
+static view_t::numeric_label_type& bottom_value1_label = main_view.bottom_value1_label;
+static view_t::numeric_label_type& bottom_value2_label = main_view.bottom_value2_label;
 
-static bar_t bottom_value1_bar;
-static bar_t bottom_value2_bar;
+static view_t::bar_type& bottom_value1_bar = main_view.bottom_value1_bar;
+static view_t::bar_type& bottom_value2_bar = main_view.bottom_value2_bar;
 
 static int8_t screen_index = -1;
 
 #if LCD_HEIGHT > 128
-static graph_t history_graph;
+static view_t::graph_type& history_graph = main_view.history_graph;
 #endif
 
 static char top_label_text[12]={0};
 static char bottom_label_text[12]={0};
 
-static uint16_t top_value1_max=1;
-static uint16_t top_value2_max=1;
-static char top_value1_text[12]={0};
-static char top_value1_suffix[4]={0};
-static char top_value2_text[12]={0};
-static char top_value2_suffix[4]={0};
-static uint16_t bottom_value1_max=1;
-static uint16_t bottom_value2_max=1;
-static char bottom_value1_text[12]={0};
-static char bottom_value1_suffix[4]={0};
-static char bottom_value2_text[12]={0};
-static char bottom_value2_suffix[4]={0};
-static label_t disconnected_label;
+// reciprocals of the per screen maximums, see fixed_point.hpp
+static q16_recip_t top_value1_recip=q16_recip(1);
+static q16_recip_t top_value2_recip=q16_recip(1);
+static q16_recip_t bottom_value1_recip=q16_recip(1);
+static q16_recip_t bottom_value2_recip=q16_recip(1);
+static view_t::label_type& disconnected_label = main_view.disconnected_label;
+#ifndef NO_LINK_STATS
+static view_t::label_type& diagnostics_label = main_view.diagnostics_label;
+static link_stats link_timing;
+// set once a host has answered a ping, so it understands data_ex
+static bool link_extended = false;
+// set when the host's screen says it answers pings. the Windows host
+// doesn't, and drops requests it has queued when it sees one
+static bool link_host_pings = false;
+// pings in a row that went unanswered. after a few the host is taken to
+// not keep the link alive after all, and gets plain data and no pings
+// until its next screen. the data timeout alone decides a disconnect
+static int link_ping_misses = 0;
+// 100ms ticks since the last ping
+static int link_ping_ticks = 0;
+static char diagnostics_text[48] = {0};
+static void diagnostics_update() {
+    if(!diagnostics_label.visible()) {
+        return;
+    }
+    if(!link_timing.synced()) {
+        strcpy(diagnostics_text,"no link timing");
+    } else {
+        snprintf(diagnostics_text,sizeof(diagnostics_text),"rtt %d.%d age %d jit %d.%d ms",
+            (int)(link_timing.rtt_mean()/1000),(int)(link_timing.rtt_mean()%1000/100),
+            (int)(link_timing.age_mean()/1000),
+            (int)(link_timing.jitter()/1000),(int)(link_timing.jitter()%1000/100));
+    }
+    diagnostics_label.text(diagnostics_text);
+}
+#endif
+
+#ifndef NO_LAYER_CACHE
+// boards without PSRAM only get a layer cache if it's this small
+#ifndef LAYER_CACHE_INTERNAL_MAX
+#define LAYER_CACHE_INTERNAL_MAX (32*1024)
+#endif
+static layer_t static_layer;
+static void static_layer_on_paint(layer_t::bitmap_type& destination, void* state) {
+    kernel_fill(destination,(srect16)destination.bounds(),main_screen.background_color());
+    top_value1_bar.paint_static(destination);
+    top_value2_bar.paint_static(destination);
+    bottom_value1_bar.paint_static(destination);
+    bottom_value2_bar.paint_static(destination);
+#if LCD_HEIGHT > 128
+    history_graph.paint_static(destination);
+#endif
+}
+static void static_layer_init() {
+    static_layer.bounds(main_screen.bounds());
+    const size_t size = layer_t::buffer_size(main_screen.dimensions());
+    uint8_t* buffer = nullptr;
+#if CONFIG_SPIRAM
+    buffer = (uint8_t*)heap_caps_malloc(size,MALLOC_CAP_SPIRAM);
+#endif
+    if(buffer==nullptr && size<=LAYER_CACHE_INTERNAL_MAX) {
+        buffer = (uint8_t*)heap_caps_malloc(size,MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT);
+    }
+    if(buffer==nullptr) {
+        // no room, everything paints itself like usual
+        return;
+    }
+#ifdef LCD_INDEXED_BITS
+    static_layer.buffer(buffer,&screen_palette);
+#else
+    static_layer.buffer(buffer);
+#endif
+    static_layer.on_paint_layer_callback(static_layer_on_paint);
+    // this has to be first so it paints underneath everything else
+    main_screen.register_control(static_layer);
+}
+static void static_layer_invalidate() {
+    static_layer.invalidate_layer();
+}
+#else
+static void static_layer_invalidate() {
+}
+#endif
+// labels don't need to paint a background the layer already provides
+static uix_pixel label_background(uix_pixel color) {
+#ifndef NO_LAYER_CACHE
+    if(static_layer.cached()) {
+        return uix_pixel(0,0,0,0);
+    }
+#endif
+    return color;
+}
+#ifdef LCD_INDEXED_BITS
+// gives the screen's own colors exact palette entries. black, white and
+// gray always come first so the background and chrome keep their indexes
+static void indexed_palette_slots() {
+    screen_palette.clear_slots();
+    screen_palette.add_slot(uix_color_t::black);
+    screen_palette.add_slot(uix_color_t::white);
+    screen_palette.add_slot(uix_color_t::gray);
+    screen_palette.add_slot(value1_label.color());
+    screen_palette.add_slot(value2_label.color());
+    screen_palette.add_slot(top_value1_bar.color());
+    screen_palette.add_slot(top_value1_bar.back_color());
+    screen_palette.add_slot(top_value2_bar.color());
+    screen_palette.add_slot(top_value2_bar.back_color());
+    screen_palette.add_slot(bottom_value1_bar.color());
+    screen_palette.add_slot(bottom_value1_bar.back_color());
+    screen_palette.add_slot(bottom_value2_bar.color());
+    screen_palette.add_slot(bottom_value2_bar.back_color());
+#ifndef NO_FLUSH_TILES
+    // the same indexes may mean different colors now
+    flush_tiles.clear();
+#endif
+}
+#endif
+
+// top value 1, top value 2, bottom value 1, bottom value 2
+using stats_t = metric_stats<q16_t,5>;
+static stats_t value_stats[4];
+// which statistic gets pushed to the history graph
+static const stat_kind history_stat = stat_kind::window_mean;
 
 static void refresh_display() {
+#ifndef NO_TELEMETRY
+    if(!disp.dirty()) {
+        return;
+    }
+    const uint32_t start = (uint32_t)esp_timer_get_time();
+#endif
+    TRACE_BEGIN(frame,0);
     while(disp.dirty()) {
         disp.update();
     }
+    TRACE_END(frame,0);
+#ifdef INPUT_LATENCY
+    input_timing.frame_end((uint32_t)esp_timer_get_time());
+#endif
+#ifndef NO_TELEMETRY
+    if(!telemetry_frame_open) {
+        telemetry_frame_open = true;
+        telemetry_frame_start = start;
+    }
+    telemetry_frame_end = (uint32_t)esp_timer_get_time();
+#endif
+}
+#ifndef NO_TELEMETRY
+// counts the frame painted since the last call, if there was one
+static void telemetry_frame_done() {
+    if(!telemetry_frame_open) {
+        return;
+    }
+    telemetry_frame_open = false;
+    const uint32_t elapsed = telemetry_frame_end-telemetry_frame_start;
+    ++telemetry_frames;
+    telemetry_frame_us+=elapsed;
+    if(elapsed>telemetry_frame_max_us) {
+        telemetry_frame_max_us = elapsed;
+    }
 }
+#endif
+#ifndef NO_TELEMETRY
+// fills a telemetry report and starts the counters over. returns its size
+static size_t telemetry_report(uint8_t* payload) {
+    using heap = espmon::telemetry_view::heap;
+    espmon::telemetry_writer w(payload);
+    const uint32_t now_ms = (uint32_t)(esp_timer_get_time()/1000);
+    const uint32_t interval_ms = now_ms-telemetry_start_ms;
+    w.uptime_ms(now_ms);
+    w.interval_ms(interval_ms);
+    w.frames(telemetry_frames);
+    w.fps_x10((uint16_t)(interval_ms==0?0:((uint64_t)telemetry_frames*10000)/interval_ms));
+    w.frame_us(telemetry_frame_us);
+    w.frame_max_us(telemetry_frame_max_us);
+    w.flushes(telemetry_flushes);
+    w.flush_pixels(telemetry_flush_pixels);
+    w.flush_us(telemetry_flush_us);
+    w.flush_max_us(telemetry_flush_max_us);
+#ifdef FLUSH_RING
+    w.flush_stalls(flush_ring_stalls);
+    w.flush_stall_us((uint32_t)flush_ring_stall_us);
+    flush_ring_stalls = 0;
+    flush_ring_stall_us = 0;
+    w.flush_ring_flushes(flush_ring_flushes);
+    w.flush_ring_depth((uint8_t)flush_ring_count);
+    portENTER_CRITICAL(&flush_ring_lock);
+    w.flush_ring_max_queued((uint8_t)flush_ring_max_queued);
+    flush_ring_max_queued = flush_ring_queued;
+    portEXIT_CRITICAL(&flush_ring_lock);
+    flush_ring_flushes = 0;
+#endif
+#ifndef NO_FLUSH_TILES
+    w.flush_skipped(flush_tiles.skipped());
+    flush_tiles.reset_counters();
+#endif
+    serial_stats_t serial;
+    serial_take_stats(&serial);
+    w.rx_bytes(serial.rx_bytes);
+    w.tx_bytes(serial.tx_bytes);
+    w.rx_packets(serial.rx_packets);
+    w.rx_dropped(serial.rx_dropped);
+    w.heap_free(heap::internal,heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    w.heap_min_free(heap::internal,heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    w.heap_free(heap::dma,heap_caps_get_free_size(MALLOC_CAP_DMA));
+    w.heap_min_free(heap::dma,heap_caps_get_minimum_free_size(MALLOC_CAP_DMA));
+    w.heap_free(heap::psram,heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    w.heap_min_free(heap::psram,heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+#ifndef NO_TELEMETRY_LOAD
+    for(int core = 0;core<TELEMETRY_CORES;++core) {
+        const uint32_t idle_us = telemetry_idle_us[core];
+        const uint32_t idle = idle_us-telemetry_idle_seen[core];
+        telemetry_idle_seen[core] = idle_us;
+        const uint64_t elapsed_us = (uint64_t)interval_ms*1000;
+        if(telemetry_start_ms!=0 && elapsed_us>0) {
+            w.cpu_load(core,(uint8_t)(idle>=elapsed_us?0:100-(uint64_t)idle*100/elapsed_us));
+        }
+    }
+#endif
+#ifdef TELEMETRY_TASK_STATS
+    const UBaseType_t task_count = uxTaskGetSystemState(telemetry_tasks,sizeof(telemetry_tasks)/sizeof(TaskStatus_t),nullptr);
+    // the loop task (this one), then whichever others are closest to
+    // overflowing
+    const TaskHandle_t loop_handle = xTaskGetCurrentTaskHandle();
+    w.add_stack("loop",uxTaskGetStackHighWaterMark(nullptr));
+    bool used[sizeof(telemetry_tasks)/sizeof(TaskStatus_t)] = {false};
+    for(size_t n = 1;n<espmon::telemetry_view::max_stacks;++n) {
+        int least = -1;
+        for(UBaseType_t i = 0;i<task_count;++i) {
+            if(!used[i] && telemetry_tasks[i].xHandle!=loop_handle &&
+                    (least==-1 || telemetry_tasks[i].usStackHighWaterMark<telemetry_tasks[least].usStackHighWaterMark)) {
+                least = (int)i;
+            }
+        }
+        if(least==-1) {
+            break;
+        }
+        used[least] = true;
+        w.add_stack(telemetry_tasks[least].pcTaskName,telemetry_tasks[least].usStackHighWaterMark);
+    }
+#elif defined(INCLUDE_uxTaskGetStackHighWaterMark) && INCLUDE_uxTaskGetStackHighWaterMark
+    w.add_stack("loop",uxTaskGetStackHighWaterMark(nullptr));
+#if defined(INCLUDE_xTaskGetHandle) && INCLUDE_xTaskGetHandle
+    // the system tasks the dashboard leans on
+    static const char* const task_names[] = {"esp_timer","ipc0","ipc1"};
+    for(size_t i = 0;i<sizeof(task_names)/sizeof(task_names[0]);++i) {
+        const TaskHandle_t task = xTaskGetHandle(task_names[i]);
+        if(task!=nullptr) {
+            w.add_stack(task_names[i],uxTaskGetStackHighWaterMark(task));
+        }
+    }
+#endif
+#endif
+    paint_counters* controls[view_t::control_count];
+    main_view.paint_counters(controls);
+    for(size_t i = 0;i<view_t::control_count;++i) {
+        w.add_control(controls[i]->paints,controls[i]->total_us,controls[i]->max_us);
+        controls[i]->clear();
+    }
+    telemetry_start_ms = now_ms;
+    telemetry_frames = 0;
+    telemetry_frame_us = 0;
+    telemetry_frame_max_us = 0;
+    telemetry_flushes = 0;
+    telemetry_flush_pixels = 0;
+    telemetry_flush_us = 0;
+    telemetry_flush_max_us = 0;
+    return w.size();
+}
+#endif
 #if defined(TOUCH_BUS) || defined(BUTTON)
+#if LCD_HEIGHT < 128
+static void bar_trace_colors(uix_pixel color) {
+    top_value1_bar.trace_color(color);
+    top_value2_bar.trace_color(color);
+    bottom_value1_bar.trace_color(color);
+    bottom_value2_bar.trace_color(color);
+}
+#endif
 static void switch_light_dark_mode() {
+#ifdef LCD_INDEXED_BITS
+    // controls always paint the dark theme. the light theme is only a
+    // different palette, but nothing keeps the indexes of what's already
+    // on the panel, so it's repainted through the new one
+    screen_palette.light(dark_mode);
+#ifndef NO_FLUSH_TILES
+    flush_tiles.clear();
+#endif
+    main_screen.invalidate();
+    refresh_display();
+#else
     if(dark_mode) {
         main_screen.background_color(color_t::white);
-        value1_label.background_color(uix_color_t::white);
-        value2_label.background_color(uix_color_t::white);
+        value1_label.background_color(label_background(uix_color_t::white));
+        value2_label.background_color(label_background(uix_color_t::white));
         top_value1_label.color(uix_color_t::black);
-        top_value1_label.background_color(uix_color_t::white);
+        top_value1_label.background_color(label_background(uix_color_t::white));
         top_value2_label.color(uix_color_t::black);
-        top_value2_label.background_color(uix_color_t::white);
+        top_value2_label.background_color(label_background(uix_color_t::white));
         bottom_value1_label.color(uix_color_t::black);
-        bottom_value1_label.background_color(uix_color_t::white);
+        bottom_value1_label.background_color(label_background(uix_color_t::white));
         bottom_value2_label.color(uix_color_t::black);
-        bottom_value2_label.background_color(uix_color_t::white);
+        bottom_value2_label.background_color(label_background(uix_color_t::white));
         disconnected_label.background_color(uix_color_t::white);
         disconnected_label.color(uix_color_t::black);
+#if LCD_HEIGHT < 128
+        bar_trace_colors(uix_color_t::white);
+#endif
+        static_layer_invalidate();
         refresh_display();
     } else {
         main_screen.background_color(color_t::black);
-        value1_label.background_color(uix_color_t::black);
-        value2_label.background_color(uix_color_t::black);
+        value1_label.background_color(label_background(uix_color_t::black));
+        value2_label.background_color(label_background(uix_color_t::black));
         top_value1_label.color(uix_color_t::white);
-        top_value1_label.background_color(uix_color_t::black);
+        top_value1_label.background_color(label_background(uix_color_t::black));
         top_value2_label.color(uix_color_t::white);
-        top_value2_label.background_color(uix_color_t::black);
+        top_value2_label.background_color(label_background(uix_color_t::black));
         bottom_value1_label.color(uix_color_t::white);
-        bottom_value1_label.background_color(uix_color_t::black);
+        bottom_value1_label.background_color(label_background(uix_color_t::black));
         bottom_value2_label.color(uix_color_t::white);
-        bottom_value2_label.background_color(uix_color_t::black);
+        bottom_value2_label.background_color(label_background(uix_color_t::black));
         disconnected_label.background_color(uix_color_t::black);
         disconnected_label.color(uix_color_t::white);
+#if LCD_HEIGHT < 128
+        bar_trace_colors(uix_color_t::black);
+#endif
+        static_layer_invalidate();
         refresh_display();
     }
+#endif
     dark_mode=!dark_mode;
 }
 static nvs_handle_t storage_handle = 0;
 
-static void update_input() {
-#ifdef TOUCH_BUS
-    panel_touch_update();
-    uint16_t x,y,s;
-    size_t count = 1;
-    panel_touch_read_raw(&count,&x,&y,&s);
-    if(count>0) {
-        if(pressed==0) {
-            pressed = xTaskGetTickCount();
-        }
-    } else {
-        if(pressed>0) {
-            if(xTaskGetTickCount()>=pressed+pdMS_TO_TICKS(250)) {
-                switch_light_dark_mode();
-                nvs_set_u8(storage_handle,"dark",(uint8_t)dark_mode);
-                nvs_commit(storage_handle);
-            } else if(!disconnected_label.visible()) {
-                screen_index++;
-                serial_write(0,screen_index);
-            }
+#ifndef INPUT_DEBOUNCE_MS
+#define INPUT_DEBOUNCE_MS 20
+#endif
+#ifndef INPUT_POLL_MS
+// how often the touch controller is read when it can't interrupt, or to
+// catch the release while it's pressed
+#define INPUT_POLL_MS 20
+#endif
+// acts on a press that was let go. a long one switches the theme, a short
+// one asks the host for the next screen. event_us is when it was let go
+static void input_released(uint32_t event_us, uint32_t held_us) {
+#ifdef INPUT_LATENCY
+    const uint32_t now = (uint32_t)esp_timer_get_time();
+#endif
+    if(held_us>=250*1000) {
+#ifdef INPUT_LATENCY
+        input_timing.begin(input_latency::kind::theme,event_us,now);
+        input_timing.applied(now);
+#endif
+        switch_light_dark_mode();
+        nvs_set_u8(storage_handle,"dark",(uint8_t)dark_mode);
+        TRACE_BEGIN(nvs_commit,0);
+        nvs_commit(storage_handle);
+        TRACE_END(nvs_commit,0);
+    } else if(!disconnected_label.visible()) {
+#ifdef INPUT_LATENCY
+        // applied when the host's screen comes back
+        input_timing.begin(input_latency::kind::screen,event_us,now);
+#endif
+        screen_index++;
+        serial_write(0,screen_index);
+    }
+}
+static void input_edge(uint32_t event_us, bool down) {
+    if(down) {
+        if(!pressed) {
+            pressed = true;
+            pressed_us = event_us;
         }
-        pressed = 0;
+    } else if(pressed) {
+        pressed = false;
+        input_released(event_us,event_us-pressed_us);
     }
+}
+#ifdef BUTTON
+// the buttons interrupt on both edges and are read once they settle
+static input_debouncer button_edges(INPUT_DEBOUNCE_MS*1000);
+static void IRAM_ATTR button_isr(void* arg) {
+    button_edges.edge((uint32_t)esp_timer_get_time());
+}
+#endif
+#ifdef TOUCH_BUS
+// the controller's interrupt line doesn't bounce, it just says there's a
+// report to read. without one the controller is polled
+static input_debouncer touch_edges(0);
+static bool touch_interrupt = false;
+static uint32_t touch_poll_us = 0;
+#ifdef TOUCH_PIN_NUM_INT
+static void IRAM_ATTR touch_isr(void* arg) {
+    touch_edges.edge((uint32_t)esp_timer_get_time());
+}
+#endif
 #endif
+static void input_init() {
+    // the panel's drivers may have installed it already
+    gpio_install_isr_service(0);
 #ifdef BUTTON
-    if(panel_button_read_all()) {
-        if(pressed==0) {
-            pressed = xTaskGetTickCount();
+    for(int pin = 0;pin<GPIO_NUM_MAX;++pin) {
+        if(0!=(((uint64_t)(BUTTON_MASK)>>pin)&1)) {
+            gpio_set_intr_type((gpio_num_t)pin,GPIO_INTR_ANYEDGE);
+            gpio_isr_handler_add((gpio_num_t)pin,button_isr,nullptr);
+            gpio_intr_enable((gpio_num_t)pin);
         }
-    } else {
-        if(pressed>0) {
-            if(xTaskGetTickCount()>=pressed+pdMS_TO_TICKS(250)) {
-                switch_light_dark_mode();
-                nvs_set_u8(storage_handle,"dark",(uint8_t)dark_mode);
-                nvs_commit(storage_handle);
-            } else if(!disconnected_label.visible()) {
-                screen_index++;
-                serial_write(0,screen_index);
-            }
+    }
+#endif
+#if defined(TOUCH_BUS) && defined(TOUCH_PIN_NUM_INT)
+    if((int)TOUCH_PIN_NUM_INT>=0) {
+        gpio_set_intr_type((gpio_num_t)TOUCH_PIN_NUM_INT,GPIO_INTR_NEGEDGE);
+        touch_interrupt = ESP_OK==gpio_isr_handler_add((gpio_num_t)TOUCH_PIN_NUM_INT,touch_isr,nullptr);
+        if(touch_interrupt) {
+            gpio_intr_enable((gpio_num_t)TOUCH_PIN_NUM_INT);
         }
-        pressed = 0;
+    }
+#endif
+}
+static void update_input() {
+    const uint32_t now = (uint32_t)esp_timer_get_time();
+#ifdef INPUT_LATENCY
+    input_timing.update(now);
+#endif
+#ifdef TOUCH_BUS
+    uint32_t touch_us = now;
+    const bool touch_edge = touch_interrupt && touch_edges.settled(now,&touch_us);
+    if(touch_edge || ((!touch_interrupt || pressed) && now-touch_poll_us>=INPUT_POLL_MS*1000)) {
+        touch_poll_us = now;
+        panel_touch_update();
+        uint16_t x,y,s;
+        size_t count = 1;
+        panel_touch_read_raw(&count,&x,&y,&s);
+        input_edge(touch_us,count>0);
+    }
+#endif
+#ifdef BUTTON
+    uint32_t button_us;
+    if(button_edges.settled(now,&button_us)) {
+        input_edge(button_us,0!=panel_button_read_all());
     }
 #endif
 }
@@ -638,6 +1325,9 @@ static void loop_task(void* arg) {
             vTaskDelay(5);
         }
         loop();
+#ifndef NO_TELEMETRY
+        telemetry_frame_done();
+#endif
     }
 }
 static bool screen_populated = false;
@@ -664,123 +1354,82 @@ extern "C" void app_main() {
 #ifdef TOUCH_BUS
     panel_touch_init();
 #endif
+#if defined(TOUCH_BUS) || defined(BUTTON)
+    input_init();
+#endif
 #ifdef LCD_BCKL_PWM
     panel_lcd_backlight(64);
 #endif
     serial_init();
+#if !defined(NO_TELEMETRY) && !defined(NO_TELEMETRY_LOAD)
+    telemetry_load_init();
+#endif
+#ifdef LCD_INDEXED_BITS
+    indexed_init();
+    disp.buffer_size(INDEXED_BUFFER_SIZE);
+    disp.buffer1(indexed_buffers[0]);
+#if LCD_SYNC_TRANSFER == 0
+    disp.buffer2(indexed_buffers[1]);
+#endif
+#elif defined(WIDEN_FLUSH)
+    widen_init();
+    // pixels are widened in place, so leave room for the panel's 3 bytes
+    disp.buffer_size(LCD_TRANSFER_SIZE/3*2);
+#else
     disp.buffer_size(LCD_TRANSFER_SIZE);
+#endif
+#ifndef LCD_INDEXED_BITS
     disp.buffer1((uint8_t*)panel_lcd_transfer_buffer());
+#ifdef LCD_DIRECT_FRAMEBUFFER
+    direct_init();
+#endif
 #if LCD_SYNC_TRANSFER == 0
+#ifdef LCD_DIRECT_FRAMEBUFFER
+    // copies into the framebuffer finish before the flush returns, so
+    // a second buffer would never be used
+    if(direct_frame==nullptr) {
+        disp.buffer2((uint8_t*)panel_lcd_transfer_buffer2());
+    }
+#else
     disp.buffer2((uint8_t*)panel_lcd_transfer_buffer2());
+#endif
+#endif
+#endif
+#ifdef FLUSH_RING
+    flush_ring_init();
+#endif
+#ifdef TUNED_BUFFERS
+    tuned_buffers_init();
 #endif
     disp.on_flush_callback(uix_on_flush);
 
-#if LCD_HEIGHT > 128
-    static const int section_height_divisor = 4;
-#else
-    static const int section_height_divisor = 2;
-#endif
     main_screen.dimensions({LCD_WIDTH,LCD_HEIGHT});
+#ifdef LCD_INDEXED_BITS
+    // index 0 is black
+    screen_t::pixel_type bg_px;
+    bg_px.native_value = 0;
+    main_screen.background_color(bg_px);
+#else
     main_screen.background_color(gfx::color<typename screen_t::pixel_type>::black);
-    value1_label.bounds(srect16(0,0,(main_screen.dimensions().width)/10-1,main_screen.dimensions().height/section_height_divisor).inflate(-2,-4));
-    value1_label.text("---");
-    value1_label.background_color(uix_color_t::black);
-    value1_label.color(uix_color_t::white);
-    main_screen.register_control(value1_label);
-    srect16 b = value1_label.bounds();
-    top_value1_label.bounds(srect16(b.x2+2,b.y1,b.x2+1+(main_screen.dimensions().width/5),b.height()/2+b.y1));
-    top_value1_label.text("---");
-    top_value1_label.font(text_font_stm);
-    top_value1_label.color(uix_color_t::white);
-    strcpy(top_value1_text,"---");
-    main_screen.register_control(top_value1_label);
-    b = top_value1_label.bounds();
-    top_value2_label.bounds(srect16(b.x1,b.y2+1,b.x2,b.y2+b.height()));
-    top_value2_label.text("---");
-    top_value2_label.font(text_font_stm);
-    top_value2_label.color(uix_color_t::white);
-    strcpy(top_value2_text,"---");
-    main_screen.register_control(top_value2_label);
-
-    b=top_value1_label.bounds();
-    b.x1 = b.x2+4;
-    b.x2 = main_screen.dimensions().width-1;
-    b.y2-=2;
-    top_value1_bar.bounds(b);
-    top_value1_bar.back_color(uix_color_t::black);
-    main_screen.register_control(top_value1_bar);
-
-    b=top_value2_label.bounds();
-    b.x1 = b.x2+4;
-    b.x2 = main_screen.dimensions().width-1;
-    b.y2-=2;
-    top_value2_bar.bounds(b);
-    auto px = uix_color_t::white;
-    top_value2_bar.color(px);
-    top_value2_bar.is_gradient(true);
-    top_value2_bar.back_color(uix_color_t::black);
-    main_screen.register_control(top_value2_bar);
-    
-
-    value2_label.bounds(value1_label.bounds().offset(0,main_screen.dimensions().height/section_height_divisor+3));
-    value2_label.color(uix_color_t::white);
-    value2_label.background_color(uix_color_t::black);
-    value2_label.text("---");
-    main_screen.register_control(value2_label);
-    b = value2_label.bounds();
-    bottom_value1_label.bounds(srect16(b.x2+2,b.y1,b.x2+1+(main_screen.dimensions().width/5),b.height()/2+b.y1));
-    bottom_value1_label.text("---");
-    bottom_value1_label.font(text_font_stm);
-    bottom_value1_label.color(uix_color_t::white);
-    strcpy(bottom_value1_text,"---");
-    main_screen.register_control(bottom_value1_label);
-    b = bottom_value1_label.bounds();
-    bottom_value2_label.bounds(srect16(b.x1,b.y2+1,b.x2,b.y2+b.height()));
-    bottom_value2_label.text("---"); // \xC2\xB0
-    bottom_value2_label.color(uix_color_t::white);
-    bottom_value2_label.font(text_font_stm);
-    strcpy(bottom_value2_text,"---");
-    main_screen.register_control(bottom_value2_label);
-    
-    b=bottom_value1_label.bounds();
-    b.x1 = b.x2+4;
-    b.x2 = main_screen.dimensions().width-1;
-    b.y2-=2;
-    bottom_value1_bar.bounds(b);
-    bottom_value1_bar.color(uix_color_t::white);
-    bottom_value1_bar.back_color(uix_color_t::black);
-    main_screen.register_control(bottom_value1_bar);
-
-    b=bottom_value2_label.bounds();
-    b.x1 = b.x2+4;
-    b.x2 = main_screen.dimensions().width-1;
-    b.y2-=2;
-    bottom_value2_bar.bounds(b);
-    px = uix_color_t::white;
-    bottom_value2_bar.color(px);
-    bottom_value2_bar.back_color(uix_color_t::black);
-    bottom_value2_bar.is_gradient(true);
-    main_screen.register_control(bottom_value2_bar);
-    
-#if LCD_HEIGHT>128
-    b = main_screen.bounds();
-    b.y1=main_screen.dimensions().height/2+1;
-    history_graph.bounds(b);
-    history_graph.add_line(top_value1_bar.color());
-    history_graph.add_line(top_value2_bar.color());
-    history_graph.add_line(bottom_value1_bar.color());
-    history_graph.add_line(bottom_value2_bar.color());
-    main_screen.register_control(history_graph);
-#endif
-    disconnected_label.bounds(srect16(0,0,main_screen.dimensions().width/2,main_screen.dimensions().width/8).center(main_screen.bounds()));
-    rgba_pixel<32> bg = uix_color_t::black;
-    //bg.opacity_inplace(.6f);
-    disconnected_label.font(text_font_stm);
-    disconnected_label.color(uix_color_t::white);
-    disconnected_label.background_color(bg);
-    disconnected_label.text("[ disconnected ]");
-    disconnected_label.text_justify(uix_justify::center);
-    main_screen.register_control(disconnected_label);
+#endif
+#ifndef NO_LAYER_CACHE
+    static_layer_init();
+#endif
+#ifndef NO_TELEMETRY
+    paint_clock() = paint_clock_us;
+#endif
+#if defined(TRACE_RING_SIZE) || defined(INPUT_LATENCY)
+    paint_trace() = paint_hook;
+#endif
+    main_view.layout(main_screen,text_font_stm,label_background(uix_color_t::black));
+#ifndef NO_LAYER_CACHE
+    if(static_layer.cached()) {
+        main_view.static_cached(true);
+    }
+#endif
+#ifdef LCD_INDEXED_BITS
+    indexed_palette_slots();
+#endif
     ESP_ERROR_CHECK(nvs_open("storage", NVS_READWRITE, &storage_handle));
     uint8_t tmp;
     err = nvs_get_u8(storage_handle, "screen", &tmp);
@@ -800,12 +1449,21 @@ extern "C" void app_main() {
     if(!dark_mode) {
         dark_mode=true;
         switch_light_dark_mode();
-    } else {
-        refresh_display();
     }
+    refresh_display();
     TaskHandle_t loop_handle;
     xTaskCreate(loop_task,"loop_task",4096,nullptr,20,&loop_handle);
 }
+// the cells a value label needs to show up to max. values can run a little
+// past their maximum, so never fewer than the 3 a percentage needs
+static size_t value_digits(uint16_t max) {
+    size_t digits = 1;
+    while(max>=10) {
+        max/=10;
+        ++digits;
+    }
+    return digits<3?3:digits;
+}
 static uix_pixel to_color(const uint8_t* col_array) {
 #if LCD_BIT_DEPTH > 1
     return uix_pixel(col_array[0],col_array[1],col_array[2],col_array[3]);
@@ -820,17 +1478,12 @@ static uix_pixel to_color(const uint8_t* col_array) {
 #endif
 }
 static void loop() {
-    struct to_avg {
-        float g0,g1,g2,g3;
-    };
-    static to_avg values[5];
     static TickType_t ts = 0;
     static int ts_count = 0;
     static int index =0;
     
-    float v;
+    q16_t v;
     
-    to_avg& value=values[index];
     response_t resp; 
     int cmd = serial_read_packet(&resp);
     while(cmd!=-1) {
@@ -847,18 +1500,31 @@ static void loop() {
             nvs_set_u8(storage_handle,"screen",(uint8_t)scr.index);
             //nvs_commit(storage_handle);
             screen_index = scr.index;
+#ifndef NO_LINK_STATS
+            link_host_pings = 0!=(scr.flags&espmon::screen_pings);
+            if(!link_host_pings) {
+                link_extended = false;
+            }
+            link_ping_misses = 0;
+#endif
         
 #if LCD_BIT_DEPTH == 1
             scr.flags &= 0xF0; // turn off gradients for monochrome displays
+#elif defined(LCD_INDEXED_BITS) && LCD_INDEXED_BITS == 4
+            scr.flags &= 0xF0; // 16 colors only has room for the slots
 #endif
-            top_value1_max = scr.top_max1;
-            strcpy(top_value1_suffix,scr.top_suffix1);
-            top_value2_max = scr.top_max2;
-            strcpy(top_value2_suffix,scr.top_suffix2);
-            bottom_value1_max = scr.bottom_max1;
-            strcpy(bottom_value1_suffix,scr.bottom_suffix1);
-            bottom_value2_max = scr.bottom_max2;
-            strcpy(bottom_value2_suffix,scr.bottom_suffix2);
+            top_value1_recip = q16_recip(scr.top_max1);
+            top_value1_label.suffix(scr.top_suffix1);
+            top_value1_label.fit_digits(value_digits(scr.top_max1));
+            top_value2_recip = q16_recip(scr.top_max2);
+            top_value2_label.suffix(scr.top_suffix2);
+            top_value2_label.fit_digits(value_digits(scr.top_max2));
+            bottom_value1_recip = q16_recip(scr.bottom_max1);
+            bottom_value1_label.suffix(scr.bottom_suffix1);
+            bottom_value1_label.fit_digits(value_digits(scr.bottom_max1));
+            bottom_value2_recip = q16_recip(scr.bottom_max2);
+            bottom_value2_label.suffix(scr.bottom_suffix2);
+            bottom_value2_label.fit_digits(value_digits(scr.bottom_max2));
             screen_index = scr.index;
             strcpy(top_label_text,scr.top_label);
             value1_label.text(top_label_text);
@@ -894,6 +1560,15 @@ static void loop() {
             bottom_value2_bar.back_color(uix_color_t::black);
 #endif
             bottom_value2_bar.is_gradient((scr.flags&(1<<3)));
+#ifdef LCD_INDEXED_BITS
+            indexed_palette_slots();
+#endif
+            // the bar backs changed
+            static_layer_invalidate();
+            for(int i = 0;i<4;++i) {
+                value_stats[i].clear();
+            }
+            index = 0;
 #if LCD_HEIGHT > 128
             history_graph.clear_data();
             history_graph.set_line(0,to_color(scr.top_color1));
@@ -905,74 +1580,150 @@ static void loop() {
             top_value2_bar.clear();
             bottom_value1_bar.clear();
             bottom_value2_bar.clear();
+#endif
+#ifdef INPUT_LATENCY
+            // a screen switch from the input is set up now
+            input_timing.applied((uint32_t)esp_timer_get_time());
 #endif
             refresh_display();
             cmd = serial_read_packet(&resp);
+            continue;
+        }
+#ifndef NO_LINK_STATS
+        if(cmd==2) { // pong
+            if(link_timing.pong(resp.pong.id,resp.pong.host_receive_us,resp.pong.host_send_us,(uint32_t)esp_timer_get_time())) {
+                link_extended = true;
+                link_ping_misses = 0;
+            }
+            cmd = serial_read_packet(&resp);
+            continue;
+        }
+        if(cmd==4) { // diagnostics query
+            const bool overlay = 0!=(resp.diagnostics.flags&1);
+            if(overlay!=diagnostics_label.visible()) {
+                diagnostics_label.visible(overlay);
+                diagnostics_update();
+                refresh_display();
+            }
+            uint8_t report[espmon::diagnostics_report_size];
+            link_timing.encode(report,overlay);
+            serial_write_frame(4,report,sizeof(report));
+            cmd = serial_read_packet(&resp);
+            continue;
+        }
+#endif
+#ifndef NO_TELEMETRY
+        if(cmd==5) { // telemetry query
+            uint8_t report[255];
+            const size_t size = telemetry_report(report);
+            serial_write_frame(5,report,(uint8_t)size);
+            cmd = serial_read_packet(&resp);
+            continue;
+        }
+#endif
+        if(cmd==6) { // trace dump
+            uint8_t chunk[255];
+#ifdef TRACE_RING_SIZE
+            // hold the rings still while they go out
+            trace_log.enabled(false);
+            trace_rings_t::dump_cursor cursor;
+            while(!cursor.done()) {
+                const size_t size = trace_log.dump(cursor,trace_clock::hz(),chunk);
+                serial_write_frame(6,chunk,(uint8_t)size);
+            }
+            if(0==(resp.trace.flags&espmon::trace_keep)) {
+                trace_log.clear();
+            }
+            trace_log.enabled(true);
+#else
+            // tracing isn't built in, so the dump is empty
+            espmon::trace_chunk_writer w(chunk,0,0);
+            w.last();
+            serial_write_frame(6,chunk,(uint8_t)w.size());
+#endif
+            cmd = serial_read_packet(&resp);
+            continue;
         }
+        if(cmd==7) { // profile query
+            profiler_query(resp.profile);
+            cmd = serial_read_packet(&resp);
+            continue;
+        }
+        if(cmd==8) { // latency query
+            uint8_t report[espmon::latency_report_size];
+#ifdef INPUT_LATENCY
+            const size_t size = input_timing.encode(report);
+            if(0!=(resp.latency.flags&espmon::latency_clear)) {
+                input_timing.clear();
+            }
+#else
+            // there are no inputs to time
+            const size_t size = espmon::latency_writer(report,0,0).size();
+#endif
+            serial_write_frame(8,report,(uint8_t)size);
+            cmd = serial_read_packet(&resp);
+            continue;
+        }
+#ifndef NO_LINK_STATS
+        if(cmd==3) { // screen data with link timing
+            link_timing.data(resp.data_ex.seq,resp.data_ex.sample_us,(uint32_t)esp_timer_get_time());
+        }
+        if(cmd==1 || cmd==3) { // screen data
+            response_data_t& data = cmd==3?resp.data_ex.data:resp.data;
+#else
         if(cmd==1) { // screen data
             response_data_t& data = resp.data;
-            v=((float)data.top_value1)/top_value1_max;
-            value.g0=v;
-            itoa(data.top_value1,top_value1_text,10);
-            strcat(top_value1_text,top_value1_suffix);
-            top_value1_label.text(top_value1_text);
+#endif
+            v=q16_normalize(data.top_value1,top_value1_recip);
+            value_stats[0].add(v);
+            top_value1_label.value(data.top_value1);
             refresh_display();
-            top_value1_bar.value(v);
+            top_value1_bar.value_q16(v);
             refresh_display();
-            v=((float)data.top_value2)/top_value2_max;
-            value.g1=v;
-            itoa(data.top_value2,top_value2_text,10);
-            strcat(top_value2_text,top_value2_suffix);
-            top_value2_label.text(top_value2_text);
+            v=q16_normalize(data.top_value2,top_value2_recip);
+            value_stats[1].add(v);
+            top_value2_label.value(data.top_value2);
             refresh_display();
-            top_value2_bar.value(v);
+            top_value2_bar.value_q16(v);
             refresh_display();
-            v=((float)data.bottom_value1)/bottom_value1_max;
-            value.g2=v;
-            itoa(data.bottom_value1,bottom_value1_text,10);
-            strcat(bottom_value1_text,bottom_value1_suffix);
-            bottom_value1_label.text(bottom_value1_text);
+            v=q16_normalize(data.bottom_value1,bottom_value1_recip);
+            value_stats[2].add(v);
+            bottom_value1_label.value(data.bottom_value1);
             refresh_display();
-            bottom_value1_bar.value(v);
+            bottom_value1_bar.value_q16(v);
             refresh_display();
-            v=((float)data.bottom_value2)/bottom_value2_max;
-            value.g3=v;
-            itoa(data.bottom_value2,bottom_value2_text,10);
-            strcat(bottom_value2_text,bottom_value2_suffix);
-            bottom_value2_label.text(bottom_value2_text);
+            v=q16_normalize(data.bottom_value2,bottom_value2_recip);
+            value_stats[3].add(v);
+            bottom_value2_label.value(data.bottom_value2);
             refresh_display();
-            bottom_value2_bar.value(v);
+            bottom_value2_bar.value_q16(v);
             refresh_display();
+#ifndef NO_LINK_STATS
+            link_timing.displayed((uint32_t)esp_timer_get_time());
+#endif
             ++index;
             cmd = serial_read_packet(&resp);
+            continue;
         }
+        // anything else the serial layer doesn't hand back, but don't spin
+        // if it ever does
+        cmd = serial_read_packet(&resp);
     }
 #if LCD_HEIGHT>128
-    if(index>=5 && !disconnected_label.visible()) {
+    if(index>=(int)stats_t::window_size && !disconnected_label.visible()) {
         index = 0;
-        to_avg total;
-        memset(&total,0,sizeof(total));
-        for(int i = 0;i<5;++i) {
-            total.g0+=values[i].g0;
-            total.g1+=values[i].g1;
-            total.g2+=values[i].g2;
-            total.g3+=values[i].g3;
-    
+        for(int i = 0;i<4;++i) {
+            history_graph.add_data_q16(i,value_stats[i].get(history_stat));
         }
-        total.g0/=5.f;
-        total.g1/=5.f;
-        total.g2/=5.f;
-        total.g3/=5.f;
-        history_graph.add_data(0,total.g0);
-        history_graph.add_data(1,total.g1);
-        history_graph.add_data(2,total.g2);
-        history_graph.add_data(3,total.g3);
         refresh_display();
     } 
 #endif
     if(ts_count>=10 && !disconnected_label.visible()) { // 1 second
         ts_count = 0;
         index = 0;
+        for(int i = 0;i<4;++i) {
+            value_stats[i].clear();
+        }
         top_value1_label.text("---");
         refresh_display();
         top_value1_bar.value(0);
@@ -1001,6 +1752,14 @@ static void loop() {
 #endif
         disconnected_label.visible(true);
         refresh_display();
+#ifndef NO_LINK_STATS
+        // the next host may be a different one
+        link_extended = false;
+        link_host_pings = false;
+        link_ping_misses = 0;
+        link_ping_ticks = 0;
+        link_timing.reset();
+#endif
     }
     if(xTaskGetTickCount()>=ts+pdMS_TO_TICKS(100)) {
         ts=xTaskGetTickCount();
@@ -1010,10 +1769,42 @@ static void loop() {
             serial_write(0,screen_index==-1?0:screen_index);
         } else {
             // printf("populate screen data: %d\n",screen_index);;
+#ifndef NO_LINK_STATS
+            serial_write(screen_index==-1?0:(link_extended?3:1),screen_index==-1?0:screen_index);
+            // ping about once a second
+            if(++link_ping_ticks>=10) {
+                link_ping_ticks = 0;
+                if(link_host_pings && link_ping_misses<3) {
+                    if(link_timing.ping_pending() && ++link_ping_misses==3) {
+                        link_extended = false;
+                    } else {
+                        serial_write(2,link_timing.ping_begin((uint32_t)esp_timer_get_time()));
+                    }
+                }
+                if(diagnostics_label.visible()) {
+                    diagnostics_update();
+                    refresh_display();
+                }
+            }
+#else
             serial_write(screen_index==-1?0:1,screen_index==-1?0:screen_index);
+#endif
         }
     }
 #if defined(TOUCH_BUS) || defined(BUTTON)
+#ifdef TRACE_RING_SIZE
+    // this runs every spin, so only the ones that saw a press or took a
+    // while go in the ring. the rest would push out everything else
+    const uint32_t input_start = trace_clock::cycles();
+    const bool input_was_pressed = pressed;
     update_input();
+    const bool input_active = input_was_pressed || pressed;
+    if(input_active || trace_clock::cycles()-input_start>trace_clock::hz()/1000) {
+        trace_log.record(espmon::trace_kind::begin,espmon::trace_point::input,input_active,input_start);
+        TRACE_END(input,input_active);
+    }
+#else
+    update_input();
+#endif
 #endif
 }
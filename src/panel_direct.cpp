@@ -0,0 +1,108 @@
+#include "panel_direct.h"
+#include <stddef.h>
+#include "esp_idf_version.h"
+#include "soc/soc_caps.h"
+#if SOC_LCD_RGB_SUPPORTED && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5,1,0)
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_attr.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_panel_rgb.h"
+#include "esp_timer.h"
+
+// the linker sends htcw_esp_panel's calls through the __wrap_ versions
+extern "C" esp_err_t __real_esp_lcd_new_rgb_panel(const esp_lcd_rgb_panel_config_t* config, esp_lcd_panel_handle_t* ret_panel);
+extern "C" esp_err_t __real_esp_lcd_rgb_panel_register_event_callbacks(esp_lcd_panel_handle_t panel, const esp_lcd_rgb_panel_event_callbacks_t* callbacks, void* user_ctx);
+
+static esp_lcd_panel_handle_t rgb_panel = nullptr;
+static size_t rgb_fb_count = 0;
+static SemaphoreHandle_t rgb_vsync = nullptr;
+// when the last frame started and how long the one before it took
+static volatile int64_t rgb_vsync_us = 0;
+static volatile int64_t rgb_frame_us = 0;
+// whatever the panel library registered, so it still gets its callbacks
+static esp_lcd_rgb_panel_event_callbacks_t rgb_callbacks = {};
+static void* rgb_callbacks_ctx = nullptr;
+
+static IRAM_ATTR bool rgb_on_vsync(esp_lcd_panel_handle_t panel, const esp_lcd_rgb_panel_event_data_t* edata, void* user_ctx) {
+    const int64_t now = esp_timer_get_time();
+    if(rgb_vsync_us!=0) {
+        rgb_frame_us = now-rgb_vsync_us;
+    }
+    rgb_vsync_us = now;
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(rgb_vsync,&woken);
+    bool result = woken==pdTRUE;
+    if(rgb_callbacks.on_vsync!=nullptr) {
+        result = rgb_callbacks.on_vsync(panel,edata,rgb_callbacks_ctx) || result;
+    }
+    return result;
+}
+// registers the library's callbacks with ours chained onto vsync
+static esp_err_t rgb_register() {
+    esp_lcd_rgb_panel_event_callbacks_t cbs = rgb_callbacks;
+    cbs.on_vsync = rgb_on_vsync;
+    return __real_esp_lcd_rgb_panel_register_event_callbacks(rgb_panel,&cbs,rgb_callbacks_ctx);
+}
+extern "C" esp_err_t __wrap_esp_lcd_new_rgb_panel(const esp_lcd_rgb_panel_config_t* config, esp_lcd_panel_handle_t* ret_panel) {
+    const esp_err_t err = __real_esp_lcd_new_rgb_panel(config,ret_panel);
+    if(err!=ESP_OK) {
+        return err;
+    }
+    rgb_panel = *ret_panel;
+    // 0 means the default of one
+    rgb_fb_count = config->num_fbs==0?1:config->num_fbs;
+    if(rgb_vsync==nullptr) {
+        rgb_vsync = xSemaphoreCreateBinary();
+    }
+    rgb_register();
+    return ESP_OK;
+}
+extern "C" esp_err_t __wrap_esp_lcd_rgb_panel_register_event_callbacks(esp_lcd_panel_handle_t panel, const esp_lcd_rgb_panel_event_callbacks_t* callbacks, void* user_ctx) {
+    if(panel!=rgb_panel || callbacks==nullptr) {
+        return __real_esp_lcd_rgb_panel_register_event_callbacks(panel,callbacks,user_ctx);
+    }
+    rgb_callbacks = *callbacks;
+    rgb_callbacks_ctx = user_ctx;
+    return rgb_register();
+}
+void* panel_lcd_frame_buffer(void) {
+    // with more than one the driver flips between them, so none of them
+    // is always the one on the panel
+    if(rgb_panel==nullptr || rgb_fb_count!=1) {
+        return nullptr;
+    }
+    void* fb = nullptr;
+    if(ESP_OK!=esp_lcd_rgb_panel_get_frame_buffer(rgb_panel,1,&fb)) {
+        return nullptr;
+    }
+    return fb;
+}
+bool panel_lcd_vsync_wait(void) {
+    if(rgb_vsync==nullptr) {
+        return false;
+    }
+    // a vsync nobody waited on says nothing about where the panel is now
+    xSemaphoreTake(rgb_vsync,0);
+    // a frame is well under this even at the slowest pixel clocks
+    return pdTRUE==xSemaphoreTake(rgb_vsync,pdMS_TO_TICKS(100));
+}
+int panel_lcd_scan_row(int rows) {
+    const int64_t frame = rgb_frame_us;
+    if(frame<=0) {
+        return -1;
+    }
+    const int64_t into = (esp_timer_get_time()-rgb_vsync_us)%frame;
+    return (int)(into*rows/frame);
+}
+#else
+void* panel_lcd_frame_buffer(void) {
+    return nullptr;
+}
+bool panel_lcd_vsync_wait(void) {
+    return false;
+}
+int panel_lcd_scan_row(int rows) {
+    return -1;
+}
+#endif
@@ -0,0 +1,207 @@
+#include "profiler.hpp"
+#include "espmon_protocol.hpp"
+#ifdef PROFILER_SLOTS
+#include "esp_idf_version.h"
+#if ESP_IDF_VERSION_MAJOR < 5
+#error "PROFILER_SLOTS needs ESP-IDF 5 or later"
+#endif
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gptimer.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_memory_utils.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#ifdef __XTENSA__
+#include "esp_debug_helpers.h"
+#include "xtensa_context.h"
+#else
+#include "riscv/rvruntime-frames.h"
+#endif
+#include "sample_histogram.hpp"
+
+// program counters kept per sample, the interrupted one first. RISC-V
+// builds only get callers with CONFIG_ESP_SYSTEM_USE_FRAME_POINTER
+#ifndef PROFILER_DEPTH
+#define PROFILER_DEPTH 4
+#endif
+// samples a second per core until a query says otherwise. off the 1kHz
+// tick so the samples don't land in step with it
+#ifndef PROFILER_RATE_HZ
+#define PROFILER_RATE_HZ 997
+#endif
+#define PROFILER_MAX_RATE_HZ 10000
+#if defined(portNUM_PROCESSORS) && !defined(CONFIG_FREERTOS_UNICORE)
+#define PROFILER_CORES portNUM_PROCESSORS
+#include "esp_ipc.h"
+#else
+#define PROFILER_CORES 1
+#endif
+
+using histograms_t = sample_histograms<PROFILER_SLOTS,PROFILER_DEPTH,PROFILER_CORES>;
+static histograms_t histograms;
+static gptimer_handle_t timers[PROFILER_CORES];
+static bool timers_created = false;
+static volatile uint8_t sample_depth = PROFILER_DEPTH;
+static uint16_t sample_rate = PROFILER_RATE_HZ;
+static bool running = false;
+// time spent sampling since the counts were cleared
+static uint64_t elapsed_us = 0;
+static int64_t started_us = 0;
+
+#ifdef __XTENSA__
+// return addresses carry the caller's window increment in their top two
+// bits, and point past the call
+static inline uint32_t call_site(uint32_t pc) {
+    if(pc&0x80000000U) {
+        pc = (pc&0x3FFFFFFFU)|0x40000000U;
+    }
+    return pc-3;
+}
+#endif
+// fills pcs with the interrupted program counter and up to depth-1 of its
+// callers. a level 1 interrupt can only have preempted a task, and on
+// entry the port saved the task's frame on its stack and pointed the
+// task's pxTopOfStack, the first thing in its TCB, at it
+static IRAM_ATTR void sample_stack(uint32_t* pcs, size_t depth) {
+    void* const* tcb = (void* const*)xTaskGetCurrentTaskHandle();
+#ifdef __XTENSA__
+    const XtExcFrame* frame = (const XtExcFrame*)*tcb;
+    pcs[0] = frame->pc;
+    // the windows were spilled on the way in, so the stack can be walked
+    esp_backtrace_frame_t f;
+    f.pc = frame->pc;
+    f.sp = frame->a1;
+    f.next_pc = frame->a0;
+    f.exc_frame = frame;
+    size_t n = 1;
+    while(n<depth && f.next_pc!=0 && esp_backtrace_get_next_frame(&f)) {
+        pcs[n++] = call_site(f.pc);
+    }
+#else
+    const RvExcFrame* frame = (const RvExcFrame*)*tcb;
+    pcs[0] = frame->mepc;
+#if CONFIG_ESP_SYSTEM_USE_FRAME_POINTER
+    // each frame keeps its return address and the caller's frame pointer
+    // just under its own frame pointer
+    uint32_t fp = frame->s0;
+    size_t n = 1;
+    while(n<depth && esp_stack_ptr_is_sane(fp)) {
+        const uint32_t ra = ((const uint32_t*)fp)[-1];
+        if(!esp_ptr_executable((void*)ra)) {
+            break;
+        }
+        pcs[n++] = ra-2;
+        fp = ((const uint32_t*)fp)[-2];
+    }
+#else
+    (void)depth;
+#endif
+#endif
+}
+static IRAM_ATTR bool on_sample(gptimer_handle_t timer, const gptimer_alarm_event_data_t* edata, void* user_ctx) {
+    const uint32_t start = esp_cpu_get_cycle_count();
+    const size_t core = (size_t)xPortGetCoreID();
+    uint32_t pcs[PROFILER_DEPTH] = {};
+    sample_stack(pcs,sample_depth);
+    histograms.add(core,pcs);
+    // the interrupt's entry and exit aren't in here, so this is a floor
+    histograms.account(core,esp_cpu_get_cycle_count()-start);
+    return false;
+}
+// the alarm interrupt is allocated on the core that registers for it
+static void sample_timer_create(void* arg) {
+    gptimer_handle_t& timer = timers[(size_t)arg];
+    gptimer_config_t config = {};
+    config.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+    config.direction = GPTIMER_COUNT_UP;
+    config.resolution_hz = 1000000;
+    if(ESP_OK!=gptimer_new_timer(&config,&timer)) {
+        timer = nullptr;
+        return;
+    }
+    gptimer_event_callbacks_t callbacks = {};
+    callbacks.on_alarm = on_sample;
+    if(ESP_OK!=gptimer_register_event_callbacks(timer,&callbacks,nullptr) || ESP_OK!=gptimer_enable(timer)) {
+        gptimer_del_timer(timer);
+        timer = nullptr;
+    }
+}
+static void timers_start() {
+    gptimer_alarm_config_t alarm = {};
+    alarm.alarm_count = 1000000/sample_rate;
+    alarm.reload_count = 0;
+    alarm.flags.auto_reload_on_alarm = true;
+    for(size_t i = 0;i<PROFILER_CORES;++i) {
+        if(timers[i]!=nullptr) {
+            // spread the cores' samples out over the period
+            gptimer_set_raw_count(timers[i],alarm.alarm_count*i/PROFILER_CORES);
+            gptimer_set_alarm_action(timers[i],&alarm);
+            gptimer_start(timers[i]);
+        }
+    }
+}
+static void timers_stop() {
+    for(size_t i = 0;i<PROFILER_CORES;++i) {
+        if(timers[i]!=nullptr) {
+            gptimer_stop(timers[i]);
+        }
+    }
+}
+#endif
+void profiler_query(const response_profile_t& query) {
+    uint8_t chunk[255];
+#ifdef PROFILER_SLOTS
+    if(!timers_created) {
+        timers_created = true;
+        for(size_t i = 0;i<PROFILER_CORES;++i) {
+#if PROFILER_CORES > 1
+            if(i!=(size_t)xPortGetCoreID()) {
+                esp_ipc_call_blocking(i,sample_timer_create,(void*)i);
+                continue;
+            }
+#endif
+            sample_timer_create((void*)i);
+        }
+    }
+    // the tables can't be read while the interrupts are writing them
+    const bool was_running = running;
+    if(running) {
+        timers_stop();
+        elapsed_us+=esp_timer_get_time()-started_us;
+        running = false;
+    }
+    histograms_t::dump_cursor cursor;
+    const uint32_t mhz = esp_rom_get_cpu_ticks_per_us();
+    while(!cursor.done()) {
+        const size_t size = histograms.dump(cursor,sample_depth,sample_rate,was_running,(uint32_t)elapsed_us,mhz,chunk);
+        serial_write_frame((int8_t)espmon::command::profile,chunk,(uint8_t)size);
+    }
+    bool clear = 0!=(query.flags&espmon::profile_clear);
+    if(query.depth!=0) {
+        const uint8_t depth = query.depth>PROFILER_DEPTH?PROFILER_DEPTH:query.depth;
+        // stacks of different depths would be counted apart
+        clear = clear || depth!=sample_depth;
+        sample_depth = depth;
+    }
+    if(query.rate_hz!=0) {
+        sample_rate = query.rate_hz>PROFILER_MAX_RATE_HZ?PROFILER_MAX_RATE_HZ:query.rate_hz;
+    }
+    if(clear) {
+        histograms.clear();
+        elapsed_us = 0;
+    }
+    if(0!=(query.flags&espmon::profile_run)) {
+        started_us = esp_timer_get_time();
+        running = true;
+        timers_start();
+    }
+#else
+    // the profiler isn't built in, so the dump is empty
+    (void)query;
+    espmon::profile_chunk_writer w(chunk,0,0);
+    w.last();
+    serial_write_frame((int8_t)espmon::command::profile,chunk,(uint8_t)w.size());
+#endif
+}
@@ -10,6 +10,8 @@
 #include <esp_err.h>
 #include <esp_log.h>
 #include "serial.hpp"
+#include "espmon_protocol.hpp"
+#include "trace_points.hpp"
 #define SERIAL_QUEUE_SIZE 64
 #define SERIAL_BUF_SIZE (2*SERIAL_QUEUE_SIZE)
 const char* TAG = "Serial";
@@ -20,22 +22,87 @@ static int8_t waiting = -1;
 static int index_requested = -1;
 #endif
 
+static serial_stats_t stats = {0,0,0,0};
+#ifndef TEST_NO_SERIAL
+// reads the payload after a command byte, counting it
+static bool read_payload(uint8_t* payload, size_t size) {
+    const int read = uart_read_bytes(UART_NUM_0,payload,size,portMAX_DELAY);
+    if(read<=0) {
+        ++stats.rx_dropped;
+        return false;
+    }
+    stats.rx_bytes+=read;
+    ++stats.rx_packets;
+    return true;
+}
+// reads the rest of a packet once its command byte is in
+static int8_t read_packet(uint8_t tmp, response_t* out_resp) {
+    // payloads are decoded field by field, so struct layout doesn't matter
+    uint8_t payload[espmon::max_payload_size];
+    if(tmp==(uint8_t)espmon::command::screen) {
+        if(read_payload(payload,espmon::screen_payload_size)) {
+            espmon::decode(espmon::screen_view(payload),&out_resp->screen);
+            return tmp;
+        }
+    } else if(tmp==(uint8_t)espmon::command::data) {
+        if(read_payload(payload,espmon::data_payload_size)) {
+            espmon::decode(espmon::data_view(payload),&out_resp->data);
+            return tmp;
+        }
+    } else if(tmp==(uint8_t)espmon::command::ping) {
+        if(read_payload(payload,espmon::pong_payload_size)) {
+            espmon::decode(espmon::pong_view(payload),&out_resp->pong);
+            return tmp;
+        }
+    } else if(tmp==(uint8_t)espmon::command::data_ex) {
+        if(read_payload(payload,espmon::data_ex_payload_size)) {
+            espmon::decode(espmon::data_ex_view(payload),&out_resp->data_ex);
+            return tmp;
+        }
+    } else if(tmp==(uint8_t)espmon::command::diagnostics) {
+        if(read_payload(payload,espmon::diagnostics_query_size)) {
+            out_resp->diagnostics.flags = payload[0];
+            return tmp;
+        }
+    } else if(tmp==(uint8_t)espmon::command::telemetry) {
+        if(read_payload(payload,espmon::telemetry_query_size)) {
+            out_resp->telemetry.flags = payload[0];
+            return tmp;
+        }
+    } else if(tmp==(uint8_t)espmon::command::trace) {
+        if(read_payload(payload,espmon::trace_query_size)) {
+            out_resp->trace.flags = payload[0];
+            return tmp;
+        }
+    } else if(tmp==(uint8_t)espmon::command::profile) {
+        if(read_payload(payload,espmon::profile_query_size)) {
+            espmon::decode(espmon::profile_query_view(payload),&out_resp->profile);
+            return tmp;
+        }
+    } else if(tmp==(uint8_t)espmon::command::latency) {
+        if(read_payload(payload,espmon::latency_query_size)) {
+            out_resp->latency.flags = payload[0];
+            return tmp;
+        }
+    } else {
+        ++stats.rx_dropped;
+        while(uart_read_bytes(UART_NUM_0,&tmp,1,0)>0) {
+            ++stats.rx_bytes;
+            vTaskDelay(5);
+        }
+    }
+    return -1;
+}
+#endif
 int8_t serial_read_packet(response_t* out_resp) {
 #ifndef TEST_NO_SERIAL
     uint8_t tmp;
     if(1==uart_read_bytes(UART_NUM_0,&tmp,1,0)) {
-        if(tmp==0) {
-            if(0!=uart_read_bytes(UART_NUM_0,out_resp,sizeof(response_screen_t),portMAX_DELAY)) {
-                return tmp;
-            }
-        }
-        if(tmp==1) {
-            if(0!=uart_read_bytes(UART_NUM_0,out_resp,sizeof(response_data_t),portMAX_DELAY)) {
-                return tmp;
-            }
-        } else {
-            while(uart_read_bytes(UART_NUM_0,&tmp,1,0)>0) vTaskDelay(5);
-        }
+        ++stats.rx_bytes;
+        TRACE_BEGIN(packet,tmp);
+        const int8_t result = read_packet(tmp,out_resp);
+        TRACE_END(packet,tmp);
+        return result;
     }
     return -1;
 #else
@@ -82,24 +149,45 @@ int8_t serial_read_packet(response_t* out_resp) {
 }
 void serial_write(int8_t cmd, uint8_t screen_index) {
 #ifndef TEST_NO_SERIAL
-    uint8_t ba[] = {(uint8_t)cmd,screen_index};
-    if(0>uart_write_bytes(UART_NUM_0,ba,2)) {
+    uint8_t ba[espmon::request_size];
+    espmon::request{(uint8_t)cmd,screen_index}.encode(ba);
+    if(0>uart_write_bytes(UART_NUM_0,ba,sizeof(ba))) {
         int i=1000;
         while(i-->0) {
             vTaskDelay(5);
-            if(-1<uart_write_bytes(UART_NUM_0,ba,2)) {
+            if(-1<uart_write_bytes(UART_NUM_0,ba,sizeof(ba))) {
                 break;
             }
         }
         if(i==0) { return; }
     }
-    
+    stats.tx_bytes+=sizeof(ba);
     uart_wait_tx_done(UART_NUM_0,portMAX_DELAY);
 #else
+    // there's no host to ping or to ask for timestamps
+    if(cmd>(int8_t)espmon::command::data) {
+        return;
+    }
     waiting = cmd;
     index_requested = screen_index;
 #endif
 }
+void serial_write_frame(int8_t cmd, const uint8_t* payload, uint8_t size) {
+#ifndef TEST_NO_SERIAL
+    uint8_t ba[espmon::request_size];
+    espmon::request{(uint8_t)cmd,size}.encode(ba);
+    uart_write_bytes(UART_NUM_0,ba,sizeof(ba));
+    if(size>0) {
+        uart_write_bytes(UART_NUM_0,payload,size);
+    }
+    stats.tx_bytes+=sizeof(ba)+size;
+    uart_wait_tx_done(UART_NUM_0,portMAX_DELAY);
+#endif
+}
+void serial_take_stats(serial_stats_t* out_stats) {
+    *out_stats = stats;
+    memset(&stats,0,sizeof(stats));
+}
 bool serial_init() {
 #ifndef TEST_NO_SERIAL
     esp_log_level_set(TAG, ESP_LOG_INFO);